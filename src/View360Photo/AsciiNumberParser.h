@@ -0,0 +1,285 @@
+﻿// 日本語。
+#pragma once
+
+// ロケールに依存しない、std::from_chars風の数値テキスト解析関数。
+// PLYのような大量の数値が並ぶテキストを高速に読むために使う。
+// (VS2017のstd::from_charsは浮動小数点数に対応していないので自前で用意する。)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#  include <emmintrin.h>
+#  define ASCII_NUMBER_PARSER_SSE2 1
+#endif
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace AsciiNumberParser {
+
+    inline int
+    CountTrailingZeros(uint32_t v)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, v);
+        return (int)idx;
+#else
+        return __builtin_ctz(v);
+#endif
+    }
+
+    /// [p, end)から'\n'を探す。見つからないときendを戻す。
+    /// 16バイトずつSSE2で比較する。
+    inline const char*
+    FindLF(const char* p, const char* end)
+    {
+#ifdef ASCII_NUMBER_PARSER_SSE2
+        const __m128i lf = _mm_set1_epi8('\n');
+        while (16 <= end - p) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)p);
+            const int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+            if (m != 0) {
+                return p + CountTrailingZeros((uint32_t)m);
+            }
+            p += 16;
+        }
+#endif
+        while (p < end && *p != '\n') {
+            ++p;
+        }
+        return p;
+    }
+
+    /// [p, end)に含まれる'\n'の数を数える。
+    inline size_t
+    CountLF(const char* p, const char* end)
+    {
+        size_t n = 0;
+#ifdef ASCII_NUMBER_PARSER_SSE2
+        const __m128i lf = _mm_set1_epi8('\n');
+        while (16 <= end - p) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)p);
+            uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+            while (m != 0) {
+                m &= m - 1;
+                ++n;
+            }
+            p += 16;
+        }
+#endif
+        while (p < end) {
+            if (*p == '\n') {
+                ++n;
+            }
+            ++p;
+        }
+        return n;
+    }
+
+    inline bool
+    IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    /// 数値の直後が、行末か空白か。
+    inline bool
+    IsTokenEnd(const char* p, const char* end)
+    {
+        return p == end || IsSpace(*p) || *p == '\n';
+    }
+
+    inline const char*
+    SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    inline bool
+    IsDigit(char c)
+    {
+        return (unsigned)(c - '0') < 10;
+    }
+
+    /// 整数を読む。
+    /// @return 成功のとき数値の次の位置。失敗のときnullptr。
+    inline const char*
+    ParseInt(const char* p, const char* end, int& value_r)
+    {
+        bool neg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg = (*p == '-');
+            ++p;
+        }
+        if (p >= end || !IsDigit(*p)) {
+            return nullptr;
+        }
+
+        int64_t v = 0;
+        while (p < end && IsDigit(*p)) {
+            v = v * 10 + (*p - '0');
+            if (0x80000000LL < v) {
+                return nullptr;
+            }
+            ++p;
+        }
+        if (!neg && 0x7fffffffLL < v) {
+            return nullptr;
+        }
+
+        value_r = (int)(neg ? -v : v);
+        return p;
+    }
+
+    /// 浮動小数点数を読む。結果はstrtofと同じ、最も近いfloatに丸めた値。
+    /// 有効桁数が15桁程度までの普通の数値は整数演算と1回のdoubleの乗除算で変換する。
+    /// 仮数が2^53以下、10の指数が22以下なら、このdoubleは正しく丸めた値になる。
+    /// doubleからfloatへの2度目の丸めで結果が変わるのは、doubleがfloatの2つの値のちょうど中間になったときだけなので、そのときは遅い経路にする。
+    /// それ以外(桁数が多い、指数が大きい、inf、nan等)はstrtofで変換する。
+    /// @return 成功のとき数値の次の位置。失敗のときnullptr。
+    inline const char*
+    ParseFloat(const char* p, const char* end, float& value_r)
+    {
+        static const double kPow10[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        const char* first = p;
+        bool neg = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg = (*p == '-');
+            ++p;
+        }
+
+        uint64_t mant = 0;
+        int nMantDigits = 0;
+        int nDigits = 0;
+        int exp10 = 0;
+        bool truncated = false;
+
+        while (p < end && IsDigit(*p)) {
+            if (nMantDigits < 19) {
+                mant = mant * 10 + (*p - '0');
+                if (mant != 0) {
+                    ++nMantDigits;
+                }
+            } else {
+                ++exp10;
+                truncated = true;
+            }
+            ++nDigits;
+            ++p;
+        }
+        if (p < end && *p == '.') {
+            ++p;
+            while (p < end && IsDigit(*p)) {
+                if (nMantDigits < 19) {
+                    mant = mant * 10 + (*p - '0');
+                    if (mant != 0) {
+                        ++nMantDigits;
+                    }
+                    --exp10;
+                } else {
+                    truncated = true;
+                }
+                ++nDigits;
+                ++p;
+            }
+        }
+
+        if (nDigits == 0) {
+            // inf, nan等。
+            goto slowPath;
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char* q = p + 1;
+            int e = 0;
+            q = ParseInt(q, end, e);
+            if (q == nullptr || e < -9999 || 9999 < e) {
+                goto slowPath;
+            }
+            exp10 += e;
+            p = q;
+        }
+
+        if (!truncated && mant <= (1ULL << 53) && -22 <= exp10 && exp10 <= 22) {
+            double d = (double)mant;
+            if (exp10 < 0) {
+                d /= kPow10[-exp10];
+            } else {
+                d *= kPow10[exp10];
+            }
+
+            // この範囲の0以外の値はfloatの正規化数なので、doubleの仮数の下位29ビットがfloatで捨てる部分。
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof bits);
+            if ((bits & ((1ULL << 29) - 1)) != (1ULL << 28)) {
+                value_r = (float)(neg ? -d : d);
+                return p;
+            }
+        }
+
+    slowPath:
+        {
+            char buf[64];
+            const char* q = first;
+            while (q < end && !IsSpace(*q) && *q != '\n') {
+                ++q;
+            }
+            size_t len = q - first;
+            if (len == 0 || sizeof buf <= len) {
+                return nullptr;
+            }
+            memcpy(buf, first, len);
+            buf[len] = 0;
+
+            char* e = nullptr;
+            const float f = strtof(buf, &e);
+            if (e == buf) {
+                return nullptr;
+            }
+            value_r = f;
+            return first + (e - buf);
+        }
+    }
+
+    /// 空白区切りの浮動小数点数を最大n個読む。
+    /// "1.5-2"のように空白を挟まずに続く数値は、読めなかったものとする。
+    /// @return 読めた個数。
+    inline int
+    ParseFloats(const char* p, const char* end, float* values_r, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            p = SkipSpaces(p, end);
+            p = ParseFloat(p, end, values_r[i]);
+            if (p == nullptr || !IsTokenEnd(p, end)) {
+                return i;
+            }
+        }
+        return n;
+    }
+
+    /// 空白区切りの整数を最大n個読む。
+    /// 空白を挟まずに続く数値は、読めなかったものとする。
+    /// @return 読めた個数。
+    inline int
+    ParseInts(const char* p, const char* end, int* values_r, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            p = SkipSpaces(p, end);
+            p = ParseInt(p, end, values_r[i]);
+            if (p == nullptr || !IsTokenEnd(p, end)) {
+                return i;
+            }
+        }
+        return n;
+    }
+
+}; // namespace AsciiNumberParser
@@ -0,0 +1,795 @@
+﻿// 日本語。
+
+#include "BlockCompress.h"
+#include "ParallelFor.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+const char*
+BcFormatToStr(BcFormat f)
+{
+    switch (f) {
+    case BCF_None: return "BGRA8";
+    case BCF_Bc1:  return "BC1";
+    case BCF_Bc7:  return "BC7";
+    default:       return "Unknown";
+    }
+}
+
+int
+BcBlockBytes(BcFormat f)
+{
+    switch (f) {
+    case BCF_Bc1: return 8;
+    case BCF_Bc7: return 16;
+    default:      return 0;
+    }
+}
+
+const char*
+BcQualityToStr(BcQuality q)
+{
+    switch (q) {
+    case BCQ_Fast:   return "Fast";
+    case BCQ_Normal: return "Normal";
+    case BCQ_Slow:   return "Slow";
+    default:         return "Unknown";
+    }
+}
+
+/// 1ブロックの画素。RGBAの順。
+struct BcBlock {
+    int px[16][4];
+};
+
+static void
+LoadBlock(const uint8_t* bgra, int w, int h, int stride, int bx, int by, BcBlock& b_r)
+{
+    for (int y = 0; y < 4; ++y) {
+        const int sy = std::min(by * 4 + y, h - 1);
+        for (int x = 0; x < 4; ++x) {
+            const int sx = std::min(bx * 4 + x, w - 1);
+            const uint8_t* p = bgra + (size_t)stride * sy + 4 * sx;
+            int* d = b_r.px[y * 4 + x];
+            d[0] = p[2];
+            d[1] = p[1];
+            d[2] = p[0];
+            d[3] = p[3];
+        }
+    }
+}
+
+/// ブロックの平均と、共分散の最大の固有値の方向。方向は正規化しない。
+static void
+PrincipalAxis(const BcBlock& b, int numChannels, float mean_r[4], float axis_r[4])
+{
+    for (int c = 0; c < 4; ++c) {
+        float s = 0;
+        for (int i = 0; i < 16; ++i) {
+            s += (float)b.px[i][c];
+        }
+        mean_r[c] = s / 16.0f;
+    }
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < numChannels; ++c) {
+            d[c] = b.px[i][c] - mean_r[c];
+        }
+        for (int r = 0; r < numChannels; ++r) {
+            for (int c = 0; c < numChannels; ++c) {
+                cov[r][c] += d[r] * d[c];
+            }
+        }
+    }
+
+    // べき乗法。
+    float v[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 6; ++iter) {
+        float nv[4] = {};
+        float len = 0;
+        for (int r = 0; r < numChannels; ++r) {
+            for (int c = 0; c < numChannels; ++c) {
+                nv[r] += cov[r][c] * v[c];
+            }
+            len = std::max(len, fabsf(nv[r]));
+        }
+        if (len < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < numChannels; ++c) {
+            v[c] = nv[c] / len;
+        }
+    }
+    for (int c = 0; c < 4; ++c) {
+        axis_r[c] = (c < numChannels) ? v[c] : 0.0f;
+    }
+}
+
+/// 主成分の方向に投影した範囲の両端を、端点の初期値にする。
+static void
+InitialEndpoints(const BcBlock& b, int numChannels, float e_r[2][4])
+{
+    float mean[4];
+    float axis[4];
+    PrincipalAxis(b, numChannels, mean, axis);
+
+    float tMin = 0;
+    float tMax = 0;
+    float axisLen2 = 0;
+    for (int c = 0; c < numChannels; ++c) {
+        axisLen2 += axis[c] * axis[c];
+    }
+    if (1e-12f < axisLen2) {
+        tMin = 1e30f;
+        tMax = -1e30f;
+        for (int i = 0; i < 16; ++i) {
+            float t = 0;
+            for (int c = 0; c < numChannels; ++c) {
+                t += (b.px[i][c] - mean[c]) * axis[c];
+            }
+            t /= axisLen2;
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+    }
+    for (int c = 0; c < 4; ++c) {
+        e_r[0][c] = mean[c] + tMin * axis[c];
+        e_r[1][c] = mean[c] + tMax * axis[c];
+    }
+}
+
+/// 添え字の重みt[i] (0～1)から、最小二乗法で端点を求める。解けないときfalse。
+static bool
+LeastSquaresEndpoints(const BcBlock& b, const float t[16], float e_r[2][4])
+{
+    float a = 0;
+    float bb = 0;
+    float c = 0;
+    float d0[4] = {};
+    float d1[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        const float u = 1.0f - t[i];
+        a += u * u;
+        bb += u * t[i];
+        c += t[i] * t[i];
+        for (int k = 0; k < 4; ++k) {
+            d0[k] += u * b.px[i][k];
+            d1[k] += t[i] * b.px[i][k];
+        }
+    }
+    const float det = a * c - bb * bb;
+    if (fabsf(det) < 1e-6f) {
+        return false;
+    }
+    for (int k = 0; k < 4; ++k) {
+        e_r[0][k] = (c * d0[k] - bb * d1[k]) / det;
+        e_r[1][k] = (a * d1[k] - bb * d0[k]) / det;
+    }
+    return true;
+}
+
+// BC1 ////////////////////////////////////////////////////////////////////////////////
+
+static inline int
+Clampi(int v, int lo, int hi)
+{
+    return std::min(std::max(v, lo), hi);
+}
+
+/// 565の端点。q[0] = R 5ビット, q[1] = G 6ビット, q[2] = B 5ビット。
+struct Bc1Endpoints {
+    int q[2][3];
+};
+
+static inline int
+Expand5(int v)
+{
+    return (v << 3) | (v >> 2);
+}
+
+static inline int
+Expand6(int v)
+{
+    return (v << 2) | (v >> 4);
+}
+
+static inline int
+Bc1Color565(const int q[3])
+{
+    return (q[0] << 11) | (q[1] << 5) | q[2];
+}
+
+static void
+Bc1Quantize(const float e[2][4], Bc1Endpoints& q_r)
+{
+    for (int j = 0; j < 2; ++j) {
+        q_r.q[j][0] = Clampi((int)floorf(e[j][0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+        q_r.q[j][1] = Clampi((int)floorf(e[j][1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+        q_r.q[j][2] = Clampi((int)floorf(e[j][2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    }
+}
+
+/// 4色のパレット。c0 > c1のときの4色モード。c0 == c1のときは全部同じ色。
+static void
+Bc1Palette(int c0, int c1, int pal_r[4][3])
+{
+    const int e[2][3] = {
+        { Expand5((c0 >> 11) & 31), Expand6((c0 >> 5) & 63), Expand5(c0 & 31) },
+        { Expand5((c1 >> 11) & 31), Expand6((c1 >> 5) & 63), Expand5(c1 & 31) },
+    };
+    for (int k = 0; k < 3; ++k) {
+        pal_r[0][k] = e[0][k];
+        pal_r[1][k] = e[1][k];
+        pal_r[2][k] = (2 * e[0][k] + e[1][k] + 1) / 3;
+        pal_r[3][k] = (e[0][k] + 2 * e[1][k] + 1) / 3;
+    }
+}
+
+/// 端点の順番をc0 > c1にしてから添え字を選ぶ。誤差の二乗和を戻す。
+static int
+Bc1Assign(const BcBlock& b, const Bc1Endpoints& q, uint16_t* c0_r, uint16_t* c1_r, uint8_t idx_r[16])
+{
+    int c0 = Bc1Color565(q.q[0]);
+    int c1 = Bc1Color565(q.q[1]);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+    *c0_r = (uint16_t)c0;
+    *c1_r = (uint16_t)c1;
+
+    int pal[4][3];
+    Bc1Palette(c0, c1, pal);
+    const int numColors = (c0 == c1) ? 1 : 4;
+
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0x7fffffff;
+        int bestK = 0;
+        for (int k = 0; k < numColors; ++k) {
+            int err = 0;
+            for (int c = 0; c < 3; ++c) {
+                const int d = b.px[i][c] - pal[k][c];
+                err += d * d;
+            }
+            if (err < best) {
+                best = err;
+                bestK = k;
+            }
+        }
+        idx_r[i] = (uint8_t)bestK;
+        total += best;
+    }
+    return total;
+}
+
+static void
+Bc1EncodeBlock(const BcBlock& b, BcQuality quality, uint8_t* out)
+{
+    static const float WEIGHT[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    float e[2][4];
+    InitialEndpoints(b, 3, e);
+
+    Bc1Endpoints q;
+    Bc1Quantize(e, q);
+    uint16_t c0;
+    uint16_t c1;
+    uint8_t idx[16];
+    int err = Bc1Assign(b, q, &c0, &c1, idx);
+    if (quality != BCQ_Fast) {
+        // 範囲の両端は外れ値のことが多いので、1/16ずつ内側に寄せた端点も試す。
+        float ie[2][4];
+        for (int c = 0; c < 4; ++c) {
+            const float inset = (e[1][c] - e[0][c]) / 16.0f;
+            ie[0][c] = e[0][c] + inset;
+            ie[1][c] = e[1][c] - inset;
+        }
+        Bc1Endpoints iq;
+        Bc1Quantize(ie, iq);
+        uint16_t ic0;
+        uint16_t ic1;
+        uint8_t iidx[16];
+        const int ierr = Bc1Assign(b, iq, &ic0, &ic1, iidx);
+        if (ierr < err) {
+            q = iq;
+            err = ierr;
+            c0 = ic0;
+            c1 = ic1;
+            memcpy(idx, iidx, 16);
+        }
+    }
+
+    // 最小二乗法で端点を直す。添え字の重みは、c0 > c1に並べ替えた後の端点に対するもの。
+    const int iterations = (quality == BCQ_Fast) ? 1 : 3;
+    for (int it = 0; it < iterations && 0 < err; ++it) {
+        float t[16];
+        for (int i = 0; i < 16; ++i) {
+            t[i] = WEIGHT[idx[i]];
+        }
+        float le[2][4];
+        if (!LeastSquaresEndpoints(b, t, le)) {
+            break;
+        }
+        Bc1Endpoints lq;
+        Bc1Quantize(le, lq);
+        uint16_t lc0;
+        uint16_t lc1;
+        uint8_t lidx[16];
+        const int lerr = Bc1Assign(b, lq, &lc0, &lc1, lidx);
+        if (err <= lerr) {
+            break;
+        }
+        q = lq;
+        err = lerr;
+        c0 = lc0;
+        c1 = lc1;
+        memcpy(idx, lidx, 16);
+    }
+
+    if (quality == BCQ_Slow) {
+        // 端点の各要素を1段ずつ動かして、誤差が減る間続ける。
+        static const int MAXQ[3] = { 31, 63, 31 };
+        bool improved = true;
+        for (int pass = 0; pass < 4 && improved && 0 < err; ++pass) {
+            improved = false;
+            for (int j = 0; j < 2; ++j) {
+                for (int c = 0; c < 3; ++c) {
+                    for (int d = -1; d <= 1; d += 2) {
+                        Bc1Endpoints tq = q;
+                        tq.q[j][c] = Clampi(tq.q[j][c] + d, 0, MAXQ[c]);
+                        uint16_t tc0;
+                        uint16_t tc1;
+                        uint8_t tidx[16];
+                        const int terr = Bc1Assign(b, tq, &tc0, &tc1, tidx);
+                        if (terr < err) {
+                            q = tq;
+                            err = terr;
+                            c0 = tc0;
+                            c1 = tc1;
+                            memcpy(idx, tidx, 16);
+                            improved = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        bits |= (uint32_t)idx[i] << (2 * i);
+    }
+    out[0] = (uint8_t)c0;
+    out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)c1;
+    out[3] = (uint8_t)(c1 >> 8);
+    out[4] = (uint8_t)bits;
+    out[5] = (uint8_t)(bits >> 8);
+    out[6] = (uint8_t)(bits >> 16);
+    out[7] = (uint8_t)(bits >> 24);
+}
+
+static void
+Bc1DecodeBlock(const uint8_t* in, uint8_t rgba_r[16][4])
+{
+    const int c0 = in[0] | (in[1] << 8);
+    const int c1 = in[2] | (in[3] << 8);
+    const uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+
+    int pal[4][4];
+    int p3[4][3];
+    Bc1Palette(c0, c1, p3);
+    for (int k = 0; k < 4; ++k) {
+        pal[k][0] = p3[k][0];
+        pal[k][1] = p3[k][1];
+        pal[k][2] = p3[k][2];
+        pal[k][3] = 255;
+    }
+    if (c0 <= c1) {
+        // 3色モード。添え字3は透明な黒。
+        for (int k = 0; k < 3; ++k) {
+            pal[2][k] = (pal[0][k] + pal[1][k] + 1) / 2;
+            pal[3][k] = 0;
+        }
+        pal[3][3] = 0;
+    }
+    for (int i = 0; i < 16; ++i) {
+        const int k = (bits >> (2 * i)) & 3;
+        for (int c = 0; c < 4; ++c) {
+            rgba_r[i][c] = (uint8_t)pal[k][c];
+        }
+    }
+}
+
+// BC7 mode 6 /////////////////////////////////////////////////////////////////////////
+
+static const int gBc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+/// RGBA 7ビットの端点とpビット。8ビットの値は(q << 1) | p。
+struct Bc7Endpoints {
+    int q[2][4];
+    int p[2];
+};
+
+static inline int
+Bc7Interp(int e0, int e1, int w)
+{
+    return ((64 - w) * e0 + w * e1 + 32) >> 6;
+}
+
+/// 端点jをpビットpで量子化したときの誤差の二乗和。
+static float
+Bc7QuantizeEndpoint(const float e[4], int p, int q_r[4])
+{
+    float err = 0;
+    for (int c = 0; c < 4; ++c) {
+        q_r[c] = Clampi((int)floorf((e[c] - p) * 0.5f + 0.5f), 0, 127);
+        const float d = (float)((q_r[c] << 1) | p) - e[c];
+        err += d * d;
+    }
+    return err;
+}
+
+/// pビットが負のときは、端点ごとに誤差の小さい方を選ぶ。
+static void
+Bc7Quantize(const float e[2][4], int p0, int p1, Bc7Endpoints& q_r)
+{
+    const int ps[2] = { p0, p1 };
+    for (int j = 0; j < 2; ++j) {
+        if (0 <= ps[j]) {
+            q_r.p[j] = ps[j];
+            Bc7QuantizeEndpoint(e[j], ps[j], q_r.q[j]);
+            continue;
+        }
+        int q0[4];
+        int q1[4];
+        const float err0 = Bc7QuantizeEndpoint(e[j], 0, q0);
+        const float err1 = Bc7QuantizeEndpoint(e[j], 1, q1);
+        q_r.p[j] = (err1 < err0) ? 1 : 0;
+        memcpy(q_r.q[j], (err1 < err0) ? q1 : q0, sizeof q0);
+    }
+}
+
+static int
+Bc7Assign(const BcBlock& b, const Bc7Endpoints& q, uint8_t idx_r[16])
+{
+    int pal[16][4];
+    for (int c = 0; c < 4; ++c) {
+        const int e0 = (q.q[0][c] << 1) | q.p[0];
+        const int e1 = (q.q[1][c] << 1) | q.p[1];
+        for (int k = 0; k < 16; ++k) {
+            pal[k][c] = Bc7Interp(e0, e1, gBc7Weights4[k]);
+        }
+    }
+
+    // 端点を結ぶ線に投影して添え字の見当をつけ、その前後だけ誤差を比べる。
+    int axis[4];
+    int axisLen2 = 0;
+    for (int c = 0; c < 4; ++c) {
+        axis[c] = pal[15][c] - pal[0][c];
+        axisLen2 += axis[c] * axis[c];
+    }
+
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int k0 = 0;
+        if (0 < axisLen2) {
+            int dot = 0;
+            for (int c = 0; c < 4; ++c) {
+                dot += (b.px[i][c] - pal[0][c]) * axis[c];
+            }
+            k0 = Clampi((dot * 15 + axisLen2 / 2) / axisLen2, 0, 15);
+        }
+        int best = 0x7fffffff;
+        int bestK = 0;
+        for (int k = std::max(k0 - 1, 0); k <= std::min(k0 + 1, 15); ++k) {
+            int err = 0;
+            for (int c = 0; c < 4; ++c) {
+                const int d = b.px[i][c] - pal[k][c];
+                err += d * d;
+            }
+            if (err < best) {
+                best = err;
+                bestK = k;
+            }
+        }
+        idx_r[i] = (uint8_t)bestK;
+        total += best;
+    }
+    return total;
+}
+
+/// 128ビットのブロックに下位ビットから書く。
+struct Bc7BitWriter {
+    uint8_t* out;
+    int pos;
+
+    void Put(uint32_t v, int n)
+    {
+        for (int i = 0; i < n; ++i, ++pos) {
+            if ((v >> i) & 1) {
+                out[pos >> 3] |= (uint8_t)(1 << (pos & 7));
+            }
+        }
+    }
+};
+
+static void
+Bc7EncodeBlock(const BcBlock& b, BcQuality quality, uint8_t* out)
+{
+    float e[2][4];
+    InitialEndpoints(b, 4, e);
+
+    Bc7Endpoints q;
+    Bc7Quantize(e, -1, -1, q);
+    uint8_t idx[16];
+    int err = Bc7Assign(b, q, idx);
+    if (quality != BCQ_Fast) {
+        for (int pc = 0; pc < 4; ++pc) {
+            Bc7Endpoints pq;
+            Bc7Quantize(e, pc & 1, pc >> 1, pq);
+            uint8_t pidx[16];
+            const int perr = Bc7Assign(b, pq, pidx);
+            if (perr < err) {
+                q = pq;
+                err = perr;
+                memcpy(idx, pidx, 16);
+            }
+        }
+    }
+
+    const int iterations = (quality == BCQ_Fast) ? 1 : 3;
+    for (int it = 0; it < iterations && 0 < err; ++it) {
+        float t[16];
+        for (int i = 0; i < 16; ++i) {
+            t[i] = gBc7Weights4[idx[i]] / 64.0f;
+        }
+        float le[2][4];
+        if (!LeastSquaresEndpoints(b, t, le)) {
+            break;
+        }
+
+        // Normal以上は、pビットの4通りも試す。
+        Bc7Endpoints bestQ = q;
+        int bestErr = err;
+        uint8_t bestIdx[16];
+        memcpy(bestIdx, idx, 16);
+        const int numP = (quality == BCQ_Fast) ? 1 : 5;
+        for (int pc = 0; pc < numP; ++pc) {
+            Bc7Endpoints lq;
+            if (pc == 0) {
+                Bc7Quantize(le, -1, -1, lq);
+            } else {
+                Bc7Quantize(le, (pc - 1) & 1, (pc - 1) >> 1, lq);
+            }
+            uint8_t lidx[16];
+            const int lerr = Bc7Assign(b, lq, lidx);
+            if (lerr < bestErr) {
+                bestQ = lq;
+                bestErr = lerr;
+                memcpy(bestIdx, lidx, 16);
+            }
+        }
+        if (err <= bestErr) {
+            break;
+        }
+        q = bestQ;
+        err = bestErr;
+        memcpy(idx, bestIdx, 16);
+    }
+
+    if (quality == BCQ_Slow) {
+        bool improved = true;
+        for (int pass = 0; pass < 4 && improved && 0 < err; ++pass) {
+            improved = false;
+            for (int j = 0; j < 2; ++j) {
+                for (int c = 0; c < 4; ++c) {
+                    for (int d = -1; d <= 1; d += 2) {
+                        Bc7Endpoints tq = q;
+                        tq.q[j][c] = Clampi(tq.q[j][c] + d, 0, 127);
+                        uint8_t tidx[16];
+                        const int terr = Bc7Assign(b, tq, tidx);
+                        if (terr < err) {
+                            q = tq;
+                            err = terr;
+                            memcpy(idx, tidx, 16);
+                            improved = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // 画素0の添え字の最上位ビットは書かないので0にする。1のときは端点を入れ替えて添え字を反転する。
+    if (idx[0] & 8) {
+        for (int c = 0; c < 4; ++c) {
+            std::swap(q.q[0][c], q.q[1][c]);
+        }
+        std::swap(q.p[0], q.p[1]);
+        for (int i = 0; i < 16; ++i) {
+            idx[i] = (uint8_t)(15 - idx[i]);
+        }
+    }
+
+    memset(out, 0, 16);
+    Bc7BitWriter w = { out, 0 };
+    w.Put(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        w.Put(q.q[0][c], 7);
+        w.Put(q.q[1][c], 7);
+    }
+    w.Put(q.p[0], 1);
+    w.Put(q.p[1], 1);
+    w.Put(idx[0], 3);
+    for (int i = 1; i < 16; ++i) {
+        w.Put(idx[i], 4);
+    }
+}
+
+static uint32_t
+GetBits128(const uint8_t* in, int& pos, int n)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < n; ++i, ++pos) {
+        v |= (uint32_t)((in[pos >> 3] >> (pos & 7)) & 1) << i;
+    }
+    return v;
+}
+
+static bool
+Bc7DecodeBlock(const uint8_t* in, uint8_t rgba_r[16][4])
+{
+    if ((in[0] & 0x7f) != 0x40) {
+        return false;
+    }
+    int pos = 7;
+    int e[2][4];
+    for (int c = 0; c < 4; ++c) {
+        e[0][c] = (int)GetBits128(in, pos, 7) << 1;
+        e[1][c] = (int)GetBits128(in, pos, 7) << 1;
+    }
+    const int p0 = (int)GetBits128(in, pos, 1);
+    const int p1 = (int)GetBits128(in, pos, 1);
+    for (int c = 0; c < 4; ++c) {
+        e[0][c] |= p0;
+        e[1][c] |= p1;
+    }
+    for (int i = 0; i < 16; ++i) {
+        const int k = (int)GetBits128(in, pos, (i == 0) ? 3 : 4);
+        for (int c = 0; c < 4; ++c) {
+            rgba_r[i][c] = (uint8_t)Bc7Interp(e[0][c], e[1][c], gBc7Weights4[k]);
+        }
+    }
+    return true;
+}
+
+// 画像 ///////////////////////////////////////////////////////////////////////////////
+
+int
+BcEncode(const uint8_t* bgra, int w, int h, int stride, BcFormat f, BcQuality q, uint8_t* out, int numThreads)
+{
+    const int blockBytes = BcBlockBytes(f);
+    if (bgra == nullptr || out == nullptr || w <= 0 || h <= 0 || stride < 4 * w || blockBytes == 0
+            || q < 0 || BCQ_NUM <= q) {
+        printf("E: BcEncode() invalid argument\n");
+        return -1;
+    }
+
+    const int bw = (w + 3) / 4;
+    const int bh = (h + 3) / 4;
+    ParallelFor(bh, [&](int by) {
+        BcBlock b;
+        uint8_t* o = out + (size_t)blockBytes * bw * by;
+        for (int bx = 0; bx < bw; ++bx) {
+            LoadBlock(bgra, w, h, stride, bx, by, b);
+            if (f == BCF_Bc1) {
+                Bc1EncodeBlock(b, q, o + (size_t)blockBytes * bx);
+            } else {
+                Bc7EncodeBlock(b, q, o + (size_t)blockBytes * bx);
+            }
+        }
+    }, numThreads);
+    return 0;
+}
+
+int
+BcDecode(const uint8_t* blocks, int w, int h, BcFormat f, uint8_t* bgra, int stride)
+{
+    const int blockBytes = BcBlockBytes(f);
+    if (blocks == nullptr || bgra == nullptr || w <= 0 || h <= 0 || stride < 4 * w || blockBytes == 0) {
+        printf("E: BcDecode() invalid argument\n");
+        return -1;
+    }
+
+    const int bw = (w + 3) / 4;
+    const int bh = (h + 3) / 4;
+    for (int by = 0; by < bh; ++by) {
+        for (int bx = 0; bx < bw; ++bx) {
+            const uint8_t* in = blocks + (size_t)blockBytes * (by * bw + bx);
+            uint8_t rgba[16][4];
+            if (f == BCF_Bc1) {
+                Bc1DecodeBlock(in, rgba);
+            } else if (!Bc7DecodeBlock(in, rgba)) {
+                printf("E: BcDecode() BC7 block (%d, %d) is not mode 6\n", bx, by);
+                return -1;
+            }
+            for (int y = 0; y < 4 && by * 4 + y < h; ++y) {
+                for (int x = 0; x < 4 && bx * 4 + x < w; ++x) {
+                    const uint8_t* s = rgba[y * 4 + x];
+                    uint8_t* d = bgra + (size_t)stride * (by * 4 + y) + 4 * (bx * 4 + x);
+                    d[0] = s[2];
+                    d[1] = s[1];
+                    d[2] = s[0];
+                    d[3] = s[3];
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+double
+BcPsnr(const uint8_t* a, int strideA, const uint8_t* b, int strideB, int w, int h)
+{
+    double sum = 0;
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* pa = a + (size_t)strideA * y;
+        const uint8_t* pb = b + (size_t)strideB * y;
+        int64_t row = 0;
+        for (int x = 0; x < w; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const int d = pa[4 * x + c] - pb[4 * x + c];
+                row += d * d;
+            }
+        }
+        sum += (double)row;
+    }
+    if (sum == 0) {
+        return 999.0;
+    }
+    const double mse = sum / (3.0 * w * h);
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+int
+BcEncodeMips(const MipSource& level0, const MipChain& chain, BcFormat f, BcQuality q, BcTexture* tex_r, int numThreads)
+{
+    const int blockBytes = BcBlockBytes(f);
+    if (tex_r == nullptr || blockBytes == 0 || level0.width != chain.width || level0.height != chain.height
+            || chain.numLevels < 1) {
+        printf("E: BcEncodeMips() invalid argument\n");
+        return -1;
+    }
+    if ((level0.width & 3) != 0 || (level0.height & 3) != 0) {
+        printf("E: BcEncodeMips() %dx%d is not a multiple of 4\n", level0.width, level0.height);
+        return -1;
+    }
+
+    BcTexture& t = *tex_r;
+    t.format = f;
+    t.width = chain.width;
+    t.height = chain.height;
+    t.numLevels = chain.numLevels;
+    t.levelOffset.assign(t.numLevels, 0);
+    size_t bytes = 0;
+    for (int l = 0; l < t.numLevels; ++l) {
+        t.levelOffset[l] = bytes;
+        bytes += (size_t)t.LevelPitch(l) * t.LevelBlockRows(l);
+    }
+    t.blocks.resize(bytes);
+
+    for (int l = 0; l < t.numLevels; ++l) {
+        const uint8_t* src = (l == 0) ? level0.pixels : chain.Level(l);
+        const int stride = (l == 0) ? level0.stride : 4 * chain.LevelWidth(l);
+        int rv = BcEncode(src, t.LevelWidth(l), t.LevelHeight(l), stride, f, q, t.blocks.data() + t.levelOffset[l],
+                numThreads);
+        if (rv < 0) {
+            return rv;
+        }
+    }
+    return 0;
+}
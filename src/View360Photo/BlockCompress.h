@@ -0,0 +1,84 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+#include "MipBuilder.h"
+
+/// テクスチャーのブロック圧縮の形式。4x4画素を1ブロックにする。
+enum BcFormat {
+    /// 圧縮しない。BGRA 8ビット。
+    BCF_None,
+
+    /// BC1。RGB 565の端点2個と2ビットの添え字。8バイト/ブロック。アルファーは持たない(不透明)。
+    BCF_Bc1,
+
+    /// BC7のmode 6。RGBA 7ビット + pビットの端点2個と4ビットの添え字。16バイト/ブロック。
+    BCF_Bc7,
+
+    BCF_NUM
+};
+
+const char* BcFormatToStr(BcFormat f);
+
+/// 1ブロックのバイト数。BCF_Noneのとき0。
+int BcBlockBytes(BcFormat f);
+
+/// 圧縮の品質と速さ。
+enum BcQuality {
+    /// 主成分の方向の端点を1回だけ最小二乗法で直す。
+    BCQ_Fast,
+
+    /// 最小二乗法を繰り返す。BC1は内側に寄せた端点、BC7はpビットの4通りも試す。
+    BCQ_Normal,
+
+    /// Normalに加えて、端点の各要素を1段ずつ動かして誤差が減る間続ける。
+    BCQ_Slow,
+
+    BCQ_NUM
+};
+
+const char* BcQualityToStr(BcQuality q);
+
+/// w x hのBGRA 8ビットの画像を圧縮する。出力は(w + 3) / 4 x (h + 3) / 4ブロックを行優先で隙間なく並べる。
+/// 端の欠けたブロックは端の画素を繰り返して埋める。誤差はsRGBの値のままRGBAの二乗和で測る。
+/// ブロックの行ごとに複数のスレッドで圧縮する。
+/// @param out 少なくとも(w + 3) / 4 * (h + 3) / 4 * BcBlockBytes(f)バイト。
+/// @return 成功のとき0。失敗のとき負の値。
+int BcEncode(const uint8_t* bgra, int w, int h, int stride, BcFormat f, BcQuality q, uint8_t* out, int numThreads = 0);
+
+/// BcEncode()の出力をBGRA 8ビットに戻す。BC7はmode 6のブロックだけ読める。
+/// @return 成功のとき0。失敗のとき負の値。
+int BcDecode(const uint8_t* blocks, int w, int h, BcFormat f, uint8_t* bgra, int stride);
+
+/// 2個のBGRA 8ビットの画像のRGBのPSNR (dB)。同じ画像のとき999。
+double BcPsnr(const uint8_t* a, int strideA, const uint8_t* b, int strideB, int w, int h);
+
+/// ブロック圧縮したミップマップの全段。level 0を含む。
+struct BcTexture {
+    BcFormat format = BCF_Bc7;
+    int width = 0;
+    int height = 0;
+    int numLevels = 0;
+
+    /// levelOffset[l]は、blocksの中のlevel lの先頭。
+    std::vector<size_t> levelOffset;
+    std::vector<uint8_t> blocks;
+
+    int LevelWidth(int level) const { return std::max(1, width >> level); }
+    int LevelHeight(int level) const { return std::max(1, height >> level); }
+
+    /// level lのブロックの1行のバイト数。
+    int LevelPitch(int level) const { return (LevelWidth(level) + 3) / 4 * BcBlockBytes(format); }
+    int LevelBlockRows(int level) const { return (LevelHeight(level) + 3) / 4; }
+
+    const uint8_t* Level(int level) const { return blocks.data() + levelOffset[level]; }
+};
+
+/// level0とMipBuild()で作ったchainの全段を圧縮する。
+/// D3D11のBC形式はlevel 0の幅と高さが4の倍数であること。そうでないときは失敗を戻す。
+/// @return 成功のとき0。失敗のとき負の値。
+int BcEncodeMips(const MipSource& level0, const MipChain& chain, BcFormat f, BcQuality q, BcTexture* tex_r,
+        int numThreads = 0);
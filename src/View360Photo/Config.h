@@ -2,4 +2,48 @@
 
 #define NUM_BLUR (4)
 #define NUM_VIEWS (4)
+
+// 半球メッシュの経度方向、緯度方向の分割数。
+#define SPHERE_DIVISIONS (64)
+
+// GPUに送る頂点の形式。MeshPack.hのMeshVertexFormat。
+#define MESH_VERTEX_FORMAT (MVF_Octahedral16)
+
+// 最初に表示する縮小画像の幅の上限。全画素のテクスチャーは後から別のスレッドで作って差し替える。0のとき縮小しない。
+#define PREVIEW_MAX_WIDTH (2048)
+
+// プログレッシブJPEGの途中の画像でテクスチャーを更新する間隔のバイト数。0のときスキャンごと。
+#define PROGRESSIVE_UPDATE_BYTES (0)
+
+// 全画素のテクスチャーのミップマップを、CPUでリニアな明るさで縮小するフィルター。MipBuilder.hのMipFilter。
+#define MIP_FILTER (MF_Kaiser)
+
+// 全画素のテクスチャーに作るミップマップの段数(最も精細な段を含む)。0のとき1x1まで。サンプラーのMaxLODもこれに合わせる。
+#define TEXTURE_MIP_LEVELS (1)
+
+// 全画素のテクスチャーの幅の上限を、画面の視野の中心の1度あたりの画素数から決める。DisplayDensity.hを参照。
+// 画像の赤道の1画素が画面の1 / TEXTURE_DENSITY_SCALE画素になる幅より大きい画像は、縮小してデコードしてからMIP_FILTERで縮める。
+// 0のとき上限を設けない。
+// 視野はフレームを描くまで分からないので、1眼の水平の視野をDISPLAY_FOV_DEGREES度とする。狭いほど上限は大きい。
+#define TEXTURE_DENSITY_SCALE (1.0)
+#define DISPLAY_FOV_DEGREES (90)
+
+// 全画素のテクスチャーのブロック圧縮の形式と品質。BlockCompress.hのBcFormat, BcQuality。BCF_Noneのとき圧縮しない。
+#define TEXTURE_FORMAT (BCF_Bc7)
+#define TEXTURE_QUALITY (BCQ_Fast)
+
+// 全画素のテクスチャーの全段を保存するキャッシュの合計の上限(MiB)。超えたら最後に使ったのが古いものから消す。0のとき使わない。
+#define TEXTURE_CACHE_MAX_MB (2048)
+
+// 全画素のテクスチャーの形。CubeMap.hのPanoramaLayout。PL_Cube, PL_Eacのとき、正距円筒図法の画像を立方体マップ
+// (等角キューブマップ)にしてTextureCubeで読む。PL_Octahedralのとき八面体マップにする。
+// 立方体マップの面の一辺の画素数はCUBE_FACE_SIZE。0のとき画像の幅 / 4で、画素数は元の画像の3/4になる。
+// 八面体マップの一辺の画素数はOCT_MAP_SIZE。0のとき画像の幅 / 2で、画素数は元の画像の1/2になる。
+// PL_LatitudeBandsのとき、画像をLATITUDE_BANDS本の緯度の帯に分けて、帯ごとに横をcos(緯度)の比率で縮めて詰める。
+// 32本のとき画素数は元の画像の約68%になる。
+#define TEXTURE_LAYOUT (PL_Equirect)
+#define CUBE_FACE_SIZE (0)
+#define OCT_MAP_SIZE (0)
+#define LATITUDE_BANDS (32)
+
 #define PROGRAM_NAME "View360Photo v1.0.3"
\ No newline at end of file
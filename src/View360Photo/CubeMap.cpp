@@ -0,0 +1,690 @@
+﻿// 日本語。
+
+#include "CubeMap.h"
+#include "ParallelFor.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#ifndef CUBE_MAP_SSE2
+#  if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#    define CUBE_MAP_SSE2 1
+#  else
+#    define CUBE_MAP_SSE2 0
+#  endif
+#endif
+
+#if CUBE_MAP_SSE2
+#  include <emmintrin.h>
+#endif
+
+static const double PI = 3.14159265358979323846;
+static const float F_PI = 3.14159265358979f;
+static const float F_PI_2 = 1.57079632679490f;
+static const float F_PI_4 = 0.785398163397448f;
+
+/// タイルの一辺の画素数。
+static const int TILE = 64;
+
+const char*
+PanoramaLayoutToStr(PanoramaLayout l)
+{
+    switch (l) {
+    case PL_Equirect:      return "Equirect";
+    case PL_Cube:          return "Cube";
+    case PL_Eac:           return "EAC";
+    case PL_Octahedral:    return "Octahedral";
+    case PL_LatitudeBands: return "LatitudeBands";
+    default:               return "Unknown";
+    }
+}
+
+const char*
+CubeFilterToStr(CubeFilter f)
+{
+    switch (f) {
+    case CUF_Bilinear: return "Bilinear";
+    case CUF_Bicubic:  return "Bicubic";
+    default:           return "Unknown";
+    }
+}
+
+int
+CubeMapAutoFaceSize(int equirectWidth)
+{
+    return std::max(4, (equirectWidth / 4 + 3) & ~3);
+}
+
+int
+OctMapAutoSize(int equirectWidth)
+{
+    return std::max(4, (equirectWidth / 2 + 3) & ~3);
+}
+
+float
+EacToCube(float a)
+{
+    return tanf(a * F_PI_4);
+}
+
+float
+CubeToEac(float sc)
+{
+    return atanf(sc) / F_PI_4;
+}
+
+void
+CubeFaceDirection(int face, float sc, float tc, float dir_r[3])
+{
+    switch (face) {
+    case CUBE_PosX: dir_r[0] = 1.0f; dir_r[1] = -tc;   dir_r[2] = -sc;   break;
+    case CUBE_NegX: dir_r[0] = -1.0f; dir_r[1] = -tc;  dir_r[2] = sc;    break;
+    case CUBE_PosY: dir_r[0] = sc;   dir_r[1] = 1.0f;  dir_r[2] = tc;    break;
+    case CUBE_NegY: dir_r[0] = sc;   dir_r[1] = -1.0f; dir_r[2] = -tc;   break;
+    case CUBE_PosZ: dir_r[0] = sc;   dir_r[1] = -tc;   dir_r[2] = 1.0f;  break;
+    default:        dir_r[0] = -sc;  dir_r[1] = -tc;   dir_r[2] = -1.0f; break;
+    }
+}
+
+int
+DirectionToCubeFace(const float dir[3], bool equiAngular, float* sc_r, float* tc_r)
+{
+    const float ax = fabsf(dir[0]);
+    const float ay = fabsf(dir[1]);
+    const float az = fabsf(dir[2]);
+    int face;
+    float sc;
+    float tc;
+    if (ay <= ax && az <= ax) {
+        face = (0 < dir[0]) ? CUBE_PosX : CUBE_NegX;
+        sc = (0 < dir[0]) ? -dir[2] / ax : dir[2] / ax;
+        tc = -dir[1] / ax;
+    } else if (az <= ay) {
+        face = (0 < dir[1]) ? CUBE_PosY : CUBE_NegY;
+        sc = dir[0] / ay;
+        tc = (0 < dir[1]) ? dir[2] / ay : -dir[2] / ay;
+    } else {
+        face = (0 < dir[2]) ? CUBE_PosZ : CUBE_NegZ;
+        sc = (0 < dir[2]) ? dir[0] / az : -dir[0] / az;
+        tc = -dir[1] / az;
+    }
+    *sc_r = equiAngular ? CubeToEac(sc) : sc;
+    *tc_r = equiAngular ? CubeToEac(tc) : tc;
+    return face;
+}
+
+void
+OctDirection(float s, float t, float dir_r[3])
+{
+    // MeshPack.cppのOctDecode()と同じ。下半分は四隅に折り返す。
+    const float y = 1.0f - fabsf(s) - fabsf(t);
+    const float f = std::max(-y, 0.0f);
+    dir_r[0] = s - copysignf(f, s);
+    dir_r[1] = y;
+    dir_r[2] = t - copysignf(f, t);
+}
+
+void
+DirectionToOct(const float dir[3], float* s_r, float* t_r)
+{
+    const float l1 = fabsf(dir[0]) + fabsf(dir[1]) + fabsf(dir[2]);
+    float s = dir[0] / l1;
+    float t = dir[2] / l1;
+    if (dir[1] < 0) {
+        const float s0 = s;
+        s = copysignf(1.0f - fabsf(t), s0);
+        t = copysignf(1.0f - fabsf(s0), t);
+    }
+    *s_r = s;
+    *t_r = t;
+}
+
+// atan2 ///////////////////////////////////////////////////////////////////////////////
+// CephesのatanfのtanのPI/8での範囲の縮小と多項式。誤差は1e-7 rad程度。
+// スカラーとSSE2で同じ順番で計算するので、結果は同じになる。
+
+static const float ATAN_TAN_PI_8 = 0.414213562373095f;
+static const float ATAN_P0 = 8.05374449538e-2f;
+static const float ATAN_P1 = -1.38776856032e-1f;
+static const float ATAN_P2 = 1.99777106478e-1f;
+static const float ATAN_P3 = -3.33329491539e-1f;
+
+/// 0 <= a <= 1のatan。
+static inline float
+AtanUnit(float a)
+{
+    float base = 0.0f;
+    if (ATAN_TAN_PI_8 < a) {
+        a = (a - 1.0f) / (a + 1.0f);
+        base = F_PI_4;
+    }
+    const float z = a * a;
+    const float p = (((ATAN_P0 * z + ATAN_P1) * z + ATAN_P2) * z + ATAN_P3) * z * a + a;
+    return base + p;
+}
+
+static inline float
+Atan2Scalar(float y, float x)
+{
+    const float ay = fabsf(y);
+    const float ax = fabsf(x);
+    const float mx = std::max(ax, ay);
+    const float mn = std::min(ax, ay);
+    float r = (mx == 0.0f) ? 0.0f : AtanUnit(mn / mx);
+    if (ax < ay) {
+        r = F_PI_2 - r;
+    }
+    if (x < 0.0f) {
+        r = F_PI - r;
+    }
+    return (y < 0.0f) ? -r : r;
+}
+
+#if CUBE_MAP_SSE2
+
+static inline __m128
+Select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128
+AtanUnitPs(__m128 a)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 big = _mm_cmplt_ps(_mm_set1_ps(ATAN_TAN_PI_8), a);
+    a = Select(big, _mm_div_ps(_mm_sub_ps(a, one), _mm_add_ps(a, one)), a);
+    const __m128 base = _mm_and_ps(big, _mm_set1_ps(F_PI_4));
+    const __m128 z = _mm_mul_ps(a, a);
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_P0), z), _mm_set1_ps(ATAN_P1));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_P2));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(ATAN_P3));
+    p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), a), a);
+    return _mm_add_ps(base, p);
+}
+
+static inline __m128
+Atan2Ps(__m128 y, __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 ay = _mm_andnot_ps(signMask, y);
+    const __m128 ax = _mm_andnot_ps(signMask, x);
+    const __m128 mx = _mm_max_ps(ax, ay);
+    const __m128 mn = _mm_min_ps(ax, ay);
+    const __m128 mxZero = _mm_cmpeq_ps(mx, zero);
+    const __m128 q = _mm_div_ps(mn, Select(mxZero, _mm_set1_ps(1.0f), mx));
+    __m128 r = _mm_andnot_ps(mxZero, AtanUnitPs(q));
+    r = Select(_mm_cmplt_ps(ax, ay), _mm_sub_ps(_mm_set1_ps(F_PI_2), r), r);
+    r = Select(_mm_cmplt_ps(x, zero), _mm_sub_ps(_mm_set1_ps(F_PI), r), r);
+    return Select(_mm_cmplt_ps(y, zero), _mm_sub_ps(zero, r), r);
+}
+
+#endif // CUBE_MAP_SSE2
+
+// 座標 ////////////////////////////////////////////////////////////////////////////////
+
+/// 面の画素の列と行に共通の表。
+struct CubeTables {
+    /// 面の座標。a = (i + 0.5) * 2 / faceSize - 1のとき、sc[i] = a。EACのときsc[i] = tan(π/4 a)。
+    std::vector<float> sc;
+
+    /// 横の面の列iの経度のatan(sc[i]) / 2π。EACのときa / 8。
+    std::vector<float> sideU;
+
+    /// 横の面の列iの、水平方向の長さの逆数 1 / sqrt(1 + sc[i]^2)。
+    std::vector<float> sideInvR;
+};
+
+static void
+BuildTables(int n, bool equiAngular, CubeTables& t_r)
+{
+    t_r.sc.resize(n);
+    t_r.sideU.resize(n);
+    t_r.sideInvR.resize(n);
+    for (int i = 0; i < n; ++i) {
+        const double a = (i + 0.5) * 2.0 / n - 1.0;
+        const double sc = equiAngular ? tan(a * PI / 4) : a;
+        t_r.sc[i] = (float)sc;
+        t_r.sideU[i] = (float)(atan(sc) / (2.0 * PI));
+        t_r.sideInvR[i] = (float)(1.0 / sqrt(1.0 + sc * sc));
+    }
+}
+
+/// 横の面の経度の基準。φ = base - atan(sc)。
+static double
+SideFaceBaseLon(int face)
+{
+    switch (face) {
+    case CUBE_PosX: return 0.0;
+    case CUBE_NegX: return PI;
+    case CUBE_PosZ: return PI / 2;
+    default:        return -PI / 2;
+    }
+}
+
+/// floorf()は関数呼び出しになることがあるので、整数への変換で切り捨てる。
+static inline int
+FloorToInt(float v)
+{
+    const int i = (int)v;
+    return (v < (float)i) ? i - 1 : i;
+}
+
+/// uの小数部。画像の左右の端で折り返す。
+static inline float
+WrapU(float u)
+{
+    return u - (float)FloorToInt(u);
+}
+
+/// 面faceの行jの、列i0 ～ i0 + n - 1の画素の、元の画像の座標(sx, sy)。画素の中心が整数。
+static void
+RowCoords(const CubeTables& t, int face, int j, int i0, int n, int W, int H, bool simd, float* sx_r, float* sy_r)
+{
+    const float tc = t.sc[j];
+    const float fW = (float)W;
+    const float fH = (float)H;
+    const float invPi = (float)(1.0 / PI);
+    const float inv2Pi = (float)(0.5 / PI);
+    int i = 0;
+
+    if (face != CUBE_PosY && face != CUBE_NegY) {
+        // 横の面。経度は列だけで決まる。緯度 = atan(-tc / sqrt(1 + sc^2))。
+        const float u0 = (float)(0.5 - SideFaceBaseLon(face) / (2.0 * PI));
+#if CUBE_MAP_SSE2
+        if (simd) {
+            const __m128 vY = _mm_set1_ps(-tc);
+            const __m128 vOne = _mm_set1_ps(1.0f);
+            for (; i + 4 <= n; i += 4) {
+                const __m128 lat = Atan2Ps(_mm_mul_ps(vY, _mm_loadu_ps(&t.sideInvR[i0 + i])), vOne);
+                const __m128 v = _mm_add_ps(_mm_set1_ps(0.5f), _mm_mul_ps(lat, _mm_set1_ps(invPi)));
+                _mm_storeu_ps(sy_r + i, _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(fH)), _mm_set1_ps(0.5f)));
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            const float lat = Atan2Scalar(-tc * t.sideInvR[i0 + i], 1.0f);
+            sy_r[i] = (0.5f + lat * invPi) * fH - 0.5f;
+        }
+        for (i = 0; i < n; ++i) {
+            sx_r[i] = WrapU(u0 + t.sideU[i0 + i]) * fW - 0.5f;
+        }
+        return;
+    }
+
+    // 上下の面。向き(sc, ±1, ±tc)。
+    const float y = (face == CUBE_PosY) ? 1.0f : -1.0f;
+    const float z = (face == CUBE_PosY) ? tc : -tc;
+#if CUBE_MAP_SSE2
+    if (simd) {
+        const __m128 vY = _mm_set1_ps(y);
+        const __m128 vZ = _mm_set1_ps(z);
+        const __m128 vZ2 = _mm_set1_ps(z * z);
+        for (; i + 4 <= n; i += 4) {
+            const __m128 x = _mm_loadu_ps(&t.sc[i0 + i]);
+            const __m128 r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), vZ2));
+            const __m128 lon = Atan2Ps(vZ, x);
+            const __m128 lat = Atan2Ps(vY, r);
+            const __m128 v = _mm_add_ps(_mm_set1_ps(0.5f), _mm_mul_ps(lat, _mm_set1_ps(invPi)));
+            const __m128 u = _mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(lon, _mm_set1_ps(inv2Pi)));
+            _mm_storeu_ps(sx_r + i, u);
+            _mm_storeu_ps(sy_r + i, _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(fH)), _mm_set1_ps(0.5f)));
+        }
+        for (int k = 0; k < i; ++k) {
+            sx_r[k] = WrapU(sx_r[k]) * fW - 0.5f;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        const float x = t.sc[i0 + i];
+        const float r = sqrtf(x * x + z * z);
+        const float lon = Atan2Scalar(z, x);
+        const float lat = Atan2Scalar(y, r);
+        sx_r[i] = WrapU(0.5f - lon * inv2Pi) * fW - 0.5f;
+        sy_r[i] = (0.5f + lat * invPi) * fH - 0.5f;
+    }
+}
+
+/// 八面体マップの行jの、列i0 ～ i0 + n - 1の画素の、元の画像の座標(sx, sy)。stは面の座標の表(CubeTables::sc)。
+static void
+OctRowCoords(const std::vector<float>& st, int j, int i0, int n, int W, int H, bool simd, float* sx_r, float* sy_r)
+{
+    const float t = st[j];
+    const float fW = (float)W;
+    const float fH = (float)H;
+    const float invPi = (float)(1.0 / PI);
+    const float inv2Pi = (float)(0.5 / PI);
+    int i = 0;
+#if CUBE_MAP_SSE2
+    if (simd) {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 vT = _mm_set1_ps(t);
+        const __m128 tSign = _mm_and_ps(vT, signMask);
+        const __m128 absT = _mm_andnot_ps(signMask, vT);
+        for (; i + 4 <= n; i += 4) {
+            // OctDirection()と同じ計算。
+            const __m128 s = _mm_loadu_ps(&st[i0 + i]);
+            const __m128 y = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_andnot_ps(signMask, s)), absT);
+            const __m128 f = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), y), _mm_setzero_ps());
+            const __m128 x = _mm_sub_ps(s, _mm_or_ps(f, _mm_and_ps(s, signMask)));
+            const __m128 z = _mm_sub_ps(vT, _mm_or_ps(f, tSign));
+            const __m128 r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)));
+            const __m128 lon = Atan2Ps(z, x);
+            const __m128 lat = Atan2Ps(y, r);
+            const __m128 v = _mm_add_ps(_mm_set1_ps(0.5f), _mm_mul_ps(lat, _mm_set1_ps(invPi)));
+            const __m128 u = _mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(lon, _mm_set1_ps(inv2Pi)));
+            _mm_storeu_ps(sx_r + i, u);
+            _mm_storeu_ps(sy_r + i, _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(fH)), _mm_set1_ps(0.5f)));
+        }
+        for (int k = 0; k < i; ++k) {
+            sx_r[k] = WrapU(sx_r[k]) * fW - 0.5f;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        float d[3];
+        OctDirection(st[i0 + i], t, d);
+        const float r = sqrtf(d[0] * d[0] + d[2] * d[2]);
+        const float lon = Atan2Scalar(d[2], d[0]);
+        const float lat = Atan2Scalar(d[1], r);
+        sx_r[i] = WrapU(0.5f - lon * inv2Pi) * fW - 0.5f;
+        sy_r[i] = (0.5f + lat * invPi) * fH - 0.5f;
+    }
+}
+
+// 画素を読む /////////////////////////////////////////////////////////////////////////
+
+/// Catmull-Romの4個の重み。
+static inline void
+CubicWeights(float f, float w_r[4])
+{
+    w_r[0] = ((-0.5f * f + 1.0f) * f - 0.5f) * f;
+    w_r[1] = ((1.5f * f - 2.5f) * f) * f + 1.0f;
+    w_r[2] = ((-1.5f * f + 2.0f) * f + 0.5f) * f;
+    w_r[3] = ((0.5f * f - 0.5f) * f) * f;
+}
+
+/// xは-W ～ 2W - 1。
+static inline int
+WrapX(int x, int W)
+{
+    if (x < 0) {
+        return x + W;
+    }
+    return (W <= x) ? x - W : x;
+}
+
+static inline int
+ClampY(int y, int H)
+{
+    return std::min(std::max(y, 0), H - 1);
+}
+
+/// 元の画像の(sx[i], sy[i])の画素を、dst (BGRA) にn画素書く。TAPSは2のとき双線形、4のときCatmull-Rom。
+template <int TAPS, bool SIMD>
+static void
+SampleRow(const MipSource& src, const float* sx, const float* sy, int n, uint8_t* dst)
+{
+    for (int i = 0; i < n; ++i) {
+        const int x0 = FloorToInt(sx[i]);
+        const int y0 = FloorToInt(sy[i]);
+        const float fx = sx[i] - (float)x0;
+        const float fy = sy[i] - (float)y0;
+
+        int xs[TAPS];
+        const uint8_t* rows[TAPS];
+        float wx[TAPS];
+        float wy[TAPS];
+        if constexpr (TAPS == 2) {
+            wx[0] = 1.0f - fx;
+            wx[1] = fx;
+            wy[0] = 1.0f - fy;
+            wy[1] = fy;
+        } else {
+            CubicWeights(fx, wx);
+            CubicWeights(fy, wy);
+        }
+        for (int k = 0; k < TAPS; ++k) {
+            xs[k] = 4 * WrapX(x0 - TAPS / 2 + 1 + k, src.width);
+            rows[k] = src.pixels + (size_t)src.stride * ClampY(y0 - TAPS / 2 + 1 + k, src.height);
+        }
+        uint8_t* d = dst + 4 * i;
+
+#if CUBE_MAP_SSE2
+        if constexpr (SIMD) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128 acc = _mm_setzero_ps();
+            for (int ky = 0; ky < TAPS; ++ky) {
+                __m128 racc = _mm_setzero_ps();
+                for (int kx = 0; kx < TAPS; ++kx) {
+                    const __m128i p8 = _mm_cvtsi32_si128(*(const int*)(rows[ky] + xs[kx]));
+                    const __m128 px = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(p8, zero), zero));
+                    racc = _mm_add_ps(racc, _mm_mul_ps(px, _mm_set1_ps(wx[kx])));
+                }
+                acc = _mm_add_ps(acc, _mm_mul_ps(racc, _mm_set1_ps(wy[ky])));
+            }
+            // 0～255にして四捨五入する。
+            acc = _mm_min_ps(_mm_max_ps(acc, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+            const __m128i v = _mm_cvttps_epi32(_mm_add_ps(acc, _mm_set1_ps(0.5f)));
+            const __m128i v16 = _mm_packs_epi32(v, v);
+            *(int*)d = _mm_cvtsi128_si32(_mm_packus_epi16(v16, v16));
+            continue;
+        }
+#endif
+
+        float acc[4] = {};
+        for (int ky = 0; ky < TAPS; ++ky) {
+            float racc[4] = {};
+            for (int kx = 0; kx < TAPS; ++kx) {
+                const uint8_t* px = rows[ky] + xs[kx];
+                for (int c = 0; c < 4; ++c) {
+                    racc[c] = racc[c] + (float)px[c] * wx[kx];
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                acc[c] = acc[c] + racc[c] * wy[ky];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            const float v = std::min(std::max(acc[c], 0.0f), 255.0f);
+            d[c] = (uint8_t)(int)(v + 0.5f);
+        }
+    }
+}
+
+typedef void (*SampleRowFunc)(const MipSource& src, const float* sx, const float* sy, int n, uint8_t* dst);
+
+static SampleRowFunc
+SelectSampleRow(CubeFilter filter, bool simd)
+{
+    if (filter == CUF_Bilinear) {
+        return simd ? SampleRow<2, true> : SampleRow<2, false>;
+    }
+    return simd ? SampleRow<4, true> : SampleRow<4, false>;
+}
+
+/// numFaces面の一辺n画素の画像dst_rの各画素を、rowCoords(face, j, i0, n, sx_r, sy_r)で求めた元の画像の座標から作る。
+/// 面を64x64画素のタイルに分けて、複数のスレッドで作る。
+template <typename F>
+static void
+ResampleTiles(const MipSource& src, const CubeMapParams& p, int n, int numFaces, uint8_t* dst_r, F&& rowCoords)
+{
+    const SampleRowFunc sampleRow = SelectSampleRow(p.filter, p.simd);
+    const int tilesPerSide = (n + TILE - 1) / TILE;
+    const int tilesPerFace = tilesPerSide * tilesPerSide;
+    ParallelFor(numFaces * tilesPerFace, [&](int tile) {
+        const int face = tile / tilesPerFace;
+        const int ty = (tile % tilesPerFace) / tilesPerSide;
+        const int tx = tile % tilesPerSide;
+        const int i0 = tx * TILE;
+        const int w = std::min(TILE, n - i0);
+        uint8_t* faceDst = dst_r + (size_t)4 * n * n * face;
+
+        float sx[TILE];
+        float sy[TILE];
+        for (int j = ty * TILE; j < std::min((ty + 1) * TILE, n); ++j) {
+            rowCoords(face, j, i0, w, sx, sy);
+            sampleRow(src, sx, sy, w, faceDst + ((size_t)n * j + i0) * 4);
+        }
+    }, p.numThreads);
+}
+
+static bool
+IsValidSource(const MipSource& src, const CubeMapParams& p)
+{
+    return src.pixels != nullptr && 0 < src.width && 0 < src.height && 4 * src.width <= src.stride
+            && 0 <= p.faceSize && 0 <= p.filter && p.filter < CUF_NUM;
+}
+
+int
+EquirectToCube(const MipSource& equirect, const CubeMapParams& p, CubeMap* cube_r)
+{
+    if (cube_r == nullptr || !IsValidSource(equirect, p)) {
+        printf("E: EquirectToCube() invalid argument\n");
+        return -1;
+    }
+
+    const int n = (p.faceSize == 0) ? CubeMapAutoFaceSize(equirect.width) : p.faceSize;
+    cube_r->faceSize = n;
+    cube_r->equiAngular = p.equiAngular;
+    cube_r->pixels.resize(cube_r->FaceBytes() * CUBE_NUM);
+
+    CubeTables t;
+    BuildTables(n, p.equiAngular, t);
+
+    ResampleTiles(equirect, p, n, CUBE_NUM, cube_r->pixels.data(),
+            [&](int face, int j, int i0, int w, float* sx_r, float* sy_r) {
+        RowCoords(t, face, j, i0, w, equirect.width, equirect.height, p.simd, sx_r, sy_r);
+    });
+    return 0;
+}
+
+int
+EquirectToOct(const MipSource& equirect, const CubeMapParams& p, OctMap* oct_r)
+{
+    if (oct_r == nullptr || !IsValidSource(equirect, p)) {
+        printf("E: EquirectToOct() invalid argument\n");
+        return -1;
+    }
+
+    const int n = (p.faceSize == 0) ? OctMapAutoSize(equirect.width) : p.faceSize;
+    oct_r->size = n;
+    oct_r->pixels.resize((size_t)4 * n * n);
+
+    CubeTables t;
+    BuildTables(n, false, t);
+
+    ResampleTiles(equirect, p, n, 1, oct_r->pixels.data(),
+            [&](int, int j, int i0, int w, float* sx_r, float* sy_r) {
+        OctRowCoords(t.sc, j, i0, w, equirect.width, equirect.height, p.simd, sx_r, sy_r);
+    });
+    return 0;
+}
+
+/// 一辺n画素の面faceの、画素の座標(fx, fy)を双線形で読んでdstに書く。面の端は端の画素を延ばす。
+static void
+SampleFaceBilinear(const uint8_t* face, int n, float fx, float fy, uint8_t* dst)
+{
+    const int x0 = FloorToInt(fx);
+    const int y0 = FloorToInt(fy);
+    const float wx = fx - (float)x0;
+    const float wy = fy - (float)y0;
+    for (int c = 0; c < 4; ++c) {
+        float v = 0;
+        for (int ky = 0; ky < 2; ++ky) {
+            const int yy = std::min(std::max(y0 + ky, 0), n - 1);
+            for (int kx = 0; kx < 2; ++kx) {
+                const int xx = std::min(std::max(x0 + kx, 0), n - 1);
+                v += (float)face[((size_t)n * yy + xx) * 4 + c] * (kx == 0 ? 1.0f - wx : wx) * (ky == 0 ? 1.0f - wy : wy);
+            }
+        }
+        dst[c] = (uint8_t)(int)(std::min(std::max(v, 0.0f), 255.0f) + 0.5f);
+    }
+}
+
+/// 一辺n画素の八面体マップの、画素の座標(fx, fy)を双線形で読んでdstに書く。
+/// 外周の外の画素は、外周の辺の中点で折り返した画素を読む。八面体マップの外周は、辺の中点をはさんで同じ向きが並ぶ。
+static void
+SampleOctBilinear(const uint8_t* oct, int n, float fx, float fy, uint8_t* dst)
+{
+    const int x0 = FloorToInt(fx);
+    const int y0 = FloorToInt(fy);
+    const float wx = fx - (float)x0;
+    const float wy = fy - (float)y0;
+    const uint8_t* p[2][2];
+    for (int ky = 0; ky < 2; ++ky) {
+        for (int kx = 0; kx < 2; ++kx) {
+            int xx = x0 + kx;
+            int yy = y0 + ky;
+            if (xx < 0 || n <= xx) {
+                xx = std::min(std::max(xx, 0), n - 1);
+                yy = n - 1 - yy;
+            }
+            if (yy < 0 || n <= yy) {
+                yy = std::min(std::max(yy, 0), n - 1);
+                xx = n - 1 - xx;
+            }
+            p[ky][kx] = oct + ((size_t)n * yy + xx) * 4;
+        }
+    }
+    for (int c = 0; c < 4; ++c) {
+        const float top = (float)p[0][0][c] + ((float)p[0][1][c] - (float)p[0][0][c]) * wx;
+        const float bottom = (float)p[1][0][c] + ((float)p[1][1][c] - (float)p[1][0][c]) * wx;
+        const float v = top + (bottom - top) * wy;
+        dst[c] = (uint8_t)(int)(std::min(std::max(v, 0.0f), 255.0f) + 0.5f);
+    }
+}
+
+/// w x hの正距円筒図法の画像の各画素の向きを、func(dir, dst)で書く。
+template <typename F>
+static void
+ForEachEquirectPixel(int w, int h, uint8_t* dst, int stride, int numThreads, F&& func)
+{
+    ParallelFor(h, [&](int y) {
+        const double lat = ((y + 0.5) / h - 0.5) * PI;
+        uint8_t* row = dst + (size_t)stride * y;
+        for (int x = 0; x < w; ++x) {
+            const double lon = (0.5 - (x + 0.5) / w) * 2.0 * PI;
+            const float d[3] = { (float)(cos(lat) * cos(lon)), (float)sin(lat), (float)(cos(lat) * sin(lon)) };
+            func(d, row + 4 * x);
+        }
+    }, numThreads);
+}
+
+int
+CubeToEquirect(const CubeMap& cube, int w, int h, uint8_t* dst, int stride, int numThreads)
+{
+    const int n = cube.faceSize;
+    if (n <= 0 || cube.pixels.size() < cube.FaceBytes() * CUBE_NUM || dst == nullptr || w <= 0 || h <= 0
+            || stride < 4 * w) {
+        printf("E: CubeToEquirect() invalid argument\n");
+        return -1;
+    }
+
+    ForEachEquirectPixel(w, h, dst, stride, numThreads, [&](const float d[3], uint8_t* px) {
+        float sc;
+        float tc;
+        const int face = DirectionToCubeFace(d, cube.equiAngular, &sc, &tc);
+        SampleFaceBilinear(cube.Face(face), n, (sc + 1.0f) * 0.5f * n - 0.5f, (tc + 1.0f) * 0.5f * n - 0.5f, px);
+    });
+    return 0;
+}
+
+int
+OctToEquirect(const OctMap& oct, int w, int h, uint8_t* dst, int stride, int numThreads)
+{
+    const int n = oct.size;
+    if (n <= 0 || oct.pixels.size() < (size_t)4 * n * n || dst == nullptr || w <= 0 || h <= 0 || stride < 4 * w) {
+        printf("E: OctToEquirect() invalid argument\n");
+        return -1;
+    }
+
+    ForEachEquirectPixel(w, h, dst, stride, numThreads, [&](const float d[3], uint8_t* px) {
+        float s;
+        float t;
+        DirectionToOct(d, &s, &t);
+        SampleOctBilinear(oct.pixels.data(), n, (s + 1.0f) * 0.5f * n - 0.5f, (t + 1.0f) * 0.5f * n - 0.5f, px);
+    });
+    return 0;
+}
@@ -0,0 +1,138 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "MipBuilder.h"
+
+/// 全画素のテクスチャーの形。
+enum PanoramaLayout {
+    /// 正距円筒図法の画像の左半分と右半分を、半球のメッシュのテクスチャーにする。
+    PL_Equirect,
+
+    /// 立方体マップにして、メッシュの頂点の向きでTextureCubeを読む。
+    PL_Cube,
+
+    /// 等角キューブマップ(Equi-Angular Cubemap)。面の座標aと立方体の面の座標scはsc = tan(π/4 a)。
+    /// 面の中心と端の画素の角度の差がPL_Cubeより小さい。
+    PL_Eac,
+
+    /// 八面体マップ。向きを八面体に投影して、上半分を中の菱形、下半分を四隅に置いた正方形1枚。
+    PL_Octahedral,
+
+    /// 正距円筒図法の画像を緯度の帯に分け、各帯を横にcos(緯度)の比率で縮めて1枚に詰める。LatitudeBands.hを参照。
+    PL_LatitudeBands,
+
+    PL_NUM
+};
+
+const char* PanoramaLayoutToStr(PanoramaLayout l);
+
+/// 立方体マップの面。D3D11のTEXTURECUBEの配列の順番。
+enum CubeFace {
+    CUBE_PosX,
+    CUBE_NegX,
+    CUBE_PosY,
+    CUBE_NegY,
+    CUBE_PosZ,
+    CUBE_NegZ,
+    CUBE_NUM
+};
+
+/// 正距円筒図法の画像を読むフィルター。
+enum CubeFilter {
+    CUF_Bilinear,
+
+    /// Catmull-Romの4x4。
+    CUF_Bicubic,
+
+    CUF_NUM
+};
+
+const char* CubeFilterToStr(CubeFilter f);
+
+struct CubeMapParams {
+    /// 面の一辺の画素数。0のときCubeMapAutoFaceSize()。EquirectToOct()では画像の一辺で、0のときOctMapAutoSize()。
+    int faceSize = 0;
+
+    /// trueのとき等角キューブマップ(PL_Eac)にする。EquirectToOct()では使わない。
+    bool equiAngular = false;
+
+    CubeFilter filter = CUF_Bicubic;
+
+    /// falseのとき、SSE2があってもスカラーで計算する(比較用)。
+    bool simd = true;
+
+    /// 0のときハードウェアスレッド数。
+    int numThreads = 0;
+};
+
+/// 立方体マップの6面。BGRA 8ビット、sRGB。面fはFace(f)からfaceSize x faceSize画素、行の隙間なく並べる。
+struct CubeMap {
+    int faceSize = 0;
+
+    /// trueのとき等角キューブマップ。面の座標はEacToCube()で立方体の面の座標にする。
+    bool equiAngular = false;
+
+    std::vector<uint8_t> pixels;
+
+    size_t FaceBytes(void) const { return (size_t)4 * faceSize * faceSize; }
+    uint8_t* Face(int face) { return pixels.data() + FaceBytes() * face; }
+    const uint8_t* Face(int face) const { return pixels.data() + FaceBytes() * face; }
+};
+
+/// 正距円筒図法の幅equirectWidthの画像の赤道と同程度の細かさになる面の一辺。幅 / 4を4の倍数に切り上げる。
+/// 画素数は元の画像の3/4になる。
+int CubeMapAutoFaceSize(int equirectWidth);
+
+/// 八面体マップ。BGRA 8ビット、sRGB。size x size画素を行の隙間なく並べる。
+struct OctMap {
+    int size = 0;
+    std::vector<uint8_t> pixels;
+};
+
+/// 正距円筒図法の幅equirectWidthの画像の八面体マップの一辺。幅 / 2を4の倍数に切り上げる。
+/// 画素数は元の画像の1/2。
+int OctMapAutoSize(int equirectWidth);
+
+/// 面faceの、面の座標(sc, tc) (-1～1、右と下が正)の向き。長さは1とは限らない。D3D11のTextureCubeと同じ。
+void CubeFaceDirection(int face, float sc, float tc, float dir_r[3]);
+
+/// 向きdirが当たる面と、その面の座標(sc, tc)。equiAngularのとき等角キューブマップの面の座標にする。
+/// @return CubeFace。
+int DirectionToCubeFace(const float dir[3], bool equiAngular, float* sc_r, float* tc_r);
+
+/// 等角キューブマップの面の座標a (-1～1) を、立方体の面の座標tan(π/4 a)にする。
+float EacToCube(float a);
+
+/// EacToCube()の逆。
+float CubeToEac(float sc);
+
+/// 八面体マップの座標(s, t) (-1～1、右と下が正)の向き。長さは1とは限らない。
+/// s + tの絶対値が1以下の菱形がy > 0の半球。MeshPack.cppの八面体符号化と同じ。
+void OctDirection(float s, float t, float dir_r[3]);
+
+/// OctDirection()の逆。dirは0でないこと。
+void DirectionToOct(const float dir[3], float* s_r, float* t_r);
+
+/// 正距円筒図法の画像を立方体マップにする。向きはSphereMesh.cppのメッシュと同じで、
+/// 経度φ = atan2(z, x)のとき画像のu = 0.5 - φ / 2π、y = +1が画像の下端。
+/// 面を64x64画素のタイルに分けて、複数のスレッドで作る。向きから経度と緯度への変換はSSE2で4画素ずつ行い、
+/// 横の面は列ごとの経度の表を使う。画像の左右の端は繋がっているものとし、上下の端は端の画素を延ばす。
+/// @return 成功のとき0。失敗のとき負の値。
+int EquirectToCube(const MipSource& equirect, const CubeMapParams& p, CubeMap* cube_r);
+
+/// 正距円筒図法の画像を八面体マップにする。EquirectToCube()と同じく、タイルに分けて複数のスレッドで作る。
+/// @return 成功のとき0。失敗のとき負の値。
+int EquirectToOct(const MipSource& equirect, const CubeMapParams& p, OctMap* oct_r);
+
+/// 立方体マップをw x hの正距円筒図法の画像に戻す。面の中は双線形、面の端は端の画素を延ばす。
+/// 変換の誤差を見るためのもの。
+/// @return 成功のとき0。失敗のとき負の値。
+int CubeToEquirect(const CubeMap& cube, int w, int h, uint8_t* dst, int stride, int numThreads = 0);
+
+/// 八面体マップをw x hの正距円筒図法の画像に戻す。双線形で、外周の外は外周の辺の中点で折り返した画素を読む。
+/// TexturedMeshRenderer.cppのMainOctPSと同じ読み方。
+/// @return 成功のとき0。失敗のとき負の値。
+int OctToEquirect(const OctMap& oct, int w, int h, uint8_t* dst, int stride, int numThreads = 0);
@@ -0,0 +1,117 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "DecodedImage.h"
+#include "ImageDecoder.h"
+
+int
+DecodedImage::Load(const wchar_t* path, int maxWidth,
+        const DecodedImageProgress& progress, size_t progressBytes, int minWidth)
+{
+    Clear();
+
+    // 内蔵のデコーダーを先に使い、読めない形式のときGDI+で読む。
+    for (int t = 0; t < IDT_NUM; ++t) {
+        int scale = 1;
+        auto dec = ImageDecoderOpen((ImageDecoderType)t, path, maxWidth, &scale, minWidth);
+        if (!dec) {
+            continue;
+        }
+
+        // 途中の画像もprogressから読めるよう、大きさは先に置く。
+        mWidth = dec->Width();
+        mHeight = dec->Height();
+        mStride = 4 * mWidth;
+        mScale = scale;
+        mComplete = true;
+        mPixels.resize((size_t)mStride * mHeight);
+        if (progress) {
+            dec->SetProgress([&](int scans) {
+                mComplete = progress(*this, scans);
+                return mComplete;
+            }, progressBytes);
+        }
+        if (FAILED(dec->Decode(mPixels.data(), mStride))) {
+            Clear();
+            continue;
+        }
+        return S_OK;
+    }
+
+    printf("E: DecodedImage::Load(%S) failed\n", path);
+    return E_FAIL;
+}
+
+void
+DecodedImage::Clear(void)
+{
+    mPixels = std::vector<uint8_t>();
+    mWidth = 0;
+    mHeight = 0;
+    mStride = 0;
+    mScale = 1;
+    mComplete = false;
+}
+
+int
+DecodedImage::Resize(int width, int height, MipFilter filter)
+{
+    MipSource src;
+    src.pixels = mPixels.data();
+    src.width = mWidth;
+    src.height = mHeight;
+    src.stride = mStride;
+    MipBuildParams mp;
+    mp.filter = filter;
+    mp.wrapX = true;
+    std::vector<uint8_t> pixels;
+    if (MipResize(src, width, height, mp, &pixels) < 0) {
+        return E_FAIL;
+    }
+
+    mPixels.swap(pixels);
+    mWidth = width;
+    mHeight = height;
+    mStride = 4 * width;
+    return S_OK;
+}
+
+ImageView
+DecodedImage::View(void) const
+{
+    ImageView v;
+    v.pixels = mPixels.data();
+    v.width = mWidth;
+    v.height = mHeight;
+    v.stride = mStride;
+    return v;
+}
+
+PixelRect
+PortionToPixelRect(const XrRect2Df& portion, int w, int h)
+{
+    assert(0.0f <= portion.offset.x);
+    assert(0.0f <= portion.offset.y);
+    assert(portion.offset.x + portion.extent.width <= 1.0f);
+    assert(portion.offset.y + portion.extent.height <= 1.0f);
+
+    PixelRect r;
+    r.x = (int)(portion.offset.x * w);
+    r.y = (int)(portion.offset.y * h);
+    r.width = (int)(portion.extent.width * w);
+    r.height = (int)(portion.extent.height * h);
+    return r;
+}
+
+ImageView
+DecodedImage::Crop(const XrRect2Df& portion) const
+{
+    const PixelRect r = PortionToPixelRect(portion, mWidth, mHeight);
+
+    ImageView v;
+    v.pixels = mPixels.data() + (size_t)mStride * r.y + 4 * (size_t)r.x;
+    v.width = r.width;
+    v.height = r.height;
+    v.stride = mStride;
+    return v;
+}
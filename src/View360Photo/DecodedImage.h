@@ -0,0 +1,77 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "MipBuilder.h"
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+/// BGRA 8ビットの画像の一部を指す。画素は複写しない。
+struct ImageView {
+    /// 左上の画素。
+    const uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+
+    /// 次の行までのバイト数。
+    int stride = 0;
+};
+
+/// 画像の中の画素の長方形。
+struct PixelRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+/// 比率0～1で指定したportionを、w x hの画像の画素の長方形にする。DecodedImage::Crop()はこの長方形を切り出す。
+PixelRect PortionToPixelRect(const XrRect2Df& portion, int w, int h);
+
+class DecodedImage;
+
+/// プログレッシブJPEGのデコードの途中で呼ばれる。imgは途中の画像で、関数から戻るまで読める。
+/// falseを戻すとデコードをやめ、imgは途中の画像のままIsComplete()がfalseになる。
+typedef std::function<bool(const DecodedImage& img, int scans)> DecodedImageProgress;
+
+/// 画像ファイルを1回だけデコードしたBGRA 8ビットの画像。
+/// Crop()で切り出した複数のImageViewから、同時にテクスチャーを作れる。
+class DecodedImage {
+public:
+    /// ImageDecoderTypeの順にデコーダーを試す。
+    /// @param maxWidth 0より大きいとき、幅がmaxWidth以下になる最小の縮小率(1/2, 1/4, 1/8まで)でデコードする。
+    ///        縮小できないデコーダーでは元の大きさでデコードする。
+    /// @param progress nullptrでないとき、プログレッシブJPEGのスキャンごとに途中の画像を渡す。
+    /// @param progressBytes progressを呼ぶ間隔の最小のバイト数。0のときスキャンごと。
+    /// @param minWidth 0より大きいとき、幅がminWidth以上のままの最大の縮小率でデコードする。後でResize()で縮小するときに使う。
+    int Load(const wchar_t* path, int maxWidth = 0,
+            const DecodedImageProgress& progress = nullptr, size_t progressBytes = 0, int minWidth = 0);
+    void Clear(void);
+
+    /// 画像をfilterでリニアな明るさでwidth x heightに縮小する。正距円筒図法の経度の継ぎ目のため、左右の端はつながっているとする。
+    /// Scale()は変えない。
+    int Resize(int width, int height, MipFilter filter);
+
+    int Width(void) const { return mWidth; }
+    int Height(void) const { return mHeight; }
+
+    /// Load()での縮小率の分母。1, 2, 4, 8。
+    int Scale(void) const { return mScale; }
+
+    /// Load()で最後まで読んだときtrue。progressがfalseを戻してやめたときfalse。
+    bool IsComplete(void) const { return mComplete; }
+
+    ImageView View(void) const;
+
+    /// @param portion 比率を0～1で指定。
+    ImageView Crop(const XrRect2Df& portion) const;
+
+private:
+    std::vector<uint8_t> mPixels;
+    int mWidth = 0;
+    int mHeight = 0;
+    int mStride = 0;
+    int mScale = 1;
+    bool mComplete = false;
+};
@@ -0,0 +1,41 @@
+﻿// 日本語。
+
+#include "DisplayDensity.h"
+#include <math.h>
+#include <stdint.h>
+
+static const double PI = 3.14159265358979323846;
+
+double
+DisplayPixelsPerDegree(int viewWidth, double angleLeft, double angleRight)
+{
+    // 画面上の位置はtanに比例し、tanの傾きは中心で1。
+    const double tanSpan = tan(angleRight) - tan(angleLeft);
+    if (viewWidth <= 0 || tanSpan <= 0) {
+        return 0;
+    }
+    return viewWidth / tanSpan * PI / 180.0;
+}
+
+int
+EquirectWidthForDensity(double pixelsPerDegree, double densityScale)
+{
+    if (pixelsPerDegree <= 0 || densityScale <= 0) {
+        return 0;
+    }
+    const int w = (int)ceil(360.0 * pixelsPerDegree * densityScale);
+    return (w + 7) & ~7;
+}
+
+void
+CappedImageSize(int width, int height, int maxWidth, int* width_r, int* height_r)
+{
+    if (maxWidth <= 0 || width <= maxWidth) {
+        *width_r = width;
+        *height_r = height;
+        return;
+    }
+    const int h = (int)(((int64_t)height * maxWidth + width / 2) / width);
+    *width_r = maxWidth;
+    *height_r = (h < 4) ? 4 : (h + 2) & ~3;
+}
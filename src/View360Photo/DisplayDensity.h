@@ -0,0 +1,20 @@
+﻿// 日本語。
+#pragma once
+
+/// 画面の解像度から、全画素のテクスチャーに要る画素数を決める。
+/// 球の内側に貼った正距円筒図法の画像は、幅が経度360度に広がる。画面の1度あたりの画素数より細かい画素は見分けられないので、
+/// 画像の幅をそれに合わせて縮めれば、見た目を変えずにデコード、ミップマップ、圧縮、アップロードの時間とメモリーを減らせる。
+
+/// 視野の中心の1度あたりの画素数。
+/// 1眼の画像の幅viewWidth画素を、水平の視野の左端angleLeftから右端angleRightまで(ラジアン、左は負。XrFovfと同じ)に
+/// 透視投影で広げたとき。透視投影では視野の中心の画素が最も細かい。
+double DisplayPixelsPerDegree(int viewWidth, double angleLeft, double angleRight);
+
+/// 1度あたりpixelsPerDegree画素の画面で、正距円筒図法の画像の赤道の1画素が画面の1 / densityScale画素になる画像の幅。
+/// 左右の半分をBC形式で圧縮できるように8の倍数に切り上げる。
+/// @return 上限の幅。pixelsPerDegreeかdensityScaleが0以下のとき0 (上限なし)。
+int EquirectWidthForDensity(double pixelsPerDegree, double densityScale);
+
+/// width x heightの画像を、縦横比を保って幅maxWidth以下にした大きさ。高さは4の倍数に丸める。
+/// maxWidthが0以下か、幅がmaxWidth以下のときは元の大きさ。
+void CappedImageSize(int width, int height, int maxWidth, int* width_r, int* height_r);
@@ -0,0 +1,227 @@
+﻿// 日本語。
+
+#include "FileUtil.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#  include <errno.h>
+#  include <sys/stat.h>
+#  include <sys/time.h>
+#endif
+
+static bool
+EndsWith(const std::wstring& s, const std::wstring& suffix)
+{
+    return suffix.size() <= s.size() && 0 == s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
+#ifdef _WIN32
+
+FILE*
+OpenFileToWrite(const std::wstring& path)
+{
+    FILE* fp = nullptr;
+    if (0 != _wfopen_s(&fp, path.c_str(), L"wb")) {
+        return nullptr;
+    }
+    return fp;
+}
+
+bool
+RenameReplacing(const std::wstring& from, const std::wstring& to)
+{
+    return FALSE != MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+void
+RemoveFile(const std::wstring& path)
+{
+    _wremove(path.c_str());
+}
+
+bool
+CreateDirectories(const std::wstring& path)
+{
+    if (path.empty()) {
+        return false;
+    }
+    const DWORD attr = GetFileAttributesW(path.c_str());
+    if (attr != INVALID_FILE_ATTRIBUTES) {
+        return 0 != (attr & FILE_ATTRIBUTE_DIRECTORY);
+    }
+    const size_t sep = path.find_last_of(L"\\/");
+    if (sep != std::wstring::npos && 0 < sep && path[sep - 1] != L':') {
+        CreateDirectories(path.substr(0, sep));
+    }
+    return FALSE != CreateDirectoryW(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool
+ListFiles(const std::wstring& dir, const std::wstring& suffix, std::vector<FileListEntry>& list_r)
+{
+    list_r.clear();
+    WIN32_FIND_DATAW fd;
+    HANDLE h = FindFirstFileW((dir + L"\\*").c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+    do {
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 || !EndsWith(fd.cFileName, suffix)) {
+            continue;
+        }
+        FileListEntry e;
+        e.path = dir + L"\\" + fd.cFileName;
+        e.bytes = ((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+        e.writeTime = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime;
+        list_r.push_back(e);
+    } while (FALSE != FindNextFileW(h, &fd));
+    FindClose(h);
+    return true;
+}
+
+bool
+TouchFile(const std::wstring& path)
+{
+    HANDLE h = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    const bool ok = FALSE != SetFileTime(h, nullptr, nullptr, &ft);
+    CloseHandle(h);
+    return ok;
+}
+
+std::wstring
+UserCacheDirectory(const std::wstring& appName)
+{
+    wchar_t buf[MAX_PATH];
+    const DWORD n = GetEnvironmentVariableW(L"LOCALAPPDATA", buf, MAX_PATH);
+    if (n == 0 || MAX_PATH <= n) {
+        return std::wstring();
+    }
+    return std::wstring(buf) + L"\\" + appName;
+}
+
+#else // _WIN32
+
+/// POSIXではマルチバイト文字列のパスを使う。
+static std::string
+ToMultiByte(const std::wstring& path)
+{
+    size_t n = wcstombs(nullptr, path.c_str(), 0);
+    if (n == (size_t)-1) {
+        return std::string();
+    }
+    std::string s(n, '\0');
+    wcstombs(&s[0], path.c_str(), n + 1);
+    return s;
+}
+
+FILE*
+OpenFileToWrite(const std::wstring& path)
+{
+    return fopen(ToMultiByte(path).c_str(), "wb");
+}
+
+bool
+RenameReplacing(const std::wstring& from, const std::wstring& to)
+{
+    return 0 == rename(ToMultiByte(from).c_str(), ToMultiByte(to).c_str());
+}
+
+void
+RemoveFile(const std::wstring& path)
+{
+    remove(ToMultiByte(path).c_str());
+}
+
+bool
+CreateDirectories(const std::wstring& path)
+{
+    if (path.empty()) {
+        return false;
+    }
+    const std::string mb = ToMultiByte(path);
+    struct stat st;
+    if (0 == stat(mb.c_str(), &st)) {
+        return S_ISDIR(st.st_mode);
+    }
+    const size_t sep = path.find_last_of(L'/');
+    if (sep != std::wstring::npos && 0 < sep) {
+        CreateDirectories(path.substr(0, sep));
+    }
+    return 0 == mkdir(mb.c_str(), 0755) || errno == EEXIST;
+}
+
+bool
+ListFiles(const std::wstring& dir, const std::wstring& suffix, std::vector<FileListEntry>& list_r)
+{
+    list_r.clear();
+    const std::string mbDir = ToMultiByte(dir);
+    DIR* d = opendir(mbDir.c_str());
+    if (d == nullptr) {
+        return errno == ENOENT;
+    }
+    while (const struct dirent* de = readdir(d)) {
+        const std::string mbPath = mbDir + "/" + de->d_name;
+        const size_t n = mbstowcs(nullptr, de->d_name, 0);
+        if (n == (size_t)-1) {
+            continue;
+        }
+        std::wstring name(n, L'\0');
+        mbstowcs(&name[0], de->d_name, n + 1);
+        struct stat st;
+        if (!EndsWith(name, suffix) || 0 != stat(mbPath.c_str(), &st) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        FileListEntry e;
+        e.path = dir + L"/" + name;
+        e.bytes = (uint64_t)st.st_size;
+#ifdef __APPLE__
+        e.writeTime = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ULL + (uint64_t)st.st_mtimespec.tv_nsec;
+#else
+        e.writeTime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+#endif
+        list_r.push_back(e);
+    }
+    closedir(d);
+    return true;
+}
+
+bool
+TouchFile(const std::wstring& path)
+{
+    return 0 == utimes(ToMultiByte(path).c_str(), nullptr);
+}
+
+std::wstring
+UserCacheDirectory(const std::wstring& appName)
+{
+    std::string base;
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (xdg != nullptr && xdg[0] != '\0') {
+        base = xdg;
+    } else if (home != nullptr && home[0] != '\0') {
+        base = std::string(home) + "/.cache";
+    } else {
+        return std::wstring();
+    }
+    const size_t n = mbstowcs(nullptr, base.c_str(), 0);
+    if (n == (size_t)-1) {
+        return std::wstring();
+    }
+    std::wstring w(n, L'\0');
+    mbstowcs(&w[0], base.c_str(), n + 1);
+    return w + L"/" + appName;
+}
+
+#endif // _WIN32
@@ -0,0 +1,39 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// ファイル書き込み用の小さな関数群。
+// Windows以外(POSIX)でもビルドできるようにpch.hを使わない。
+
+/// pathを書き込み用("wb")に開く。失敗のときnullptr。
+FILE* OpenFileToWrite(const std::wstring& path);
+
+/// fromをtoに改名する。toが既にあるときは置き換える。
+bool RenameReplacing(const std::wstring& from, const std::wstring& to);
+
+void RemoveFile(const std::wstring& path);
+
+/// pathのディレクトリーを、途中のディレクトリーも含めて作る。既にあるときも成功。
+bool CreateDirectories(const std::wstring& path);
+
+struct FileListEntry {
+    std::wstring path;
+    uint64_t bytes;
+
+    /// 最終更新時刻。MappedFile::LastWriteTime()と同じ単位。
+    uint64_t writeTime;
+};
+
+/// dirの直下にある、名前がsuffixで終わるファイルの一覧。
+bool ListFiles(const std::wstring& dir, const std::wstring& suffix, std::vector<FileListEntry>& list_r);
+
+/// pathの最終更新時刻を今にする。
+bool TouchFile(const std::wstring& path);
+
+/// ユーザーごとのキャッシュのディレクトリーの下のappNameのパス。作らない。
+/// WindowsはLOCALAPPDATA、それ以外はXDG_CACHE_HOMEまたはHOME/.cache。わからないときは空。
+std::wstring UserCacheDirectory(const std::wstring& appName);
@@ -0,0 +1,91 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "GdiplusImageDecoder.h"
+#include <windows.h>
+#include <minmax.h>
+#include <gdiplus.h>
+#include "GdiplusHousekeeping.h"
+#include "PixelConvert.h"
+
+namespace {
+
+class GdiplusImageDecoder : public ImageDecoder {
+public:
+    ~GdiplusImageDecoder(void) override { Close(); }
+
+    ImageDecoderType Type(void) const override { return IDT_Gdiplus; }
+
+    int Open(const wchar_t* path) override
+    {
+        Close();
+
+        mBitmap = new Gdiplus::Bitmap(path, TRUE);
+        if (mBitmap == nullptr || mBitmap->GetLastStatus() != Gdiplus::Ok) {
+            printf("E: GdiplusImageDecoder::Open(%S) failed\n", path);
+            Close();
+            return E_FAIL;
+        }
+        return S_OK;
+    }
+
+    int Width(void) const override { return (mBitmap == nullptr) ? 0 : (int)mBitmap->GetWidth(); }
+    int Height(void) const override { return (mBitmap == nullptr) ? 0 : (int)mBitmap->GetHeight(); }
+
+    int DecodeTargets(const ImageDecodeTarget* targets, int numTargets, uint8_t alpha) override
+    {
+        if (mBitmap == nullptr) {
+            printf("E: GdiplusImageDecoder::DecodeTargets() not opened\n");
+            return E_FAIL;
+        }
+
+        for (int i = 0; i < numTargets; ++i) {
+            const ImageDecodeTarget& t = targets[i];
+
+            // GDI+の内部バッファーを経由せず、長方形をt.dstに直接デコードする。
+            Gdiplus::BitmapData bd;
+            bd.Width = t.width;
+            bd.Height = t.height;
+            bd.Stride = t.stride;
+            bd.PixelFormat = PixelFormat32bppARGB;
+            bd.Scan0 = t.dst;
+            bd.Reserved = 0;
+
+            auto rect = Gdiplus::Rect(t.x, t.y, t.width, t.height);
+            auto r = mBitmap->LockBits(&rect, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+                    PixelFormat32bppARGB, &bd);
+            if (r != Gdiplus::Ok) {
+                printf("E: GdiplusImageDecoder::DecodeTargets() failed %s\n", GdiplusStatusToStr(r));
+                return E_FAIL;
+            }
+            mBitmap->UnlockBits(&bd);
+
+            // GDI+はアルファーを画像の値で書くので、指定があるときだけ上書きする。
+            if (alpha != 0xff) {
+                const PixelKernels& pk = PixelConvert();
+                for (int y = 0; y < t.height; ++y) {
+                    uint8_t* row = t.dst + (size_t)t.stride * y;
+                    pk.bgraSetAlpha(row, row, t.width, alpha);
+                }
+            }
+        }
+        return S_OK;
+    }
+
+    void Close(void) override
+    {
+        delete mBitmap;
+        mBitmap = nullptr;
+    }
+
+private:
+    Gdiplus::Bitmap* mBitmap = nullptr;
+};
+
+} // namespace
+
+std::unique_ptr<ImageDecoder>
+GdiplusImageDecoderCreate(void)
+{
+    return std::unique_ptr<ImageDecoder>(new GdiplusImageDecoder());
+}
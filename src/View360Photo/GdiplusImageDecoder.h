@@ -0,0 +1,7 @@
+﻿// 日本語。
+#pragma once
+
+#include "ImageDecoder.h"
+
+/// GDI+のImageDecoder。JPEG以外の形式やプログレッシブJPEGも読める。Windowsのみ。
+std::unique_ptr<ImageDecoder> GdiplusImageDecoderCreate(void);
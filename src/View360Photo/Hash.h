@@ -0,0 +1,114 @@
+﻿// 日本語。
+#pragma once
+
+// キャッシュの検証に使う64ビットハッシュ。
+// アルゴリズムはxxHash64と同じなので、外部のツールで求めた値と比較できる。
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace Hash {
+
+    static const uint64_t kPrime1 = 11400714785074694791ULL;
+    static const uint64_t kPrime2 = 14029467366897019727ULL;
+    static const uint64_t kPrime3 =  1609587929392839161ULL;
+    static const uint64_t kPrime4 =  9650029242287828579ULL;
+    static const uint64_t kPrime5 =  2870177450012600261ULL;
+
+    inline uint64_t
+    Rotl64(uint64_t v, int r)
+    {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    inline uint64_t
+    Load64(const uint8_t* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint32_t
+    Load32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint64_t
+    Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * kPrime2;
+        acc = Rotl64(acc, 31);
+        return acc * kPrime1;
+    }
+
+    inline uint64_t
+    MergeRound(uint64_t acc, uint64_t v)
+    {
+        acc ^= Round(0, v);
+        return acc * kPrime1 + kPrime4;
+    }
+
+    /// dataのbytesバイトのハッシュ値を計算する。
+    inline uint64_t
+    Hash64(const void* data, size_t bytes, uint64_t seed = 0)
+    {
+        const uint8_t* p = (const uint8_t*)data;
+        const uint8_t* const end = p + bytes;
+        uint64_t h;
+
+        if (32 <= bytes) {
+            // 4本の独立した累積値で32バイトずつ処理する。
+            uint64_t v1 = seed + kPrime1 + kPrime2;
+            uint64_t v2 = seed + kPrime2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - kPrime1;
+            const uint8_t* const limit = end - 32;
+            do {
+                v1 = Round(v1, Load64(p));
+                v2 = Round(v2, Load64(p + 8));
+                v3 = Round(v3, Load64(p + 16));
+                v4 = Round(v4, Load64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+            h = MergeRound(h, v1);
+            h = MergeRound(h, v2);
+            h = MergeRound(h, v3);
+            h = MergeRound(h, v4);
+        } else {
+            h = seed + kPrime5;
+        }
+
+        h += (uint64_t)bytes;
+
+        while (8 <= end - p) {
+            h ^= Round(0, Load64(p));
+            h = Rotl64(h, 27) * kPrime1 + kPrime4;
+            p += 8;
+        }
+        if (4 <= end - p) {
+            h ^= (uint64_t)Load32(p) * kPrime1;
+            h = Rotl64(h, 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+        while (p < end) {
+            h ^= (*p) * kPrime5;
+            h = Rotl64(h, 11) * kPrime1;
+            ++p;
+        }
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+}; // namespace Hash
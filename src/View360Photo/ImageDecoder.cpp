@@ -0,0 +1,156 @@
+﻿// 日本語。
+
+#include "ImageDecoder.h"
+#include "JpegDecoder.h"
+#include "MappedFile.h"
+#include <stdio.h>
+#include <vector>
+
+#ifdef _WIN32
+#  include "GdiplusImageDecoder.h"
+#endif
+
+const char*
+ImageDecoderTypeToStr(ImageDecoderType t)
+{
+    switch (t) {
+    case IDT_Builtin:
+        return "builtin";
+    case IDT_Gdiplus:
+        return "gdiplus";
+    default:
+        return "unknown";
+    }
+}
+
+int
+ImageDecoder::Decode(uint8_t* dst, int stride)
+{
+    ImageDecodeTarget t;
+    t.x = 0;
+    t.y = 0;
+    t.width = Width();
+    t.height = Height();
+    t.dst = dst;
+    t.stride = stride;
+    return DecodeTargets(&t, 1, 0xff);
+}
+
+namespace {
+
+/// ファイルをメモリーマップしてJpegDecoderでデコードする。
+class BuiltinImageDecoder : public ImageDecoder {
+public:
+    ImageDecoderType Type(void) const override { return IDT_Builtin; }
+
+    int Open(const wchar_t* path) override
+    {
+        Close();
+
+        int hr = mFile.Open(path);
+        if (hr < 0) {
+            return hr;
+        }
+        hr = mJpeg.ReadHeader(mFile.Data(), mFile.Size());
+        if (hr < 0) {
+            Close();
+            return hr;
+        }
+        return 0;
+    }
+
+    int Width(void) const override { return mJpeg.Width(); }
+    int Height(void) const override { return mJpeg.Height(); }
+
+    int SetScale(int denom) override { return mJpeg.SetScale(denom); }
+
+    void SetNumThreads(int n) override { mJpeg.SetNumThreads(n); }
+
+    void SetProgress(const ImageDecodeProgress& f, size_t byteInterval) override { mJpeg.SetProgress(f, byteInterval); }
+
+    int DecodeTargets(const ImageDecodeTarget* targets, int numTargets, uint8_t alpha) override
+    {
+        if (!mFile.IsOpen()) {
+            printf("E: BuiltinImageDecoder::DecodeTargets() not opened\n");
+            return -1;
+        }
+        std::vector<JpegDecoder::Target> jt(numTargets);
+        for (int i = 0; i < numTargets; ++i) {
+            const ImageDecodeTarget& t = targets[i];
+            jt[i] = { t.x, t.y, t.width, t.height, t.dst, t.stride };
+        }
+        return mJpeg.Decode(jt.data(), numTargets, alpha);
+    }
+
+    void Close(void) override
+    {
+        mJpeg.Clear();
+        mFile.Close();
+    }
+
+private:
+    MappedFile mFile;
+    JpegDecoder mJpeg;
+};
+
+} // namespace
+
+std::unique_ptr<ImageDecoder>
+ImageDecoderCreate(ImageDecoderType type)
+{
+    switch (type) {
+    case IDT_Builtin:
+        return std::unique_ptr<ImageDecoder>(new BuiltinImageDecoder());
+#ifdef _WIN32
+    case IDT_Gdiplus:
+        return GdiplusImageDecoderCreate();
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+/// 幅wをmaxWidth以下にする最小の分母。8で打ち切る。
+static int
+ScaleForWidth(int w, int maxWidth)
+{
+    int denom = 1;
+    while (0 < maxWidth && denom < 8 && maxWidth < (w + denom - 1) / denom) {
+        denom *= 2;
+    }
+    return denom;
+}
+
+/// 幅wを縮小してもminWidth以上のままの最大の分母。8で打ち切る。
+static int
+ScaleForMinWidth(int w, int minWidth)
+{
+    int denom = 1;
+    while (denom < 8 && minWidth <= (w + 2 * denom - 1) / (2 * denom)) {
+        denom *= 2;
+    }
+    return denom;
+}
+
+std::unique_ptr<ImageDecoder>
+ImageDecoderOpen(ImageDecoderType type, const wchar_t* path, int maxWidth, int* scale_r, int minWidth)
+{
+    auto dec = ImageDecoderCreate(type);
+    if (!dec) {
+        return nullptr;
+    }
+    if (dec->Open(path) < 0) {
+        return nullptr;
+    }
+
+    int scale = ScaleForWidth(dec->Width(), maxWidth);
+    if (0 < minWidth) {
+        const int minScale = ScaleForMinWidth(dec->Width(), minWidth);
+        scale = (0 < maxWidth && scale < minScale) ? scale : minScale;
+    }
+    if (dec->SetScale(scale) < 0) {
+        scale = 1;
+    }
+    *scale_r = scale;
+    return dec;
+}
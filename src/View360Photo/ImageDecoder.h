@@ -0,0 +1,84 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <functional>
+
+enum ImageDecoderType {
+    /// JpegDecoder。どの環境でも使える。ベースラインJPEGのみ。
+    IDT_Builtin,
+
+    /// GDI+。Windowsのみ。先にGdiplusHousekeepingInit()を呼んでおくこと。
+    IDT_Gdiplus,
+
+    IDT_NUM
+};
+
+const char* ImageDecoderTypeToStr(ImageDecoderType t);
+
+/// デコード先の長方形。画像の(x, y)からwidth x heightの画素を、dstからstrideバイトおきの行に書く。
+/// dstはテクスチャーをMapしたメモリーなど、呼び出し元が用意する。
+struct ImageDecodeTarget {
+    int x;
+    int y;
+    int width;
+    int height;
+    uint8_t* dst;
+    int stride;
+};
+
+/// デコードの途中の画像を受け取る関数。Decode()のdstに途中の画像を書いた後に呼ばれる。
+/// 引数は読み終えたスキャンの数。falseを戻すとデコードをやめ、Decode()はその画像のまま成功を戻す。
+typedef std::function<bool(int scans)> ImageDecodeProgress;
+
+/// 画像ファイルを、呼び出し元が用意したBGRA 8ビットのバッファーにデコードする。
+class ImageDecoder {
+public:
+    virtual ~ImageDecoder(void) {}
+
+    virtual ImageDecoderType Type(void) const = 0;
+
+    /// ファイルを開いて画像の大きさを読む。
+    /// @return 成功のとき0。失敗のとき負の値。
+    virtual int Open(const wchar_t* path) = 0;
+
+    /// デコードされる画像の大きさ。SetScale()の縮小後。
+    virtual int Width(void) const = 0;
+    virtual int Height(void) const = 0;
+
+    /// Open()の後に呼ぶ。大きさを1/denomにしてデコードする。denomは1, 2, 4, 8。縮小後の大きさは切り上げ。
+    /// @return 成功のとき0。縮小に対応しないとき負の値。
+    virtual int SetScale(int denom) { return (denom == 1) ? 0 : -1; }
+
+    /// デコードに使うスレッド数。0のときハードウェアスレッド数。対応しないデコーダーは無視する。
+    virtual void SetNumThreads(int n) { (void)n; }
+
+    /// Decode()の前に呼ぶ。プログレッシブJPEGで、最後以外のスキャンを読み終えるたびにfを呼ぶ。
+    /// byteIntervalが0より大きいときは、前回からbyteIntervalバイト以上読むまで呼ばない。
+    /// 途中の画像を出せないデコーダーは無視する。
+    virtual void SetProgress(const ImageDecodeProgress& f, size_t byteInterval) { (void)f; (void)byteInterval; }
+
+    /// Width() x Height()の画素をdstに書く。dstの各行はstrideバイトおき。アルファーは255。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Decode(uint8_t* dst, int stride);
+
+    /// targetsの各長方形を、中間のバッファーを使わずに直接書く。アルファーはalpha。
+    /// 各長方形はWidth() x Height()の中にあること。
+    /// @return 成功のとき0。失敗のとき負の値。
+    virtual int DecodeTargets(const ImageDecodeTarget* targets, int numTargets, uint8_t alpha) = 0;
+
+    virtual void Close(void) = 0;
+};
+
+/// @return typeのデコーダー。この環境で使えないとき(Windows以外のIDT_Gdiplus)nullptr。
+std::unique_ptr<ImageDecoder> ImageDecoderCreate(ImageDecoderType type);
+
+/// typeのデコーダーでpathを開き、maxWidthが0より大きいときは幅がmaxWidth以下になる最小の縮小率(1/8まで)を設定する。
+/// 縮小できないデコーダーは元の大きさのまま。
+/// @param scale_r 設定した縮小率の分母を置く。
+/// @param minWidth 0より大きいとき、幅がminWidth以上のままの最小の大きさになる縮小率にする。maxWidthも0より大きいときは
+///        小さい方の縮小率。デコードした後にCPUでminWidthに縮小するとき、デコードする画素を減らすのに使う。
+/// @return 開いたデコーダー。使えない、または開けないときnullptr。
+std::unique_ptr<ImageDecoder> ImageDecoderOpen(ImageDecoderType type, const wchar_t* path, int maxWidth, int* scale_r,
+        int minWidth = 0);
@@ -0,0 +1,1853 @@
+﻿// 日本語。
+
+#include "JpegDecoder.h"
+#include "ParallelFor.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <atomic>
+
+#ifndef JPEG_DECODER_SSE2
+#  if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#    define JPEG_DECODER_SSE2 1
+#  else
+#    define JPEG_DECODER_SSE2 0
+#  endif
+#endif
+#if JPEG_DECODER_SSE2
+#  include <emmintrin.h>
+#endif
+
+enum JpegMarker {
+    JM_SOF0 = 0xc0,
+    JM_SOF1 = 0xc1,
+    JM_SOF2 = 0xc2,
+    JM_DHT = 0xc4,
+    JM_RST0 = 0xd0,
+    JM_RST7 = 0xd7,
+    JM_SOI = 0xd8,
+    JM_EOI = 0xd9,
+    JM_SOS = 0xda,
+    JM_DQT = 0xdb,
+    JM_DNL = 0xdc,
+    JM_DRI = 0xdd,
+    JM_APP14 = 0xee,
+};
+
+/// ハフマン符号をこのビット数まで表引きで復号する。
+static const int FAST_BITS = 9;
+
+/// 色変換を並列に行う単位の行数。
+static const int CONVERT_BAND_ROWS = 64;
+
+/// リスタート区間を並列に復号するとき、1個の仕事にまとめる最小のMCUの数。
+static const int MIN_MCUS_PER_TASK = 512;
+
+/// ジグザグ順の番号から、行優先の番号。範囲外の番号で読んでも壊れないよう後ろを埋める。
+static const uint8_t gZigzag[64 + 16] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+    63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63,
+};
+
+static int
+Be16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint8_t
+Clamp255(int v)
+{
+    if ((unsigned)v <= 255) {
+        return (uint8_t)v;
+    }
+    return (v < 0) ? 0 : 255;
+}
+
+/// pから次のマーカーを探す。戻り値はマーカーの2バイト目。pはマーカーの次を指す。見つからないとき-1。
+static int
+NextMarker(const uint8_t*& p, const uint8_t* end)
+{
+    while (p + 1 < end) {
+        if (p[0] != 0xff) {
+            ++p;
+            continue;
+        }
+        const uint8_t m = p[1];
+        if (m == 0xff) {
+            // 詰め物の0xff。
+            ++p;
+            continue;
+        }
+        if (m == 0x00) {
+            // エントロピー符号化データ中の0xff。
+            p += 2;
+            continue;
+        }
+        p += 2;
+        return m;
+    }
+    p = end;
+    return -1;
+}
+
+// ハフマン符号の読み出し ////////////////////////////////////////////////////////////
+
+namespace {
+
+/// エントロピー符号化データをMSBから読む。
+/// マーカーに着いたら先に進まず0を供給する。
+struct BitReader {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    /// 上位bitsビットが有効。
+    uint64_t buf;
+    int bits;
+
+    /// 着いたマーカー。pはその0xffを指す。まだのとき0。
+    int marker;
+
+    void Init(const uint8_t* begin, const uint8_t* aEnd)
+    {
+        p = begin;
+        end = aEnd;
+        buf = 0;
+        bits = 0;
+        marker = 0;
+    }
+
+    void Fill(void)
+    {
+        while (bits <= 56) {
+            uint32_t b = 0;
+            if (marker == 0) {
+                if (p < end) {
+                    b = *p;
+                    if (b != 0xff) {
+                        ++p;
+                    } else if (p + 1 < end && p[1] == 0x00) {
+                        p += 2;
+                    } else {
+                        marker = (p + 1 < end) ? (int)p[1] : (int)JM_EOI;
+                        b = 0;
+                    }
+                } else {
+                    marker = JM_EOI;
+                }
+            }
+            buf |= (uint64_t)b << (56 - bits);
+            bits += 8;
+        }
+    }
+
+    void Skip(int n)
+    {
+        buf <<= n;
+        bits -= n;
+    }
+
+    /// リスタート区間の終わり。端数のビットを捨ててRSTnマーカーを読み飛ばす。
+    void Restart(void)
+    {
+        buf = 0;
+        bits = 0;
+
+        const uint8_t* q = p;
+        const int m = NextMarker(q, end);
+        if (JM_RST0 <= m && m <= JM_RST7) {
+            p = q;
+            marker = 0;
+        } else if (0 <= m) {
+            // RSTnが無い壊れたデータ。残りは0として読む。
+            p = q - 2;
+            marker = m;
+        } else {
+            p = end;
+            marker = JM_EOI;
+        }
+    }
+};
+
+} // namespace
+
+static int
+BuildHuffman(uint16_t fast[1 << FAST_BITS], uint16_t code0[17], uint16_t count[17], uint16_t offset[17],
+        uint8_t symbols[256], const uint8_t* counts, const uint8_t* syms, int nSyms)
+{
+    int code = 0;
+    int k = 0;
+    code0[0] = 0;
+    count[0] = 0;
+    offset[0] = 0;
+    for (int len = 1; len <= 16; ++len) {
+        code0[len] = (uint16_t)code;
+        count[len] = counts[len - 1];
+        offset[len] = (uint16_t)k;
+        code += counts[len - 1];
+        k += counts[len - 1];
+        if ((1 << len) < code) {
+            return -1;
+        }
+        code <<= 1;
+    }
+    if (k != nSyms || 256 < k) {
+        return -1;
+    }
+    memcpy(symbols, syms, nSyms);
+
+    memset(fast, 0, sizeof(uint16_t) << FAST_BITS);
+    for (int len = 1; len <= FAST_BITS; ++len) {
+        for (int i = 0; i < count[len]; ++i) {
+            const int c = (code0[len] + i) << (FAST_BITS - len);
+            const uint16_t e = (uint16_t)((len << 8) | symbols[offset[len] + i]);
+            for (int j = 0; j < (1 << (FAST_BITS - len)); ++j) {
+                fast[c + j] = e;
+            }
+        }
+    }
+    return 0;
+}
+
+/// @return 値。符号が表に無いとき-1。
+template <typename H>
+static inline int
+DecodeHuffman(BitReader& br, const H& h)
+{
+    if (br.bits < 16) {
+        br.Fill();
+    }
+    const uint16_t f = h.fast[br.buf >> (64 - FAST_BITS)];
+    if (f != 0) {
+        br.Skip(f >> 8);
+        return f & 0xff;
+    }
+
+    const uint32_t c16 = (uint32_t)(br.buf >> 48);
+    for (int len = FAST_BITS + 1; len <= 16; ++len) {
+        const uint32_t d = (c16 >> (16 - len)) - h.code0[len];
+        if (d < h.count[len]) {
+            br.Skip(len);
+            return h.symbols[h.offset[len] + d];
+        }
+    }
+    return -1;
+}
+
+/// sビットの符号付きの値を読む。1 <= s <= 16。
+static inline int
+Receive(BitReader& br, int s)
+{
+    if (br.bits < s) {
+        br.Fill();
+    }
+    const int v = (int)(br.buf >> (64 - s));
+    br.Skip(s);
+    return (v < (1 << (s - 1))) ? v - (1 << s) + 1 : v;
+}
+
+/// nビットの符号無しの値を読む。1 <= n <= 16。
+static inline int
+GetBits(BitReader& br, int n)
+{
+    if (br.bits < n) {
+        br.Fill();
+    }
+    const int v = (int)(br.buf >> (64 - n));
+    br.Skip(n);
+    return v;
+}
+
+// 逆DCT ////////////////////////////////////////////////////////////////////////////
+// jidctint.cと同じ分解の整数演算。定数は12ビットの固定小数点。
+// SSE2版は各定数の和を16ビットの係数にして、スカラー版と同じ整数の積和を求める。
+
+#define IDCT_FIX(x) ((int)((x) * 4096 + 0.5))
+
+/// 1次元の逆DCT。x0～x3は偶数部、t0～t3は奇数部。出力はx0 + t3, x1 + t2, x2 + t1, x3 + t0, x3 - t0, ...
+#define IDCT_1D(s0, s1, s2, s3, s4, s5, s6, s7)         \
+    int t0, t1, t2, t3, p1, p2, p3, p4, p5, x0, x1, x2, x3; \
+    p2 = s2;                                            \
+    p3 = s6;                                            \
+    p1 = (p2 + p3) * IDCT_FIX(0.5411961f);              \
+    t2 = p1 + p3 * IDCT_FIX(-1.847759065f);             \
+    t3 = p1 + p2 * IDCT_FIX(0.765366865f);              \
+    p2 = s0;                                            \
+    p3 = s4;                                            \
+    t0 = (p2 + p3) * 4096;                              \
+    t1 = (p2 - p3) * 4096;                              \
+    x0 = t0 + t3;                                       \
+    x3 = t0 - t3;                                       \
+    x1 = t1 + t2;                                       \
+    x2 = t1 - t2;                                       \
+    t0 = s7;                                            \
+    t1 = s5;                                            \
+    t2 = s3;                                            \
+    t3 = s1;                                            \
+    p3 = t0 + t2;                                       \
+    p4 = t1 + t3;                                       \
+    p1 = t0 + t3;                                       \
+    p2 = t1 + t2;                                       \
+    p5 = (p3 + p4) * IDCT_FIX(1.175875602f);            \
+    t0 = t0 * IDCT_FIX(0.298631336f);                   \
+    t1 = t1 * IDCT_FIX(2.053119869f);                   \
+    t2 = t2 * IDCT_FIX(3.072711026f);                   \
+    t3 = t3 * IDCT_FIX(1.501321110f);                   \
+    p1 = p5 + p1 * IDCT_FIX(-0.899976223f);             \
+    p2 = p5 + p2 * IDCT_FIX(-2.562915447f);             \
+    p3 = p3 * IDCT_FIX(-1.961570560f);                  \
+    p4 = p4 * IDCT_FIX(-0.390180644f);                  \
+    t3 += p1 + p4;                                      \
+    t2 += p2 + p3;                                      \
+    t1 += p2 + p4;                                      \
+    t0 += p1 + p3;
+
+/// 列方向の後の丸めと、+128のレベルシフト。
+static const int IDCT_ROW_BIAS = 65536 + (128 << 17);
+
+#if !JPEG_DECODER_SSE2
+
+static void
+IdctBlockScalar(const int16_t* in, uint8_t* out, int stride)
+{
+    int v[64];
+
+    // 列方向。結果は<< 2の精度で持つ。
+    for (int i = 0; i < 8; ++i) {
+        const int16_t* d = in + i;
+        int* o = v + i;
+        if (d[8] == 0 && d[16] == 0 && d[24] == 0 && d[32] == 0 && d[40] == 0 && d[48] == 0 && d[56] == 0) {
+            const int dc = d[0] * 4;
+            for (int j = 0; j < 8; ++j) {
+                o[8 * j] = dc;
+            }
+            continue;
+        }
+        IDCT_1D(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56]);
+        x0 += 512;
+        x1 += 512;
+        x2 += 512;
+        x3 += 512;
+        o[0] = (x0 + t3) >> 10;
+        o[56] = (x0 - t3) >> 10;
+        o[8] = (x1 + t2) >> 10;
+        o[48] = (x1 - t2) >> 10;
+        o[16] = (x2 + t1) >> 10;
+        o[40] = (x2 - t1) >> 10;
+        o[24] = (x3 + t0) >> 10;
+        o[32] = (x3 - t0) >> 10;
+    }
+
+    // 行方向。
+    for (int i = 0; i < 8; ++i) {
+        const int* d = v + 8 * i;
+        uint8_t* o = out + (size_t)stride * i;
+        IDCT_1D(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+        x0 += IDCT_ROW_BIAS;
+        x1 += IDCT_ROW_BIAS;
+        x2 += IDCT_ROW_BIAS;
+        x3 += IDCT_ROW_BIAS;
+        o[0] = Clamp255((x0 + t3) >> 17);
+        o[7] = Clamp255((x0 - t3) >> 17);
+        o[1] = Clamp255((x1 + t2) >> 17);
+        o[6] = Clamp255((x1 - t2) >> 17);
+        o[2] = Clamp255((x2 + t1) >> 17);
+        o[5] = Clamp255((x2 - t1) >> 17);
+        o[3] = Clamp255((x3 + t0) >> 17);
+        o[4] = Clamp255((x3 - t0) >> 17);
+    }
+}
+
+#else // JPEG_DECODER_SSE2
+
+namespace {
+
+/// 32ビット×8個。
+struct Wide {
+    __m128i l;
+    __m128i h;
+};
+
+} // namespace
+
+static inline __m128i
+IdctConst(int x, int y)
+{
+    return _mm_setr_epi16((short)x, (short)y, (short)x, (short)y, (short)x, (short)y, (short)x, (short)y);
+}
+
+/// out0 = x * c0[偶数] + y * c0[奇数]、out1 = x * c1[偶数] + y * c1[奇数]。
+static inline void
+IdctRotate(__m128i x, __m128i y, __m128i c0, __m128i c1, Wide& out0, Wide& out1)
+{
+    const __m128i lo = _mm_unpacklo_epi16(x, y);
+    const __m128i hi = _mm_unpackhi_epi16(x, y);
+    out0.l = _mm_madd_epi16(lo, c0);
+    out0.h = _mm_madd_epi16(hi, c0);
+    out1.l = _mm_madd_epi16(lo, c1);
+    out1.h = _mm_madd_epi16(hi, c1);
+}
+
+/// x << 12を32ビットで。
+static inline Wide
+IdctWiden(__m128i x)
+{
+    Wide r;
+    r.l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), x), 4);
+    r.h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), x), 4);
+    return r;
+}
+
+static inline Wide
+WideAdd(const Wide& a, const Wide& b)
+{
+    Wide r;
+    r.l = _mm_add_epi32(a.l, b.l);
+    r.h = _mm_add_epi32(a.h, b.h);
+    return r;
+}
+
+static inline Wide
+WideSub(const Wide& a, const Wide& b)
+{
+    Wide r;
+    r.l = _mm_sub_epi32(a.l, b.l);
+    r.h = _mm_sub_epi32(a.h, b.h);
+    return r;
+}
+
+/// out0 = (a + b + bias) >> S、out1 = (a - b + bias) >> S を16ビットに飽和して詰める。
+template <int S>
+static inline void
+IdctButterfly(const Wide& a, const Wide& b, __m128i bias, __m128i& out0, __m128i& out1)
+{
+    const __m128i al = _mm_add_epi32(a.l, bias);
+    const __m128i ah = _mm_add_epi32(a.h, bias);
+    out0 = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(al, b.l), S), _mm_srai_epi32(_mm_add_epi32(ah, b.h), S));
+    out1 = _mm_packs_epi32(_mm_srai_epi32(_mm_sub_epi32(al, b.l), S), _mm_srai_epi32(_mm_sub_epi32(ah, b.h), S));
+}
+
+static inline void
+Interleave16(__m128i& a, __m128i& b)
+{
+    const __m128i t = a;
+    a = _mm_unpacklo_epi16(a, b);
+    b = _mm_unpackhi_epi16(t, b);
+}
+
+static inline void
+Interleave8(__m128i& a, __m128i& b)
+{
+    const __m128i t = a;
+    a = _mm_unpacklo_epi8(a, b);
+    b = _mm_unpackhi_epi8(t, b);
+}
+
+/// 8列(または8行)の1次元逆DCTを同時に行う。
+template <int S>
+static inline void
+IdctPass(__m128i r[8], __m128i bias)
+{
+    const __m128i rot0_0 = IdctConst(IDCT_FIX(0.5411961f), IDCT_FIX(0.5411961f) + IDCT_FIX(-1.847759065f));
+    const __m128i rot0_1 = IdctConst(IDCT_FIX(0.5411961f) + IDCT_FIX(0.765366865f), IDCT_FIX(0.5411961f));
+    const __m128i rot1_0 = IdctConst(IDCT_FIX(1.175875602f) + IDCT_FIX(-0.899976223f), IDCT_FIX(1.175875602f));
+    const __m128i rot1_1 = IdctConst(IDCT_FIX(1.175875602f), IDCT_FIX(1.175875602f) + IDCT_FIX(-2.562915447f));
+    const __m128i rot2_0 = IdctConst(IDCT_FIX(-1.961570560f) + IDCT_FIX(0.298631336f), IDCT_FIX(-1.961570560f));
+    const __m128i rot2_1 = IdctConst(IDCT_FIX(-1.961570560f), IDCT_FIX(-1.961570560f) + IDCT_FIX(3.072711026f));
+    const __m128i rot3_0 = IdctConst(IDCT_FIX(-0.390180644f) + IDCT_FIX(2.053119869f), IDCT_FIX(-0.390180644f));
+    const __m128i rot3_1 = IdctConst(IDCT_FIX(-0.390180644f), IDCT_FIX(-0.390180644f) + IDCT_FIX(1.501321110f));
+
+    // 偶数部。
+    Wide t2e, t3e;
+    IdctRotate(r[2], r[6], rot0_0, rot0_1, t2e, t3e);
+    const Wide t0e = IdctWiden(_mm_add_epi16(r[0], r[4]));
+    const Wide t1e = IdctWiden(_mm_sub_epi16(r[0], r[4]));
+    const Wide x0 = WideAdd(t0e, t3e);
+    const Wide x3 = WideSub(t0e, t3e);
+    const Wide x1 = WideAdd(t1e, t2e);
+    const Wide x2 = WideSub(t1e, t2e);
+
+    // 奇数部。
+    Wide y0o, y1o, y2o, y3o, y4o, y5o;
+    IdctRotate(r[7], r[3], rot2_0, rot2_1, y0o, y2o);
+    IdctRotate(r[5], r[1], rot3_0, rot3_1, y1o, y3o);
+    IdctRotate(_mm_add_epi16(r[1], r[7]), _mm_add_epi16(r[3], r[5]), rot1_0, rot1_1, y4o, y5o);
+    const Wide x4 = WideAdd(y0o, y4o);
+    const Wide x5 = WideAdd(y1o, y5o);
+    const Wide x6 = WideAdd(y2o, y5o);
+    const Wide x7 = WideAdd(y3o, y4o);
+
+    IdctButterfly<S>(x0, x7, bias, r[0], r[7]);
+    IdctButterfly<S>(x1, x6, bias, r[1], r[6]);
+    IdctButterfly<S>(x2, x5, bias, r[2], r[5]);
+    IdctButterfly<S>(x3, x4, bias, r[3], r[4]);
+}
+
+static void
+IdctBlockSse2(const int16_t* in, uint8_t* out, int stride)
+{
+    __m128i r[8];
+    for (int i = 0; i < 8; ++i) {
+        r[i] = _mm_load_si128((const __m128i*)(in + 8 * i));
+    }
+
+    // 列方向。
+    IdctPass<10>(r, _mm_set1_epi32(512));
+
+    // 16ビットの8x8の転置。
+    Interleave16(r[0], r[4]);
+    Interleave16(r[1], r[5]);
+    Interleave16(r[2], r[6]);
+    Interleave16(r[3], r[7]);
+    Interleave16(r[0], r[2]);
+    Interleave16(r[1], r[3]);
+    Interleave16(r[4], r[6]);
+    Interleave16(r[5], r[7]);
+    Interleave16(r[0], r[1]);
+    Interleave16(r[2], r[3]);
+    Interleave16(r[4], r[5]);
+    Interleave16(r[6], r[7]);
+
+    // 行方向。
+    IdctPass<17>(r, _mm_set1_epi32(IDCT_ROW_BIAS));
+
+    // 8ビットに飽和して詰め、8x8の転置で元の向きに戻す。
+    __m128i p0 = _mm_packus_epi16(r[0], r[1]);
+    __m128i p1 = _mm_packus_epi16(r[2], r[3]);
+    __m128i p2 = _mm_packus_epi16(r[4], r[5]);
+    __m128i p3 = _mm_packus_epi16(r[6], r[7]);
+    Interleave8(p0, p2);
+    Interleave8(p1, p3);
+    Interleave8(p0, p1);
+    Interleave8(p2, p3);
+    Interleave8(p0, p2);
+    Interleave8(p1, p3);
+
+    const __m128i rows[4] = { p0, p2, p1, p3 };
+    for (int i = 0; i < 4; ++i) {
+        _mm_storel_epi64((__m128i*)(out + (size_t)stride * (2 * i)), rows[i]);
+        _mm_storel_epi64((__m128i*)(out + (size_t)stride * (2 * i + 1)), _mm_shuffle_epi32(rows[i], 0x4e));
+    }
+}
+
+#endif // JPEG_DECODER_SSE2
+
+/// 縮小用の逆DCTの係数。n点の出力に、8点の逆DCTの低周波n個の係数を使う。
+/// 直交変換で画素数を1/2にすると低周波の係数が1/√2になることから、重みは8点の逆DCTと同じで、余弦だけn点のものになる。
+/// table[x * n + u] = 4096 α(u) cos((2x + 1) u π / 2n)。α(0) = 1/√8、α(u) = 1/2。
+namespace {
+
+struct ReducedIdctTable {
+    int16_t t4[4 * 4];
+    int16_t t2[2 * 2];
+
+    /// SSE2用。pair4[x][k]はt4[x * 4 + 2k], t4[x * 4 + 2k + 1]の組を4回繰り返したもの。
+    alignas(16) int16_t pair4[4][2][8];
+
+    ReducedIdctTable(void)
+    {
+        Fill(4, t4);
+        Fill(2, t2);
+        for (int x = 0; x < 4; ++x) {
+            for (int k = 0; k < 2; ++k) {
+                for (int i = 0; i < 8; ++i) {
+                    pair4[x][k][i] = t4[x * 4 + 2 * k + (i & 1)];
+                }
+            }
+        }
+    }
+
+    static void Fill(int n, int16_t* t)
+    {
+        const double PI = 3.14159265358979323846;
+        for (int x = 0; x < n; ++x) {
+            for (int u = 0; u < n; ++u) {
+                const double a = (u == 0) ? 1.0 / sqrt(8.0) : 0.5;
+                t[x * n + u] = (int16_t)floor(4096.0 * a * cos((2 * x + 1) * u * PI / (2 * n)) + 0.5);
+            }
+        }
+    }
+};
+
+const ReducedIdctTable gReducedIdct;
+
+} // namespace
+
+static inline int
+ClampInt16(int v)
+{
+    return (v < -32768) ? -32768 : (32767 < v) ? 32767 : v;
+}
+
+/// 8x8の係数の左上N x Nから、N x Nの画素を作る。N = 4, 2。
+/// 列方向の結果は16ビットに飽和して<< 2の精度で持つ。IdctBlockReduced4Sse2()と同じ結果になる。
+/// 低周波の係数だけのN点の逆DCTで、奇数次の高い周波数も使うlibjpegのjidctred.cとは同じ結果にならない。
+/// 写真ではlibjpeg-turboのscale_denomの出力との差は平均1以下、最大8程度だが、細い縞のような高い周波数の多い画像では大きくなる。
+/// View360Tool decode -scaleは、全画素のデコードを平均したものとのPSNRが下限以上であることを確かめる。
+template <int N>
+static void
+IdctBlockReduced(const int16_t* in, uint8_t* out, int stride)
+{
+    const int16_t* t = (N == 4) ? gReducedIdct.t4 : gReducedIdct.t2;
+    int tmp[N * N];
+
+    // 列方向。
+    for (int u = 0; u < N; ++u) {
+        for (int y = 0; y < N; ++y) {
+            int sum = 0;
+            for (int v = 0; v < N; ++v) {
+                sum += t[y * N + v] * in[8 * v + u];
+            }
+            tmp[y * N + u] = ClampInt16((sum + 512) >> 10);
+        }
+    }
+
+    // 行方向。
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int sum = 0;
+            for (int u = 0; u < N; ++u) {
+                sum += t[x * N + u] * tmp[y * N + u];
+            }
+            out[(size_t)stride * y + x] = Clamp255(ClampInt16((sum + 8192) >> 14) + 128);
+        }
+    }
+}
+
+#if JPEG_DECODER_SSE2
+
+/// IdctBlockReduced<4>のSSE2版。_mm_madd_epi16で係数2個ずつの積和を4列同時に求める。
+static void
+IdctBlockReduced4Sse2(const int16_t* in, uint8_t* out, int stride)
+{
+    const __m128i (*m)[2] = (const __m128i (*)[2])gReducedIdct.pair4;
+
+    // 列方向。a[y]は列u = 0..3の値。
+    const __m128i r01 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(in + 0)),
+            _mm_loadl_epi64((const __m128i*)(in + 8)));
+    const __m128i r23 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(in + 16)),
+            _mm_loadl_epi64((const __m128i*)(in + 24)));
+    const __m128i bias1 = _mm_set1_epi32(512);
+    __m128i a[4];
+    for (int y = 0; y < 4; ++y) {
+        const __m128i sum = _mm_add_epi32(_mm_madd_epi16(r01, m[y][0]), _mm_madd_epi16(r23, m[y][1]));
+        a[y] = _mm_srai_epi32(_mm_add_epi32(sum, bias1), 10);
+    }
+
+    // 16ビットに詰め、行yごとに(u0, u1)の組と(u2, u3)の組を並べる。
+    const __m128i p01 = _mm_shuffle_epi32(_mm_packs_epi32(a[0], a[1]), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i p23 = _mm_shuffle_epi32(_mm_packs_epi32(a[2], a[3]), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i lo = _mm_unpacklo_epi64(p01, p23);
+    const __m128i hi = _mm_unpackhi_epi64(p01, p23);
+
+    // 行方向。c[x]は行y = 0..3の値。
+    const __m128i bias2 = _mm_set1_epi32(8192);
+    __m128i c[4];
+    for (int x = 0; x < 4; ++x) {
+        const __m128i sum = _mm_add_epi32(_mm_madd_epi16(lo, m[x][0]), _mm_madd_epi16(hi, m[x][1]));
+        c[x] = _mm_srai_epi32(_mm_add_epi32(sum, bias2), 14);
+    }
+
+    // 8ビットに飽和して詰め、4x4の転置で元の向きに戻す。
+    const __m128i level = _mm_set1_epi16(128);
+    const __m128i c01 = _mm_adds_epi16(_mm_packs_epi32(c[0], c[1]), level);
+    const __m128i c23 = _mm_adds_epi16(_mm_packs_epi32(c[2], c[3]), level);
+    __m128i v = _mm_packus_epi16(c01, c23);
+    v = _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+    v = _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+    for (int y = 0; y < 4; ++y) {
+        const int32_t row = _mm_cvtsi128_si32(v);
+        memcpy(out + (size_t)stride * y, &row, 4);
+        v = _mm_srli_si128(v, 4);
+    }
+}
+
+#endif // JPEG_DECODER_SSE2
+
+/// 8x8の逆量子化済みの係数(行優先)から、n x nの画素をoutに書く。n = 8, 4, 2, 1。
+/// nCoefはジグザグ順で最後の非0係数の次の番号。
+static inline void
+IdctBlock(const int16_t* coef, int nCoef, uint8_t* out, int stride, int n)
+{
+    if (nCoef <= 1 || n == 1) {
+        // 直流成分だけ。全体の逆DCTと同じ丸め。
+        const uint8_t v = Clamp255(((coef[0] + 4) >> 3) + 128);
+        for (int i = 0; i < n; ++i) {
+            memset(out + (size_t)stride * i, v, n);
+        }
+        return;
+    }
+    if (n == 4) {
+#if JPEG_DECODER_SSE2
+        IdctBlockReduced4Sse2(coef, out, stride);
+#else
+        IdctBlockReduced<4>(coef, out, stride);
+#endif
+        return;
+    }
+    if (n == 2) {
+        IdctBlockReduced<2>(coef, out, stride);
+        return;
+    }
+#if JPEG_DECODER_SSE2
+    IdctBlockSse2(coef, out, stride);
+#else
+    IdctBlockScalar(coef, out, stride);
+#endif
+}
+
+// アップサンプリングと色変換 ///////////////////////////////////////////////////////////
+// jdsample.c, jdcolor.cのfancy upsamplingとJFIFのYCbCrに合わせる。
+
+/// 水平に2倍する。s[-1]～s[n + 8]が有効で、両端は端の値を複写してあること。
+/// out[2i] = (3 s[i] + s[i - 1] + biasEven) >> shift、out[2i + 1] = (3 s[i] + s[i + 1] + biasOdd) >> shift。
+static void
+UpsampleH2(const int16_t* s, int n, int biasEven, int biasOdd, int shift, uint8_t* out)
+{
+    int i = 0;
+#if JPEG_DECODER_SSE2
+    const __m128i be = _mm_set1_epi16((short)biasEven);
+    const __m128i bo = _mm_set1_epi16((short)biasOdd);
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    for (; i < n; i += 8) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)(s + i));
+        const __m128i l = _mm_loadu_si128((const __m128i*)(s + i - 1));
+        const __m128i r = _mm_loadu_si128((const __m128i*)(s + i + 1));
+        const __m128i c3 = _mm_add_epi16(_mm_add_epi16(c, c), c);
+        const __m128i e = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(c3, l), be), sh);
+        const __m128i o = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(c3, r), bo), sh);
+        const __m128i e8 = _mm_packus_epi16(e, e);
+        const __m128i o8 = _mm_packus_epi16(o, o);
+        _mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi8(e8, o8));
+    }
+#else
+    for (; i < n; ++i) {
+        const int c3 = 3 * s[i];
+        out[2 * i] = (uint8_t)((c3 + s[i - 1] + biasEven) >> shift);
+        out[2 * i + 1] = (uint8_t)((c3 + s[i + 1] + biasOdd) >> shift);
+    }
+#endif
+}
+
+/// s[i] = 3 near[i] + far[i]。nを8の倍数に切り上げた数だけ書く。
+static void
+ColumnSum(const uint8_t* nearRow, const uint8_t* farRow, int n, int16_t* s)
+{
+    int i = 0;
+#if JPEG_DECODER_SSE2
+    const __m128i z = _mm_setzero_si128();
+    for (; i < n; i += 8) {
+        const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(nearRow + i)), z);
+        const __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(farRow + i)), z);
+        _mm_storeu_si128((__m128i*)(s + i), _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(a, a), a), b));
+    }
+#else
+    for (; i < n; ++i) {
+        s[i] = (int16_t)(3 * nearRow[i] + farRow[i]);
+    }
+#endif
+}
+
+/// 色変換の係数。16ビットの固定小数点で、SSE2版の_mm_mulhi_epi16と同じ結果になるようにスカラー版も計算する。
+static const int CR_R = (int)(1.40200f * 4096.0f + 0.5f);
+static const int CR_G = -(int)(0.71414f * 4096.0f + 0.5f);
+static const int CB_G = -(int)(0.34414f * 4096.0f + 0.5f);
+static const int CB_B = (int)(1.77200f * 4096.0f + 0.5f);
+
+static inline void
+YCbCrToBgraPixel(int y, int cb, int cr, uint8_t alpha, uint8_t* out)
+{
+    const int yw = (y << 4) + 8;
+    const int cbw = (cb - 128) * 256;
+    const int crw = (cr - 128) * 256;
+    out[0] = Clamp255((yw + ((cbw * CB_B) >> 16)) >> 4);
+    out[1] = Clamp255((yw + ((cbw * CB_G) >> 16) + ((crw * CR_G) >> 16)) >> 4);
+    out[2] = Clamp255((yw + ((crw * CR_R) >> 16)) >> 4);
+    out[3] = alpha;
+}
+
+static void
+YCbCrToBgra(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t alpha, uint8_t* out, int n)
+{
+    int i = 0;
+#if JPEG_DECODER_SSE2
+    const __m128i signFlip = _mm_set1_epi8(-0x80);
+    const __m128i crR = _mm_set1_epi16((short)CR_R);
+    const __m128i crG = _mm_set1_epi16((short)CR_G);
+    const __m128i cbG = _mm_set1_epi16((short)CB_G);
+    const __m128i cbB = _mm_set1_epi16((short)CB_B);
+    const __m128i yBias = _mm_set1_epi8((char)0x80);
+    const __m128i a = _mm_set1_epi16(alpha);
+    const __m128i z = _mm_setzero_si128();
+
+    for (; i + 8 <= n; i += 8) {
+        // Cb, Crは-128して上位バイトに置く。Yは(y << 4) + 8にする。
+        const __m128i yb = _mm_loadl_epi64((const __m128i*)(y + i));
+        const __m128i cbb = _mm_xor_si128(_mm_loadl_epi64((const __m128i*)(cb + i)), signFlip);
+        const __m128i crb = _mm_xor_si128(_mm_loadl_epi64((const __m128i*)(cr + i)), signFlip);
+        const __m128i yw = _mm_srli_epi16(_mm_unpacklo_epi8(yBias, yb), 4);
+        const __m128i cbw = _mm_unpacklo_epi8(z, cbb);
+        const __m128i crw = _mm_unpacklo_epi8(z, crb);
+
+        const __m128i b = _mm_srai_epi16(_mm_add_epi16(yw, _mm_mulhi_epi16(cbw, cbB)), 4);
+        const __m128i g = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(yw, _mm_mulhi_epi16(cbw, cbG)),
+                _mm_mulhi_epi16(crw, crG)), 4);
+        const __m128i r = _mm_srai_epi16(_mm_add_epi16(yw, _mm_mulhi_epi16(crw, crR)), 4);
+
+        // B, G, R, Aの順に並べる。
+        const __m128i br = _mm_packus_epi16(b, r);
+        const __m128i ga = _mm_packus_epi16(g, a);
+        const __m128i bg = _mm_unpacklo_epi8(br, ga);
+        const __m128i ra = _mm_unpackhi_epi8(br, ga);
+        _mm_storeu_si128((__m128i*)(out + 4 * i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+#endif
+    for (; i < n; ++i) {
+        YCbCrToBgraPixel(y[i], cb[i], cr[i], alpha, out + 4 * i);
+    }
+}
+
+static void
+GrayToBgra(const uint8_t* y, uint8_t alpha, uint8_t* out, int n)
+{
+    int i = 0;
+#if JPEG_DECODER_SSE2
+    const __m128i a = _mm_set1_epi8((char)alpha);
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(y + i));
+        const __m128i vv0 = _mm_unpacklo_epi8(v, v);
+        const __m128i vv1 = _mm_unpackhi_epi8(v, v);
+        const __m128i va0 = _mm_unpacklo_epi8(v, a);
+        const __m128i va1 = _mm_unpackhi_epi8(v, a);
+        _mm_storeu_si128((__m128i*)(out + 4 * i), _mm_unpacklo_epi16(vv0, va0));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 16), _mm_unpackhi_epi16(vv0, va0));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 32), _mm_unpacklo_epi16(vv1, va1));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 48), _mm_unpackhi_epi16(vv1, va1));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[4 * i] = y[i];
+        out[4 * i + 1] = y[i];
+        out[4 * i + 2] = y[i];
+        out[4 * i + 3] = alpha;
+    }
+}
+
+static void
+RgbToBgra(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t alpha, uint8_t* out, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        out[4 * i] = b[i];
+        out[4 * i + 1] = g[i];
+        out[4 * i + 2] = r[i];
+        out[4 * i + 3] = alpha;
+    }
+}
+
+// マーカーの読み出し ////////////////////////////////////////////////////////////////
+
+void
+JpegDecoder::Clear(void)
+{
+    mData = nullptr;
+    mEnd = nullptr;
+    mPos = nullptr;
+    mWidth = 0;
+    mHeight = 0;
+    mScale = 1;
+    mOutW = 0;
+    mOutH = 0;
+    mNumComponents = 0;
+    mHMax = 1;
+    mVMax = 1;
+    mMcusX = 0;
+    mMcusY = 0;
+    mRestartInterval = 0;
+    mAdobeTransform = -1;
+    mFrameRead = false;
+    mProgressive = false;
+    mEobRun = 0;
+    mProgressPos = nullptr;
+    mScansDone = 0;
+    mStopped = false;
+    mTargets.clear();
+
+    memset(mQuant, 0, sizeof mQuant);
+    for (int i = 0; i < 4; ++i) {
+        mDc[i].defined = false;
+        mAc[i].defined = false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        mComp[i].plane.reset();
+        mComp[i].coefs.reset();
+    }
+}
+
+int
+JpegDecoder::ReadHeader(const uint8_t* data, size_t bytes)
+{
+    Clear();
+
+    if (bytes < 4 || data[0] != 0xff || data[1] != JM_SOI) {
+        printf("E: JpegDecoder::ReadHeader() not a JPEG\n");
+        return -1;
+    }
+    mData = data;
+    mEnd = data + bytes;
+
+    const uint8_t* p = data + 2;
+    while (true) {
+        const int m = NextMarker(p, mEnd);
+        if (m < 0 || m == JM_EOI || m == JM_SOS) {
+            printf("E: JpegDecoder::ReadHeader() SOF not found\n");
+            return -1;
+        }
+        if ((JM_RST0 <= m && m <= JM_RST7) || m == 0x01) {
+            continue;
+        }
+        if (mEnd < p + 2 || mEnd < p + Be16(p) || Be16(p) < 2) {
+            printf("E: JpegDecoder::ReadHeader() truncated\n");
+            return -1;
+        }
+        const int len = Be16(p);
+
+        int hr = 0;
+        if (m == JM_SOF0 || m == JM_SOF1 || m == JM_SOF2) {
+            mProgressive = m == JM_SOF2;
+            hr = ReadSof(p + 2, len - 2);
+            if (hr < 0) {
+                return hr;
+            }
+            mPos = p + len;
+            return 0;
+        }
+        if ((m & 0xf0) == 0xc0 && m != JM_DHT && m != 0xc8 && m != 0xcc) {
+            printf("E: JpegDecoder::ReadHeader() unsupported SOF%d\n", m - JM_SOF0);
+            return -1;
+        }
+        hr = ReadMarkerSegment(m, p + 2, len - 2);
+        if (hr < 0) {
+            return hr;
+        }
+        p += len;
+    }
+}
+
+int
+JpegDecoder::ReadMarkerSegment(int marker, const uint8_t* p, int len)
+{
+    switch (marker) {
+    case JM_DQT:
+        return ReadDqt(p, len);
+    case JM_DHT:
+        return ReadDht(p, len);
+    case JM_DRI:
+        if (len < 2) {
+            printf("E: JpegDecoder::ReadMarkerSegment() bad DRI\n");
+            return -1;
+        }
+        mRestartInterval = Be16(p);
+        return 0;
+    case JM_APP14:
+        if (12 <= len && memcmp(p, "Adobe", 5) == 0) {
+            mAdobeTransform = p[11];
+        }
+        return 0;
+    case JM_DNL:
+        printf("E: JpegDecoder::ReadMarkerSegment() DNL is not supported\n");
+        return -1;
+    default:
+        // APPn, COMなど。
+        return 0;
+    }
+}
+
+int
+JpegDecoder::ReadDqt(const uint8_t* p, int len)
+{
+    const uint8_t* end = p + len;
+    while (p < end) {
+        const int pq = p[0] >> 4;
+        const int tq = p[0] & 15;
+        const int n = (pq == 0) ? 64 : 128;
+        if (1 < pq || 3 < tq || end < p + 1 + n) {
+            printf("E: JpegDecoder::ReadDqt() bad DQT\n");
+            return -1;
+        }
+        for (int k = 0; k < 64; ++k) {
+            mQuant[tq][gZigzag[k]] = (uint16_t)((pq == 0) ? p[1 + k] : Be16(p + 1 + 2 * k));
+        }
+        p += 1 + n;
+    }
+    return 0;
+}
+
+int
+JpegDecoder::ReadDht(const uint8_t* p, int len)
+{
+    const uint8_t* end = p + len;
+    while (p < end) {
+        if (end < p + 17) {
+            printf("E: JpegDecoder::ReadDht() bad DHT\n");
+            return -1;
+        }
+        const int tc = p[0] >> 4;
+        const int th = p[0] & 15;
+        int n = 0;
+        for (int i = 0; i < 16; ++i) {
+            n += p[1 + i];
+        }
+        if (1 < tc || 3 < th || 256 < n || end < p + 17 + n) {
+            printf("E: JpegDecoder::ReadDht() bad DHT\n");
+            return -1;
+        }
+
+        Huffman& h = (tc == 0) ? mDc[th] : mAc[th];
+        if (BuildHuffman(h.fast, h.code0, h.count, h.offset, h.symbols, p + 1, p + 17, n) < 0) {
+            printf("E: JpegDecoder::ReadDht() bad Huffman table\n");
+            return -1;
+        }
+        h.defined = true;
+        p += 17 + n;
+    }
+    return 0;
+}
+
+int
+JpegDecoder::ReadSof(const uint8_t* p, int len)
+{
+    if (len < 6) {
+        printf("E: JpegDecoder::ReadSof() bad SOF\n");
+        return -1;
+    }
+    const int precision = p[0];
+    mHeight = Be16(p + 1);
+    mWidth = Be16(p + 3);
+    mNumComponents = p[5];
+    if (precision != 8) {
+        printf("E: JpegDecoder::ReadSof() %d bit precision is not supported\n", precision);
+        return -1;
+    }
+    if (mWidth == 0 || mHeight == 0) {
+        printf("E: JpegDecoder::ReadSof() image size %dx%d is not supported\n", mWidth, mHeight);
+        return -1;
+    }
+    if (mNumComponents != 1 && mNumComponents != 3) {
+        printf("E: JpegDecoder::ReadSof() %d components is not supported\n", mNumComponents);
+        return -1;
+    }
+    if (len < 6 + 3 * mNumComponents) {
+        printf("E: JpegDecoder::ReadSof() bad SOF\n");
+        return -1;
+    }
+
+    mHMax = 1;
+    mVMax = 1;
+    for (int i = 0; i < mNumComponents; ++i) {
+        Component& c = mComp[i];
+        c.id = p[6 + 3 * i];
+        c.h = p[7 + 3 * i] >> 4;
+        c.v = p[7 + 3 * i] & 15;
+        c.tq = p[8 + 3 * i];
+        if (c.h < 1 || 4 < c.h || c.v < 1 || 4 < c.v || 3 < c.tq) {
+            printf("E: JpegDecoder::ReadSof() bad component\n");
+            return -1;
+        }
+        if (mNumComponents == 1) {
+            // 成分が1個のときはMCUが1ブロックで、間引き率は意味を持たない。
+            c.h = 1;
+            c.v = 1;
+        }
+        mHMax = std::max(mHMax, c.h);
+        mVMax = std::max(mVMax, c.v);
+    }
+
+    mMcusX = (mWidth + 8 * mHMax - 1) / (8 * mHMax);
+    mMcusY = (mHeight + 8 * mVMax - 1) / (8 * mVMax);
+    for (int i = 0; i < mNumComponents; ++i) {
+        Component& c = mComp[i];
+        if (mHMax % c.h != 0 || mVMax % c.v != 0) {
+            printf("E: JpegDecoder::ReadSof() sampling factor %dx%d is not supported\n", c.h, c.v);
+            return -1;
+        }
+        c.blocksW = ((mWidth * c.h + mHMax - 1) / mHMax + 7) / 8;
+        c.blocksH = ((mHeight * c.v + mVMax - 1) / mVMax + 7) / 8;
+        c.coefW = mMcusX * c.h;
+    }
+
+    mFrameRead = true;
+    return SetScale(1);
+}
+
+int
+JpegDecoder::SetScale(int denom)
+{
+    if (!mFrameRead) {
+        printf("E: JpegDecoder::SetScale() ReadHeader() is not called\n");
+        return -1;
+    }
+    if (denom != 1 && denom != 2 && denom != 4 && denom != 8) {
+        printf("E: JpegDecoder::SetScale(%d) denom must be 1, 2, 4 or 8\n", denom);
+        return -1;
+    }
+
+    // 輝度の1ブロックが(8 / denom)画素角になる。
+    // 間引かれた成分は、縦横とも割り切れる範囲で1ブロックを大きく逆DCTし、拡大の一部を逆DCTで行う。libjpegと同じ。
+    mScale = denom;
+    mOutW = (mWidth + denom - 1) / denom;
+    mOutH = (mHeight + denom - 1) / denom;
+    const int n = 8 / denom;
+    for (int i = 0; i < mNumComponents; ++i) {
+        Component& c = mComp[i];
+        int cn = n;
+        while (cn < 8 && (mHMax * n) % (c.h * cn * 2) == 0 && (mVMax * n) % (c.v * cn * 2) == 0) {
+            cn *= 2;
+        }
+        c.n = cn;
+        c.hf = mHMax * n / (c.h * cn);
+        c.vf = mVMax * n / (c.v * cn);
+        c.width = (mWidth * c.h * cn + mHMax * 8 - 1) / (mHMax * 8);
+        c.height = (mHeight * c.v * cn + mVMax * 8 - 1) / (mVMax * 8);
+        c.planeW = mMcusX * c.h * cn;
+        c.planeH = mMcusY * c.v * cn;
+    }
+    return 0;
+}
+
+// 復号 ////////////////////////////////////////////////////////////////////////////
+
+/// 1ブロックの係数を読み、逆量子化して行優先でcoefに置く。coefは0で埋めてあること。
+/// DC_ONLYのとき交流成分は読み飛ばす。
+/// @return ジグザグ順で最後の非0係数の次の番号。データが壊れているとき-1。
+template <bool DC_ONLY, typename H>
+static inline int
+DecodeBlock(BitReader& br, const H& dc, const H& ac, const uint16_t* q, int& dcPred_r, int16_t* coef)
+{
+    const int t = DecodeHuffman(br, dc);
+    if (t < 0 || 16 < t) {
+        return -1;
+    }
+    dcPred_r += (t == 0) ? 0 : Receive(br, t);
+    coef[0] = (int16_t)(dcPred_r * q[0]);
+
+    int k = 1;
+    int nCoef = 1;
+    while (k < 64) {
+        const int rs = DecodeHuffman(br, ac);
+        if (rs < 0) {
+            return -1;
+        }
+        const int r = rs >> 4;
+        const int s = rs & 15;
+        if (s == 0) {
+            if (r != 15) {
+                // EOB
+                break;
+            }
+            k += 16;
+            continue;
+        }
+        k += r;
+        if (63 < k) {
+            return -1;
+        }
+        if (DC_ONLY) {
+            if (br.bits < s) {
+                br.Fill();
+            }
+            br.Skip(s);
+            ++k;
+            continue;
+        }
+        const int z = gZigzag[k];
+        coef[z] = (int16_t)(Receive(br, s) * q[z]);
+        nCoef = ++k;
+    }
+    return nCoef;
+}
+
+int
+JpegDecoder::DecodeMcus(const Scan& scan, const uint8_t* begin, int mcu0, int mcu1, const uint8_t** end_r)
+{
+    BitReader br;
+    br.Init(begin, mEnd);
+
+    alignas(16) int16_t coef[64];
+    int dcPred[3] = {};
+
+    for (int mcu = mcu0; mcu < mcu1; ++mcu) {
+        if (mRestartInterval != 0 && mcu != mcu0 && (mcu - mcu0) % mRestartInterval == 0) {
+            br.Restart();
+            dcPred[0] = dcPred[1] = dcPred[2] = 0;
+        }
+
+        const int mx = mcu % scan.mcusX;
+        const int my = mcu / scan.mcusX;
+        for (int i = 0; i < scan.ns; ++i) {
+            Component& c = *scan.comps[i];
+            const int bw = (scan.ns == 1) ? 1 : c.h;
+            const int bh = (scan.ns == 1) ? 1 : c.v;
+            const Huffman& dc = mDc[c.td];
+            const Huffman& ac = mAc[c.ta];
+            const uint16_t* q = mQuant[c.tq];
+            const int n = c.n;
+
+            for (int by = 0; by < bh; ++by) {
+                for (int bx = 0; bx < bw; ++bx) {
+                    if (n != 1) {
+                        memset(coef, 0, sizeof coef);
+                    }
+                    const int nCoef = (n == 1)
+                            ? DecodeBlock<true>(br, dc, ac, q, dcPred[i], coef)
+                            : DecodeBlock<false>(br, dc, ac, q, dcPred[i], coef);
+                    if (nCoef < 0) {
+                        return -1;
+                    }
+
+                    const int x = n * (mx * bw + bx);
+                    const int y = n * (my * bh + by);
+                    IdctBlock(coef, nCoef, &c.plane[(size_t)c.planeW * y + x], c.planeW, n);
+                }
+            }
+        }
+    }
+
+    if (end_r != nullptr) {
+        *end_r = br.p;
+    }
+    return 0;
+}
+
+// プログレッシブ ////////////////////////////////////////////////////////////////////
+// 係数は逆量子化せずに行優先でblkに足してゆく。T.81 G.1.2とlibjpegのjdphuff.cに合わせる。
+
+/// 直流成分の最初のスキャン。
+template <typename H>
+static inline int
+DecodeDcFirst(BitReader& br, const H& dc, int al, int& dcPred_r, int16_t* blk)
+{
+    const int t = DecodeHuffman(br, dc);
+    if (t < 0 || 16 < t) {
+        return -1;
+    }
+    dcPred_r += (t == 0) ? 0 : Receive(br, t);
+    blk[0] = (int16_t)(dcPred_r * (1 << al));
+    return 0;
+}
+
+/// 直流成分の2回目以降のスキャン。1ビット足す。
+static inline void
+DecodeDcRefine(BitReader& br, int al, int16_t* blk)
+{
+    if (GetBits(br, 1) != 0) {
+        blk[0] |= (int16_t)(1 << al);
+    }
+}
+
+/// 交流成分ss ～ seの最初のスキャン。
+template <typename H>
+static inline int
+DecodeAcFirst(BitReader& br, const H& ac, int ss, int se, int al, int& eobRun_r, int16_t* blk)
+{
+    if (0 < eobRun_r) {
+        --eobRun_r;
+        return 0;
+    }
+    for (int k = ss; k <= se; ++k) {
+        const int rs = DecodeHuffman(br, ac);
+        if (rs < 0) {
+            return -1;
+        }
+        const int r = rs >> 4;
+        const int s = rs & 15;
+        if (s == 0) {
+            if (r != 15) {
+                // EOBn。このブロックを含めて(1 << r) + 追加ビットのブロックが終わり。
+                eobRun_r = (1 << r) - 1;
+                if (r != 0) {
+                    eobRun_r += GetBits(br, r);
+                }
+                break;
+            }
+            k += 15;
+            continue;
+        }
+        k += r;
+        if (63 < k) {
+            return -1;
+        }
+        blk[gZigzag[k]] = (int16_t)(Receive(br, s) * (1 << al));
+    }
+    return 0;
+}
+
+/// 交流成分ss ～ seの2回目以降のスキャン。0でない係数に1ビットずつ足し、新たに±1 << alになる係数を置く。
+template <typename H>
+static inline int
+DecodeAcRefine(BitReader& br, const H& ac, int ss, int se, int al, int& eobRun_r, int16_t* blk)
+{
+    const int p1 = 1 << al;
+    const int m1 = -(1 << al);
+
+    // 0でない係数の絶対値を、読んだビットが1のとき1 << al増やす。
+    auto refine = [&](int16_t& coef) {
+        if (GetBits(br, 1) != 0 && (coef & p1) == 0) {
+            coef = (int16_t)(coef + ((0 <= coef) ? p1 : m1));
+        }
+    };
+
+    int k = ss;
+    if (eobRun_r == 0) {
+        for (; k <= se; ++k) {
+            const int rs = DecodeHuffman(br, ac);
+            if (rs < 0) {
+                return -1;
+            }
+            int r = rs >> 4;
+            int s = rs & 15;
+            if (s != 0) {
+                if (s != 1) {
+                    return -1;
+                }
+                s = (GetBits(br, 1) != 0) ? p1 : m1;
+            } else if (r != 15) {
+                eobRun_r = 1 << r;
+                if (r != 0) {
+                    eobRun_r += GetBits(br, r);
+                }
+                break;
+            }
+
+            // 0でない係数を補正しながら、0の係数をr個飛ばす。
+            while (k <= se) {
+                int16_t& coef = blk[gZigzag[k]];
+                if (coef != 0) {
+                    refine(coef);
+                } else {
+                    if (r == 0) {
+                        break;
+                    }
+                    --r;
+                }
+                ++k;
+            }
+            if (s != 0) {
+                if (se < k) {
+                    return -1;
+                }
+                blk[gZigzag[k]] = (int16_t)s;
+            }
+        }
+    }
+
+    if (0 < eobRun_r) {
+        // EOBランの中のブロック。0でない係数だけ補正する。
+        for (; k <= se; ++k) {
+            int16_t& coef = blk[gZigzag[k]];
+            if (coef != 0) {
+                refine(coef);
+            }
+        }
+        --eobRun_r;
+    }
+    return 0;
+}
+
+int
+JpegDecoder::DecodeProgressiveMcus(const Scan& scan, const uint8_t* begin, int numMcus, int ss, int se, int ah, int al)
+{
+    BitReader br;
+    br.Init(begin, mEnd);
+
+    int dcPred[3] = {};
+    mEobRun = 0;
+
+    for (int mcu = 0; mcu < numMcus; ++mcu) {
+        if (mRestartInterval != 0 && mcu != 0 && mcu % mRestartInterval == 0) {
+            br.Restart();
+            dcPred[0] = dcPred[1] = dcPred[2] = 0;
+            mEobRun = 0;
+        }
+
+        const int mx = mcu % scan.mcusX;
+        const int my = mcu / scan.mcusX;
+        for (int i = 0; i < scan.ns; ++i) {
+            Component& c = *scan.comps[i];
+            const int bw = (scan.ns == 1) ? 1 : c.h;
+            const int bh = (scan.ns == 1) ? 1 : c.v;
+
+            for (int by = 0; by < bh; ++by) {
+                for (int bx = 0; bx < bw; ++bx) {
+                    const int x = mx * bw + bx;
+                    const int y = my * bh + by;
+                    int16_t* blk = &c.coefs[((size_t)c.coefW * y + x) * 64];
+
+                    int hr = 0;
+                    if (ss == 0) {
+                        if (ah == 0) {
+                            hr = DecodeDcFirst(br, mDc[c.td], al, dcPred[i], blk);
+                        } else {
+                            DecodeDcRefine(br, al, blk);
+                        }
+                    } else if (ah == 0) {
+                        hr = DecodeAcFirst(br, mAc[c.ta], ss, se, al, mEobRun, blk);
+                    } else {
+                        hr = DecodeAcRefine(br, mAc[c.ta], ss, se, al, mEobRun, blk);
+                    }
+                    if (hr < 0) {
+                        return -1;
+                    }
+                }
+            }
+        }
+
+        // スキャンの途中で、MCUの行の終わりごとに途中の画像を出す。
+        if (mProgress && 0 < mProgressBytes && mx == scan.mcusX - 1 && mcu != numMcus - 1
+                && mProgressBytes <= (size_t)(br.p - mProgressPos)) {
+            EmitProgress(br.p);
+            if (mStopped) {
+                break;
+            }
+        }
+    }
+
+    mPos = br.p;
+    return 0;
+}
+
+/// beginから始まるエントロピー符号化データのRSTnを探し、各リスタート区間の先頭をstarts_rに置く。
+/// RSTnの数や番号が合わないとき-1。end_rはスキャンの次のマーカー。
+static int
+FindRestartIntervals(const uint8_t* begin, const uint8_t* end, int numIntervals,
+        std::vector<const uint8_t*>& starts_r, const uint8_t** end_r)
+{
+    starts_r.clear();
+    starts_r.reserve(numIntervals);
+    starts_r.push_back(begin);
+
+    const uint8_t* p = begin;
+    while (true) {
+        p = (const uint8_t*)memchr(p, 0xff, end - p);
+        if (p == nullptr || end <= p + 1) {
+            *end_r = end;
+            break;
+        }
+        const uint8_t m = p[1];
+        if (m == 0x00) {
+            p += 2;
+        } else if (m == 0xff) {
+            ++p;
+        } else if (JM_RST0 <= m && m <= JM_RST7) {
+            const int n = (int)starts_r.size();
+            if (numIntervals <= n || m != JM_RST0 + (n - 1) % 8) {
+                return -1;
+            }
+            p += 2;
+            starts_r.push_back(p);
+        } else {
+            *end_r = p;
+            break;
+        }
+    }
+    return ((int)starts_r.size() == numIntervals) ? 0 : -1;
+}
+
+int
+JpegDecoder::DecodeScan(const uint8_t* p, int len)
+{
+    if (len < 1) {
+        printf("E: JpegDecoder::DecodeScan() bad SOS\n");
+        return -1;
+    }
+    Scan scan;
+    scan.ns = p[0];
+    if (scan.ns < 1 || mNumComponents < scan.ns || len < 4 + 2 * scan.ns) {
+        printf("E: JpegDecoder::DecodeScan() bad SOS\n");
+        return -1;
+    }
+    const int ns = scan.ns;
+
+    for (int i = 0; i < ns; ++i) {
+        const int id = p[1 + 2 * i];
+        Component* c = nullptr;
+        for (int j = 0; j < mNumComponents; ++j) {
+            if (mComp[j].id == id) {
+                c = &mComp[j];
+            }
+        }
+        if (c == nullptr) {
+            printf("E: JpegDecoder::DecodeScan() unknown component %d\n", id);
+            return -1;
+        }
+        c->td = p[2 + 2 * i] >> 4;
+        c->ta = p[2 + 2 * i] & 15;
+        scan.comps[i] = c;
+    }
+    const int ss = p[1 + 2 * ns];
+    const int se = p[2 + 2 * ns];
+    const int ah = p[3 + 2 * ns] >> 4;
+    const int al = p[3 + 2 * ns] & 15;
+    if (mProgressive) {
+        // 直流成分だけのスキャンか、成分が1個の交流成分のスキャン。
+        const bool bad = (ss == 0) ? (se != 0) : (se < ss || 63 < se || ns != 1);
+        if (bad || 13 < al) {
+            printf("E: JpegDecoder::DecodeScan() bad progressive scan\n");
+            return -1;
+        }
+    } else if (ss != 0 || se != 63 || ah != 0 || al != 0) {
+        printf("E: JpegDecoder::DecodeScan() not a sequential scan\n");
+        return -1;
+    }
+
+    // プログレッシブでは、直流成分の最初のスキャンだけDCの表、交流成分のスキャンだけACの表を使う。
+    const bool useDc = !mProgressive || (ss == 0 && ah == 0);
+    const bool useAc = !mProgressive || ss != 0;
+    for (int i = 0; i < ns; ++i) {
+        const Component* c = scan.comps[i];
+        if ((useDc && (3 < c->td || !mDc[c->td].defined)) || (useAc && (3 < c->ta || !mAc[c->ta].defined))) {
+            printf("E: JpegDecoder::DecodeScan() Huffman table is not defined\n");
+            return -1;
+        }
+    }
+
+    // 成分が1個のスキャンは、MCUが1ブロックで、成分の画素数のブロックだけ並ぶ。
+    scan.mcusX = mMcusX;
+    int mcusY = mMcusY;
+    if (ns == 1) {
+        scan.mcusX = scan.comps[0]->blocksW;
+        mcusY = scan.comps[0]->blocksH;
+    }
+    const int numMcus = scan.mcusX * mcusY;
+    const uint8_t* begin = p + len;
+
+    if (mProgressive) {
+        // 係数を足してゆくので、1スレッドで先頭から復号する。
+        if (DecodeProgressiveMcus(scan, begin, numMcus, ss, se, ah, al) < 0) {
+            printf("E: JpegDecoder::DecodeScan() corrupt data\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // リスタート区間は互いに独立に復号できるので、区間ごとに並列に復号する。
+    // 区間はMCUの番号で連続しているので、書き込むブロックは重ならない。
+    const int nThreads = ParallelForNumThreads(mNumThreads);
+    if (mRestartInterval != 0 && 1 < nThreads) {
+        const int numIntervals = (numMcus + mRestartInterval - 1) / mRestartInterval;
+        std::vector<const uint8_t*> starts;
+        const uint8_t* scanEnd = nullptr;
+        if (1 < numIntervals && 0 <= FindRestartIntervals(begin, mEnd, numIntervals, starts, &scanEnd)) {
+            // 小さい区間はまとめて、1個の仕事が少なくともMIN_MCUS_PER_TASK個のMCUになるようにする。
+            const int perTask = std::max(1, MIN_MCUS_PER_TASK / mRestartInterval);
+            const int numTasks = (numIntervals + perTask - 1) / perTask;
+            std::atomic<int> result(0);
+            ParallelFor(numTasks, [&](int task) {
+                for (int i = task * perTask; i < std::min((task + 1) * perTask, numIntervals); ++i) {
+                    const int mcu0 = i * mRestartInterval;
+                    const int mcu1 = std::min(mcu0 + mRestartInterval, numMcus);
+                    if (DecodeMcus(scan, starts[i], mcu0, mcu1, nullptr) < 0) {
+                        result = -1;
+                        return;
+                    }
+                }
+            }, nThreads);
+            if (result < 0) {
+                printf("E: JpegDecoder::DecodeScan() corrupt data\n");
+                return -1;
+            }
+            mPos = scanEnd;
+            return 0;
+        }
+    }
+
+    // リスタートマーカーが無い、または数が合わないときは1スレッドで先頭から復号する。
+    if (DecodeMcus(scan, begin, 0, numMcus, &mPos) < 0) {
+        printf("E: JpegDecoder::DecodeScan() corrupt data\n");
+        return -1;
+    }
+    return 0;
+}
+
+const uint8_t*
+JpegDecoder::UpsampleRow(int ci, int y, uint8_t* buf, int16_t* work) const
+{
+    const Component& c = mComp[ci];
+    const int hf = c.hf;
+    const int vf = c.vf;
+    const uint8_t* plane = c.plane.get();
+    const size_t pw = c.planeW;
+
+    if (hf == 1 && vf == 1) {
+        return plane + pw * y;
+    }
+
+    if (2 < hf || 2 < vf || c.n == 1) {
+        // 最近傍。libjpegも1/8の縮小で1画素になるブロックは補間しない。
+        const uint8_t* row = plane + pw * (y / vf);
+        for (int x = 0; x < mOutW; ++x) {
+            buf[x] = row[x / hf];
+        }
+        return buf;
+    }
+
+    // 出力の行yに最も近い入力の行と、次に近い入力の行。画像の上下端では端の行を使う。
+    const int n = c.width;
+    const uint8_t* nearRow = plane + pw * (y / vf);
+    const uint8_t* farRow = nearRow;
+    bool odd = false;
+    if (vf == 2) {
+        const int yn = y >> 1;
+        odd = (y & 1) != 0;
+        const int yf = std::min(std::max(odd ? yn + 1 : yn - 1, 0), c.height - 1);
+        farRow = plane + pw * yf;
+    }
+
+    int16_t* s = work + 1;
+    if (vf == 2) {
+        ColumnSum(nearRow, farRow, n, s);
+    } else {
+        for (int x = 0; x < n; ++x) {
+            s[x] = nearRow[x];
+        }
+    }
+
+    if (hf == 1) {
+        // 縦だけ2倍。
+        const int bias = odd ? 2 : 1;
+        for (int x = 0; x < n; ++x) {
+            buf[x] = (uint8_t)((s[x] + bias) >> 2);
+        }
+        return buf;
+    }
+
+    s[-1] = s[0];
+    for (int x = n; x < n + 16; ++x) {
+        s[x] = s[n - 1];
+    }
+    if (vf == 2) {
+        UpsampleH2(s, n, 8, 7, 4, buf);
+    } else {
+        UpsampleH2(s, n, 1, 2, 2, buf);
+    }
+    return buf;
+}
+
+void
+JpegDecoder::ConvertRows(int y0, int y1) const
+{
+    const bool rgb = mNumComponents == 3
+            && (mAdobeTransform == 0
+                || (mAdobeTransform < 0 && mComp[0].id == 'R' && mComp[1].id == 'G' && mComp[2].id == 'B'));
+
+    // UpsampleH2()は8画素単位で書くので余裕を持たせる。
+    const int bufW = (mOutW + 2 + 32) & ~15;
+    std::vector<uint8_t> buf((size_t)3 * bufW);
+    std::vector<int16_t> work((size_t)bufW + 32);
+
+    for (int y = y0; y < y1; ++y) {
+        // 行yを含む長方形だけに、その範囲の画素を直接書く。どれにも含まれない行は拡大もしない。
+        const uint8_t* rows[3] = {};
+        for (const Target& t : mTargets) {
+            if (y < t.y || t.y + t.height <= y) {
+                continue;
+            }
+            uint8_t* out = t.dst + (size_t)t.stride * (y - t.y);
+            if (mNumComponents == 1) {
+                GrayToBgra(mComp[0].plane.get() + (size_t)mComp[0].planeW * y + t.x, mAlpha, out, t.width);
+                continue;
+            }
+
+            if (rows[0] == nullptr) {
+                for (int c = 0; c < 3; ++c) {
+                    rows[c] = UpsampleRow(c, y, &buf[(size_t)bufW * c], work.data());
+                }
+            }
+            if (rgb) {
+                RgbToBgra(rows[0] + t.x, rows[1] + t.x, rows[2] + t.x, mAlpha, out, t.width);
+            } else {
+                YCbCrToBgra(rows[0] + t.x, rows[1] + t.x, rows[2] + t.x, mAlpha, out, t.width);
+            }
+        }
+    }
+}
+
+void
+JpegDecoder::ConvertAll(void) const
+{
+    const int nBands = (mOutH + CONVERT_BAND_ROWS - 1) / CONVERT_BAND_ROWS;
+    ParallelFor(nBands, [&](int band) {
+        const int y0 = band * CONVERT_BAND_ROWS;
+        ConvertRows(y0, std::min(y0 + CONVERT_BAND_ROWS, mOutH));
+    }, mNumThreads);
+}
+
+void
+JpegDecoder::CoefsToPlanes(void)
+{
+    for (int i = 0; i < mNumComponents; ++i) {
+        Component& c = mComp[i];
+        const uint16_t* q = mQuant[c.tq];
+        const int n = c.n;
+
+        // ブロックの行ごとに並列に行う。
+        ParallelFor(c.blocksH, [&](int by) {
+            alignas(16) int16_t coef[64];
+            for (int bx = 0; bx < c.blocksW; ++bx) {
+                const int16_t* blk = &c.coefs[((size_t)c.coefW * by + bx) * 64];
+                int ac = 0;
+                coef[0] = (int16_t)(blk[0] * q[0]);
+                for (int k = 1; k < 64; ++k) {
+                    coef[k] = (int16_t)(blk[k] * q[k]);
+                    ac |= coef[k];
+                }
+                IdctBlock(coef, (ac == 0) ? 1 : 64, &c.plane[(size_t)c.planeW * n * by + n * bx], c.planeW, n);
+            }
+        }, mNumThreads);
+    }
+}
+
+void
+JpegDecoder::EmitProgress(const uint8_t* pos)
+{
+    mProgressPos = pos;
+    CoefsToPlanes();
+    ConvertAll();
+    if (!mProgress(mScansDone)) {
+        mStopped = true;
+    }
+}
+
+int
+JpegDecoder::Decode(uint8_t* dst, int stride)
+{
+    Target t;
+    t.x = 0;
+    t.y = 0;
+    t.width = mOutW;
+    t.height = mOutH;
+    t.dst = dst;
+    t.stride = stride;
+    return Decode(&t, 1);
+}
+
+int
+JpegDecoder::Decode(const Target* targets, int numTargets, uint8_t alpha)
+{
+    if (!mFrameRead) {
+        printf("E: JpegDecoder::Decode() ReadHeader() is not called\n");
+        return -1;
+    }
+    for (int i = 0; i < numTargets; ++i) {
+        const Target& t = targets[i];
+        if (t.x < 0 || t.y < 0 || t.width < 0 || t.height < 0 || mOutW < t.x + t.width || mOutH < t.y + t.height) {
+            printf("E: JpegDecoder::Decode() target is outside the image\n");
+            return -1;
+        }
+        if (t.stride < 4 * t.width) {
+            printf("E: JpegDecoder::Decode() stride is too small\n");
+            return -1;
+        }
+    }
+    mTargets.assign(targets, targets + numTargets);
+    mAlpha = alpha;
+
+    for (int i = 0; i < mNumComponents; ++i) {
+        Component& c = mComp[i];
+        const size_t bytes = (size_t)c.planeW * c.planeH;
+        c.plane.reset(new (std::nothrow) uint8_t[bytes]);
+        if (!c.plane) {
+            printf("E: JpegDecoder::Decode() out of memory\n");
+            return -1;
+        }
+        // スキャンが欠けていても未初期化の値を出さない。
+        memset(c.plane.get(), 0x80, bytes);
+
+        if (mProgressive) {
+            const size_t numCoefs = (size_t)c.coefW * mMcusY * c.v * 64;
+            c.coefs.reset(new (std::nothrow) int16_t[numCoefs]);
+            if (!c.coefs) {
+                printf("E: JpegDecoder::Decode() out of memory\n");
+                return -1;
+            }
+            memset(c.coefs.get(), 0, numCoefs * sizeof(int16_t));
+        }
+    }
+    mProgressPos = mPos;
+    mScansDone = 0;
+    mStopped = false;
+
+    int hr = 0;
+    bool scanRead = false;
+    const uint8_t* p = mPos;
+    while (true) {
+        const int m = NextMarker(p, mEnd);
+        if (m < 0 || m == JM_EOI) {
+            // EOIの無い途中で切れたファイルは、読めたところまでを出力する。
+            break;
+        }
+        if ((JM_RST0 <= m && m <= JM_RST7) || m == 0x01) {
+            continue;
+        }
+        if (mEnd < p + 2 || mEnd < p + Be16(p) || Be16(p) < 2) {
+            break;
+        }
+        const int len = Be16(p);
+        if (m == JM_SOS) {
+            hr = DecodeScan(p + 2, len - 2);
+            if (hr < 0 || mStopped) {
+                break;
+            }
+            scanRead = true;
+            ++mScansDone;
+            p = mPos;
+
+            // プログレッシブで後にスキャンが残っているとき、途中の画像を出す。
+            const uint8_t* q = p;
+            const int next = NextMarker(q, mEnd);
+            if (mProgressive && mProgress && 0 <= next && next != JM_EOI
+                    && mProgressBytes <= (size_t)(p - mProgressPos)) {
+                EmitProgress(p);
+                if (mStopped) {
+                    break;
+                }
+            }
+            continue;
+        }
+        if ((m & 0xf0) == 0xc0 && m != JM_DHT && m != 0xc8 && m != 0xcc) {
+            printf("E: JpegDecoder::Decode() unexpected SOF\n");
+            hr = -1;
+            break;
+        }
+        hr = ReadMarkerSegment(m, p + 2, len - 2);
+        if (hr < 0) {
+            break;
+        }
+        p += len;
+    }
+    if (0 <= hr && !scanRead && !mStopped) {
+        printf("E: JpegDecoder::Decode() no scan\n");
+        hr = -1;
+    }
+
+    // 途中でやめたときは、dstに最後に出した画像が残っている。
+    if (0 <= hr && !mStopped) {
+        if (mProgressive) {
+            CoefsToPlanes();
+        }
+        ConvertAll();
+    }
+
+    for (int i = 0; i < mNumComponents; ++i) {
+        mComp[i].plane.reset();
+        mComp[i].coefs.reset();
+    }
+    mTargets.clear();
+    return hr;
+}
@@ -0,0 +1,184 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <functional>
+#include <vector>
+
+/// ハフマン符号のJPEGのデコーダー。
+/// 対応: SOF0/SOF1 (ベースライン)、SOF2 (プログレッシブ)、8ビット精度、成分数1 (グレー) または3 (YCbCr、AdobeのRGB)、
+/// 各成分の間引き1/1または1/2 (4:4:4, 4:2:2, 4:2:0, 4:4:0)、リスタートマーカー。
+/// それ以外の間引きは最近傍で拡大する。算術符号、CMYKは失敗を戻す。
+/// ベースラインでリスタートマーカーがあるときは、リスタート区間ごとに複数のスレッドでハフマン復号と逆DCTを行う。
+/// プログレッシブのときはSetProgress()で、スキャンごとに途中の画像を受け取れる。
+/// SetScale()で1/2, 1/4, 1/8に縮小してデコードできる。縮小は係数の低周波成分だけの逆DCTで行う。
+/// 逆DCTと色変換はSSE2があればSSE2を使う。
+class JpegDecoder {
+public:
+    /// data ～ data + bytesのJPEGのヘッダーを読む。dataはDecode()が終わるまで保持すること。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int ReadHeader(const uint8_t* data, size_t bytes);
+
+    /// デコードされる画像の大きさ。SetScale()の縮小後。
+    int Width(void) const { return mOutW; }
+    int Height(void) const { return mOutH; }
+
+    /// ファイルに記録された画像の大きさ。
+    int ImageWidth(void) const { return mWidth; }
+    int ImageHeight(void) const { return mHeight; }
+
+    int NumComponents(void) const { return mNumComponents; }
+
+    /// ReadHeader()の後、Decode()の前に呼ぶ。大きさを1/denomにしてデコードする。denomは1, 2, 4, 8。
+    /// 縮小後の大きさは切り上げ。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int SetScale(int denom);
+
+    /// 復号と色変換に使うスレッド数。0のときハードウェアスレッド数。
+    void SetNumThreads(int n) { mNumThreads = n; }
+
+    /// デコード先の長方形。出力画像の(x, y)からwidth x heightの画素を、dstからstrideバイトおきの行に書く。
+    struct Target {
+        int x;
+        int y;
+        int width;
+        int height;
+        uint8_t* dst;
+        int stride;
+    };
+
+    /// プログレッシブJPEGの途中の画像を受け取る関数。Decode()のdstに途中の画像を書いた後に呼ばれる。
+    /// 引数は読み終えたスキャンの数。falseを戻すとデコードをやめ、Decode()はその画像のまま成功を戻す。
+    typedef std::function<bool(int scans)> Progress;
+
+    /// Decode()の前に呼ぶ。最後以外のスキャンを読み終えるたびにfを呼ぶ。
+    /// byteIntervalが0より大きいときは、前回から読んだバイト数がbyteInterval未満の間は呼ばず、
+    /// スキャンの途中でもbyteInterval以上読んだMCUの行の終わりで呼ぶ。ベースラインでは呼ばない。
+    void SetProgress(const Progress& f, size_t byteInterval = 0) { mProgress = f; mProgressBytes = byteInterval; }
+
+    bool IsProgressive(void) const { return mProgressive; }
+
+    /// 画像全体をBGRA 8ビットでdstに書く。dstはHeight()行、各行strideバイトおき。アルファーは255。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Decode(uint8_t* dst, int stride);
+
+    /// targetsの各長方形を、BGRA 8ビットで直接書く。アルファーはalpha。
+    /// 各長方形はWidth() x Height()の中にあること。どの長方形にも含まれない行は色変換しない。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Decode(const Target* targets, int numTargets, uint8_t alpha = 0xff);
+
+    /// 内部のバッファーを捨てて、ReadHeader()を呼ぶ前の状態に戻す。
+    void Clear(void);
+
+private:
+    struct Huffman {
+        /// 先頭FAST_BITSビットで引く表。(符号長 << 8) | 値。符号長が長いとき0。
+        uint16_t fast[1 << 9];
+        uint16_t code0[17];
+        uint16_t count[17];
+        uint16_t offset[17];
+        uint8_t symbols[256];
+        bool defined;
+    };
+
+    struct Component {
+        int id;
+        int h;
+        int v;
+        int tq;
+        int td;
+        int ta;
+
+        /// 1ブロックから作る画素の一辺。8, 4, 2, 1。
+        int n;
+
+        /// 出力の大きさにするための、残りの拡大率。
+        int hf;
+        int vf;
+
+        /// 成分が1個のスキャンでのブロックの数。
+        int blocksW;
+        int blocksH;
+
+        /// 間引きと縮小の後の画素数。
+        int width;
+        int height;
+
+        /// MCUの倍数に切り上げた、縮小後の画素の平面。
+        int planeW;
+        int planeH;
+        std::unique_ptr<uint8_t[]> plane;
+
+        /// プログレッシブのとき、逆量子化前の係数(行優先)。MCUの倍数に切り上げたブロックの並びで、1行にcoefW個。
+        int coefW;
+        std::unique_ptr<int16_t[]> coefs;
+    };
+
+    /// 1個のスキャンで復号する成分と、MCUの並び。
+    struct Scan {
+        int ns;
+        Component* comps[3];
+        int mcusX;
+    };
+
+    const uint8_t* mData = nullptr;
+    const uint8_t* mEnd = nullptr;
+    const uint8_t* mPos = nullptr;
+
+    int mWidth = 0;
+    int mHeight = 0;
+    int mScale = 1;
+    int mOutW = 0;
+    int mOutH = 0;
+    int mNumComponents = 0;
+    int mHMax = 1;
+    int mVMax = 1;
+    int mMcusX = 0;
+    int mMcusY = 0;
+    int mRestartInterval = 0;
+    int mAdobeTransform = -1;
+    int mNumThreads = 0;
+    bool mFrameRead = false;
+    bool mProgressive = false;
+
+    /// プログレッシブのスキャンの状態。EOBランはリスタート区間の中で続く。
+    int mEobRun = 0;
+
+    Progress mProgress;
+    size_t mProgressBytes = 0;
+    const uint8_t* mProgressPos = nullptr;
+    int mScansDone = 0;
+    bool mStopped = false;
+    std::vector<Target> mTargets;
+    uint8_t mAlpha = 0xff;
+
+    uint16_t mQuant[4][64];
+    Huffman mDc[4];
+    Huffman mAc[4];
+    Component mComp[3];
+
+    int ReadMarkerSegment(int marker, const uint8_t* p, int len);
+    int ReadDqt(const uint8_t* p, int len);
+    int ReadDht(const uint8_t* p, int len);
+    int ReadSof(const uint8_t* p, int len);
+    int DecodeScan(const uint8_t* p, int len);
+
+    /// beginから、MCUの番号mcu0 ～ mcu1 - 1を復号する。mcu0はリスタート区間の先頭であること。
+    /// end_rが非nullptrのとき、読み終えた位置を置く。
+    int DecodeMcus(const Scan& scan, const uint8_t* begin, int mcu0, int mcu1, const uint8_t** end_r);
+
+    /// プログレッシブのスキャンのMCUを、係数の並びに復号する。ss, se, ah, alはSOSの値。
+    int DecodeProgressiveMcus(const Scan& scan, const uint8_t* begin, int numMcus, int ss, int se, int ah, int al);
+
+    /// 係数の並びを逆量子化、逆DCTして画素の平面にする。
+    void CoefsToPlanes(void);
+
+    /// 今の係数からmTargetsに画像を書き、mProgressを呼ぶ。falseが戻ったらmStoppedをtrueにする。
+    void EmitProgress(const uint8_t* pos);
+
+    const uint8_t* UpsampleRow(int ci, int y, uint8_t* buf, int16_t* work) const;
+    void ConvertRows(int y0, int y1) const;
+    void ConvertAll(void) const;
+};
@@ -2,111 +2,78 @@
 
 #include "pch.h"
 #include "JpegToTexture.h"
-#include <windows.h>
-#include <minmax.h>
-#include <gdiplus.h>
-#include "GdiplusHousekeeping.h"
+#include "ImageDecoder.h"
+#include "PixelConvert.h"
 
-
-struct WH 
+int
+JpegToTexture::ImageViewToLevel0Texture(
+        ID3D11Device* device,
+        const ImageView& view,
+        ID3D11Texture2D** level0_r,
+        uint8_t alpha)
 {
-    int w;
-    int h;
-};
-
-/// @param portion 比率を0～1で指定。nullptrのとき全域をテクスチャーにする。
-static int ExtractJpegToBGRA(const wchar_t * path, const XrRect2Df *portion, const uint8_t alpha, D3D11_SUBRESOURCE_DATA &srd_r, WH& wh_r) {
-    Gdiplus::BitmapData bd;
-    Gdiplus::Bitmap* bm = new Gdiplus::Bitmap(path, TRUE);
-    if (bm == nullptr || bm->GetLastStatus() != Gdiplus::Ok) {
-        printf("Error: JpegToTexture::LoadFromFile(%S) failed\n", path);
-        return E_FAIL;
-    }
-
-    int origW = bm->GetWidth();
-    int origH = bm->GetHeight();
-
-    auto origR = Gdiplus::Rect(0, 0, origW, origH);
-	auto cropR = origR;
-	if (portion != nullptr) {
-		cropR = Gdiplus::Rect(
-			(int)(portion->offset.x * origW),
-			(int)(portion->offset.y * origH),
-			(int)(portion->extent.width * origW),
-			(int)(portion->extent.height * origH)
-			);
-	}
-	int cropW = cropR.Width;
-	int cropH = cropR.Height;
-
-    auto r = bm->LockBits(&origR, Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, &bd);
-    if (r != Gdiplus::Ok) {
-        printf("Error: JpegToTexture::LoadFromFile(%S) failed %s\n", path, GdiplusStatusToStr(r));
-        return E_FAIL;
-    }
-
-    uint8_t* lockedMem = (uint8_t*)bd.Scan0;
-
-    uint8_t* rawBGRA = new uint8_t[4 * cropW * cropH];
-    srd_r.pSysMem = (void*)rawBGRA;
-    srd_r.SysMemPitch = 4 * cropW;
-    srd_r.SysMemSlicePitch = 0;
-
-	for (int y = 0; y < cropH; ++y) {
-		uint8_t *fromPos = lockedMem + cropR.X * 4 + bd.Stride * (y + cropR.Y);
-		memcpy(&rawBGRA[4 * cropW * y], fromPos, 4 * cropW);
-	}
-
-	if (alpha != 0xff) {
-		const uint32_t alpha32 = alpha << 24;
-		uint32_t *p = (uint32_t*)rawBGRA;
-		for (int y = 0; y < cropH; ++y) {
-			for (int x = 0; x < cropW; ++x) {
-				*p = (*p & 0x00ffffff) | alpha32;
-				++p;
-			}
-		}
-	}
+    assert(level0_r != nullptr);
 
-    bm->UnlockBits(&bd);
+    // アルファー値を変えるときだけ複写する。それ以外は切り出し元の画素をそのまま渡す。
+    std::vector<uint8_t> withAlpha;
+    D3D11_SUBRESOURCE_DATA srd;
+    srd.pSysMem = view.pixels;
+    srd.SysMemPitch = view.stride;
+    srd.SysMemSlicePitch = 0;
 
-    delete bm;
+    if (alpha != 0xff) {
+        withAlpha.resize((size_t)4 * view.width * view.height);
+        const PixelKernels& pk = PixelConvert();
+        for (int y = 0; y < view.height; ++y) {
+            pk.bgraSetAlpha(view.pixels + (size_t)view.stride * y, &withAlpha[(size_t)4 * view.width * y], view.width, alpha);
+        }
+        srd.pSysMem = withAlpha.data();
+        srd.SysMemPitch = 4 * view.width;
+    }
 
-    wh_r.w = cropW;
-    wh_r.h = cropH;
+    D3D11_TEXTURE2D_DESC desc = CD3D11_TEXTURE2D_DESC(DXGI_FORMAT_B8G8R8A8_UNORM, view.width, view.height, 1, 1, 0);
 
+    HRESULT hr = device->CreateTexture2D(&desc, &srd, level0_r);
+    if (FAILED(hr)) {
+        printf("E: JpegToTexture::ImageViewToLevel0Texture() d3dDevice->CreateTexture2D() failed %x\n", hr);
+        return hr;
+    }
     return S_OK;
 }
 
-static int
-CreateTextureFromMemory(
+int
+JpegToTexture::Level0ToMipmappedTexture(
         ID3D11Device* dev,
-        ID3D11DeviceContext*  dctx,
-        const WH& wh_in,
-        D3D11_SUBRESOURCE_DATA &srd_in,
+        ID3D11DeviceContext* dctx,
+        ID3D11Texture2D* level0,
         ID3D11Texture2D** tex_r,
-        ID3D11ShaderResourceView **srv_r)
+        ID3D11ShaderResourceView** srv_r,
+        int mipLevels)
 {
 	HRESULT hr;
     assert(tex_r != nullptr);
     assert(srv_r != nullptr);
 
-	D3D11_TEXTURE2D_DESC desc = CD3D11_TEXTURE2D_DESC(DXGI_FORMAT_B8G8R8A8_UNORM, wh_in.w, wh_in.h);
-	desc.MipLevels = 0;
+    D3D11_TEXTURE2D_DESC desc;
+    level0->GetDesc(&desc);
+	desc.MipLevels = mipLevels;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.CPUAccessFlags = 0;
 	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
 	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
 
     hr = dev->CreateTexture2D(&desc, nullptr, tex_r);
     if (FAILED(hr)) {
-        printf("E: CreateTextureFromMemory() d3dDevice->CreateTexture2D() failed %x\n", hr);
+        printf("E: JpegToTexture::Level0ToMipmappedTexture() d3dDevice->CreateTexture2D() failed %x\n", hr);
         return hr;
     }
     if (*tex_r == 0) {
-        printf("E: CreateTextureFromMemory() d3dDevice->CreateTexture2D() tex_r == nullptr\n");
+        printf("E: JpegToTexture::Level0ToMipmappedTexture() d3dDevice->CreateTexture2D() tex_r == nullptr\n");
         return E_FAIL;
     }
 
-	dctx->UpdateSubresource(*tex_r, 0, nullptr, srd_in.pSysMem, srd_in.SysMemPitch, 0);
+    // GPU上で最も精細な段に複写する。
+	dctx->CopySubresourceRegion(*tex_r, 0, 0, 0, 0, level0, 0, nullptr);
 
     D3D11_SHADER_RESOURCE_VIEW_DESC sd = {};
     sd.Format = desc.Format;
@@ -117,7 +84,7 @@ CreateTextureFromMemory(
     hr = dev->CreateShaderResourceView(*tex_r, &sd, srv_r);
     if (FAILED(hr)) {
         (*tex_r)->Release();
-        printf("E: CreateTextureFromMemory() d3dDevice->CreateShaderResourceView() failed %x\n", hr);
+        printf("E: JpegToTexture::Level0ToMipmappedTexture() d3dDevice->CreateShaderResourceView() failed %x\n", hr);
         return hr;
     }
 
@@ -128,32 +95,243 @@ CreateTextureFromMemory(
 }
 
 int
-JpegToTexture::ImageFileToTexture(
+JpegToTexture::ImageFileToLevel0Textures(
         ID3D11Device* device,
         ID3D11DeviceContext* dctx,
         const wchar_t* path,
-        const XrRect2Df &portion,
+        const XrRect2Df* portions,
+        int numPortions,
+        winrt::com_ptr<ID3D11Texture2D>* level0_r,
+        uint8_t alpha,
+        int maxWidth,
+        bool firstScanOnly,
+        int* scale_r,
+        bool* complete_r)
+{
+    assert(level0_r != nullptr);
+
+    // 内蔵のデコーダーを先に使い、読めない形式のときGDI+で読む。
+    for (int t = 0; t < IDT_NUM; ++t) {
+        int scale = 1;
+        auto dec = ImageDecoderOpen((ImageDecoderType)t, path, maxWidth, &scale);
+        if (!dec) {
+            continue;
+        }
+
+        // 各portionの大きさのDYNAMICテクスチャーを作ってMapし、行の間隔をRowPitchにしてデコードする。
+        std::vector<ImageDecodeTarget> targets(numPortions);
+        HRESULT hr = S_OK;
+        int numMapped = 0;
+        for (int i = 0; i < numPortions && SUCCEEDED(hr); ++i) {
+            const PixelRect r = PortionToPixelRect(portions[i], dec->Width(), dec->Height());
+            const D3D11_TEXTURE2D_DESC desc = CD3D11_TEXTURE2D_DESC(DXGI_FORMAT_B8G8R8A8_UNORM, r.width, r.height, 1, 1,
+                    D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+            level0_r[i] = nullptr;
+            hr = device->CreateTexture2D(&desc, nullptr, level0_r[i].put());
+            if (FAILED(hr)) {
+                printf("E: JpegToTexture::ImageFileToLevel0Textures() d3dDevice->CreateTexture2D() failed %x\n", hr);
+                break;
+            }
+
+            D3D11_MAPPED_SUBRESOURCE msr;
+            hr = dctx->Map(level0_r[i].get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &msr);
+            if (FAILED(hr)) {
+                printf("E: JpegToTexture::ImageFileToLevel0Textures() dctx->Map() failed %x\n", hr);
+                break;
+            }
+            ++numMapped;
+
+            ImageDecodeTarget& tg = targets[i];
+            tg.x = r.x;
+            tg.y = r.y;
+            tg.width = r.width;
+            tg.height = r.height;
+            tg.dst = (uint8_t*)msr.pData;
+            tg.stride = (int)msr.RowPitch;
+        }
+
+        bool complete = true;
+        if (SUCCEEDED(hr)) {
+            if (firstScanOnly) {
+                dec->SetProgress([&](int) {
+                    complete = false;
+                    return false;
+                }, 0);
+            }
+            hr = dec->DecodeTargets(targets.data(), numPortions, alpha);
+        }
+        for (int i = 0; i < numMapped; ++i) {
+            dctx->Unmap(level0_r[i].get(), 0);
+        }
+        if (FAILED(hr)) {
+            for (int i = 0; i < numPortions; ++i) {
+                level0_r[i] = nullptr;
+            }
+            if (numMapped == numPortions) {
+                // デコードの失敗。次のデコーダーを試す。
+                continue;
+            }
+            return hr;
+        }
+
+        if (scale_r != nullptr) {
+            *scale_r = scale;
+        }
+        if (complete_r != nullptr) {
+            *complete_r = complete;
+        }
+        return S_OK;
+    }
+
+    printf("E: JpegToTexture::ImageFileToLevel0Textures(%S) failed\n", path);
+    return E_FAIL;
+}
+
+void
+JpegToTexture::UpdateMipmappedTexture(
+        ID3D11DeviceContext* dctx,
+        ID3D11Texture2D* level0,
+        ID3D11Texture2D* tex,
+        ID3D11ShaderResourceView* srv)
+{
+    dctx->CopySubresourceRegion(tex, 0, 0, 0, 0, level0, 0, nullptr);
+    dctx->GenerateMips(srv);
+}
+
+/// srdの各段を初期データにして、IMMUTABLEのテクスチャーとSRVを作る。
+/// cubeがtrueのとき6面のTEXTURECUBEにする。srd[face * numLevels + level]。
+static int
+CreateImmutableTexture(
+        ID3D11Device* device,
+        DXGI_FORMAT format,
+        int width,
+        int height,
+        int numLevels,
+        const D3D11_SUBRESOURCE_DATA* srd,
         ID3D11Texture2D** tex_r,
         ID3D11ShaderResourceView** srv_r,
-		uint8_t alpha)
+        bool cube=false)
 {
-    D3D11_SUBRESOURCE_DATA srd;
-    WH wh;
-
-	assert(0.0f <= portion.offset.x);
-	assert(0.0f <= portion.offset.y);
-	assert(portion.offset.x + portion.extent.width <= 1.0f);
-	assert(portion.offset.y + portion.extent.height <= 1.0f);
+    D3D11_TEXTURE2D_DESC desc = CD3D11_TEXTURE2D_DESC(format, width, height, cube ? CUBE_NUM : 1,
+            numLevels, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE, 0, 1, 0,
+            cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0);
 
-    int hr = ExtractJpegToBGRA(path, &portion, alpha, srd, wh);
+    HRESULT hr = device->CreateTexture2D(&desc, srd, tex_r);
     if (FAILED(hr)) {
+        printf("E: CreateImmutableTexture() d3dDevice->CreateTexture2D() failed %x\n", hr);
         return hr;
     }
 
-    hr = CreateTextureFromMemory(device, dctx, wh, srd, tex_r, srv_r);
-	if (FAILED(hr)) {
-		return hr;
+    D3D11_SHADER_RESOURCE_VIEW_DESC sd = {};
+    sd.Format = desc.Format;
+    if (cube) {
+        sd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+        sd.TextureCube.MipLevels = numLevels;
+        sd.TextureCube.MostDetailedMip = 0;
+    } else {
+        sd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        sd.Texture2D.MipLevels = numLevels;
+        sd.Texture2D.MostDetailedMip = 0;
     }
 
+    hr = device->CreateShaderResourceView(*tex_r, &sd, srv_r);
+    if (FAILED(hr)) {
+        (*tex_r)->Release();
+        *tex_r = nullptr;
+        printf("E: CreateImmutableTexture() d3dDevice->CreateShaderResourceView() failed %x\n", hr);
+        return hr;
+    }
     return S_OK;
 }
+
+/// BcFormatに対応するDXGIの形式。
+static DXGI_FORMAT
+BcFormatToDxgi(BcFormat f)
+{
+    switch (f) {
+    case BCF_None: return DXGI_FORMAT_B8G8R8A8_UNORM;
+    case BCF_Bc1:  return DXGI_FORMAT_BC1_UNORM;
+    case BCF_Bc7:  return DXGI_FORMAT_BC7_UNORM;
+    default:       return DXGI_FORMAT_UNKNOWN;
+    }
+}
+
+int
+JpegToTexture::TextureCacheEntryToTexture(
+        ID3D11Device* device,
+        const TextureCacheEntry& entry,
+        ID3D11Texture2D** tex_r,
+        ID3D11ShaderResourceView** srv_r)
+{
+    assert(tex_r != nullptr);
+    assert(srv_r != nullptr);
+
+    const DXGI_FORMAT format = BcFormatToDxgi(entry.Format());
+    if (!entry.IsOpen() || format == DXGI_FORMAT_UNKNOWN) {
+        printf("E: JpegToTexture::TextureCacheEntryToTexture() invalid entry\n");
+        return E_INVALIDARG;
+    }
+
+    // マップしたファイルを、そのまま初期データにする。
+    std::vector<D3D11_SUBRESOURCE_DATA> srd(entry.NumLevels());
+    for (int l = 0; l < entry.NumLevels(); ++l) {
+        srd[l].pSysMem = entry.LevelPixels(l);
+        srd[l].SysMemPitch = entry.LevelPitch(l);
+        srd[l].SysMemSlicePitch = 0;
+    }
+
+    return CreateImmutableTexture(device, format, entry.Width(), entry.Height(), entry.NumLevels(),
+            srd.data(), tex_r, srv_r);
+}
+
+int
+JpegToTexture::LevelsToTexture(
+        ID3D11Device* device,
+        BcFormat format,
+        int width,
+        int height,
+        int numLevels,
+        const TextureCacheLevelData* levels,
+        bool cube,
+        ID3D11Texture2D** tex_r,
+        ID3D11ShaderResourceView** srv_r)
+{
+    assert(levels != nullptr);
+    assert(tex_r != nullptr);
+    assert(srv_r != nullptr);
+
+    const DXGI_FORMAT dxgiFormat = BcFormatToDxgi(format);
+    if (dxgiFormat == DXGI_FORMAT_UNKNOWN || width <= 0 || height <= 0 || numLevels < 1) {
+        printf("E: JpegToTexture::LevelsToTexture() invalid argument\n");
+        return E_INVALIDARG;
+    }
+
+    std::vector<D3D11_SUBRESOURCE_DATA> srd((size_t)(cube ? CUBE_NUM : 1) * numLevels);
+    for (size_t i = 0; i < srd.size(); ++i) {
+        srd[i].pSysMem = levels[i].pixels;
+        srd[i].SysMemPitch = levels[i].stride;
+        srd[i].SysMemSlicePitch = 0;
+    }
+
+    return CreateImmutableTexture(device, dxgiFormat, width, height, numLevels, srd.data(), tex_r, srv_r, cube);
+}
+
+int
+JpegToTexture::ImageFileToTexture(
+        ID3D11Device* device,
+        ID3D11DeviceContext* dctx,
+        const wchar_t* path,
+        const XrRect2Df &portion,
+        ID3D11Texture2D** tex_r,
+        ID3D11ShaderResourceView** srv_r,
+		uint8_t alpha,
+        int maxWidth)
+{
+    winrt::com_ptr<ID3D11Texture2D> level0;
+    int hr = ImageFileToLevel0Textures(device, dctx, path, &portion, 1, &level0, alpha, maxWidth);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    return Level0ToMipmappedTexture(device, dctx, level0.get(), tex_r, srv_r);
+}
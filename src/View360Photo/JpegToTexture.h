@@ -3,10 +3,81 @@
 #include <string>
 #include <d3d11.h>
 #include <stdint.h>
+#include "DecodedImage.h"
+#include "BlockCompress.h"
+#include "TextureCache.h"
 
 class JpegToTexture {
 public:
+    /// 画像の一部を、ミップマップの無いテクスチャーにする。
+    /// ID3D11Deviceだけを使うので、複数のスレッドから同時に呼べる。
+    int ImageViewToLevel0Texture(
+        ID3D11Device* device,
+        const ImageView& view,
+        ID3D11Texture2D** level0_r,
+        uint8_t alpha=0xff);
+
+    /// pathの画像のportions[i]を、ミップマップの無いテクスチャーlevel0_r[i]にする。
+    /// 中間のバッファーを使わず、DYNAMICのテクスチャーをMapしたメモリーに各portionを直接デコードする。
+    /// dctxを使うスレッドから呼ぶ。
+    /// @param maxWidth 0より大きいとき、画像の幅がmaxWidth以下になるよう縮小してデコードする。DecodedImage::Load()を参照。
+    /// @param firstScanOnly trueのとき、プログレッシブJPEGは最初のスキャンまでで止める。
+    /// @param scale_r nullptrでないとき、縮小率の分母を置く。
+    /// @param complete_r nullptrでないとき、最後まで読んだときtrueを置く。
+    int ImageFileToLevel0Textures(
+        ID3D11Device* device,
+        ID3D11DeviceContext* dctx,
+        const wchar_t* path,
+        const XrRect2Df* portions,
+        int numPortions,
+        winrt::com_ptr<ID3D11Texture2D>* level0_r,
+        uint8_t alpha=0xff,
+        int maxWidth=0,
+        bool firstScanOnly=false,
+        int* scale_r=nullptr,
+        bool* complete_r=nullptr);
+
+    /// level0を最も精細な段に複写し、ミップマップ付きのテクスチャーを作る。dctxを使うスレッドから呼ぶ。
+    /// @param mipLevels 作る段数(最も精細な段を含む)。0のとき1x1まで。
+    int Level0ToMipmappedTexture(
+        ID3D11Device* device,
+        ID3D11DeviceContext* dctx,
+        ID3D11Texture2D* level0,
+        ID3D11Texture2D** tex_r,
+        ID3D11ShaderResourceView** srv_r,
+        int mipLevels=0);
+
+    /// level0をtexの最も精細な段に複写し、ミップマップを作り直す。texはLevel0ToMipmappedTexture()で作った同じ大きさのもの。
+    /// dctxを使うスレッドから呼ぶ。
+    void UpdateMipmappedTexture(
+        ID3D11DeviceContext* dctx,
+        ID3D11Texture2D* level0,
+        ID3D11Texture2D* tex,
+        ID3D11ShaderResourceView* srv);
+
+    /// TextureCache::Open()したキャッシュの全段を、マップしたまま初期データにしてテクスチャーを作る。
+    int TextureCacheEntryToTexture(
+        ID3D11Device* device,
+        const TextureCacheEntry& entry,
+        ID3D11Texture2D** tex_r,
+        ID3D11ShaderResourceView** srv_r);
+
+    /// levelsの全段を初期データにしてテクスチャーを作る。BC形式のときは1行がブロックの1行。
+    /// cubeがtrueのとき立方体マップの6面をTextureCubeとして読むテクスチャーにする。
+    /// levels[face * numLevels + level]は面face (CubeFace) の段level。
+    int LevelsToTexture(
+        ID3D11Device* device,
+        BcFormat format,
+        int width,
+        int height,
+        int numLevels,
+        const TextureCacheLevelData* levels,
+        bool cube,
+        ID3D11Texture2D** tex_r,
+        ID3D11ShaderResourceView** srv_r);
+
     /// @param portion 比率を0～1で指定。nullptrのとき全域をテクスチャーにする。
+    /// @param maxWidth 0より大きいとき、画像の幅がmaxWidth以下になるよう縮小してデコードする。DecodedImage::Load()を参照。
     int ImageFileToTexture(
         ID3D11Device* device,
         ID3D11DeviceContext* dctx,
@@ -14,5 +85,6 @@ public:
         const XrRect2Df &portion,
         ID3D11Texture2D** tex_r,
         ID3D11ShaderResourceView** srv_r,
-		uint8_t alpha=0xff);
+		uint8_t alpha=0xff,
+        int maxWidth=0);
 };
\ No newline at end of file
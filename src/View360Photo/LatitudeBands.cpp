@@ -0,0 +1,252 @@
+﻿// 日本語。
+
+#include "LatitudeBands.h"
+#include "PixelConvert.h"
+#include "ParallelFor.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static const double PI = 3.14159265358979323846;
+
+/// 帯の周りの縁の画素数。
+static const int BORDER = 1;
+
+int
+LatitudeBandLayoutBuild(int srcWidth, int srcHeight, int numBands, LatitudeBandLayout* layout_r)
+{
+    if (srcWidth < 1 || srcHeight < 1 || numBands < 1 || LATITUDE_BANDS_MAX < numBands || srcHeight < numBands
+            || layout_r == nullptr) {
+        printf("E: LatitudeBandLayoutBuild() invalid argument\n");
+        return -1;
+    }
+
+    LatitudeBandLayout& l = *layout_r;
+    l.srcWidth = srcWidth;
+    l.srcHeight = srcHeight;
+    l.bands.resize(numBands);
+    l.segments.clear();
+
+    // 段の幅。縁を除いて元の画像の幅の半分以上にする。
+    l.width = ((srcWidth + 1) / 2 + 2 * BORDER + 3) & ~3;
+
+    std::vector<int> shelfRows;
+    int used = l.width;
+    for (int k = 0; k < numBands; ++k) {
+        LatitudeBand& b = l.bands[k];
+        b.srcY0 = (int)((int64_t)k * srcHeight / numBands);
+        b.srcY1 = (int)((int64_t)(k + 1) * srcHeight / numBands);
+
+        // 行yの上端の緯度のcosはsin(π y / srcHeight)。赤道をまたぐ帯は縮めない。
+        double c = 1.0;
+        if (2 * b.srcY1 <= srcHeight) {
+            c = sin(PI * b.srcY1 / srcHeight);
+        } else if (srcHeight <= 2 * b.srcY0) {
+            c = sin(PI * b.srcY0 / srcHeight);
+        }
+        b.width = std::min(srcWidth, std::max(1, (int)ceil(srcWidth * c)));
+
+        // 前の帯の続きに置き、段の右端で切る。縁と1列が入らない残りは使わない。
+        b.firstSegment = (int)l.segments.size();
+        int col = 0;
+        while (col < b.width) {
+            if (l.width - used < 2 * BORDER + 1) {
+                shelfRows.push_back(0);
+                used = 0;
+            }
+            LatitudeBandSegment sg;
+            sg.col0 = col;
+            sg.col1 = std::min(b.width, col + l.width - used - 2 * BORDER);
+            sg.x = used + BORDER;
+            sg.y = (int)shelfRows.size() - 1;
+            l.segments.push_back(sg);
+            used += sg.col1 - sg.col0 + 2 * BORDER;
+            shelfRows.back() = std::max(shelfRows.back(), b.srcY1 - b.srcY0 + 2 * BORDER);
+            col = sg.col1;
+        }
+        b.numSegments = (int)l.segments.size() - b.firstSegment;
+    }
+
+    // 区間のyは段の番号なので、段の上端の行にする。
+    std::vector<int> shelfY(shelfRows.size());
+    int y = 0;
+    for (size_t i = 0; i < shelfRows.size(); ++i) {
+        shelfY[i] = y;
+        y += shelfRows[i];
+    }
+    for (LatitudeBandSegment& sg : l.segments) {
+        sg.y = shelfY[sg.y] + BORDER;
+    }
+    l.height = (y + 3) & ~3;
+    return 0;
+}
+
+void
+LatitudeBandCoord(const LatitudeBandLayout& l, float u, float v, float* x_r, float* y_r)
+{
+    const int n = (int)l.bands.size();
+    v = std::min(std::max(v, 0.0f), 1.0f);
+    const float row = v * (float)l.srcHeight;
+
+    // 帯の境目の行は切り捨てで決めたので、v * nの帯の隣のこともある。
+    int k = std::min((int)(v * (float)n), n - 1);
+    if (row < (float)l.bands[k].srcY0 && 0 < k) {
+        --k;
+    } else if ((float)l.bands[k].srcY1 <= row && k < n - 1) {
+        ++k;
+    }
+
+    const LatitudeBand& b = l.bands[k];
+    const float col = u * (float)b.width;
+    int s = b.firstSegment;
+    const int last = b.firstSegment + b.numSegments - 1;
+    while (s < last && (float)l.segments[s].col1 <= col) {
+        ++s;
+    }
+    const LatitudeBandSegment& sg = l.segments[s];
+    *x_r = (float)(sg.x - sg.col0) + col;
+    *y_r = (float)(sg.y - b.srcY0) + row;
+}
+
+/// 幅srcWの行を幅dstWに縮める箱の重み。出力の列jは元の [j * srcW / dstW, (j + 1) * srcW / dstW) の平均。
+struct BandTaps {
+    int numTaps = 0;
+
+    /// first[j]は列jの最初の元の列。weights[j * numTaps + t]は列first[j] + tの重み。
+    std::vector<int> first;
+    std::vector<float> weights;
+};
+
+static void
+BuildBandTaps(int srcW, int dstW, BandTaps* taps_r)
+{
+    const double scale = (double)srcW / dstW;
+    taps_r->numTaps = (int)ceil(scale) + 1;
+    taps_r->first.resize(dstW);
+    taps_r->weights.assign((size_t)dstW * taps_r->numTaps, 0.0f);
+    for (int j = 0; j < dstW; ++j) {
+        const double a = j * scale;
+        const double b = std::min((j + 1) * scale, (double)srcW);
+        const int i0 = (int)floor(a);
+        taps_r->first[j] = i0;
+        for (int t = 0; t < taps_r->numTaps; ++t) {
+            const double overlap = std::min(b, (double)(i0 + t + 1)) - std::max(a, (double)(i0 + t));
+            taps_r->weights[(size_t)j * taps_r->numTaps + t] = (float)(std::max(overlap, 0.0) / (b - a));
+        }
+    }
+}
+
+int
+EquirectToLatitudeBands(const MipSource& equirect, int numBands, int numThreads, LatitudeBandImage* img_r)
+{
+    if (equirect.pixels == nullptr || equirect.width < 1 || equirect.height < 1 || equirect.stride < 4 * equirect.width
+            || img_r == nullptr) {
+        printf("E: EquirectToLatitudeBands() invalid argument\n");
+        return -1;
+    }
+    LatitudeBandLayout& l = img_r->layout;
+    if (LatitudeBandLayoutBuild(equirect.width, equirect.height, numBands, &l) < 0) {
+        return -1;
+    }
+    img_r->pixels.assign((size_t)4 * l.width * l.height, 0);
+
+    // 帯ごとの重みと、縁を含めた帯の各行を1個の仕事にしたときの最初の番号。
+    const int srcW = equirect.width;
+    std::vector<BandTaps> taps(numBands);
+    std::vector<int> firstJob(numBands + 1);
+    for (int k = 0; k < numBands; ++k) {
+        const LatitudeBand& b = l.bands[k];
+        BuildBandTaps(srcW, b.width, &taps[k]);
+        firstJob[k + 1] = firstJob[k] + b.srcY1 - b.srcY0 + 2 * BORDER;
+    }
+
+    const PixelKernels& pk = PixelConvert();
+    ParallelFor(firstJob[numBands], [&](int job) {
+        const int k = (int)(std::upper_bound(firstJob.begin(), firstJob.end(), job) - firstJob.begin()) - 1;
+        const LatitudeBand& b = l.bands[k];
+        const BandTaps& bt = taps[k];
+        const int r = job - firstJob[k] - BORDER;
+        const int srcY = std::min(std::max(b.srcY0 + r, 0), equirect.height - 1);
+
+        std::vector<uint16_t> src((size_t)4 * srcW);
+        std::vector<uint16_t> dst((size_t)4 * b.width);
+        pk.srgbToLinear16(equirect.pixels + (size_t)equirect.stride * srcY, src.data(), srcW);
+        for (int j = 0; j < b.width; ++j) {
+            float acc[4] = { 0, 0, 0, 0 };
+            for (int t = 0; t < bt.numTaps; ++t) {
+                const float wt = bt.weights[(size_t)j * bt.numTaps + t];
+                if (wt == 0.0f) {
+                    continue;
+                }
+                int i = bt.first[j] + t;
+                i = (srcW <= i) ? i - srcW : i;
+                for (int c = 0; c < 4; ++c) {
+                    acc[c] += wt * (float)src[(size_t)4 * i + c];
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                dst[(size_t)4 * j + c] = (uint16_t)(int)(std::min(std::max(acc[c], 0.0f), 65535.0f) + 0.5f);
+            }
+        }
+
+        std::vector<uint8_t> bandRow((size_t)4 * b.width);
+        pk.linear16ToSrgb(dst.data(), bandRow.data(), b.width);
+
+        // 各区間と、その左右の縁の列。帯の端の外は反対側の端の列。
+        for (int i = 0; i < b.numSegments; ++i) {
+            const LatitudeBandSegment& sg = l.segments[(size_t)b.firstSegment + i];
+            uint8_t* row = img_r->pixels.data() + ((size_t)l.width * (sg.y + r) + sg.x) * 4;
+            for (int x = -BORDER; x < sg.col1 - sg.col0 + BORDER; ++x) {
+                int c = sg.col0 + x;
+                c = (c < 0) ? c + b.width : (b.width <= c) ? c - b.width : c;
+                memcpy(row + 4 * x, &bandRow[(size_t)4 * c], 4);
+            }
+        }
+    }, numThreads);
+    return 0;
+}
+
+/// w x h画素の画像の、画素の座標(fx, fy)を双線形で読んでdstに書く。画像の端は端の画素を延ばす。
+static void
+SampleBilinear(const uint8_t* img, int w, int h, float fx, float fy, uint8_t* dst)
+{
+    const int x0 = (int)floorf(fx);
+    const int y0 = (int)floorf(fy);
+    const float wx = fx - (float)x0;
+    const float wy = fy - (float)y0;
+    const int xs[2] = { std::min(std::max(x0, 0), w - 1), std::min(std::max(x0 + 1, 0), w - 1) };
+    const int ys[2] = { std::min(std::max(y0, 0), h - 1), std::min(std::max(y0 + 1, 0), h - 1) };
+    for (int c = 0; c < 4; ++c) {
+        float v = 0;
+        for (int ky = 0; ky < 2; ++ky) {
+            for (int kx = 0; kx < 2; ++kx) {
+                v += (float)img[((size_t)w * ys[ky] + xs[kx]) * 4 + c] * (kx == 0 ? 1.0f - wx : wx) * (ky == 0 ? 1.0f - wy : wy);
+            }
+        }
+        dst[c] = (uint8_t)(int)(std::min(std::max(v, 0.0f), 255.0f) + 0.5f);
+    }
+}
+
+int
+LatitudeBandsToEquirect(const LatitudeBandImage& img, int w, int h, uint8_t* dst, int stride, int numThreads)
+{
+    const LatitudeBandLayout& l = img.layout;
+    if (l.bands.empty() || img.pixels.size() < (size_t)4 * l.width * l.height || dst == nullptr || w <= 0 || h <= 0
+            || stride < 4 * w) {
+        printf("E: LatitudeBandsToEquirect() invalid argument\n");
+        return -1;
+    }
+
+    ParallelFor(h, [&](int y) {
+        const float v = (y + 0.5f) / h;
+        uint8_t* row = dst + (size_t)stride * y;
+        for (int x = 0; x < w; ++x) {
+            float fx;
+            float fy;
+            LatitudeBandCoord(l, (x + 0.5f) / w, v, &fx, &fy);
+            SampleBilinear(img.pixels.data(), l.width, l.height, fx - 0.5f, fy - 0.5f, row + 4 * x);
+        }
+    }, numThreads);
+    return 0;
+}
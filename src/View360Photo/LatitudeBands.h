@@ -0,0 +1,83 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "MipBuilder.h"
+
+/// 正距円筒図法の画像の1行は、緯度φで球面上の長さが赤道のcosφ倍しかないのに、赤道と同じ画素数を持つ。
+/// 画像を行の範囲で緯度の帯に分け、各帯を、帯の中で最も赤道に近い行のcosφの比率の幅に横だけ縮めて1枚に詰める
+/// (PL_LatitudeBands)。帯の中のどの行でも横の画素の間隔は縦の間隔以下なので、見た目はほとんど変わらない。
+/// 詰め方は、上の帯から順に横一列に並べた帯を、詰めた画像の幅ごとに切って段にする。
+/// 切れ目をまたぐ帯は列の範囲で区間に分け、区間ごとに別の段に置く。段の幅は元の画像の約半分。
+/// 各区間の周りには1画素の縁を置く。左右は区間の外の隣の列(帯の端では反対側の端の列)、上下は隣の行を同じ幅に縮めたもの。
+/// 縁があるので、LatitudeBandCoord()の座標を双線形で読めば、区間の継ぎ目と経度の継ぎ目も元の画像と同じようにつながる。
+
+/// 帯の数の上限。
+static const int LATITUDE_BANDS_MAX = 64;
+
+/// 区間の数の上限。段の幅が帯の幅の半分以上なので、1本の帯は3区間以下になる。
+static const int LATITUDE_SEGMENTS_MAX = 3 * LATITUDE_BANDS_MAX;
+
+/// 緯度の帯1本。
+struct LatitudeBand {
+    /// 元の画像の行の範囲 [srcY0, srcY1)。
+    int srcY0;
+    int srcY1;
+
+    /// 縮めた幅。
+    int width;
+
+    /// LatitudeBandLayout::segmentsの中の、この帯の区間の範囲。列の順に並ぶ。
+    int firstSegment;
+    int numSegments;
+};
+
+/// 帯の列 [col0, col1) を、詰めた画像の(x, y)を左上として置いたもの(縁を含まない)。高さは帯の行数。
+struct LatitudeBandSegment {
+    int col0;
+    int col1;
+    int x;
+    int y;
+};
+
+/// 詰め方。LatitudeBandLayoutBuild()で元の画像の大きさと帯の数から決まる。
+struct LatitudeBandLayout {
+    int srcWidth = 0;
+    int srcHeight = 0;
+
+    /// 詰めた画像の大きさ。BC形式で圧縮できるように4の倍数にする。
+    int width = 0;
+    int height = 0;
+
+    /// 上の帯から順。
+    std::vector<LatitudeBand> bands;
+    std::vector<LatitudeBandSegment> segments;
+};
+
+/// srcWidth x srcHeightの正距円筒図法の画像をnumBands本の帯に分けた詰め方。
+/// 帯kは行 [k * srcHeight / numBands, (k + 1) * srcHeight / numBands)。numBandsは1～LATITUDE_BANDS_MAXでsrcHeight以下。
+/// @return 成功のとき0。失敗のとき負の値。
+int LatitudeBandLayoutBuild(int srcWidth, int srcHeight, int numBands, LatitudeBandLayout* layout_r);
+
+/// 元の画像の座標(u, v) (0～1、vは下が正)を読む、詰めた画像の画素の座標(画素の中心は0.5)。
+/// TexturedMeshRendererのMainBandedPSと同じ計算。
+void LatitudeBandCoord(const LatitudeBandLayout& l, float u, float v, float* x_r, float* y_r);
+
+/// 詰めた画像。BGRA 8ビット、sRGB。layout.width x layout.height画素を行の隙間なく並べる。帯の外は0。
+struct LatitudeBandImage {
+    LatitudeBandLayout layout;
+    std::vector<uint8_t> pixels;
+};
+
+/// 正距円筒図法の画像を帯に分けて詰める。横の縮小は、縮小率の幅の箱でリニアな明るさで平均する。
+/// 帯の行ごとに複数のスレッドで作る。結果はスレッド数によらず同じ。
+/// @param numThreads 0のときハードウェアスレッド数。
+/// @return 成功のとき0。失敗のとき負の値。
+int EquirectToLatitudeBands(const MipSource& equirect, int numBands, int numThreads, LatitudeBandImage* img_r);
+
+/// 詰めた画像をLatitudeBandCoord()の座標で双線形に読み、w x hの正距円筒図法の画像に戻す。
+/// 変換の誤差を見るためのもの。
+/// @return 成功のとき0。失敗のとき負の値。
+int LatitudeBandsToEquirect(const LatitudeBandImage& img, int w, int h, uint8_t* dst, int stride, int numThreads = 0);
@@ -0,0 +1,181 @@
+﻿// 日本語。
+
+#include "MappedFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+int
+MappedFile::Open(const wchar_t* path)
+{
+    Close();
+
+    HANDLE h = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        printf("E: MappedFile::Open(%S) CreateFile failed %u\n", path, GetLastError());
+        return -1;
+    }
+    mFileHandle = h;
+
+    return MapOpenedFile();
+}
+
+int
+MappedFile::Open(const char* path)
+{
+    Close();
+
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        printf("E: MappedFile::Open(%s) CreateFile failed %u\n", path, GetLastError());
+        return -1;
+    }
+    mFileHandle = h;
+
+    return MapOpenedFile();
+}
+
+int
+MappedFile::MapOpenedFile(void)
+{
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(mFileHandle, &sz)) {
+        printf("E: MappedFile::MapOpenedFile() GetFileSizeEx failed %u\n", GetLastError());
+        Close();
+        return -1;
+    }
+
+    FILETIME ft;
+    if (GetFileTime(mFileHandle, nullptr, nullptr, &ft)) {
+        mLastWriteTime = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    }
+
+    if (sz.QuadPart == 0) {
+        mIsOpenEmpty = true;
+        return 0;
+    }
+
+    mMappingHandle = CreateFileMappingW(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMappingHandle == nullptr) {
+        printf("E: MappedFile::MapOpenedFile() CreateFileMapping failed %u\n", GetLastError());
+        Close();
+        return -1;
+    }
+
+    mData = (const uint8_t*)MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (mData == nullptr) {
+        printf("E: MappedFile::MapOpenedFile() MapViewOfFile failed %u\n", GetLastError());
+        Close();
+        return -1;
+    }
+
+    mSize = (size_t)sz.QuadPart;
+    return 0;
+}
+
+void
+MappedFile::Close(void)
+{
+    if (mData != nullptr) {
+        UnmapViewOfFile(mData);
+        mData = nullptr;
+    }
+    if (mMappingHandle != nullptr) {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = nullptr;
+    }
+    if (mFileHandle != nullptr) {
+        CloseHandle(mFileHandle);
+        mFileHandle = nullptr;
+    }
+    mSize = 0;
+    mLastWriteTime = 0;
+    mIsOpenEmpty = false;
+}
+
+#else // _WIN32
+
+int
+MappedFile::Open(const wchar_t* path)
+{
+    // POSIXではマルチバイト文字列に変換して開く。
+    size_t n = wcstombs(nullptr, path, 0);
+    if (n == (size_t)-1) {
+        printf("E: MappedFile::Open(%ls) path conversion failed\n", path);
+        return -1;
+    }
+    std::string s(n, '\0');
+    wcstombs(&s[0], path, n + 1);
+    return Open(s.c_str());
+}
+
+int
+MappedFile::Open(const char* path)
+{
+    Close();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("E: MappedFile::Open(%s) open failed\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        printf("E: MappedFile::Open(%s) fstat failed\n", path);
+        close(fd);
+        return -1;
+    }
+
+#ifdef __APPLE__
+    mLastWriteTime = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ULL + (uint64_t)st.st_mtimespec.tv_nsec;
+#else
+    mLastWriteTime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+#endif
+
+    if (st.st_size == 0) {
+        close(fd);
+        mIsOpenEmpty = true;
+        return 0;
+    }
+
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        printf("E: MappedFile::Open(%s) mmap failed\n", path);
+        return -1;
+    }
+
+    mData = (const uint8_t*)p;
+    mSize = (size_t)st.st_size;
+    return 0;
+}
+
+void
+MappedFile::Close(void)
+{
+    if (mData != nullptr) {
+        munmap((void*)mData, mSize);
+        mData = nullptr;
+    }
+    mSize = 0;
+    mLastWriteTime = 0;
+    mIsOpenEmpty = false;
+}
+
+#endif // _WIN32
@@ -0,0 +1,41 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// ファイル全体を読み出し専用でメモリーマップする。
+class MappedFile {
+public:
+    MappedFile(void) = default;
+    ~MappedFile(void) { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Open(const wchar_t* path);
+    int Open(const char* path);
+    void Close(void);
+
+    const uint8_t* Data(void) const { return mData; }
+    size_t Size(void) const { return mSize; }
+    bool IsOpen(void) const { return mData != nullptr || mIsOpenEmpty; }
+
+    /// 開いたファイルの最終更新時刻。値の単位はOSに依存し、同じ環境での比較にのみ使う。
+    uint64_t LastWriteTime(void) const { return mLastWriteTime; }
+
+private:
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    uint64_t mLastWriteTime = 0;
+
+    /// サイズ0のファイルはマップできないが、開くことには成功する。
+    bool mIsOpenEmpty = false;
+
+#ifdef _WIN32
+    void* mFileHandle = nullptr;
+    void* mMappingHandle = nullptr;
+    int MapOpenedFile(void);
+#endif
+};
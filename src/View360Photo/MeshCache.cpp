@@ -0,0 +1,129 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "MeshCache.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <string.h>
+
+static_assert(sizeof(MeshCacheHeader) == 128, "MeshCacheHeader size");
+
+static const char MESH_CACHE_MAGIC[8] = { 'V', '3', '6', '0', 'M', 'S', 'H', 0 };
+
+static uint64_t
+AlignUp(uint64_t v)
+{
+    return (v + MeshCache::ALIGN_BYTES - 1) & ~(uint64_t)(MeshCache::ALIGN_BYTES - 1);
+}
+
+int
+MeshCache::Open(const std::wstring& cachePath)
+{
+    Close();
+
+    if (mMF.Open(cachePath.c_str()) < 0) {
+        printf("E: MeshCache::Open(%S) failed.\n", cachePath.c_str());
+        return E_FAIL;
+    }
+
+    const uint64_t fileBytes = mMF.Size();
+    if (fileBytes < sizeof(MeshCacheHeader)) {
+        printf("E: MeshCache::Open() cache is too short.\n");
+        mMF.Close();
+        return E_FAIL;
+    }
+
+    MeshCacheHeader h;
+    memcpy(&h, mMF.Data(), sizeof h);
+
+    if (0 != memcmp(h.magic, MESH_CACHE_MAGIC, sizeof h.magic)
+            || h.version != VERSION
+            || h.vtxStride != sizeof(XyzUv)) {
+        printf("E: MeshCache::Open() unknown cache format.\n");
+        mMF.Close();
+        return E_FAIL;
+    }
+
+    // 各配列がファイルに収まっているか。
+    const uint64_t maxCount = fileBytes / sizeof(uint32_t);
+    if (maxCount < h.numVtx || maxCount < h.numIdx
+            || h.vtxOffset != AlignUp(sizeof(MeshCacheHeader))
+            || h.idxOffset != AlignUp(h.vtxOffset + h.numVtx * sizeof(XyzUv))
+            || fileBytes != h.idxOffset + h.numIdx * sizeof(uint32_t)) {
+        printf("E: MeshCache::Open() cache is broken.\n");
+        mMF.Close();
+        return E_FAIL;
+    }
+
+    mVtx = (const XyzUv*)(mMF.Data() + h.vtxOffset);
+    mIdx = (const uint32_t*)(mMF.Data() + h.idxOffset);
+    mNumVtx = (size_t)h.numVtx;
+    mNumIdx = (size_t)h.numIdx;
+    return S_OK;
+}
+
+void
+MeshCache::Close(void)
+{
+    mMF.Close();
+    mVtx = nullptr;
+    mIdx = nullptr;
+    mNumVtx = 0;
+    mNumIdx = 0;
+}
+
+int
+MeshCache::Read(const std::wstring& cachePath, TexturedMesh& tm_r)
+{
+    int hr = Open(cachePath);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    tm_r.vertexList.insert(tm_r.vertexList.end(), mVtx, mVtx + mNumVtx);
+    tm_r.triangleIdxList.insert(tm_r.triangleIdxList.end(), mIdx, mIdx + mNumIdx);
+
+    Close();
+    return S_OK;
+}
+
+int
+MeshCache::Write(const std::wstring& cachePath,
+        const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx)
+{
+    MeshCacheHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, MESH_CACHE_MAGIC, sizeof h.magic);
+    h.version = VERSION;
+    h.vtxStride = sizeof(XyzUv);
+    h.numVtx = numVtx;
+    h.numIdx = numIdx;
+    h.vtxOffset = AlignUp(sizeof h);
+    h.idxOffset = AlignUp(h.vtxOffset + numVtx * sizeof(XyzUv));
+
+    // 書き込み途中のファイルを読まないように、一時ファイルに書いてから改名する。
+    const std::wstring tmpPath = cachePath + L".tmp";
+    FILE* fp = OpenFileToWrite(tmpPath);
+    if (fp == nullptr) {
+        printf("E: MeshCache::Write(%S) open failed.\n", tmpPath.c_str());
+        return E_FAIL;
+    }
+
+    static const uint8_t zeros[ALIGN_BYTES] = {};
+    const size_t vtxPad = (size_t)(h.vtxOffset - sizeof h);
+    const size_t idxPad = (size_t)(h.idxOffset - h.vtxOffset - numVtx * sizeof(XyzUv));
+
+    bool ok = 1 == fwrite(&h, sizeof h, 1, fp)
+            && vtxPad == fwrite(zeros, 1, vtxPad, fp)
+            && numVtx == fwrite(vtx, sizeof(XyzUv), numVtx, fp)
+            && idxPad == fwrite(zeros, 1, idxPad, fp)
+            && numIdx == fwrite(idx, sizeof(uint32_t), numIdx, fp);
+    ok = (0 == fclose(fp)) && ok;
+
+    if (!ok || !RenameReplacing(tmpPath, cachePath)) {
+        RemoveFile(tmpPath);
+        printf("E: MeshCache::Write(%S) failed.\n", cachePath.c_str());
+        return E_FAIL;
+    }
+    return S_OK;
+}
@@ -0,0 +1,70 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "TexturedMesh.h"
+#include "MappedFile.h"
+#include <stdint.h>
+
+/// メッシュキャッシュファイルのヘッダー。
+/// ファイルの構成:
+///   MeshCacheHeader         (128バイト)
+///   XyzUv × numVtx          (vtxOffsetから。64バイト境界)
+///   uint32_t × numIdx       (idxOffsetから。64バイト境界)
+/// 値はリトルエンディアン。
+struct MeshCacheHeader {
+    char magic[8];
+
+    uint32_t version;
+
+    /// 頂点1個のバイト数。sizeof(XyzUv)。
+    uint32_t vtxStride;
+
+    /// 以前の版で元のPLYファイルのサイズ、最終更新時刻、内容のハッシュ値を入れていた。今は0。
+    uint64_t srcBytes;
+    uint64_t srcWriteTime;
+    uint64_t srcHash;
+
+    uint64_t numVtx;
+    uint64_t numIdx;
+    uint64_t vtxOffset;
+    uint64_t idxOffset;
+
+    uint64_t reserved[7];
+};
+
+/// メッシュをバイナリーのキャッシュファイルに保存し、メモリーマップして読む。
+/// View360Toolの.meshcacheの入出力に使う。
+class MeshCache {
+public:
+    /// キャッシュファイルをマップする。
+    int Open(const std::wstring& cachePath);
+
+    /// Open()したメッシュ。Close()まで有効。
+    const XyzUv* Vertices(void) const { return mVtx; }
+    size_t NumVertices(void) const { return mNumVtx; }
+    const uint32_t* Indices(void) const { return mIdx; }
+    size_t NumIndices(void) const { return mNumIdx; }
+
+    void Close(void);
+
+    /// cachePathのメッシュをOpen()してtm_rのvertexList, triangleIdxListに追加する。
+    int Read(const std::wstring& cachePath, TexturedMesh& tm_r);
+
+    /// キャッシュファイルを書く。一時ファイルに書いてから置き換える。
+    static int Write(const std::wstring& cachePath,
+            const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx);
+
+    static const uint32_t VERSION = 1;
+
+    /// 頂点と頂点番号の配列の先頭のアラインメント。
+    static const int ALIGN_BYTES = 64;
+
+private:
+    MappedFile mMF;
+
+    const XyzUv* mVtx = nullptr;
+    const uint32_t* mIdx = nullptr;
+    size_t mNumVtx = 0;
+    size_t mNumIdx = 0;
+};
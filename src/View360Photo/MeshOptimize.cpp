@@ -0,0 +1,210 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "MeshOptimize.h"
+#include <stdio.h>
+#include <string.h>
+
+static int
+CheckIndices(const char* func, const uint32_t* idx, size_t numIdx, size_t numVtx)
+{
+    if (numIdx % 3 != 0) {
+        printf("E: %s() number of indices is not a multiple of 3\n", func);
+        return E_FAIL;
+    }
+    if (UINT32_MAX <= numVtx || UINT32_MAX <= numIdx) {
+        printf("E: %s() too many vertices or indices\n", func);
+        return E_FAIL;
+    }
+    for (size_t i = 0; i < numIdx; ++i) {
+        if (numVtx <= idx[i]) {
+            printf("E: %s() index %zu out of range\n", func, i);
+            return E_FAIL;
+        }
+    }
+    return S_OK;
+}
+
+MeshCacheStats
+MeshSimulateVertexCache(const uint32_t* idx, size_t numIdx, size_t numVtx, int cacheSize)
+{
+    MeshCacheStats r;
+
+    // 頂点がキャッシュに入った時刻。FIFOなので、その後cacheSize個の頂点が入ると追い出される。
+    std::vector<size_t> inTime(numVtx, 0);
+    std::vector<bool> used(numVtx, false);
+    size_t now = (size_t)cacheSize + 1;
+    size_t numUsed = 0;
+
+    for (size_t i = 0; i < numIdx; ++i) {
+        const uint32_t v = idx[i];
+        if (!used[v]) {
+            used[v] = true;
+            ++numUsed;
+        }
+        if ((size_t)cacheSize < now - inTime[v]) {
+            inTime[v] = now++;
+            ++r.misses;
+        }
+    }
+
+    const size_t numTri = numIdx / 3;
+    r.acmr = (numTri == 0) ? 0 : (double)r.misses / numTri;
+    r.atvr = (numUsed == 0) ? 0 : (double)r.misses / numUsed;
+    return r;
+}
+
+int
+MeshOptimizeTriangleOrder(uint32_t* idx_r, size_t numIdx, size_t numVtx, int cacheSize)
+{
+    int hr = CheckIndices("MeshOptimizeTriangleOrder", idx_r, numIdx, numVtx);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    if (cacheSize < 3) {
+        printf("E: MeshOptimizeTriangleOrder() cacheSize must be 3 or more\n");
+        return E_FAIL;
+    }
+
+    const size_t numTri = numIdx / 3;
+    const int64_t k = cacheSize;
+
+    // 頂点ごとの、その頂点を使う三角形の一覧。
+    std::vector<uint32_t> adjBegin(numVtx + 1, 0);
+    for (size_t i = 0; i < numIdx; ++i) {
+        ++adjBegin[idx_r[i] + 1];
+    }
+    for (size_t v = 0; v < numVtx; ++v) {
+        adjBegin[v + 1] += adjBegin[v];
+    }
+    std::vector<uint32_t> adjTri(numIdx);
+    {
+        std::vector<uint32_t> fill(adjBegin.begin(), adjBegin.end() - 1);
+        for (size_t i = 0; i < numIdx; ++i) {
+            adjTri[fill[idx_r[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+
+    // 頂点ごとの、まだ出力していない三角形の数。
+    std::vector<uint32_t> live(numVtx);
+    for (size_t v = 0; v < numVtx; ++v) {
+        live[v] = adjBegin[v + 1] - adjBegin[v];
+    }
+
+    std::vector<int64_t> cacheTime(numVtx, 0);
+    std::vector<bool> emitted(numTri, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> out;
+    out.reserve(numIdx);
+
+    const uint32_t NONE = UINT32_MAX;
+    int64_t now = k + 1;
+    size_t cursor = 0;
+    uint32_t fan = (numVtx == 0) ? NONE : 0;
+
+    while (fan != NONE) {
+        // fanを使う三角形を全部出力する。
+        candidates.clear();
+        for (uint32_t a = adjBegin[fan]; a < adjBegin[fan + 1]; ++a) {
+            const uint32_t t = adjTri[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (int j = 0; j < 3; ++j) {
+                const uint32_t v = idx_r[3 * t + j];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (k < now - cacheTime[v]) {
+                    cacheTime[v] = now++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // 次のfanは、まだキャッシュに残っていて、三角形を出力しても追い出されないもののうち最も古い頂点。
+        uint32_t next = NONE;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (now - cacheTime[v] + 2 * (int64_t)live[v] <= k) {
+                priority = now - cacheTime[v];
+            }
+            if (bestPriority < priority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if (next == NONE) {
+            // 行き止まり。最近出力した頂点、それも無ければ頂点番号順に、三角形の残っている頂点を探す。
+            while (!deadEnd.empty()) {
+                const uint32_t d = deadEnd.back();
+                deadEnd.pop_back();
+                if (0 < live[d]) {
+                    next = d;
+                    break;
+                }
+            }
+            while (next == NONE && cursor < numVtx) {
+                if (0 < live[cursor]) {
+                    next = (uint32_t)cursor;
+                }
+                ++cursor;
+            }
+        }
+        fan = next;
+    }
+
+    assert(out.size() == numIdx);
+    memcpy(idx_r, out.data(), numIdx * sizeof(uint32_t));
+    return S_OK;
+}
+
+int
+MeshOptimizeVertexFetch(XyzUv* vtx_r, size_t numVtx, uint32_t* idx_r, size_t numIdx)
+{
+    int hr = CheckIndices("MeshOptimizeVertexFetch", idx_r, numIdx, numVtx);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    const uint32_t UNUSED = UINT32_MAX;
+    std::vector<uint32_t> remap(numVtx, UNUSED);
+    uint32_t n = 0;
+    for (size_t i = 0; i < numIdx; ++i) {
+        uint32_t& r = remap[idx_r[i]];
+        if (r == UNUSED) {
+            r = n++;
+        }
+        idx_r[i] = r;
+    }
+    for (size_t v = 0; v < numVtx; ++v) {
+        if (remap[v] == UNUSED) {
+            remap[v] = n++;
+        }
+    }
+
+    std::vector<XyzUv> tmp(vtx_r, vtx_r + numVtx);
+    for (size_t v = 0; v < numVtx; ++v) {
+        vtx_r[remap[v]] = tmp[v];
+    }
+    return S_OK;
+}
+
+int
+MeshOptimize(TexturedMesh& tm_r, int cacheSize)
+{
+    int hr = MeshOptimizeTriangleOrder(tm_r.triangleIdxList.data(), tm_r.triangleIdxList.size(),
+            tm_r.vertexList.size(), cacheSize);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    return MeshOptimizeVertexFetch(tm_r.vertexList.data(), tm_r.vertexList.size(),
+            tm_r.triangleIdxList.data(), tm_r.triangleIdxList.size());
+}
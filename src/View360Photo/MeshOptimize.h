@@ -0,0 +1,34 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "TexturedMesh.h"
+#include <stdint.h>
+
+/// 三角形の並べ替えで想定する頂点キャッシュのエントリー数。
+static const int MESH_OPTIMIZE_CACHE_SIZE = 16;
+
+/// 頂点キャッシュの模擬の結果。
+struct MeshCacheStats {
+    /// 三角形1個あたりのキャッシュミス数 (Average Cache Miss Ratio)。0.5～3。
+    double acmr = 0;
+
+    /// 使われている頂点1個あたりのキャッシュミス数 (Average Transform to Vertex Ratio)。1以上。
+    double atvr = 0;
+
+    size_t misses = 0;
+};
+
+/// FIFOの頂点キャッシュ(エントリー数cacheSize)を模擬して、idxの順に描画したときのミス数を数える。
+MeshCacheStats MeshSimulateVertexCache(const uint32_t* idx, size_t numIdx, size_t numVtx, int cacheSize);
+
+/// 三角形の順番を変えて、頂点キャッシュのヒット率を上げる。Tipsify (Sander, Nehab, Barczak 2007)。
+/// idx_rを書き換える。三角形の頂点の順番(表裏)は変えない。
+int MeshOptimizeTriangleOrder(uint32_t* idx_r, size_t numIdx, size_t numVtx, int cacheSize = MESH_OPTIMIZE_CACHE_SIZE);
+
+/// 頂点を、頂点番号で最初に参照される順に並べ替え、頂点番号を付け直す。
+/// どの三角形からも使われていない頂点は最後に元の順番で置く。
+int MeshOptimizeVertexFetch(XyzUv* vtx_r, size_t numVtx, uint32_t* idx_r, size_t numIdx);
+
+/// MeshOptimizeTriangleOrder()とMeshOptimizeVertexFetch()をtm_rのvertexList, triangleIdxListに行う。
+int MeshOptimize(TexturedMesh& tm_r, int cacheSize = MESH_OPTIMIZE_CACHE_SIZE);
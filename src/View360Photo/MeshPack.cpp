@@ -0,0 +1,335 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "MeshPack.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/// 単位球面上とみなす位置の長さの許容誤差。
+static const double UNIT_LENGTH_TOLERANCE = 1e-4;
+
+const char*
+MeshVertexFormatName(MeshVertexFormat fmt)
+{
+    switch (fmt) {
+    case MVF_Float32:      return "float32";
+    case MVF_Snorm16:      return "snorm16";
+    case MVF_Octahedral16: return "octahedral16";
+    default:               return "unknown";
+    }
+}
+
+uint32_t
+MeshVertexFormatStride(MeshVertexFormat fmt)
+{
+    switch (fmt) {
+    case MVF_Float32:      return 20;
+    case MVF_Snorm16:      return 12;
+    case MVF_Octahedral16: return 8;
+    default:
+        assert(0);
+        return 0;
+    }
+}
+
+double
+MeshPackPosErrorBound(MeshVertexFormat fmt)
+{
+    switch (fmt) {
+    case MVF_Float32:
+        return 0;
+    case MVF_Snorm16:
+        // 各成分の丸め誤差が最大0.5/32767。
+        return sqrt(3.0) * 0.5 / 32767.0;
+    case MVF_Octahedral16:
+        // 八面体の面上の1格子分の距離は、球面上では最大で約2倍に伸びる。
+        return 2.0 * sqrt(2.0) / 32767.0;
+    default:
+        assert(0);
+        return 0;
+    }
+}
+
+double
+MeshPackUvErrorBound(MeshVertexFormat fmt)
+{
+    // floatのUV値は0～1の範囲外の値を含まないとき誤差0.5/65535以内。
+    // GenerateSpherePly由来の-1e-8程度のはみ出しは0に丸める。
+    return (fmt == MVF_Float32) ? 0 : 0.5 / 65535.0 + 1e-7;
+}
+
+static inline int16_t
+EncodeSnorm16(double v)
+{
+    if (v < -1.0) {
+        v = -1.0;
+    }
+    if (1.0 < v) {
+        v = 1.0;
+    }
+    return (int16_t)lround(v * 32767.0);
+}
+
+/// D3DのSNORMの復元と同じ。-32768は-1になる。
+static inline float
+DecodeSnorm16(int16_t v)
+{
+    float f = v / 32767.0f;
+    return (f < -1.0f) ? -1.0f : f;
+}
+
+/// UNORM16で表せる値か。丸めて0～65535になる、0～1の外側に半ステップまでの値を含む。NaNは含まない。
+static inline bool
+IsUnorm16(double v)
+{
+    const double s = v * 65535.0;
+    return -0.5 < s && s < 65535.5;
+}
+
+/// vはIsUnorm16()であること。
+static inline uint16_t
+EncodeUnorm16(double v)
+{
+    if (v < 0) {
+        v = 0;
+    }
+    if (1.0 < v) {
+        v = 1.0;
+    }
+    return (uint16_t)lround(v * 65535.0);
+}
+
+static inline float
+DecodeUnorm16(uint16_t v)
+{
+    return v / 65535.0f;
+}
+
+/// 八面体符号化の復元。y軸を八面体の上下に取る。シェーダーのOctDecode()と同じ計算。
+static void
+OctDecode(float ex, float ez, float* v_r)
+{
+    float x = ex;
+    float z = ez;
+    float y = 1.0f - fabsf(ex) - fabsf(ez);
+    const float t = (-y < 0) ? 0 : -y;
+    x += (0 <= x) ? -t : t;
+    z += (0 <= z) ? -t : t;
+
+    const float len = sqrtf(x * x + y * y + z * z);
+    v_r[0] = x / len;
+    v_r[1] = y / len;
+    v_r[2] = z / len;
+}
+
+/// 八面体符号化。丸め方向の4通りのうち、復元した方向の誤差が最小のものを選ぶ。
+static void
+OctEncode(const XrVector3f& p, int16_t* e_r)
+{
+    const double x = p.x;
+    const double y = p.y;
+    const double z = p.z;
+    const double l1 = fabs(x) + fabs(y) + fabs(z);
+    double ex = x / l1;
+    double ez = z / l1;
+    if (y < 0) {
+        const double fx = (1.0 - fabs(ez)) * ((0 <= ex) ? 1.0 : -1.0);
+        const double fz = (1.0 - fabs(ex)) * ((0 <= ez) ? 1.0 : -1.0);
+        ex = fx;
+        ez = fz;
+    }
+
+    const double len = sqrt(x * x + y * y + z * z);
+    double bestErr = 1e30;
+    for (int i = 0; i < 4; ++i) {
+        const double cx = (i & 1) ? ceil(ex * 32767.0) : floor(ex * 32767.0);
+        const double cz = (i & 2) ? ceil(ez * 32767.0) : floor(ez * 32767.0);
+        const int16_t qx = (int16_t)((cx < -32767.0) ? -32767.0 : ((32767.0 < cx) ? 32767.0 : cx));
+        const int16_t qz = (int16_t)((cz < -32767.0) ? -32767.0 : ((32767.0 < cz) ? 32767.0 : cz));
+
+        float d[3];
+        OctDecode(DecodeSnorm16(qx), DecodeSnorm16(qz), d);
+        const double err = fabs(d[0] - x / len) + fabs(d[1] - y / len) + fabs(d[2] - z / len);
+        if (err < bestErr) {
+            bestErr = err;
+            e_r[0] = qx;
+            e_r[1] = qz;
+        }
+    }
+}
+
+int
+MeshPack(const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx,
+        MeshVertexFormat fmt, PackedMesh& pm_r)
+{
+    if (MVF_NUM <= (unsigned)fmt) {
+        printf("E: MeshPack() unknown vertex format %d\n", (int)fmt);
+        return E_FAIL;
+    }
+    if (UINT32_MAX < numVtx) {
+        printf("E: MeshPack() too many vertices\n");
+        return E_FAIL;
+    }
+
+    // 量子化できる範囲の位置とUVか調べる。
+    for (size_t i = 0; i < numVtx && fmt != MVF_Float32; ++i) {
+        const XrVector3f& p = vtx[i].xyz;
+        if (!IsUnorm16(vtx[i].uv.x) || !IsUnorm16(vtx[i].uv.y)) {
+            printf("E: MeshPack() vertex %zu uv is out of [0, 1]\n", i);
+            return E_FAIL;
+        }
+        if (fmt == MVF_Snorm16) {
+            if (1.0f < fabsf(p.x) || 1.0f < fabsf(p.y) || 1.0f < fabsf(p.z)) {
+                printf("E: MeshPack() vertex %zu is out of [-1, 1]\n", i);
+                return E_FAIL;
+            }
+        } else {
+            const double len = sqrt((double)p.x * p.x + (double)p.y * p.y + (double)p.z * p.z);
+            if (UNIT_LENGTH_TOLERANCE < fabs(len - 1.0)) {
+                printf("E: MeshPack() vertex %zu is not on the unit sphere\n", i);
+                return E_FAIL;
+            }
+        }
+    }
+
+    pm_r.vtxFormat = fmt;
+    pm_r.vtxStride = MeshVertexFormatStride(fmt);
+    pm_r.numVertices = numVtx;
+    pm_r.vtx.resize(numVtx * pm_r.vtxStride);
+
+    uint8_t* to = pm_r.vtx.data();
+    for (size_t i = 0; i < numVtx; ++i) {
+        const XyzUv& v = vtx[i];
+        switch (fmt) {
+        case MVF_Float32:
+            memcpy(to, &v, sizeof v);
+            break;
+        case MVF_Snorm16:
+            {
+                const int16_t p[4] = { EncodeSnorm16(v.xyz.x), EncodeSnorm16(v.xyz.y), EncodeSnorm16(v.xyz.z), 0 };
+                const uint16_t uv[2] = { EncodeUnorm16(v.uv.x), EncodeUnorm16(v.uv.y) };
+                memcpy(to, p, sizeof p);
+                memcpy(to + sizeof p, uv, sizeof uv);
+            }
+            break;
+        case MVF_Octahedral16:
+            {
+                int16_t e[2];
+                OctEncode(v.xyz, e);
+                const uint16_t uv[2] = { EncodeUnorm16(v.uv.x), EncodeUnorm16(v.uv.y) };
+                memcpy(to, e, sizeof e);
+                memcpy(to + sizeof e, uv, sizeof uv);
+            }
+            break;
+        default:
+            assert(0);
+            break;
+        }
+        to += pm_r.vtxStride;
+    }
+
+    // 頂点番号はどちらの幅でも確かめる。
+    for (size_t i = 0; i < numIdx; ++i) {
+        if (numVtx <= idx[i]) {
+            printf("E: MeshPack() index %zu out of range\n", i);
+            return E_FAIL;
+        }
+    }
+
+    // 頂点が65535個以下なら16ビットの頂点番号にする。
+    pm_r.idxBytes = (numVtx <= 65535) ? 2 : 4;
+    pm_r.numIndices = numIdx;
+    pm_r.idx.resize(numIdx * pm_r.idxBytes);
+    if (pm_r.idxBytes == 2) {
+        uint16_t* idx16 = (uint16_t*)pm_r.idx.data();
+        for (size_t i = 0; i < numIdx; ++i) {
+            idx16[i] = (uint16_t)idx[i];
+        }
+    } else {
+        memcpy(pm_r.idx.data(), idx, numIdx * sizeof(uint32_t));
+    }
+
+    return S_OK;
+}
+
+XyzUv
+MeshUnpackVertex(const PackedMesh& pm, size_t i)
+{
+    const uint8_t* from = pm.vtx.data() + i * pm.vtxStride;
+    XyzUv v;
+
+    switch (pm.vtxFormat) {
+    case MVF_Float32:
+        memcpy(&v, from, sizeof v);
+        break;
+    case MVF_Snorm16:
+        {
+            int16_t p[4];
+            uint16_t uv[2];
+            memcpy(p, from, sizeof p);
+            memcpy(uv, from + sizeof p, sizeof uv);
+            v.xyz = { DecodeSnorm16(p[0]), DecodeSnorm16(p[1]), DecodeSnorm16(p[2]) };
+            v.uv = { DecodeUnorm16(uv[0]), DecodeUnorm16(uv[1]) };
+        }
+        break;
+    case MVF_Octahedral16:
+        {
+            int16_t e[2];
+            uint16_t uv[2];
+            memcpy(e, from, sizeof e);
+            memcpy(uv, from + sizeof e, sizeof uv);
+            float d[3];
+            OctDecode(DecodeSnorm16(e[0]), DecodeSnorm16(e[1]), d);
+            v.xyz = { d[0], d[1], d[2] };
+            v.uv = { DecodeUnorm16(uv[0]), DecodeUnorm16(uv[1]) };
+        }
+        break;
+    default:
+        assert(0);
+        memset(&v, 0, sizeof v);
+        break;
+    }
+    return v;
+}
+
+uint32_t
+MeshUnpackIndex(const PackedMesh& pm, size_t i)
+{
+    if (pm.idxBytes == 2) {
+        return ((const uint16_t*)pm.idx.data())[i];
+    }
+    return ((const uint32_t*)pm.idx.data())[i];
+}
+
+MeshPackError
+MeshPackRoundTripError(const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx,
+        const PackedMesh& pm)
+{
+    MeshPackError e;
+    if (pm.numVertices != numVtx || pm.numIndices != numIdx) {
+        e.maxPos = 1e30;
+        e.maxUv = 1e30;
+        return e;
+    }
+
+    for (size_t i = 0; i < numVtx; ++i) {
+        const XyzUv a = vtx[i];
+        const XyzUv b = MeshUnpackVertex(pm, i);
+        const double dx = (double)a.xyz.x - b.xyz.x;
+        const double dy = (double)a.xyz.y - b.xyz.y;
+        const double dz = (double)a.xyz.z - b.xyz.z;
+        e.maxPos = std::max(e.maxPos, sqrt(dx * dx + dy * dy + dz * dz));
+
+        e.maxUv = std::max(e.maxUv, std::max(fabs((double)a.uv.x - b.uv.x), fabs((double)a.uv.y - b.uv.y)));
+    }
+
+    e.indicesEqual = true;
+    for (size_t i = 0; i < numIdx; ++i) {
+        if (idx[i] != MeshUnpackIndex(pm, i)) {
+            e.indicesEqual = false;
+            break;
+        }
+    }
+    return e;
+}
@@ -0,0 +1,60 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "XyzUv.h"
+#include <stdint.h>
+
+/// GPUに送る頂点の形式。
+enum MeshVertexFormat {
+    /// XyzUvそのまま。R32G32B32_FLOAT + R32G32_FLOAT。20バイト。
+    MVF_Float32,
+
+    /// 位置 R16G16B16A16_SNORM (wは0) + UV R16G16_UNORM。12バイト。
+    /// 位置の各成分は-1～1、UVの各成分は0～1であること。
+    MVF_Snorm16,
+
+    /// 位置を八面体符号化した方向 R16G16_SNORM + UV R16G16_UNORM。8バイト。
+    /// 位置は単位球面上に、UVの各成分は0～1にあること。
+    MVF_Octahedral16,
+
+    MVF_NUM,
+};
+
+const char* MeshVertexFormatName(MeshVertexFormat fmt);
+uint32_t MeshVertexFormatStride(MeshVertexFormat fmt);
+
+/// 往復変換(MeshPack→MeshUnpackVertex)の誤差の上限。
+/// 位置は単位球に対するユークリッド距離、UVは各成分の差。
+double MeshPackPosErrorBound(MeshVertexFormat fmt);
+double MeshPackUvErrorBound(MeshVertexFormat fmt);
+
+/// GPUに送る形に詰めたメッシュ。
+struct PackedMesh {
+    MeshVertexFormat vtxFormat = MVF_Float32;
+    uint32_t vtxStride = 0;
+    size_t numVertices = 0;
+    std::vector<uint8_t> vtx;
+
+    /// 頂点番号1個のバイト数。頂点数が65535以下のとき2、それ以外は4。
+    uint32_t idxBytes = 0;
+    size_t numIndices = 0;
+    std::vector<uint8_t> idx;
+};
+
+int MeshPack(const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx,
+        MeshVertexFormat fmt, PackedMesh& pm_r);
+
+/// 詰めた頂点を元の形に戻す。GPUの頂点フェッチとシェーダーでの復元と同じ計算をする。
+XyzUv MeshUnpackVertex(const PackedMesh& pm, size_t i);
+uint32_t MeshUnpackIndex(const PackedMesh& pm, size_t i);
+
+struct MeshPackError {
+    double maxPos = 0;
+    double maxUv = 0;
+    bool indicesEqual = false;
+};
+
+/// pmを元のメッシュと比べる。
+MeshPackError MeshPackRoundTripError(const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx,
+        const PackedMesh& pm);
@@ -0,0 +1,372 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "MeshWeld.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#  include <xmmintrin.h>
+#  define MESH_WELD_PREFETCH 1
+#endif
+
+/// 頂点を比べる成分の数。x, y, z, u, v。
+static const int NUM_COMPONENTS = 5;
+
+/// 空間ハッシュの格子の幅とepsilonの比。大きいほど、調べる格子が1個で済む頂点が増える。
+static const double CELL_PER_EPSILON = 64.0;
+
+/// ハッシュ表を何個先の頂点、三角形の分まで先読みするか。
+/// ハッシュ表の参照はほぼ毎回キャッシュミスになるので、メモリーの待ち時間を重ねて隠す。
+static const size_t PREFETCH_DISTANCE = 16;
+
+static const uint32_t NONE = UINT32_MAX;
+
+static inline void
+Prefetch(const void* p)
+{
+#ifdef MESH_WELD_PREFETCH
+    _mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+static inline void
+Components(const XyzUv& v, double* c_r)
+{
+    c_r[0] = v.xyz.x;
+    c_r[1] = v.xyz.y;
+    c_r[2] = v.xyz.z;
+    c_r[3] = v.uv.x;
+    c_r[4] = v.uv.y;
+}
+
+static inline uint64_t
+Mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/// 2のべき乗で、n * 2以上の数。
+static size_t
+TableCapacity(size_t n)
+{
+    size_t cap = 16;
+    while (cap < n * 2) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+/// 頂点の成分を空間ハッシュの格子の番号にする。epsilonが0のときは値そのもので比べる。
+struct WeldGrid {
+    double epsilon = 0;
+    double invCell = 0;
+
+    explicit WeldGrid(double eps) : epsilon(eps) {
+        if (0 < eps) {
+            invCell = 1.0 / (eps * CELL_PER_EPSILON);
+        }
+    }
+
+    int64_t Cell(double c) const {
+        if (0 < epsilon) {
+            return (int64_t)floor(c * invCell);
+        }
+        // -0と+0は同じ格子にする。
+        float f = (float)c + 0.0f;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof bits);
+        return bits;
+    }
+
+    bool Near(const double* a, const double* b) const {
+        for (int i = 0; i < NUM_COMPONENTS; ++i) {
+            if (epsilon < fabs(a[i] - b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static inline uint64_t
+HashCell(const int64_t* cell)
+{
+    uint64_t h = 0;
+    for (int i = 0; i < NUM_COMPONENTS; ++i) {
+        h = Mix64(h ^ (uint64_t)cell[i]) + i;
+    }
+    return h;
+}
+
+/// 頂点をまとめる。remap_rに元の頂点から代表頂点の番号、reps_rに代表頂点の元の頂点番号を入れる。
+static void
+WeldVertices(const std::vector<XyzUv>& vtx, const WeldGrid& grid,
+        std::vector<uint32_t>& remap_r, std::vector<uint32_t>& reps_r)
+{
+    const size_t numVtx = vtx.size();
+    remap_r.resize(numVtx);
+    reps_r.clear();
+    reps_r.reserve(numVtx);
+
+    // 格子のハッシュ値ごとに、代表頂点を鎖でつなぐ。slotsはハッシュ値と先頭の代表頂点。
+    // ハッシュ値が衝突した格子の鎖は混ざるが、鎖の頂点は全部Near()で比べるので結果は変わらない。
+    struct Slot {
+        uint64_t hash;
+        uint32_t rep;
+    };
+    const size_t cap = TableCapacity(numVtx);
+    const size_t mask = cap - 1;
+    std::vector<Slot> slots(cap, Slot{ 0, NONE });
+    std::vector<uint32_t> repNext;
+    repNext.reserve(numVtx);
+
+    auto findSlot = [&](const int64_t* cell) {
+        const uint64_t h = HashCell(cell);
+        size_t s = (size_t)h & mask;
+        while (slots[s].rep != NONE && slots[s].hash != h) {
+            s = (s + 1) & mask;
+        }
+        slots[s].hash = h;
+        return s;
+    };
+
+    for (size_t v = 0; v < numVtx; ++v) {
+        if (v + PREFETCH_DISTANCE < numVtx) {
+            // 先の頂点が最初に調べる格子の表の位置。
+            double c[NUM_COMPONENTS];
+            int64_t lo[NUM_COMPONENTS];
+            Components(vtx[v + PREFETCH_DISTANCE], c);
+            for (int i = 0; i < NUM_COMPONENTS; ++i) {
+                lo[i] = grid.Cell(c[i] - grid.epsilon);
+            }
+            Prefetch(&slots[(size_t)HashCell(lo) & mask]);
+        }
+
+        double c[NUM_COMPONENTS];
+        Components(vtx[v], c);
+
+        // c ± epsilonが掛かる格子を全部調べる。たいていは1個。
+        int64_t lo[NUM_COMPONENTS];
+        int64_t hi[NUM_COMPONENTS];
+        for (int i = 0; i < NUM_COMPONENTS; ++i) {
+            lo[i] = grid.Cell(c[i] - grid.epsilon);
+            hi[i] = grid.Cell(c[i] + grid.epsilon);
+        }
+
+        uint32_t found = NONE;
+        for (int bits = 0; bits < (1 << NUM_COMPONENTS) && found == NONE; ++bits) {
+            int64_t cell[NUM_COMPONENTS];
+            bool skip = false;
+            for (int i = 0; i < NUM_COMPONENTS; ++i) {
+                const bool upper = 0 != (bits & (1 << i));
+                if (upper && lo[i] == hi[i]) {
+                    skip = true;
+                    break;
+                }
+                cell[i] = upper ? hi[i] : lo[i];
+            }
+            if (skip) {
+                continue;
+            }
+
+            for (uint32_t r = slots[findSlot(cell)].rep; r != NONE; r = repNext[r]) {
+                double rc[NUM_COMPONENTS];
+                Components(vtx[reps_r[r]], rc);
+                if (grid.Near(c, rc)) {
+                    found = r;
+                    break;
+                }
+            }
+        }
+
+        if (found != NONE) {
+            remap_r[v] = found;
+            continue;
+        }
+
+        // 新しい代表頂点。
+        const uint32_t r = (uint32_t)reps_r.size();
+        reps_r.push_back((uint32_t)v);
+        repNext.push_back(NONE);
+        int64_t cell[NUM_COMPONENTS];
+        for (int i = 0; i < NUM_COMPONENTS; ++i) {
+            cell[i] = grid.Cell(c[i]);
+        }
+        const size_t s = findSlot(cell);
+        if (slots[s].rep == NONE) {
+            slots[s].rep = r;
+        } else {
+            repNext[r] = repNext[slots[s].rep];
+            repNext[slots[s].rep] = r;
+        }
+        remap_r[v] = r;
+    }
+}
+
+/// 位置で見て面積が0の三角形か。高さがepsilon以下なら0とみなす。
+static bool
+IsDegenerate(const XyzUv& a, const XyzUv& b, const XyzUv& c, double epsilon)
+{
+    const double e0[3] = { (double)b.xyz.x - a.xyz.x, (double)b.xyz.y - a.xyz.y, (double)b.xyz.z - a.xyz.z };
+    const double e1[3] = { (double)c.xyz.x - a.xyz.x, (double)c.xyz.y - a.xyz.y, (double)c.xyz.z - a.xyz.z };
+    const double e2[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+    const double n[3] = {
+        e0[1] * e1[2] - e0[2] * e1[1],
+        e0[2] * e1[0] - e0[0] * e1[2],
+        e0[0] * e1[1] - e0[1] * e1[0] };
+
+    const double area2 = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    const double maxEdge = sqrt(std::max({
+        e0[0] * e0[0] + e0[1] * e0[1] + e0[2] * e0[2],
+        e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2],
+        e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2] }));
+
+    // 面積の2倍 = 最長辺 × 高さ。
+    return area2 <= epsilon * maxEdge;
+}
+
+/// 三角形の向きを変えずに、最小の頂点番号が先頭になるように回す。重複を調べるときのキー。
+static inline void
+CanonicalTriangle(const uint32_t* t, uint32_t* key_r)
+{
+    int first = 0;
+    if (t[1] < t[first]) {
+        first = 1;
+    }
+    if (t[2] < t[first]) {
+        first = 2;
+    }
+    for (int i = 0; i < 3; ++i) {
+        key_r[i] = t[(first + i) % 3];
+    }
+}
+
+/// 三角形の重複を調べる表の、最初に調べる位置。
+static inline size_t
+TriSlotIndex(const uint32_t* t, size_t mask)
+{
+    uint32_t key[3];
+    CanonicalTriangle(t, key);
+    return (size_t)Mix64(((uint64_t)key[0] << 32 | key[1]) ^ Mix64(key[2])) & mask;
+}
+
+int
+MeshWeld(TexturedMesh& tm_r, const MeshWeldParams& p, MeshWeldStats* stats_r)
+{
+    std::vector<XyzUv>& vtx = tm_r.vertexList;
+    std::vector<uint32_t>& idx = tm_r.triangleIdxList;
+    const size_t numVtx = vtx.size();
+    const size_t numTri = idx.size() / 3;
+
+    if (idx.size() % 3 != 0 || !(0 <= p.epsilon)) {
+        printf("E: MeshWeld() invalid parameter\n");
+        return E_FAIL;
+    }
+    if (UINT32_MAX <= numVtx || UINT32_MAX <= idx.size()) {
+        printf("E: MeshWeld() too many vertices or indices\n");
+        return E_FAIL;
+    }
+    for (size_t i = 0; i < idx.size(); ++i) {
+        if (numVtx <= idx[i]) {
+            printf("E: MeshWeld() index %zu out of range\n", i);
+            return E_FAIL;
+        }
+    }
+
+    MeshWeldStats st;
+    st.vtxBefore = numVtx;
+    st.triBefore = numTri;
+
+    const WeldGrid grid(p.epsilon);
+    std::vector<uint32_t> remap;
+    std::vector<uint32_t> reps;
+    WeldVertices(vtx, grid, remap, reps);
+
+    // 三角形の頂点番号を代表頂点の番号にし、消す三角形を除く。
+    // 重複を調べる表。向きを変えずに回して最小の頂点番号を先頭にした3個の番号をキーにする。
+    struct TriSlot {
+        uint32_t key[3];
+    };
+    const size_t cap = TableCapacity(numTri);
+    const size_t mask = cap - 1;
+    std::vector<TriSlot> triSlots(p.removeDuplicate ? cap : 0, TriSlot{ { NONE, NONE, NONE } });
+    size_t nOut = 0;
+
+    for (size_t t = 0; t < numTri; ++t) {
+        const uint32_t a = remap[idx[3 * t + 0]];
+        const uint32_t b = remap[idx[3 * t + 1]];
+        const uint32_t c = remap[idx[3 * t + 2]];
+
+        if (p.removeDegenerate
+                && (a == b || b == c || c == a
+                    || IsDegenerate(vtx[reps[a]], vtx[reps[b]], vtx[reps[c]], p.epsilon))) {
+            ++st.degenerate;
+            continue;
+        }
+
+        idx[3 * nOut + 0] = a;
+        idx[3 * nOut + 1] = b;
+        idx[3 * nOut + 2] = c;
+
+        if (p.removeDuplicate) {
+            if (t + PREFETCH_DISTANCE < numTri) {
+                const uint32_t* f = &idx[3 * (t + PREFETCH_DISTANCE)];
+                const uint32_t ft[3] = { remap[f[0]], remap[f[1]], remap[f[2]] };
+                Prefetch(&triSlots[TriSlotIndex(ft, mask)]);
+            }
+
+            uint32_t key[3];
+            CanonicalTriangle(&idx[3 * nOut], key);
+            size_t s = TriSlotIndex(&idx[3 * nOut], mask);
+            bool dup = false;
+            while (triSlots[s].key[0] != NONE) {
+                if (0 == memcmp(key, triSlots[s].key, sizeof key)) {
+                    dup = true;
+                    break;
+                }
+                s = (s + 1) & mask;
+            }
+            if (dup) {
+                ++st.duplicate;
+                continue;
+            }
+            memcpy(triSlots[s].key, key, sizeof key);
+        }
+        ++nOut;
+    }
+    idx.resize(3 * nOut);
+
+    // 残った三角形が使う代表頂点だけを、元の順番で詰める。
+    std::vector<uint32_t> newIdx(reps.size(), NONE);
+    for (uint32_t i : idx) {
+        newIdx[i] = 0;
+    }
+    std::vector<XyzUv> out;
+    out.reserve(reps.size());
+    for (size_t r = 0; r < reps.size(); ++r) {
+        if (newIdx[r] != NONE) {
+            newIdx[r] = (uint32_t)out.size();
+            out.push_back(vtx[reps[r]]);
+        }
+    }
+    for (uint32_t& i : idx) {
+        i = newIdx[i];
+    }
+    vtx.swap(out);
+
+    st.vtxAfter = vtx.size();
+    st.triAfter = nOut;
+    if (stats_r) {
+        *stats_r = st;
+    }
+    return S_OK;
+}
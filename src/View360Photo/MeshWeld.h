@@ -0,0 +1,30 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "TexturedMesh.h"
+
+struct MeshWeldParams {
+    /// 位置とUVの各成分の差がすべてepsilon以下の頂点を1個にまとめる。0のときは値が等しい頂点だけ。
+    /// GenerateSpherePlyのVertex.IsSimilarTo()はdoubleで差の和 < 1e-8。floatのPLYでは1e-6程度にする。
+    double epsilon = 1e-6;
+
+    /// 位置で見て面積が0の三角形を消す。UV球の極の三角形など。
+    bool removeDegenerate = true;
+
+    /// 頂点番号が同じで向きも同じ三角形を1個にする。
+    bool removeDuplicate = true;
+};
+
+struct MeshWeldStats {
+    size_t vtxBefore = 0;
+    size_t vtxAfter = 0;
+    size_t triBefore = 0;
+    size_t triAfter = 0;
+    size_t degenerate = 0;
+    size_t duplicate = 0;
+};
+
+/// 空間ハッシュで近い頂点をまとめ、面積0の三角形と重複した三角形を消し、使われない頂点を詰める。
+/// 頂点の数に対してほぼ線形時間。残った頂点と三角形は元の順番を保つ。
+int MeshWeld(TexturedMesh& tm_r, const MeshWeldParams& p = MeshWeldParams(), MeshWeldStats* stats_r = nullptr);
@@ -0,0 +1,551 @@
+﻿// 日本語。
+
+#include "MipBuilder.h"
+#include "ParallelFor.h"
+#include "PixelConvert.h"
+#include <stdio.h>
+#include <math.h>
+
+#ifndef MIP_BUILDER_SSE2
+#  if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#    define MIP_BUILDER_SSE2 1
+#  else
+#    define MIP_BUILDER_SSE2 0
+#  endif
+#endif
+#if MIP_BUILDER_SSE2
+#  include <emmintrin.h>
+#endif
+
+/// 並列に作る単位の、出力の行数。
+static const int BAND_ROWS = 64;
+
+static const double PI = 3.14159265358979323846;
+
+const char*
+MipFilterToStr(MipFilter f)
+{
+    switch (f) {
+    case MF_Box:      return "Box";
+    case MF_Kaiser:   return "Kaiser";
+    case MF_Lanczos3: return "Lanczos3";
+    default:          return "Unknown";
+    }
+}
+
+static double
+Sinc(double x)
+{
+    if (fabs(x) < 1e-9) {
+        return 1.0;
+    }
+    return sin(PI * x) / (PI * x);
+}
+
+/// 第1種変形ベッセル関数I0。
+static double
+BesselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        const double h = x / (2.0 * k);
+        term *= h * h;
+        sum += term;
+    }
+    return sum;
+}
+
+/// フィルターの半径。縮小後の画素単位。
+static double
+FilterRadius(MipFilter f)
+{
+    return (f == MF_Box) ? 0.5 : 3.0;
+}
+
+/// 縮小後の画素単位の距離tでの重み。MF_Boxは使わない。
+static double
+FilterWeight(MipFilter f, double t)
+{
+    const double R = 3.0;
+    t = fabs(t);
+    if (R <= t) {
+        return 0.0;
+    }
+    switch (f) {
+    case MF_Kaiser:
+        {
+            const double ALPHA = 4.0;
+            const double u = t / R;
+            return Sinc(t) * BesselI0(ALPHA * sqrt(1.0 - u * u)) / BesselI0(ALPHA);
+        }
+    case MF_Lanczos3:
+        return Sinc(t) * Sinc(t / R);
+    default:
+        return 0.0;
+    }
+}
+
+/// 1次元の縮小の重み。出力の画素xは、入力のfirst[x] ～ first[x] + numTaps - 1をweights[x * numTaps + k]で足す。
+/// firstは入力の範囲外になることがある。重みの和は1。
+struct MipTaps {
+    int numTaps = 0;
+    std::vector<int> first;
+    std::vector<float> weights;
+};
+
+/// 出力の画素数dstNあたりの入力の画素数srcNの縮小で、1個の出力の画素が読む入力の画素の数。
+static int
+NumTaps(MipFilter f, int srcN, int dstN)
+{
+    return (int)ceil(2.0 * FilterRadius(f) * ((double)srcN / dstN)) + 1;
+}
+
+/// 出力の画素xが読む最初の入力の画素。範囲外になることがある。
+static int
+FirstTap(MipFilter f, int srcN, int dstN, int x)
+{
+    const double ratio = (double)srcN / dstN;
+    return (int)floor((x + 0.5) * ratio - FilterRadius(f) * ratio);
+}
+
+static void
+MakeTaps(MipFilter f, int srcN, int dstN, MipTaps& taps_r)
+{
+    const double ratio = (double)srcN / dstN;
+    const double support = FilterRadius(f) * ratio;
+
+    taps_r.numTaps = NumTaps(f, srcN, dstN);
+    taps_r.first.resize(dstN);
+    taps_r.weights.assign((size_t)dstN * taps_r.numTaps, 0.0f);
+
+    std::vector<double> w(taps_r.numTaps);
+    for (int x = 0; x < dstN; ++x) {
+        // 入力の画素sは[s, s + 1)を覆う。出力の画素xの中心は入力の(x + 0.5) * ratio。
+        const double center = (x + 0.5) * ratio;
+        const int first = FirstTap(f, srcN, dstN, x);
+        double sum = 0;
+        for (int k = 0; k < taps_r.numTaps; ++k) {
+            const double s = first + k;
+            if (f == MF_Box) {
+                const double lo = std::max(s, center - support);
+                const double hi = std::min(s + 1.0, center + support);
+                w[k] = std::max(0.0, hi - lo);
+            } else {
+                w[k] = FilterWeight(f, (s + 0.5 - center) / ratio);
+            }
+            sum += w[k];
+        }
+        taps_r.first[x] = first;
+        for (int k = 0; k < taps_r.numTaps; ++k) {
+            taps_r.weights[(size_t)x * taps_r.numTaps + k] = (float)(w[k] / sum);
+        }
+    }
+}
+
+/// sRGBの8ビットから、リニアの0～1。
+struct SrgbToLinearTable {
+    float v[256];
+
+    SrgbToLinearTable(void)
+    {
+        for (int i = 0; i < 256; ++i) {
+            const double s = i / 255.0;
+            v[i] = (float)((s <= 0.04045) ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4));
+        }
+    }
+};
+
+/// 0～1のfloatを、丸めて16ビットUNORMにする。範囲外は0か1にする。
+static void
+FloatToU16(const float* src, uint16_t* dst, int n)
+{
+    int i = 0;
+#if MIP_BUILDER_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(65535.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16(-0x8000);
+    for (; i + 8 <= n; i += 8) {
+        const __m128 a = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one), scale), half);
+        const __m128 b = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), one), scale), half);
+        // 符号付きでpackするため32768を引き、後で最上位ビットを戻す。
+        const __m128i ai = _mm_sub_epi32(_mm_cvttps_epi32(a), bias);
+        const __m128i bi = _mm_sub_epi32(_mm_cvttps_epi32(b), bias);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(ai, bi), flip));
+    }
+#endif
+    for (; i < n; ++i) {
+        const float v = std::min(std::max(src[i], 0.0f), 1.0f) * 65535.0f + 0.5f;
+        dst[i] = (uint16_t)(int)v;
+    }
+}
+
+/// 1段分の縮小。srcsは横に並べた前の段、dstsは各画像の次の段。
+struct MipLevelJob {
+    int numSrcs;
+    std::vector<const uint8_t*> srcPixels;
+    std::vector<int> srcStride;
+    std::vector<int> srcW;
+    std::vector<int> dstW;
+    std::vector<uint8_t*> dstPixels;
+    std::vector<int> dstStride;
+    int srcH;
+    int dstH;
+
+    /// srcPixelsの先頭の行と、dstPixelsの先頭の行。画像の一部の行だけを置くときに0以外にする。
+    int srcY0 = 0;
+    int dstY0 = 0;
+
+    /// 横に並べた前の段の幅と、各画像の左端の位置。
+    int totalW;
+    std::vector<int> srcX;
+
+    /// 各画像の横の重み。hCols[i][x * numTaps + k]は、横に並べた前の段の列の番号。
+    std::vector<MipTaps> hTaps;
+    std::vector<std::vector<int>> hCols;
+    MipTaps vTaps;
+};
+
+static int
+WrapOrClamp(int x, int n, bool wrap)
+{
+    if (wrap) {
+        x %= n;
+        return (x < 0) ? x + n : x;
+    }
+    return std::min(std::max(x, 0), n - 1);
+}
+
+/// 前の段の行ysを、横に並べてリニアのfloatにしてから、各画像の横の縮小をhRows[i]のys % numTaps番目の行に置く。
+static void
+MipLevelRowH(const MipLevelJob& job, const SrgbToLinearTable& lut, int ys, std::vector<float>& lin,
+        std::vector<std::vector<float>>& hRows)
+{
+    for (int i = 0; i < job.numSrcs; ++i) {
+        const uint8_t* s = job.srcPixels[i] + (size_t)job.srcStride[i] * (ys - job.srcY0);
+        float* d = &lin[(size_t)4 * job.srcX[i]];
+        for (int x = 0; x < job.srcW[i]; ++x) {
+            d[4 * x + 0] = lut.v[s[4 * x + 0]];
+            d[4 * x + 1] = lut.v[s[4 * x + 1]];
+            d[4 * x + 2] = lut.v[s[4 * x + 2]];
+            d[4 * x + 3] = s[4 * x + 3] * (1.0f / 255.0f);
+        }
+    }
+
+    for (int i = 0; i < job.numSrcs; ++i) {
+        const MipTaps& t = job.hTaps[i];
+        float* out = &hRows[i][(size_t)4 * job.dstW[i] * (ys % job.vTaps.numTaps)];
+        for (int x = 0; x < job.dstW[i]; ++x) {
+            const int* col = &job.hCols[i][(size_t)x * t.numTaps];
+            const float* w = &t.weights[(size_t)x * t.numTaps];
+#if MIP_BUILDER_SSE2
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < t.numTaps; ++k) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(&lin[(size_t)4 * col[k]])));
+            }
+            _mm_storeu_ps(out + 4 * x, acc);
+#else
+            float acc[4] = { 0, 0, 0, 0 };
+            for (int k = 0; k < t.numTaps; ++k) {
+                const float* p = &lin[(size_t)4 * col[k]];
+                for (int c = 0; c < 4; ++c) {
+                    acc[c] += w[k] * p[c];
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                out[4 * x + c] = acc[c];
+            }
+#endif
+        }
+    }
+}
+
+/// 出力の行y0 ～ y1 - 1を作る。
+/// 前の段の行の横の縮小は、出力の1行が読むnumTaps行分だけを置き、上から順に作りながら古い行に上書きする。
+static void
+MipLevelBand(const MipLevelJob& job, const SrgbToLinearTable& lut, int y0, int y1)
+{
+    const int nt = job.vTaps.numTaps;
+    std::vector<float> lin((size_t)4 * job.totalW);
+    std::vector<std::vector<float>> hRows(job.numSrcs);
+    for (int i = 0; i < job.numSrcs; ++i) {
+        hRows[i].resize((size_t)4 * job.dstW[i] * nt);
+    }
+
+    // 縦に縮小して、16ビットのリニアからsRGBの8ビットにする。
+    const PixelKernels& pk = PixelConvert();
+    std::vector<float> sum;
+    std::vector<uint16_t> u16;
+    int nextYs = std::max(0, job.vTaps.first[y0]);
+    for (int y = y0; y < y1; ++y) {
+        const int lastYs = std::min(job.srcH - 1, job.vTaps.first[y] + nt - 1);
+        for (; nextYs <= lastYs; ++nextYs) {
+            MipLevelRowH(job, lut, nextYs, lin, hRows);
+        }
+
+        const float* w = &job.vTaps.weights[(size_t)y * nt];
+        for (int i = 0; i < job.numSrcs; ++i) {
+            const int n = 4 * job.dstW[i];
+            sum.assign(n, 0.0f);
+            u16.resize(n);
+            for (int k = 0; k < nt; ++k) {
+                if (w[k] == 0.0f) {
+                    continue;
+                }
+                const int ys = WrapOrClamp(job.vTaps.first[y] + k, job.srcH, false);
+                const float* h = &hRows[i][(size_t)n * (ys % nt)];
+                int j = 0;
+#if MIP_BUILDER_SSE2
+                const __m128 wk = _mm_set1_ps(w[k]);
+                for (; j + 4 <= n; j += 4) {
+                    _mm_storeu_ps(&sum[j], _mm_add_ps(_mm_loadu_ps(&sum[j]), _mm_mul_ps(wk, _mm_loadu_ps(h + j))));
+                }
+#endif
+                for (; j < n; ++j) {
+                    sum[j] += w[k] * h[j];
+                }
+            }
+            FloatToU16(sum.data(), u16.data(), n);
+            pk.linear16ToSrgb(u16.data(), job.dstPixels[i] + (size_t)job.dstStride[i] * (y - job.dstY0), job.dstW[i]);
+        }
+    }
+}
+
+static const SrgbToLinearTable&
+SrgbToLinear(void)
+{
+    static const SrgbToLinearTable lut;
+    return lut;
+}
+
+/// jobの重みを作る。
+static void
+MipLevelTaps(MipLevelJob& job, const MipBuildParams& p)
+{
+    // 横の重みの入力の列を、横に並べた前の段の列の番号にする。
+    job.hTaps.resize(job.numSrcs);
+    job.hCols.resize(job.numSrcs);
+    for (int i = 0; i < job.numSrcs; ++i) {
+        MipTaps& t = job.hTaps[i];
+        MakeTaps(p.filter, job.srcW[i], job.dstW[i], t);
+        std::vector<int>& cols = job.hCols[i];
+        cols.resize((size_t)job.dstW[i] * t.numTaps);
+        for (int x = 0; x < job.dstW[i]; ++x) {
+            for (int k = 0; k < t.numTaps; ++k) {
+                cols[(size_t)x * t.numTaps + k] = WrapOrClamp(job.srcX[i] + t.first[x] + k, job.totalW, p.wrapX);
+            }
+        }
+    }
+    MakeTaps(p.filter, job.srcH, job.dstH, job.vTaps);
+}
+
+/// 出力の行y0 ～ y1 - 1を、行の帯ごとに複数のスレッドで縮小する。
+static void
+MipLevelRows(const MipLevelJob& job, const MipBuildParams& p, int y0, int y1)
+{
+    const SrgbToLinearTable& lut = SrgbToLinear();
+    const int numBands = (y1 - y0 + BAND_ROWS - 1) / BAND_ROWS;
+    ParallelFor(numBands, [&](int b) {
+        MipLevelBand(job, lut, y0 + b * BAND_ROWS, std::min(y1, y0 + (b + 1) * BAND_ROWS));
+    }, p.numThreads);
+}
+
+/// jobの重みを作り、全部の行を縮小する。
+static void
+MipLevelRun(MipLevelJob& job, const MipBuildParams& p)
+{
+    MipLevelTaps(job, p);
+    MipLevelRows(job, p, 0, job.dstH);
+}
+
+int
+MipBuild(const MipSource* srcs, int numSrcs, const MipBuildParams& p, MipChain* chains_r)
+{
+    if (numSrcs <= 0 || srcs == nullptr || chains_r == nullptr || p.filter < 0 || MF_NUM <= p.filter) {
+        printf("E: MipBuild() invalid argument\n");
+        return -1;
+    }
+    for (int i = 0; i < numSrcs; ++i) {
+        const MipSource& s = srcs[i];
+        if (s.pixels == nullptr || s.width <= 0 || s.height != srcs[0].height || s.height <= 0 || s.stride < 4 * s.width) {
+            printf("E: MipBuild() invalid source %d\n", i);
+            return -1;
+        }
+    }
+
+    // 最も大きい画像が1x1になるまで。
+    int numLevels = 1;
+    {
+        int maxW = 0;
+        for (int i = 0; i < numSrcs; ++i) {
+            maxW = std::max(maxW, srcs[i].width);
+        }
+        for (int size = std::max(maxW, srcs[0].height); 1 < size; size >>= 1) {
+            ++numLevels;
+        }
+    }
+    if (0 < p.maxLevels) {
+        numLevels = std::min(numLevels, p.maxLevels);
+    }
+
+    for (int i = 0; i < numSrcs; ++i) {
+        MipChain& c = chains_r[i];
+        c.width = srcs[i].width;
+        c.height = srcs[i].height;
+        c.numLevels = numLevels;
+        c.levelOffset.assign(numLevels, 0);
+        size_t bytes = 0;
+        for (int l = 1; l < numLevels; ++l) {
+            c.levelOffset[l] = bytes;
+            bytes += (size_t)4 * c.LevelWidth(l) * c.LevelHeight(l);
+        }
+        c.pixels.resize(bytes);
+    }
+
+    for (int l = 1; l < numLevels; ++l) {
+        MipLevelJob job;
+        job.numSrcs = numSrcs;
+        job.srcH = (l == 1) ? srcs[0].height : chains_r[0].LevelHeight(l - 1);
+        job.dstH = chains_r[0].LevelHeight(l);
+        job.totalW = 0;
+        for (int i = 0; i < numSrcs; ++i) {
+            const MipChain& c = chains_r[i];
+            const int sw = c.LevelWidth(l - 1);
+            job.srcPixels.push_back((l == 1) ? srcs[i].pixels : c.Level(l - 1));
+            job.srcStride.push_back((l == 1) ? srcs[i].stride : 4 * sw);
+            job.srcW.push_back(sw);
+            job.dstW.push_back(c.LevelWidth(l));
+            job.dstPixels.push_back(chains_r[i].pixels.data() + c.levelOffset[l]);
+            job.dstStride.push_back(4 * c.LevelWidth(l));
+            job.srcX.push_back(job.totalW);
+            job.totalW += sw;
+        }
+
+        MipLevelRun(job, p);
+    }
+    return 0;
+}
+
+int
+MipResize(const MipSource& src, int dstW, int dstH, const MipBuildParams& p, std::vector<uint8_t>* dst_r)
+{
+    if (src.pixels == nullptr || src.width <= 0 || src.height <= 0 || src.stride < 4 * src.width || dstW <= 0 || dstH <= 0
+            || dst_r == nullptr || p.filter < 0 || MF_NUM <= p.filter) {
+        printf("E: MipResize() invalid argument\n");
+        return -1;
+    }
+    dst_r->resize((size_t)4 * dstW * dstH);
+
+    MipLevelJob job;
+    job.numSrcs = 1;
+    job.srcPixels.push_back(src.pixels);
+    job.srcStride.push_back(src.stride);
+    job.srcW.push_back(src.width);
+    job.dstW.push_back(dstW);
+    job.dstPixels.push_back(dst_r->data());
+    job.dstStride.push_back(4 * dstW);
+    job.srcH = src.height;
+    job.dstH = dstH;
+    job.totalW = src.width;
+    job.srcX.push_back(0);
+    MipLevelRun(job, p);
+    return 0;
+}
+
+MipRowResizer::MipRowResizer(void)
+{
+}
+
+MipRowResizer::MipRowResizer(MipRowResizer&&) = default;
+
+MipRowResizer& MipRowResizer::operator=(MipRowResizer&&) = default;
+
+MipRowResizer::~MipRowResizer(void)
+{
+}
+
+int
+MipRowResizer::Init(int srcW, int srcH, int dstW, int dstH, const MipBuildParams& p)
+{
+    mJob.reset();
+    if (srcW <= 0 || srcH <= 0 || dstW <= 0 || dstH <= 0 || p.filter < 0 || MF_NUM <= p.filter) {
+        printf("E: MipRowResizer::Init() invalid argument\n");
+        return -1;
+    }
+    mJob.reset(new MipLevelJob());
+    MipLevelJob& job = *mJob;
+    job.numSrcs = 1;
+    job.srcPixels.push_back(nullptr);
+    job.srcStride.push_back(0);
+    job.srcW.push_back(srcW);
+    job.dstW.push_back(dstW);
+    job.dstPixels.push_back(nullptr);
+    job.dstStride.push_back(0);
+    job.srcH = srcH;
+    job.dstH = dstH;
+    job.totalW = srcW;
+    job.srcX.push_back(0);
+    MipLevelTaps(job, p);
+    mParams = p;
+    return 0;
+}
+
+int
+MipRowResizer::FirstSrcRow(int y) const
+{
+    return std::max(0, mJob->vTaps.first[y]);
+}
+
+int
+MipRowResizer::LastSrcRow(int y) const
+{
+    return std::min(mJob->srcH - 1, mJob->vTaps.first[y] + mJob->vTaps.numTaps - 1);
+}
+
+int
+MipRowResizer::Resize(const MipSource& src, int srcY0, int y0, int y1, uint8_t* dst, int dstStride)
+{
+    if (!mJob) {
+        printf("E: MipRowResizer::Resize() not initialized\n");
+        return -1;
+    }
+    MipLevelJob& job = *mJob;
+    if (src.pixels == nullptr || src.width != job.srcW[0] || src.stride < 4 * src.width || y0 < 0 || y1 <= y0
+            || job.dstH < y1 || dst == nullptr || dstStride < 4 * job.dstW[0] || FirstSrcRow(y0) < srcY0
+            || srcY0 + src.height <= LastSrcRow(y1 - 1)) {
+        printf("E: MipRowResizer::Resize() invalid argument\n");
+        return -1;
+    }
+    job.srcPixels[0] = src.pixels;
+    job.srcStride[0] = src.stride;
+    job.srcY0 = srcY0;
+    job.dstPixels[0] = dst;
+    job.dstStride[0] = dstStride;
+    job.dstY0 = y0;
+    MipLevelRows(job, mParams, y0, y1);
+    return 0;
+}
+
+int
+MipRowResizer::NumSrcRows(MipFilter f, int srcH, int dstH)
+{
+    return NumTaps(f, srcH, dstH);
+}
+
+size_t
+MipRowResizer::WorkBytes(MipFilter f, int srcW, int srcH, int dstW, int dstH, int numRows, int numThreads)
+{
+    // 横の重みは、出力の列ごとにnumTaps個の重みと、横に並べた前の段の列の番号。縦の重みは出力の行ごと。
+    const size_t hTaps = (size_t)NumTaps(f, srcW, dstW);
+    const size_t vTaps = (size_t)NumTaps(f, srcH, dstH);
+    const size_t taps = (sizeof(float) + sizeof(int)) * hTaps * dstW + sizeof(int) * dstW
+            + sizeof(float) * vTaps * dstH + sizeof(int) * dstH;
+
+    // MipLevelBand()は、帯ごとに入力の1行のリニアと、出力の1行が読む行数分の横の縮小と、出力の1行を置く。
+    const int numBands = (numRows + BAND_ROWS - 1) / BAND_ROWS;
+    const size_t perBand = sizeof(float) * 4 * ((size_t)srcW + (size_t)dstW * vTaps + dstW) + sizeof(uint16_t) * 4 * dstW;
+    return taps + perBand * std::min(numBands, ParallelForNumThreads(numThreads));
+}
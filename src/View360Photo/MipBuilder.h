@@ -0,0 +1,120 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+/// ミップマップを縮小するフィルター。
+enum MipFilter {
+    /// 縮小率の幅の箱。2:1のときは2x2の平均。幅が奇数の段は重なる長さで重み付けする。
+    MF_Box,
+
+    /// カイザー窓(alpha 4)のsinc。半径は縮小後の3画素。
+    MF_Kaiser,
+
+    /// Lanczos3。半径は縮小後の3画素。
+    MF_Lanczos3,
+
+    MF_NUM
+};
+
+const char* MipFilterToStr(MipFilter f);
+
+/// ミップマップの元の画像。BGRA 8ビット、sRGB。
+struct MipSource {
+    const uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+
+    /// 次の行までのバイト数。
+    int stride = 0;
+};
+
+/// level 1以降のミップマップ。level 0は元の画像なので持たない。
+/// level lはLevelWidth(l) x LevelHeight(l)のBGRA 8ビットを、行の隙間なく並べる。
+struct MipChain {
+    /// level 0の大きさ。
+    int width = 0;
+    int height = 0;
+
+    /// level 0を含む段数。
+    int numLevels = 0;
+
+    /// levelOffset[l]は、pixelsの中のlevel lの先頭。levelOffset[0]は使わない。
+    std::vector<size_t> levelOffset;
+    std::vector<uint8_t> pixels;
+
+    /// D3D11と同じく、前の段の半分(切り捨て、最小1)。
+    int LevelWidth(int level) const { return std::max(1, width >> level); }
+    int LevelHeight(int level) const { return std::max(1, height >> level); }
+
+    /// 1 <= level < numLevels。
+    const uint8_t* Level(int level) const { return pixels.data() + levelOffset[level]; }
+};
+
+struct MipBuildParams {
+    MipFilter filter = MF_Kaiser;
+
+    /// trueのとき、横に並べた画像の右端の次を左端とする(正距円筒図法の経度の継ぎ目)。
+    /// falseのとき端の画素を延ばす。上下の端は常に端の画素を延ばす。
+    bool wrapX = true;
+
+    /// 作る段数の上限(level 0を含む)。0のとき1x1まで。
+    int maxLevels = 0;
+
+    /// 0のときハードウェアスレッド数。
+    int numThreads = 0;
+};
+
+/// BGRA 8ビットのsRGBの画像から、リニアな明るさで縮小したミップマップを作る。アルファーはリニアのまま縮小する。
+/// srcs[0] ～ srcs[numSrcs - 1]を左から順に横に並べた1枚の画像として扱い、画像の端では隣の画像の画素も読む。
+/// 正距円筒図法の画像を左右の半分に分けたテクスチャーも、継ぎ目なく縮小できる。各画像の高さは同じであること。
+/// 各段は前の段から作る。段の中は行の帯ごとに複数のスレッドで作る。結果はスレッド数とSSE2の有無によらず同じ。
+/// @param chains_r numSrcs個。srcs[i]のミップマップをchains_r[i]に置く。
+/// @return 成功のとき0。失敗のとき負の値。
+int MipBuild(const MipSource* srcs, int numSrcs, const MipBuildParams& p, MipChain* chains_r);
+
+/// BGRA 8ビットのsRGBの画像srcを、MipBuild()と同じくp.filterでリニアな明るさでdstW x dstHに縮小する。縮小率は任意。
+/// p.wrapXがtrueのとき、右端の次を左端とする。p.maxLevelsは使わない。
+/// @param dst_r 4 * dstWバイトの行を隙間なく並べる。
+/// @return 成功のとき0。失敗のとき負の値。
+int MipResize(const MipSource& src, int dstW, int dstH, const MipBuildParams& p, std::vector<uint8_t>* dst_r);
+
+struct MipLevelJob;
+
+/// MipResize()を、元の画像の行を上から順に一部ずつ渡しながら行う。元の画像全体をメモリーに置かずに縮小できる。
+/// 出力の各行は、MipResize()の同じ行と同じ。横は1枚の画像のみ。
+class MipRowResizer {
+public:
+    MipRowResizer(void);
+    MipRowResizer(MipRowResizer&&);
+    MipRowResizer& operator=(MipRowResizer&&);
+    ~MipRowResizer(void);
+
+    /// srcW x srcHの画像をdstW x dstHに縮小する重みを作る。p.maxLevelsは使わない。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Init(int srcW, int srcH, int dstW, int dstH, const MipBuildParams& p);
+
+    /// 出力の行yが読む元の行はFirstSrcRow(y) ～ LastSrcRow(y)。上下の端でクランプした後。yに対して単調に増える。
+    int FirstSrcRow(int y) const;
+    int LastSrcRow(int y) const;
+
+    /// 出力の行y0 ～ y1 - 1を作る。
+    /// @param src 元の画像の行srcY0からsrc.height行。FirstSrcRow(y0) ～ LastSrcRow(y1 - 1)を含むこと。
+    /// @param dst 出力の行y0から、dstStrideバイトおきに書く。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Resize(const MipSource& src, int srcY0, int y0, int y1, uint8_t* dst, int dstStride);
+
+    /// 高さsrcHからdstHへの縮小で、出力の1行が読む元の行数の上限。
+    static int NumSrcRows(MipFilter f, int srcH, int dstH);
+
+    /// Init()で作る重みと、Resize()で1回にnumRows行を作るときにスレッド数分確保する作業用のメモリーの、合計のバイト数の上限。
+    static size_t WorkBytes(MipFilter f, int srcW, int srcH, int dstW, int dstH, int numRows, int numThreads);
+
+private:
+    std::unique_ptr<MipLevelJob> mJob;
+    MipBuildParams mParams;
+};
@@ -22,6 +22,7 @@
 #include "CubeRenderer.h"
 #include "JpegToTexture.h"
 #include "TexturedMeshRenderer.h"
+#include "DisplayDensity.h"
 #include <DirectXMath.h>
 #include "Config.h"
 
@@ -300,7 +301,22 @@ namespace {
 			// Deviceが出来たので、リソース作成。
 			m_cubeGraphics->InitGraphcisResources(device, dctx);
             m_tmr.InitGraphcisResources(device, dctx);
-			
+
+			// 全画素のテクスチャーの解像度を、画面の1度あたりの画素数に合わせる。
+			// 視野はフレームを描くまで分からないので、水平の視野をDISPLAY_FOV_DEGREES度とする。
+			{
+				uint32_t viewCount = 0;
+				CHECK_XRCMD(xrEnumerateViewConfigurationViews(m_instance.Get(), m_systemId, m_primaryViewConfigType, 0, &viewCount, nullptr));
+				std::vector<XrViewConfigurationView> configViews(viewCount, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
+				CHECK_XRCMD(xrEnumerateViewConfigurationViews(
+					m_instance.Get(), m_systemId, m_primaryViewConfigType, viewCount, &viewCount, configViews.data()));
+				CHECK(0 < viewCount);
+
+				const double halfFov = DirectX::XMConvertToRadians(DISPLAY_FOV_DEGREES * 0.5f);
+				m_tmr.SetDisplayPixelsPerDegree(
+					DisplayPixelsPerDegree(configViews[0].recommendedImageRectWidth, -halfFov, halfFov));
+			}
+
 			hr = m_tmr.Load(L"360.jpg");
 			if (FAILED(hr)) {
 				return hr;
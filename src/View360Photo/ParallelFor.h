@@ -0,0 +1,148 @@
+﻿// 日本語。
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+/// 使用するワーカースレッド数。0のときハードウェアスレッド数。
+inline int
+ParallelForNumThreads(int nThreads = 0)
+{
+    if (nThreads <= 0) {
+        nThreads = (int)std::thread::hardware_concurrency();
+    }
+    if (nThreads <= 0) {
+        nThreads = 1;
+    }
+    return nThreads;
+}
+
+/// ParallelFor()が使う、作ったままにするワーカースレッド群。
+/// 呼ぶたびにスレッドを作って終わるのを待つと、毎フレームや画像1枚ごとの呼び出しでその分遅くなるので、作ったものを使い回す。
+/// ジョブは呼び出し元スレッドも処理し、呼び出し元だけでも全部のiを終えられる。
+/// ワーカーは空いていれば手伝うだけなので、ParallelFor()の中や複数のスレッドから同時にParallelFor()を呼んでも止まらない。
+/// ワーカーは必要な数まで増やし、プロセスの終わりまで残す。
+class ParallelForPool {
+public:
+    /// プロセスで1個。終了時にワーカーを待たないように、わざと解放しない。
+    static ParallelForPool&
+    Instance(void)
+    {
+        static ParallelForPool* pool = new ParallelForPool();
+        return *pool;
+    }
+
+    /// [0, count)の各iについてcall(ctx, i)を、呼び出し元とnHelpers個までのワーカーで呼ぶ。全部終わってから戻る。
+    void
+    Run(int count, int nHelpers, void (*call)(void*, int), void* ctx)
+    {
+        Job job;
+        job.count = count;
+        job.helpersWanted = nHelpers;
+        job.call = call;
+        job.ctx = ctx;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            while ((int)mThreads.size() < nHelpers) {
+                mThreads.emplace_back([this]() { WorkerMain(); });
+                mThreads.back().detach();
+            }
+            mQueue.push_back(&job);
+        }
+        mWake.notify_all();
+
+        job.Work();
+
+        // 手伝い始めたワーカーが抜けるのを待つ。まだ誰も取っていなければ、列から外す。
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto it = std::find(mQueue.begin(), mQueue.end(), &job);
+        if (it != mQueue.end()) {
+            mQueue.erase(it);
+        }
+        mDone.wait(lock, [&]() { return job.active == 0; });
+    }
+
+private:
+    struct Job {
+        int count = 0;
+        std::atomic<int> next{ 0 };
+        void (*call)(void*, int) = nullptr;
+        void* ctx = nullptr;
+
+        /// 手伝うワーカーの上限と、取ったワーカーの数、まだ処理中のワーカーの数。mMutexで守る。
+        int helpersWanted = 0;
+        int helpersJoined = 0;
+        int active = 0;
+
+        void
+        Work(void)
+        {
+            while (true) {
+                const int i = next.fetch_add(1);
+                if (count <= i) {
+                    break;
+                }
+                call(ctx, i);
+            }
+        }
+    };
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    std::deque<Job*> mQueue;
+    std::vector<std::thread> mThreads;
+
+    void
+    WorkerMain(void)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWake.wait(lock, [&]() { return !mQueue.empty(); });
+            Job* job = mQueue.front();
+            ++job->helpersJoined;
+            ++job->active;
+            if (job->helpersWanted <= job->helpersJoined) {
+                mQueue.pop_front();
+            }
+
+            lock.unlock();
+            job->Work();
+            lock.lock();
+
+            if (--job->active == 0) {
+                mDone.notify_all();
+            }
+        }
+    }
+};
+
+/// [0, count)の各iについてfunc(i)を呼ぶ。
+/// 呼び出し元スレッドとParallelForPoolのワーカー、合わせてnThreads個が、次に処理するiをアトミックに取り合う。
+/// funcは異なるiについて同時に呼ばれるので、出力先が重ならないようにすること。
+template <typename F>
+void
+ParallelFor(int count, F&& func, int nThreads = 0)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    nThreads = std::min(ParallelForNumThreads(nThreads), count);
+    if (nThreads == 1) {
+        for (int i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    using Func = typename std::remove_reference<F>::type;
+    ParallelForPool::Instance().Run(count, nThreads - 1, [](void* ctx, int i) { (*(Func*)ctx)(i); },
+            (void*)&func);
+}
@@ -0,0 +1,933 @@
+﻿// 日本語。
+
+#include "PixelConvert.h"
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#  define PIXEL_CONVERT_X64 1
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define PIXEL_TARGET(t)
+#  else
+#    include <cpuid.h>
+#    define PIXEL_TARGET(t) __attribute__((target(t)))
+#  endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#  define PIXEL_CONVERT_NEON 1
+#  include <arm_neon.h>
+#endif
+
+// 画素は常にリトルエンディアンで扱う。
+
+static inline uint32_t
+Load32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void
+Store32(uint8_t* p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+/// floatを半精度に最近接偶数丸めで変換する。F16Cの_mm_cvtps_phと同じ値になる。
+static uint16_t
+FloatToHalf(float f)
+{
+    const uint32_t F32_INF = 255u << 23;
+    const uint32_t F16_MAX = (127u + 16) << 23;
+    const uint32_t DENORM_MAGIC = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    uint32_t o;
+    if (F16_MAX <= x) {
+        o = (F32_INF < x) ? 0x7e00 : 0x7c00;
+    } else if (x < (113u << 23)) {
+        // 非正規化数。足し算の丸めで仮数を作る。
+        float magic;
+        memcpy(&magic, &DENORM_MAGIC, 4);
+        float a;
+        memcpy(&a, &x, 4);
+        a += magic;
+        memcpy(&o, &a, 4);
+        o -= DENORM_MAGIC;
+    } else {
+        const uint32_t mantOdd = (x >> 13) & 1;
+        x += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        x += mantOdd;
+        o = x >> 13;
+    }
+    return (uint16_t)(o | sign);
+}
+
+/// スカラー版で引く表。最初に使うときに作る。
+struct PixelTables {
+    uint16_t srgbToLinear16[256];
+    uint16_t u8ToHalf[256];
+    uint8_t linear16ToSrgb[65536];
+
+    PixelTables(void)
+    {
+        for (int i = 0; i < 256; ++i) {
+            const double s = i / 255.0;
+            const double lin = (s <= 0.04045) ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4);
+            srgbToLinear16[i] = (uint16_t)(lin * 65535.0 + 0.5);
+            u8ToHalf[i] = FloatToHalf((float)i / 255.0f);
+        }
+        for (int i = 0; i < 65536; ++i) {
+            const double lin = i / 65535.0;
+            const double s = (lin <= 0.0031308) ? lin * 12.92 : 1.055 * pow(lin, 1.0 / 2.4) - 0.055;
+            linear16ToSrgb[i] = (uint8_t)(s * 255.0 + 0.5);
+        }
+    }
+};
+
+static const PixelTables&
+Tables(void)
+{
+    static const PixelTables t;
+    return t;
+}
+
+// スカラー版。各版の端数の画素もこれで処理する。 ////////////////////////////////////////
+
+static void
+BgraSetAlphaScalar(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const uint32_t a = (uint32_t)alpha << 24;
+    for (size_t i = 0; i < n; ++i) {
+        Store32(dst + 4 * i, (Load32(src + 4 * i) & 0x00ffffff) | a);
+    }
+}
+
+static void
+Rgb24ToBgraScalar(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* s = src + 3 * i;
+        uint8_t* d = dst + 4 * i;
+        d[0] = s[2];
+        d[1] = s[1];
+        d[2] = s[0];
+        d[3] = alpha;
+    }
+}
+
+static void
+Bgr24ToBgraScalar(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* s = src + 3 * i;
+        uint8_t* d = dst + 4 * i;
+        d[0] = s[0];
+        d[1] = s[1];
+        d[2] = s[2];
+        d[3] = alpha;
+    }
+}
+
+static void
+SwapRBScalar(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t v = Load32(src + 4 * i);
+        Store32(dst + 4 * i, (v & 0xff00ff00) | ((v >> 16) & 0xff) | ((v & 0xff) << 16));
+    }
+}
+
+/// round(c * a / 255)。t = c * a + 128のとき (t + (t >> 8)) >> 8 と等しい。
+static inline uint8_t
+MulDiv255(int c, int a)
+{
+    const int t = c * a + 128;
+    return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+static void
+PremultiplyScalar(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* s = src + 4 * i;
+        uint8_t* d = dst + 4 * i;
+        const int a = s[3];
+        d[0] = MulDiv255(s[0], a);
+        d[1] = MulDiv255(s[1], a);
+        d[2] = MulDiv255(s[2], a);
+        d[3] = (uint8_t)a;
+    }
+}
+
+static void
+SrgbToLinear16Scalar(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    const uint16_t* lut = Tables().srgbToLinear16;
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* s = src + 4 * i;
+        uint16_t* d = dst + 4 * i;
+        d[0] = lut[s[0]];
+        d[1] = lut[s[1]];
+        d[2] = lut[s[2]];
+        d[3] = (uint16_t)(s[3] * 257);
+    }
+}
+
+static void
+Linear16ToSrgbScalar(const uint16_t* src, uint8_t* dst, size_t n)
+{
+    const uint8_t* lut = Tables().linear16ToSrgb;
+    for (size_t i = 0; i < n; ++i) {
+        const uint16_t* s = src + 4 * i;
+        uint8_t* d = dst + 4 * i;
+        d[0] = lut[s[0]];
+        d[1] = lut[s[1]];
+        d[2] = lut[s[2]];
+        d[3] = (uint8_t)((s[3] + 128) / 257);
+    }
+}
+
+static void
+U8ToU16Scalar(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = (uint16_t)(src[i] * 257);
+    }
+}
+
+static void
+U8ToHalfScalar(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    const uint16_t* lut = Tables().u8ToHalf;
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+static const PixelKernels gScalar = {
+    BgraSetAlphaScalar,
+    Rgb24ToBgraScalar,
+    Bgr24ToBgraScalar,
+    SwapRBScalar,
+    PremultiplyScalar,
+    SrgbToLinear16Scalar,
+    Linear16ToSrgbScalar,
+    U8ToU16Scalar,
+    U8ToHalfScalar,
+};
+
+// sRGBとリニアの変換は表引きで、メモリーの帯域で決まるのでスカラー版だけにする。
+
+#ifdef PIXEL_CONVERT_X64
+
+// SSE2版。x64では常に使える。 ////////////////////////////////////////////////////////
+
+static void
+BgraSetAlphaSse2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i a = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_and_si128(v, rgbMask), a));
+    }
+    BgraSetAlphaScalar(src + 4 * i, dst + 4 * i, n - i, alpha);
+}
+
+static void
+SwapRBSse2(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    const __m128i gaMask = _mm_set1_epi32((int)0xff00ff00);
+    const __m128i loMask = _mm_set1_epi32(0x000000ff);
+    const __m128i hiMask = _mm_set1_epi32(0x00ff0000);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        const __m128i r = _mm_or_si128(_mm_and_si128(v, gaMask),
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), loMask), _mm_and_si128(_mm_slli_epi32(v, 16), hiMask)));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), r);
+    }
+    SwapRBScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+static void
+PremultiplySse2(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    // 16ビットに広げ、各画素のアルファーを色の3要素に並べて掛ける。アルファー自身には255を掛ける。
+    const __m128i z = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alphaOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i c128 = _mm_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        __m128i w[2] = { _mm_unpacklo_epi8(v, z), _mm_unpackhi_epi8(v, z) };
+        for (int k = 0; k < 2; ++k) {
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(w[k], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_or_si128(_mm_and_si128(a, colorMask), alphaOne);
+            const __m128i t = _mm_add_epi16(_mm_mullo_epi16(w[k], a), c128);
+            w[k] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi16(w[0], w[1]));
+    }
+    PremultiplyScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+static void
+U8ToU16Sse2(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    // x * 257は、xを上下のバイトに置いた値。
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, v));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, v));
+    }
+    U8ToU16Scalar(src + i, dst + i, n - i);
+}
+
+static const PixelKernels gSse2 = {
+    BgraSetAlphaSse2,
+    nullptr,
+    nullptr,
+    SwapRBSse2,
+    PremultiplySse2,
+    nullptr,
+    nullptr,
+    U8ToU16Sse2,
+    nullptr,
+};
+
+// SSSE3版。3バイトの画素の並べ替えに_mm_shuffle_epi8を使う。 ///////////////////////
+
+/// 12バイトの4画素を、shuffleで4バイトの4画素にしてアルファーを足す。
+/// 16画素(48バイト)を3回の読み込みで処理する。
+PIXEL_TARGET("ssse3")
+static void
+Rgb24ToBgraSsse3Impl(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha, __m128i shuffle,
+        void (*tail)(const uint8_t*, uint8_t*, size_t, uint8_t))
+{
+    const __m128i a = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v0 = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+        const __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 3 * i + 16));
+        const __m128i v2 = _mm_loadu_si128((const __m128i*)(src + 3 * i + 32));
+        const __m128i p0 = v0;
+        const __m128i p1 = _mm_alignr_epi8(v1, v0, 12);
+        const __m128i p2 = _mm_alignr_epi8(v2, v1, 8);
+        const __m128i p3 = _mm_srli_si128(v2, 4);
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), a));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), a));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i + 32), _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), a));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i + 48), _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), a));
+    }
+    tail(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+PIXEL_TARGET("ssse3")
+static void
+Rgb24ToBgraSsse3(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    Rgb24ToBgraSsse3Impl(src, dst, n, alpha, shuffle, Rgb24ToBgraScalar);
+}
+
+PIXEL_TARGET("ssse3")
+static void
+Bgr24ToBgraSsse3(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    Rgb24ToBgraSsse3Impl(src, dst, n, alpha, shuffle, Bgr24ToBgraScalar);
+}
+
+PIXEL_TARGET("ssse3")
+static void
+SwapRBSsse3(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_shuffle_epi8(v, shuffle));
+    }
+    SwapRBScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+static const PixelKernels gSsse3 = {
+    nullptr,
+    Rgb24ToBgraSsse3,
+    Bgr24ToBgraSsse3,
+    SwapRBSsse3,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+};
+
+// AVX2版。 ///////////////////////////////////////////////////////////////////////////
+
+PIXEL_TARGET("avx2")
+static void
+BgraSetAlphaAvx2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m256i rgbMask = _mm256_set1_epi32(0x00ffffff);
+    const __m256i a = _mm256_set1_epi32((int)((uint32_t)alpha << 24));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+        _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_or_si256(_mm256_and_si256(v, rgbMask), a));
+    }
+    BgraSetAlphaScalar(src + 4 * i, dst + 4 * i, n - i, alpha);
+}
+
+/// 4画素(12バイト)ずつ2個の128ビットの列に読み、列ごとにshuffleする。
+/// 2個目の読み込みはsrc + 12から16バイトなので、8画素を処理するのに10画素分のバイトが要る。
+PIXEL_TARGET("avx2")
+static void
+Rgb24ToBgraAvx2Impl(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha, __m128i shuffle128,
+        void (*tail)(const uint8_t*, uint8_t*, size_t, uint8_t))
+{
+    const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle128);
+    const __m256i a = _mm256_set1_epi32((int)((uint32_t)alpha << 24));
+    size_t i = 0;
+    for (; i + 10 <= n; i += 8) {
+        const __m128i lo = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+        const __m128i hi = _mm_loadu_si128((const __m128i*)(src + 3 * i + 12));
+        const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), a));
+    }
+    tail(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+PIXEL_TARGET("avx2")
+static void
+Rgb24ToBgraAvx2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    Rgb24ToBgraAvx2Impl(src, dst, n, alpha, shuffle, Rgb24ToBgraScalar);
+}
+
+PIXEL_TARGET("avx2")
+static void
+Bgr24ToBgraAvx2(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    Rgb24ToBgraAvx2Impl(src, dst, n, alpha, shuffle, Bgr24ToBgraScalar);
+}
+
+PIXEL_TARGET("avx2")
+static void
+SwapRBAvx2(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+        _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_shuffle_epi8(v, shuffle));
+    }
+    SwapRBScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+PIXEL_TARGET("avx2")
+static void
+PremultiplyAvx2(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    // SSE2版と同じ。unpackとpackusは128ビットの列ごとなので、画素の順番は保たれる。
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+    const __m256i alphaOne = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+        __m256i w[2] = { _mm256_unpacklo_epi8(v, z), _mm256_unpackhi_epi8(v, z) };
+        for (int k = 0; k < 2; ++k) {
+            __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(w[k], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm256_or_si256(_mm256_and_si256(a, colorMask), alphaOne);
+            const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(w[k], a), c128);
+            w[k] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+        }
+        _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_packus_epi16(w[0], w[1]));
+    }
+    PremultiplyScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+PIXEL_TARGET("avx2")
+static void
+U8ToU16Avx2(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(v, _mm256_slli_epi16(v, 8)));
+    }
+    U8ToU16Scalar(src + i, dst + i, n - i);
+}
+
+PIXEL_TARGET("avx2,f16c")
+static void
+U8ToHalfAvx2(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    // 255.0fで割ってから丸める。逆数を掛けると表の値と1ulp違うことがある。
+    const __m256 d = _mm256_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        const __m256 f = _mm256_div_ps(_mm256_cvtepi32_ps(v), d);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+    U8ToHalfScalar(src + i, dst + i, n - i);
+}
+
+static const PixelKernels gAvx2 = {
+    BgraSetAlphaAvx2,
+    Rgb24ToBgraAvx2,
+    Bgr24ToBgraAvx2,
+    SwapRBAvx2,
+    PremultiplyAvx2,
+    nullptr,
+    nullptr,
+    U8ToU16Avx2,
+    U8ToHalfAvx2,
+};
+
+// AVX-512版。 ////////////////////////////////////////////////////////////////////////
+
+#define PIXEL_TARGET_AVX512 PIXEL_TARGET("avx512f,avx512bw,avx2,f16c")
+
+PIXEL_TARGET_AVX512
+static void
+BgraSetAlphaAvx512(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m512i rgbMask = _mm512_set1_epi32(0x00ffffff);
+    const __m512i a = _mm512_set1_epi32((int)((uint32_t)alpha << 24));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i v = _mm512_loadu_si512((const void*)(src + 4 * i));
+        _mm512_storeu_si512((void*)(dst + 4 * i), _mm512_or_si512(_mm512_and_si512(v, rgbMask), a));
+    }
+    BgraSetAlphaScalar(src + 4 * i, dst + 4 * i, n - i, alpha);
+}
+
+/// AVX2版と同じく4画素ずつ4個の128ビットの列に読む。16画素を処理するのに18画素分のバイトが要る。
+PIXEL_TARGET_AVX512
+static void
+Rgb24ToBgraAvx512Impl(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha, __m128i shuffle128,
+        void (*tail)(const uint8_t*, uint8_t*, size_t, uint8_t))
+{
+    const __m512i shuffle = _mm512_broadcast_i32x4(shuffle128);
+    const __m512i a = _mm512_set1_epi32((int)((uint32_t)alpha << 24));
+    size_t i = 0;
+    for (; i + 18 <= n; i += 16) {
+        const uint8_t* s = src + 3 * i;
+        __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)s));
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(s + 12)), 1);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(s + 24)), 2);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(s + 36)), 3);
+        _mm512_storeu_si512((void*)(dst + 4 * i), _mm512_or_si512(_mm512_shuffle_epi8(v, shuffle), a));
+    }
+    tail(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+PIXEL_TARGET_AVX512
+static void
+Rgb24ToBgraAvx512(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    Rgb24ToBgraAvx512Impl(src, dst, n, alpha, shuffle, Rgb24ToBgraScalar);
+}
+
+PIXEL_TARGET_AVX512
+static void
+Bgr24ToBgraAvx512(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    Rgb24ToBgraAvx512Impl(src, dst, n, alpha, shuffle, Bgr24ToBgraScalar);
+}
+
+PIXEL_TARGET_AVX512
+static void
+SwapRBAvx512(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    const __m512i shuffle = _mm512_broadcast_i32x4(
+            _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i v = _mm512_loadu_si512((const void*)(src + 4 * i));
+        _mm512_storeu_si512((void*)(dst + 4 * i), _mm512_shuffle_epi8(v, shuffle));
+    }
+    SwapRBScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+PIXEL_TARGET_AVX512
+static void
+PremultiplyAvx512(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    const __m512i z = _mm512_setzero_si512();
+    const __m512i colorMask = _mm512_set1_epi64(0x0000ffffffffffffLL);
+    const __m512i alphaOne = _mm512_set1_epi64(0x00ff000000000000LL);
+    const __m512i c128 = _mm512_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i v = _mm512_loadu_si512((const void*)(src + 4 * i));
+        __m512i w[2] = { _mm512_unpacklo_epi8(v, z), _mm512_unpackhi_epi8(v, z) };
+        for (int k = 0; k < 2; ++k) {
+            __m512i a = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(w[k], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm512_or_si512(_mm512_and_si512(a, colorMask), alphaOne);
+            const __m512i t = _mm512_add_epi16(_mm512_mullo_epi16(w[k], a), c128);
+            w[k] = _mm512_srli_epi16(_mm512_add_epi16(t, _mm512_srli_epi16(t, 8)), 8);
+        }
+        _mm512_storeu_si512((void*)(dst + 4 * i), _mm512_packus_epi16(w[0], w[1]));
+    }
+    PremultiplyScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+PIXEL_TARGET_AVX512
+static void
+U8ToU16Avx512(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m512i v = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm512_storeu_si512((void*)(dst + i), _mm512_or_si512(v, _mm512_slli_epi16(v, 8)));
+    }
+    U8ToU16Scalar(src + i, dst + i, n - i);
+}
+
+PIXEL_TARGET_AVX512
+static void
+U8ToHalfAvx512(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    const __m512 d = _mm512_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        const __m512 f = _mm512_div_ps(_mm512_cvtepi32_ps(v), d);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+    U8ToHalfScalar(src + i, dst + i, n - i);
+}
+
+static const PixelKernels gAvx512 = {
+    BgraSetAlphaAvx512,
+    Rgb24ToBgraAvx512,
+    Bgr24ToBgraAvx512,
+    SwapRBAvx512,
+    PremultiplyAvx512,
+    nullptr,
+    nullptr,
+    U8ToU16Avx512,
+    U8ToHalfAvx512,
+};
+
+static void
+Cpuid(int leaf, int sub, uint32_t r[4])
+{
+#ifdef _MSC_VER
+    int v[4];
+    __cpuidex(v, leaf, sub);
+    for (int i = 0; i < 4; ++i) {
+        r[i] = (uint32_t)v[i];
+    }
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static uint64_t
+Xgetbv0(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+#endif // PIXEL_CONVERT_X64
+
+#ifdef PIXEL_CONVERT_NEON
+
+// NEON版。ARM64では常に使える。vld3/vld4で要素ごとの列に分けて読む。 ////////////////
+
+static void
+BgraSetAlphaNeon(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    const uint8x16_t a = vdupq_n_u8(alpha);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = vld4q_u8(src + 4 * i);
+        v.val[3] = a;
+        vst4q_u8(dst + 4 * i, v);
+    }
+    BgraSetAlphaScalar(src + 4 * i, dst + 4 * i, n - i, alpha);
+}
+
+static void
+Rgb24ToBgraNeon(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16x3_t s = vld3q_u8(src + 3 * i);
+        uint8x16x4_t d;
+        d.val[0] = s.val[2];
+        d.val[1] = s.val[1];
+        d.val[2] = s.val[0];
+        d.val[3] = vdupq_n_u8(alpha);
+        vst4q_u8(dst + 4 * i, d);
+    }
+    Rgb24ToBgraScalar(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+static void
+Bgr24ToBgraNeon(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16x3_t s = vld3q_u8(src + 3 * i);
+        uint8x16x4_t d;
+        d.val[0] = s.val[0];
+        d.val[1] = s.val[1];
+        d.val[2] = s.val[2];
+        d.val[3] = vdupq_n_u8(alpha);
+        vst4q_u8(dst + 4 * i, d);
+    }
+    Bgr24ToBgraScalar(src + 3 * i, dst + 4 * i, n - i, alpha);
+}
+
+static void
+SwapRBNeon(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = vld4q_u8(src + 4 * i);
+        const uint8x16_t t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst4q_u8(dst + 4 * i, v);
+    }
+    SwapRBScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+/// round(c * a / 255)。vraddhn_u16(t, (t + 128) >> 8)はスカラー版の式と同じ値になる。
+static inline uint8x16_t
+MulDiv255Neon(uint8x16_t c, uint8x16_t a)
+{
+    const uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+    const uint16x8_t hi = vmull_u8(vget_high_u8(c), vget_high_u8(a));
+    return vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+}
+
+static void
+PremultiplyNeon(const uint8_t* src, uint8_t* dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = vld4q_u8(src + 4 * i);
+        v.val[0] = MulDiv255Neon(v.val[0], v.val[3]);
+        v.val[1] = MulDiv255Neon(v.val[1], v.val[3]);
+        v.val[2] = MulDiv255Neon(v.val[2], v.val[3]);
+        vst4q_u8(dst + 4 * i, v);
+    }
+    PremultiplyScalar(src + 4 * i, dst + 4 * i, n - i);
+}
+
+static void
+U8ToU16Neon(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(src + i);
+        uint8x16x2_t vv;
+        vv.val[0] = v;
+        vv.val[1] = v;
+        vst2q_u8((uint8_t*)(dst + i), vv);
+    }
+    U8ToU16Scalar(src + i, dst + i, n - i);
+}
+
+static void
+U8ToHalfNeon(const uint8_t* src, uint16_t* dst, size_t n)
+{
+    const float32x4_t d = vdupq_n_f32(255.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+        const float32x4_t f0 = vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), d);
+        const float32x4_t f1 = vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), d);
+        vst1q_u16(dst + i, vcombine_u16(
+                vreinterpret_u16_f16(vcvt_f16_f32(f0)), vreinterpret_u16_f16(vcvt_f16_f32(f1))));
+    }
+    U8ToHalfScalar(src + i, dst + i, n - i);
+}
+
+static const PixelKernels gNeon = {
+    BgraSetAlphaNeon,
+    Rgb24ToBgraNeon,
+    Bgr24ToBgraNeon,
+    SwapRBNeon,
+    PremultiplyNeon,
+    nullptr,
+    nullptr,
+    U8ToU16Neon,
+    U8ToHalfNeon,
+};
+
+#endif // PIXEL_CONVERT_NEON
+
+const char*
+PixelSimdLevelToStr(PixelSimdLevel level)
+{
+    switch (level) {
+    case PSL_Scalar: return "Scalar";
+    case PSL_Sse2:   return "SSE2";
+    case PSL_Ssse3:  return "SSSE3";
+    case PSL_Avx2:   return "AVX2";
+    case PSL_Avx512: return "AVX-512";
+    case PSL_Neon:   return "NEON";
+    default:         return "Unknown";
+    }
+}
+
+PixelSimdLevel
+PixelSimdLevelDetect(void)
+{
+#if defined(PIXEL_CONVERT_X64)
+    uint32_t r[4];
+    Cpuid(0, 0, r);
+    const uint32_t maxLeaf = r[0];
+
+    Cpuid(1, 0, r);
+    const bool ssse3 = ((r[2] >> 9) & 1) != 0;
+    const bool osxsave = ((r[2] >> 27) & 1) != 0;
+    const bool avx = ((r[2] >> 28) & 1) != 0;
+    const bool f16c = ((r[2] >> 29) & 1) != 0;
+
+    bool avx2 = false;
+    bool avx512 = false;
+    if (7 <= maxLeaf) {
+        Cpuid(7, 0, r);
+        avx2 = ((r[1] >> 5) & 1) != 0;
+        avx512 = ((r[1] >> 16) & 1) != 0 && ((r[1] >> 30) & 1) != 0;
+    }
+
+    // OSがYMM, ZMMレジスターを保存するかをXCR0で調べる。
+    const uint64_t xcr0 = osxsave ? Xgetbv0() : 0;
+    const bool osYmm = (xcr0 & 0x06) == 0x06;
+    const bool osZmm = (xcr0 & 0xe6) == 0xe6;
+
+    if (avx && avx2 && f16c && osYmm) {
+        return (avx512 && osZmm) ? PSL_Avx512 : PSL_Avx2;
+    }
+    return ssse3 ? PSL_Ssse3 : PSL_Sse2;
+#elif defined(PIXEL_CONVERT_NEON)
+    return PSL_Neon;
+#else
+    return PSL_Scalar;
+#endif
+}
+
+/// levelだけの実装の表。このビルドに無いときnullptr。
+static const PixelKernels*
+OwnKernels(PixelSimdLevel level)
+{
+    switch (level) {
+    case PSL_Scalar: return &gScalar;
+#if defined(PIXEL_CONVERT_X64)
+    case PSL_Sse2:   return &gSse2;
+    case PSL_Ssse3:  return &gSsse3;
+    case PSL_Avx2:   return &gAvx2;
+    case PSL_Avx512: return &gAvx512;
+#elif defined(PIXEL_CONVERT_NEON)
+    case PSL_Neon:   return &gNeon;
+#endif
+    default:         return nullptr;
+    }
+}
+
+static void
+Overlay(const PixelKernels& own, PixelKernels& k_r)
+{
+#define PIXEL_OVERLAY(f) if (own.f != nullptr) { k_r.f = own.f; }
+    PIXEL_OVERLAY(bgraSetAlpha);
+    PIXEL_OVERLAY(rgb24ToBgra);
+    PIXEL_OVERLAY(bgr24ToBgra);
+    PIXEL_OVERLAY(swapRB);
+    PIXEL_OVERLAY(premultiply);
+    PIXEL_OVERLAY(srgbToLinear16);
+    PIXEL_OVERLAY(linear16ToSrgb);
+    PIXEL_OVERLAY(u8ToU16);
+    PIXEL_OVERLAY(u8ToHalf);
+#undef PIXEL_OVERLAY
+}
+
+/// 各levelの、下のlevelで埋めた表。CPUが対応しないlevelは使わない。
+struct ResolvedKernels {
+    PixelSimdLevel detected;
+    bool available[PSL_NUM];
+    PixelKernels k[PSL_NUM];
+
+    ResolvedKernels(void)
+    {
+        detected = PixelSimdLevelDetect();
+        for (int i = 0; i < PSL_NUM; ++i) {
+            const PixelSimdLevel level = (PixelSimdLevel)i;
+            k[i] = gScalar;
+
+            // NEONはスカラー版の次。x86の各版は、それより下のすべての版の次。
+            if (level == PSL_Neon) {
+                available[i] = (detected == PSL_Neon);
+            } else {
+                available[i] = (detected != PSL_Neon && level <= detected) || level == PSL_Scalar;
+            }
+            if (!available[i] || OwnKernels(level) == nullptr) {
+                available[i] = false;
+                continue;
+            }
+            if (level != PSL_Neon) {
+                for (int j = PSL_Sse2; j < i; ++j) {
+                    Overlay(*OwnKernels((PixelSimdLevel)j), k[i]);
+                }
+            }
+            Overlay(*OwnKernels(level), k[i]);
+        }
+    }
+};
+
+static const ResolvedKernels&
+Resolved(void)
+{
+    static const ResolvedKernels r;
+    return r;
+}
+
+const PixelKernels&
+PixelConvert(void)
+{
+    const ResolvedKernels& r = Resolved();
+    return r.k[r.detected];
+}
+
+const PixelKernels*
+PixelConvertForLevel(PixelSimdLevel level)
+{
+    if (level < 0 || PSL_NUM <= level) {
+        return nullptr;
+    }
+    const ResolvedKernels& r = Resolved();
+    return r.available[level] ? &r.k[level] : nullptr;
+}
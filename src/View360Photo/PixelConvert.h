@@ -0,0 +1,69 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// 画素の形式を変換するカーネルの命令セット。
+enum PixelSimdLevel {
+    PSL_Scalar,
+    PSL_Sse2,
+
+    /// SSSE3 (_mm_shuffle_epi8)。
+    PSL_Ssse3,
+
+    /// AVX2とF16C。
+    PSL_Avx2,
+
+    /// AVX-512F, AVX-512BW。
+    PSL_Avx512,
+
+    /// ARM64のNEON。
+    PSL_Neon,
+
+    PSL_NUM
+};
+
+const char* PixelSimdLevelToStr(PixelSimdLevel level);
+
+/// このCPUとOSで使える最も上の命令セット。
+PixelSimdLevel PixelSimdLevelDetect(void);
+
+/// 1行分の画素を変換するカーネル群。nは画素数(u8ToU16, u8ToHalfは要素数)。
+/// srcとdstは同じ大きさの画素のときだけ同じアドレスにしてよい。アラインメントは不要。
+/// どの版もスカラー版と全く同じ値を書く。
+struct PixelKernels {
+    /// BGRA 8ビットを複写し、アルファーをalphaにする。
+    void (*bgraSetAlpha)(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha);
+
+    /// RGB 8ビット3バイト (R, G, Bの順) をBGRA 8ビットにする。アルファーはalpha。
+    void (*rgb24ToBgra)(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha);
+
+    /// BGR 8ビット3バイト (B, G, Rの順。GDI+のPixelFormat24bppRGB) をBGRA 8ビットにする。アルファーはalpha。
+    void (*bgr24ToBgra)(const uint8_t* src, uint8_t* dst, size_t n, uint8_t alpha);
+
+    /// RGBAとBGRAの相互変換。RとBを入れ替える。
+    void (*swapRB)(const uint8_t* src, uint8_t* dst, size_t n);
+
+    /// BGRA 8ビットの色にアルファーを掛ける。各色はround(c * a / 255)。
+    void (*premultiply)(const uint8_t* src, uint8_t* dst, size_t n);
+
+    /// BGRA 8ビットのsRGBを、リニアの16ビットUNORM 4要素にする。アルファーは x * 257。
+    void (*srgbToLinear16)(const uint8_t* src, uint16_t* dst, size_t n);
+
+    /// リニアの16ビットUNORM 4要素を、BGRA 8ビットのsRGBにする。アルファーは round(x / 257)。
+    void (*linear16ToSrgb)(const uint16_t* src, uint8_t* dst, size_t n);
+
+    /// 8ビットUNORMを16ビットUNORMにする (x * 257)。
+    void (*u8ToU16)(const uint8_t* src, uint16_t* dst, size_t n);
+
+    /// 8ビットUNORMを半精度浮動小数点数にする。x / 255.0fを最近接偶数丸めで半精度にした値。
+    void (*u8ToHalf)(const uint8_t* src, uint16_t* dst, size_t n);
+};
+
+/// このCPUで最も速い版のカーネル群。最初の呼び出しでCPUの機能を調べる。
+const PixelKernels& PixelConvert(void);
+
+/// levelの版のカーネル群。levelに無いカーネルはlevelより下の最も上の版になる。
+/// CPUがlevelに対応しないときや、levelがこのビルドに無いときnullptr。ツールで各版を比べるのに使う。
+const PixelKernels* PixelConvertForLevel(PixelSimdLevel level);
@@ -2,41 +2,114 @@
 
 #include "pch.h"
 #include "PlyReader.h"
+#include "AsciiNumberParser.h"
+#include "ParallelFor.h"
 #include <stdio.h>
 #include <assert.h>
+#include <limits>
+#include <type_traits>
 
 int PlyReader::Read(const std::wstring& path, TexturedMesh& tm_r) {
-    mTM = &tm_r;
-    mVtxProp = 0;
-    mFaceProp = 0;
+    int hr = Open(path);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // ヘッダーの個数ちょうどの大きさを確保し、そこに直接読み込む。
+    const size_t vtxBase = tm_r.vertexList.size();
+    const size_t idxBase = tm_r.triangleIdxList.size();
+    tm_r.vertexList.resize(vtxBase + NumVertices());
+    tm_r.triangleIdxList.resize(idxBase + NumIndices());
+
+    hr = ReadBody(tm_r.vertexList.data() + vtxBase, NumVertices(),
+            tm_r.triangleIdxList.data() + idxBase, NumIndices());
+    if (FAILED(hr)) {
+        tm_r.vertexList.resize(vtxBase);
+        tm_r.triangleIdxList.resize(idxBase);
+    }
+    return hr;
+}
+
+int
+PlyReader::Open(const std::wstring& path)
+{
+    Close();
+
     mNumVtx = 0;
     mNumFace = 0;
+    mIsBinary = false;
+    mIsBigEndian = false;
+    mElements.clear();
+    mVtxElem = -1;
+    mFaceElem = -1;
+    mFaceIdxProp = -1;
+    for (int i = 0; i < VF_NUM; ++i) {
+        mVtxFieldProp[i] = -1;
+        mVtxFieldDiv[i] = 1.0f;
+    }
 
-    mFp = nullptr;
-    errno_t er = _wfopen_s(&mFp, path.c_str(), L"rb");
-    if (er != 0) {
+    if (mMF.Open(path.c_str()) < 0) {
         printf("E: PlyReader::Read(%S) failed.\n", path.c_str());
         return E_FAIL;
     }
+    mPos = (const char*)mMF.Data();
+    mEnd = mPos + mMF.Size();
 
-    int hr = Read1();
+    mState = ST_ReadSignature;
+    int hr = Read1(ST_ReadData);
+    if (FAILED(hr)) {
+        Close();
+    }
+    return hr;
+}
+
+size_t
+PlyReader::NumIndices(void) const
+{
+    return (mFaceIdxProp < 0) ? 0 : 3 * (size_t)mNumFace;
+}
+
+int
+PlyReader::ReadBody(XyzUv* vtx_r, size_t vtxCount, uint32_t* idx_r, size_t idxCount)
+{
+    if (mState != ST_ReadData) {
+        printf("E: PlyReader::ReadBody() Open() is not called.\n");
+        return E_FAIL;
+    }
+    if (vtxCount < NumVertices() || idxCount < NumIndices()) {
+        printf("E: PlyReader::ReadBody() destination is too small. %zu < %zu or %zu < %zu\n",
+                vtxCount, NumVertices(), idxCount, NumIndices());
+        Close();
+        return E_FAIL;
+    }
 
-    fclose(mFp);
-    mFp = nullptr;
+    mVtxDst = vtx_r;
+    mIdxDst = idx_r;
 
+    int hr = Read1(ST_Finish);
+
+    mVtxDst = nullptr;
+    mIdxDst = nullptr;
+    Close();
     return hr;
 }
 
+void
+PlyReader::Close(void)
+{
+    mMF.Close();
+    mPos = nullptr;
+    mEnd = nullptr;
+}
+
+/// mStateがstopStateになるまで読み進める。
 int
-PlyReader::Read1(void)
+PlyReader::Read1(State stopState)
 {
     int hr = 0;
-    bool bDone = false;
-    assert(mFp);
-    assert(mTM);
+    assert(mMF.IsOpen());
 
-    mState = ST_ReadSignature;
-    while (!bDone) {
+    while (mState != stopState) {
         switch (mState) {
         case ST_ReadSignature:
             hr = ReadSignature();
@@ -45,18 +118,10 @@ PlyReader::Read1(void)
             hr = ReadFormat();
             break;
         case ST_ReadHeader:
-        case ST_ReadHeaderVtx:
-        case ST_ReadHeaderFace:
             hr = ReadHeader();
             break;
-        case ST_ReadVertex:
-            hr = ReadVertex();
-            break;
-        case ST_ReadFace:
-            hr = ReadFace();
-            break;
-        case ST_Finish:
-            bDone = true;
+        case ST_ReadData:
+            hr = ReadData();
             break;
         default:
             assert(0);
@@ -72,27 +137,33 @@ PlyReader::Read1(void)
     return hr;
 }
 
-static char *
-FGetS(char *s, int sizeof_s, FILE *fp)
+/// fgets(s, sizeof_s-1, fp)と同様に、マップしたファイルから1行読む。
+char *
+PlyReader::GetLine(char *s, int sizeof_s)
 {
-    memset(s, 0, sizeof_s);
-    char *r = fgets(s, sizeof_s-1, fp);
-    if (r == nullptr) {
-        return r;
+    if (mPos >= mEnd) {
+        return nullptr;
+    }
+
+    const char *lf = (const char *)memchr(mPos, '\n', mEnd - mPos);
+    size_t len = (lf == nullptr) ? (size_t)(mEnd - mPos) : (size_t)(lf + 1 - mPos);
+    if ((size_t)(sizeof_s - 2) < len) {
+        len = sizeof_s - 2;
     }
+    memcpy(s, mPos, len);
+    s[len] = 0;
+    mPos += len;
 
     // trim last LF
-    int len = (int)strlen(s);
-    if (s[len - 1] == '\n') {
-        s[len - 1] = 0;
+    if (0 < len && s[len - 1] == '\n') {
+        s[--len] = 0;
     }
 
     // trim last CR
-    len = (int)strlen(s);
-    if (s[len - 1] == '\r') {
-        s[len - 1] = 0;
+    if (0 < len && s[len - 1] == '\r') {
+        s[--len] = 0;
     }
-    return r;
+    return s;
 }
 
 int
@@ -100,7 +171,7 @@ PlyReader::ReadSignature(void)
 {
     char s[256];
 
-    char *r = FGetS(s, sizeof s, mFp);
+    char *r = GetLine(s, sizeof s);
     if (r == nullptr) {
         printf("E: PlyReader::ReadSignature() failed.\n");
         return E_FAIL;
@@ -125,7 +196,7 @@ PlyReader::ReadFormat(void)
     char* nextTkn    = nullptr;
     char s[256];
 
-    char* r = FGetS(s, sizeof s, mFp);
+    char* r = GetLine(s, sizeof s);
     if (r == nullptr) {
         printf("E: PlyReader::ReadFormat() failed.\n");
         return E_FAIL;
@@ -135,12 +206,20 @@ PlyReader::ReadFormat(void)
     tknType    = strtok_s(nullptr, seps, &nextTkn);
     tknVersion = strtok_s(nullptr, seps, &nextTkn);
 
-    if (0 != strcmp("format", tknFmt)) {
+    if (nullptr == tknFmt || 0 != strcmp("format", tknFmt)) {
         printf("E: PlyReader::ReadFormat() Not PLY file.\n");
         return E_FAIL;
     }
-    if (0 == strcmp("binary", tknType)) {
+    if (nullptr == tknType || nullptr == tknVersion) {
+        printf("E: PlyReader::ReadFormat() format line error.\n");
+        return E_FAIL;
+    }
+    if (0 == strcmp("binary_little_endian", tknType)) {
+        mIsBinary = true;
+        mIsBigEndian = false;
+    } else if (0 == strcmp("binary_big_endian", tknType)) {
         mIsBinary = true;
+        mIsBigEndian = true;
     } else if (0 == strcmp("ascii", tknType)) {
         mIsBinary = false;
     } else {
@@ -156,6 +235,83 @@ PlyReader::ReadFormat(void)
     return S_OK;
 }
 
+static PlyReader::PlyType
+ParsePlyType(const char *type)
+{
+    static const struct {
+        const char *name;
+        PlyReader::PlyType type;
+    } tbl[] = {
+        { "char",    PlyReader::PT_Int8 },
+        { "int8",    PlyReader::PT_Int8 },
+        { "uchar",   PlyReader::PT_Uint8 },
+        { "uint8",   PlyReader::PT_Uint8 },
+        { "short",   PlyReader::PT_Int16 },
+        { "int16",   PlyReader::PT_Int16 },
+        { "ushort",  PlyReader::PT_Uint16 },
+        { "uint16",  PlyReader::PT_Uint16 },
+        { "int",     PlyReader::PT_Int32 },
+        { "int32",   PlyReader::PT_Int32 },
+        { "uint",    PlyReader::PT_Uint32 },
+        { "uint32",  PlyReader::PT_Uint32 },
+        { "float",   PlyReader::PT_Float32 },
+        { "float32", PlyReader::PT_Float32 },
+        { "double",  PlyReader::PT_Float64 },
+        { "float64", PlyReader::PT_Float64 },
+    };
+
+    for (auto &t : tbl) {
+        if (0 == strcmp(t.name, type)) {
+            return t.type;
+        }
+    }
+    return PlyReader::PT_Unknown;
+}
+
+/// PLYのプロパティー型のバイト数。
+static int
+PlyTypeBytes(PlyReader::PlyType t)
+{
+    switch (t) {
+    case PlyReader::PT_Int8:
+    case PlyReader::PT_Uint8:
+        return 1;
+    case PlyReader::PT_Int16:
+    case PlyReader::PT_Uint16:
+        return 2;
+    case PlyReader::PT_Int32:
+    case PlyReader::PT_Uint32:
+    case PlyReader::PT_Float32:
+        return 4;
+    case PlyReader::PT_Float64:
+        return 8;
+    default:
+        assert(0);
+        return 0;
+    }
+}
+
+static bool
+IsIntegerType(PlyReader::PlyType t)
+{
+    return t != PlyReader::PT_Unknown && t != PlyReader::PT_Float32 && t != PlyReader::PT_Float64;
+}
+
+/// 整数型のUVを0～1にするために割る値。UNORM/SNORMと同じく型の最大値。浮動小数点型は1。
+static double
+UvDivisor(PlyReader::PlyType t)
+{
+    switch (t) {
+    case PlyReader::PT_Int8:   return 127.0;
+    case PlyReader::PT_Uint8:  return 255.0;
+    case PlyReader::PT_Int16:  return 32767.0;
+    case PlyReader::PT_Uint16: return 65535.0;
+    case PlyReader::PT_Int32:  return 2147483647.0;
+    case PlyReader::PT_Uint32: return 4294967295.0;
+    default:                   return 1.0;
+    }
+}
+
 int
 PlyReader::ReadHeader(void)
 {
@@ -165,7 +321,7 @@ PlyReader::ReadHeader(void)
     char* nextTkn = nullptr;
     char s[256];
 
-    char* r = FGetS(s, sizeof s, mFp);
+    char* r = GetLine(s, sizeof s);
     if (r == nullptr) {
         printf("E: PlyReader::ReadHeader() failed.\n");
         return E_FAIL;
@@ -180,30 +336,16 @@ PlyReader::ReadHeader(void)
     if (0 == strcmp("end_header", tkn)) {
         // ヘッダー終わり。
         // ヘッダーデータをチェックする。
-        if (mNumVtx <= 0) {
-            printf("E: PlyReader::ReadHeader() header does not contain \"element vertex\" error\n");
-            return E_FAIL;
-        }
-        if (mVtxProp == 0) {
-            printf("E: PlyReader::ReadHeader() header does not contain vertex property error\n");
-            return E_FAIL;
-        }
-
-        if (mVtxProp == (PP_X | PP_Y | PP_Z | PP_NX | PP_NY | PP_NZ | PP_S | PP_T)) {
-            mVtxPropType = VPT_XYZ_NXNYNZ_ST;
-        } else if (mVtxProp == (PP_X | PP_Y | PP_Z | PP_S | PP_T)) {
-            mVtxPropType = VPT_XYZ_ST;
-        } else {
-            mVtxPropType = VPT_Unknown;
-            printf("E: PlyReader::ReadHeader() unknown property type\n");
-            return E_FAIL;
+        int hr = CheckHeader();
+        if (FAILED(hr)) {
+            return hr;
         }
 
-        mState = ST_ReadVertex;
+        mState = ST_ReadData;
         return S_OK;
     }
 
-    if (0 == strcmp("comment", tkn)) {
+    if (0 == strcmp("comment", tkn) || 0 == strcmp("obj_info", tkn)) {
         // コメント。スルーする。
         return S_OK;
     }
@@ -211,130 +353,367 @@ PlyReader::ReadHeader(void)
     if (0 == strcmp("element", tkn)) {
         // element vertex nVtx
         // element face nFace
-        tkn = strtok_s(nullptr, seps, &nextTkn);
-        if (nullptr == tkn) {
+        char* tknName  = strtok_s(nullptr, seps, &nextTkn);
+        char* tknCount = strtok_s(nullptr, seps, &nextTkn);
+        if (nullptr == tknName || nullptr == tknCount) {
             printf("E: PlyReader::ReadHeader() element token error\n");
             return E_FAIL;
         }
 
-        if (0 == strcmp("vertex", tkn)) {
-            tkn = strtok_s(nullptr, seps, &nextTkn);
-            if (nullptr == tkn) {
-                printf("E: PlyReader::ReadHeader() element vertex token error\n");
-                return E_FAIL;
-            }
-            
-            rv = sscanf_s(tkn, "%d", &mNumVtx);
-            if (rv != 1 || mNumVtx <= 0) {
-                printf("E: PlyReader::ReadHeader() element vertex number error\n");
-                return E_FAIL;
-            }
-            mState = ST_ReadHeaderVtx;
+        Element e;
+        e.name = tknName;
+        rv = sscanf_s(tknCount, "%d", &e.count);
+        if (rv != 1 || e.count < 0) {
+            printf("E: PlyReader::ReadHeader() element %s number error\n", tknName);
+            return E_FAIL;
         }
 
-        if (0 == strcmp("face", tkn)) {
-            tkn = strtok_s(nullptr, seps, &nextTkn);
-            if (nullptr == tkn) {
-                printf("E: PlyReader::ReadHeader() element face token error\n");
+        if (0 == strcmp("vertex", tknName)) {
+            if (e.count <= 0 || 0 <= mVtxElem) {
+                printf("E: PlyReader::ReadHeader() element vertex number error\n");
                 return E_FAIL;
             }
-
-            rv = sscanf_s(tkn, "%d", &mNumFace);
-            if (rv != 1 || mNumFace <= 0) {
+            mVtxElem = (int)mElements.size();
+            mNumVtx = e.count;
+        } else if (0 == strcmp("face", tknName)) {
+            if (e.count <= 0 || 0 <= mFaceElem) {
                 printf("E: PlyReader::ReadHeader() element face number error\n");
                 return E_FAIL;
             }
-            mState = ST_ReadHeaderFace;
+            mFaceElem = (int)mElements.size();
+            mNumFace = e.count;
+        } else {
+            // 知らないelement。データは読み飛ばす。
+            printf("D: PlyReader::ReadHeader() unknown element %s\n", tknName);
         }
+
+        mElements.push_back(e);
         return S_OK;
     }
 
     if (0 == strcmp("property", tkn)) {
+        if (mElements.empty()) {
+            printf("E: PlyReader::ReadHeader() property without element error\n");
+            return E_FAIL;
+        }
+        Element &e = mElements.back();
+        Property prop;
+
         tkn = strtok_s(nullptr, seps, &nextTkn);
         if (nullptr == tkn) {
             printf("E: PlyReader::ReadHeader() property read error\n");
             return E_FAIL;
         }
 
-        if (0 == strcmp("float", tkn)) {
-            tkn = strtok_s(nullptr, seps, &nextTkn);
-            if (nullptr == tkn) {
-                printf("E: PlyReader::ReadHeader() property float read error\n");
+        if (0 == strcmp("list", tkn)) {
+            // property list uchar uint vertex_indices
+            char* tknCount = strtok_s(nullptr, seps, &nextTkn);
+            char* tknType  = strtok_s(nullptr, seps, &nextTkn);
+            if (nullptr == tknCount || nullptr == tknType) {
+                printf("E: PlyReader::ReadHeader() property list read error\n");
+                return E_FAIL;
+            }
+            prop.isList = true;
+            prop.countType = ParsePlyType(tknCount);
+            prop.type = ParsePlyType(tknType);
+            if (!IsIntegerType(prop.countType) || prop.type == PT_Unknown) {
+                printf("E: PlyReader::ReadHeader() property list type error %s %s\n", tknCount, tknType);
+                return E_FAIL;
+            }
+        } else {
+            prop.type = ParsePlyType(tkn);
+            if (prop.type == PT_Unknown) {
+                printf("E: PlyReader::ReadHeader() unknown property type %s\n", tkn);
                 return E_FAIL;
             }
+        }
 
-            if (0 == strcmp("x", tkn)) {
-                mVtxProp |= PP_X;
-            } else if (0 == strcmp("y", tkn)) {
-                mVtxProp |= PP_Y;
-            } else if (0 == strcmp("z", tkn)) {
-                mVtxProp |= PP_Z;
-            } else if (0 == strcmp("nx", tkn)) {
-                mVtxProp |= PP_NX;
-            } else if (0 == strcmp("ny", tkn)) {
-                mVtxProp |= PP_NY;
-            } else if (0 == strcmp("nz", tkn)) {
-                mVtxProp |= PP_NZ;
-            } else if (0 == strcmp("s", tkn)) {
-                mVtxProp |= PP_S;
-            } else if (0 == strcmp("t", tkn)) {
-                mVtxProp |= PP_T;
-            } else {
-                printf("D: PlyReader::ReadHeader() unknown float plop %s\n", tkn);
-                // スルーする。
+        tkn = strtok_s(nullptr, seps, &nextTkn);
+        if (nullptr == tkn) {
+            printf("E: PlyReader::ReadHeader() property name read error\n");
+            return E_FAIL;
+        }
+        prop.name = tkn;
+
+        e.props.push_back(prop);
+        return S_OK;
+    }
+
+    return S_OK;
+}
+
+/// プロパティー名が候補のどれかと一致するプロパティーの番号。無いとき-1。
+static int
+FindProperty(const std::vector<std::string> &names, const char * const *candidates)
+{
+    for (int c = 0; candidates[c] != nullptr; ++c) {
+        for (int i = 0; i < (int)names.size(); ++i) {
+            if (names[i] == candidates[c]) {
+                return i;
             }
-            return S_OK;
         }
+    }
+    return -1;
+}
 
-        if (0 == strcmp("list", tkn)) {
-            // トライアングルリスト。
-            mFaceProp |= PP_VTX_IDX;
-            return S_OK;
+/// end_headerを読んだ後、スキーマを確定する。
+int
+PlyReader::CheckHeader(void)
+{
+    if (mVtxElem < 0) {
+        printf("E: PlyReader::ReadHeader() header does not contain \"element vertex\" error\n");
+        return E_FAIL;
+    }
+
+    // 固定長レコードのバイト位置。
+    for (auto &e : mElements) {
+        int offset = 0;
+        for (auto &p : e.props) {
+            p.offset = offset;
+            if (p.isList) {
+                offset = -1;
+                break;
+            }
+            offset += PlyTypeBytes(p.type);
+        }
+        e.stride = (offset < 0) ? 0 : offset;
+    }
+
+    const Element &ve = mElements[mVtxElem];
+    if (ve.props.empty()) {
+        printf("E: PlyReader::ReadHeader() header does not contain vertex property error\n");
+        return E_FAIL;
+    }
+    if (ve.stride == 0) {
+        printf("E: PlyReader::ReadHeader() vertex list property is not supported\n");
+        return E_FAIL;
+    }
+    if (MAX_PROPS < (int)ve.props.size()) {
+        printf("E: PlyReader::ReadHeader() too many vertex properties %d\n", (int)ve.props.size());
+        return E_FAIL;
+    }
+
+    std::vector<std::string> names;
+    for (auto &p : ve.props) {
+        names.push_back(p.name);
+    }
+
+    static const char * const xNames[] = { "x", nullptr };
+    static const char * const yNames[] = { "y", nullptr };
+    static const char * const zNames[] = { "z", nullptr };
+    static const char * const uNames[] = { "s", "u", "texture_u", "texture_s", nullptr };
+    static const char * const vNames[] = { "t", "v", "texture_v", "texture_t", nullptr };
+    static const char * const * const fieldNames[VF_NUM] = { xNames, yNames, zNames, uNames, vNames };
+
+    for (int f = 0; f < VF_NUM; ++f) {
+        mVtxFieldProp[f] = FindProperty(names, fieldNames[f]);
+        if (mVtxFieldProp[f] < 0) {
+            printf("E: PlyReader::ReadHeader() vertex property %s not found\n", fieldNames[f][0]);
+            return E_FAIL;
+        }
+        mVtxFieldDiv[f] = (f == VF_U || f == VF_V) ? (float)UvDivisor(ve.props[mVtxFieldProp[f]].type) : 1.0f;
+    }
+
+    mFaceIdxProp = -1;
+    if (0 <= mFaceElem) {
+        const Element &fe = mElements[mFaceElem];
+        int nList = 0;
+        int lastList = -1;
+        names.clear();
+        for (int i = 0; i < (int)fe.props.size(); ++i) {
+            names.push_back(fe.props[i].isList ? fe.props[i].name : std::string());
+            if (fe.props[i].isList) {
+                ++nList;
+                lastList = i;
+            }
+        }
+
+        static const char * const idxNames[] = { "vertex_indices", "vertex_index", nullptr };
+        mFaceIdxProp = FindProperty(names, idxNames);
+        if (mFaceIdxProp < 0 && nList == 1) {
+            mFaceIdxProp = lastList;
+        }
+        if (mFaceIdxProp < 0) {
+            printf("D: PlyReader::ReadHeader() face element without vertex index list\n");
+        } else if (!IsIntegerType(fe.props[mFaceIdxProp].type)) {
+            printf("E: PlyReader::ReadHeader() element face property error\n");
+            return E_FAIL;
         }
     }
 
     return S_OK;
 }
 
+/// データ部の1行の範囲を戻し、読み出し位置を次の行の先頭に進める。
+/// @return 1: 成功。0: ファイルの終わり。-1: 行が長すぎる。
+int
+PlyReader::NextDataLine(const char **line_r, const char **lineEnd_r)
+{
+    if (mPos >= mEnd) {
+        return 0;
+    }
+
+    const char *lineEnd = AsciiNumberParser::FindLF(mPos, mEnd);
+    if (MAX_LINE_BYTES < lineEnd - mPos) {
+        return -1;
+    }
+
+    *line_r = mPos;
+    *lineEnd_r = lineEnd;
+    mPos = (lineEnd < mEnd) ? lineEnd + 1 : lineEnd;
+    return 1;
+}
+
+/// ASCIIの頂点1行のうち読む必要がある数値の個数。
+int
+PlyReader::NumVtxItems(void) const
+{
+    int n = 0;
+    for (int f = 0; f < VF_NUM; ++f) {
+        n = std::max(n, mVtxFieldProp[f] + 1);
+    }
+    return n;
+}
+
+/// ASCIIの頂点1行を読む。
+/// 出力に使うプロパティーのうち最後のものまでを数値として読む。
+/// @return 読めた数値の個数。
+int
+PlyReader::ParseVertexLine(const char *line, const char *lineEnd, XyzUv &xyzUv_r) const
+{
+    float v[MAX_PROPS];
+    const int n = NumVtxItems();
+
+    int rv = AsciiNumberParser::ParseFloats(line, lineEnd, v, n);
+    if (rv == n) {
+        xyzUv_r.xyz = { v[mVtxFieldProp[VF_X]], v[mVtxFieldProp[VF_Y]], v[mVtxFieldProp[VF_Z]] };
+        xyzUv_r.uv = { v[mVtxFieldProp[VF_U]] / mVtxFieldDiv[VF_U], v[mVtxFieldProp[VF_V]] / mVtxFieldDiv[VF_V] };
+    }
+    return rv;
+}
+
+/// 頂点番号が0以上、頂点数未満か。
+static bool
+IsValidIndex(int v, int numVtx)
+{
+    return 0 <= v && v < numVtx;
+}
+
+/// ASCIIの面1行を読む。
+/// @return 成功のとき0以上。失敗のとき負の値。頂点番号が範囲外のときFACE_INDEX_OUT_OF_RANGE。
+int
+PlyReader::ParseFaceLine(const char *line, const char *lineEnd, uint32_t *idx_r, int *nIdx_r) const
+{
+    using namespace AsciiNumberParser;
+
+    const Element &fe = mElements[mFaceElem];
+    const char *p = line;
+
+    if (fe.props.size() == 1) {
+        // 頂点番号リストだけの場合。
+        int v[4];
+        int rv = ParseInts(p, lineEnd, v, 4);
+        if (rv != 4) {
+            return -1;
+        }
+        if (v[0] == 3 && !(IsValidIndex(v[1], mNumVtx) && IsValidIndex(v[2], mNumVtx) && IsValidIndex(v[3], mNumVtx))) {
+            return FACE_INDEX_OUT_OF_RANGE;
+        }
+        *nIdx_r = v[0];
+        idx_r[0] = v[1];
+        idx_r[1] = v[2];
+        idx_r[2] = v[3];
+        return 0;
+    }
+
+    for (int i = 0; i < (int)fe.props.size(); ++i) {
+        const Property &prop = fe.props[i];
+        int count = 1;
+        if (prop.isList) {
+            p = ParseInt(SkipSpaces(p, lineEnd), lineEnd, count);
+            if (p == nullptr || !IsTokenEnd(p, lineEnd) || count < 0) {
+                return -1;
+            }
+        }
+        if (i == mFaceIdxProp) {
+            *nIdx_r = count;
+            if (count != 3) {
+                return 0;
+            }
+            int v[3];
+            if (ParseInts(p, lineEnd, v, 3) != 3) {
+                return -1;
+            }
+            if (!(IsValidIndex(v[0], mNumVtx) && IsValidIndex(v[1], mNumVtx) && IsValidIndex(v[2], mNumVtx))) {
+                return FACE_INDEX_OUT_OF_RANGE;
+            }
+            idx_r[0] = v[0];
+            idx_r[1] = v[1];
+            idx_r[2] = v[2];
+            return 0;
+        }
+
+        // 使わない値を読み飛ばす。
+        for (int j = 0; j < count; ++j) {
+            float dummy;
+            p = ParseFloat(SkipSpaces(p, lineEnd), lineEnd, dummy);
+            if (p == nullptr || !IsTokenEnd(p, lineEnd)) {
+                return -1;
+            }
+        }
+    }
+    return -1;
+}
+
+/// 要素をヘッダーの順に読む。
+int
+PlyReader::ReadData(void)
+{
+    if (!mIsBinary && mParallel && PARALLEL_THRESHOLD_BYTES <= mEnd - mPos && 1 < ParallelForNumThreads()) {
+        return ReadAsciiParallel();
+    }
+
+    for (int i = 0; i < (int)mElements.size(); ++i) {
+        int hr = S_OK;
+        if (i == mVtxElem) {
+            hr = ReadVertex();
+        } else if (i == mFaceElem && 0 <= mFaceIdxProp) {
+            hr = ReadFace();
+        } else {
+            hr = SkipElement(mElements[i]);
+        }
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    mState = ST_Finish;
+    return S_OK;
+}
+
 int
 PlyReader::ReadVertex(void) {
     int rv = 0;
-    char s[256];
+    const char *line = nullptr;
+    const char *lineEnd = nullptr;
+
+    if (mIsBinary) {
+        return ReadVertexBinary();
+    }
 
     for (int i = 0; i < mNumVtx; ++i) {
-        char* r = FGetS(s, sizeof s, mFp);
-        if (r == nullptr) {
-            printf("E: PlyReader::ReadVertex() failed.\n");
+        rv = NextDataLine(&line, &lineEnd);
+        if (rv <= 0) {
+            printf("E: PlyReader::ReadVertex() failed%s.\n", rv < 0 ? " line too long" : "");
             return E_FAIL;
         }
-        XyzUv xyzUv;
-        float nx, ny, nz;
-        switch (mVtxPropType) {
-        case VPT_XYZ_NXNYNZ_ST:
-            rv = sscanf_s(s, "%f %f %f %f %f %f %f %f",
-                &xyzUv.xyz.x, &xyzUv.xyz.y, &xyzUv.xyz.z, &nx, &ny, &nz, &xyzUv.uv.x, &xyzUv.uv.y);
-            if (rv != 8) {
-                printf("E: PlyReader::ReadVertex() vertex item read failed 1 %d.\n", rv);
-                return E_FAIL;
-            }
-            break;
-        case VPT_XYZ_ST:
-            rv = sscanf_s(s, "%f %f %f %f %f",
-                &xyzUv.xyz.x, &xyzUv.xyz.y, &xyzUv.xyz.z, &xyzUv.uv.x, &xyzUv.uv.y);
-            if (rv != 5) {
-                printf("E: PlyReader::ReadVertex() vertex item read failed 2 %d.\n", rv);
-                return E_FAIL;
-            }
-            break;
-        default:
-            assert(0);
-            break;
+        rv = ParseVertexLine(line, lineEnd, mVtxDst[i]);
+        if (rv != NumVtxItems()) {
+            printf("E: PlyReader::ReadVertex() vertex item read failed %d.\n", rv);
+            return E_FAIL;
         }
-
-        mTM->vertexList.push_back(xyzUv);
     }
 
-    mState = ST_ReadFace;
     return S_OK;
 }
 
@@ -342,33 +721,27 @@ int
 PlyReader::ReadFace(void)
 {
     int rv = 0;
-    char s[256];
+    const char *line = nullptr;
+    const char *lineEnd = nullptr;
 
-    if (mFaceProp == 0) {
-        // 面が無い場合。
-        // OK.
-        mState = ST_Finish;
-        return S_OK;
-    }
-
-    if (mFaceProp != PP_VTX_IDX) {
-        printf("E: PlyReader::ReadFace() element face property error\n");
-        return E_FAIL;
+    if (mIsBinary) {
+        return ReadFaceBinary();
     }
 
     for (int i = 0; i < mNumFace; ++i) {
-        char* r = FGetS(s, sizeof s, mFp);
-        if (r == nullptr) {
-            printf("E: PlyReader::ReadFace() failed.\n");
+        rv = NextDataLine(&line, &lineEnd);
+        if (rv <= 0) {
+            printf("E: PlyReader::ReadFace() failed%s.\n", rv < 0 ? " line too long" : "");
             return E_FAIL;
         }
-        int nIdx;
-        int idx0;
-        int idx1;
-        int idx2;
-        rv = sscanf_s(s, "%d %d %d %d", &nIdx, &idx0, &idx1, &idx2);
-        if (rv != 4) {
-            printf("E: PlyReader::ReadFace() face item read failed %d.\n", rv);
+        int nIdx = 0;
+        rv = ParseFaceLine(line, lineEnd, &mIdxDst[3 * (size_t)i], &nIdx);
+        if (rv == FACE_INDEX_OUT_OF_RANGE) {
+            printf("E: PlyReader::ReadFace() face %d vertex index out of range.\n", i);
+            return E_FAIL;
+        }
+        if (rv < 0) {
+            printf("E: PlyReader::ReadFace() face item read failed.\n");
             return E_FAIL;
         }
 
@@ -376,12 +749,563 @@ PlyReader::ReadFace(void)
             printf("E: PlyReader::ReadFace() only triangle index supported error. %d.\n", nIdx);
             return E_FAIL;
         }
+    }
+
+    return S_OK;
+}
+
+/// 使わない要素を読み飛ばす。
+int
+PlyReader::SkipElement(const Element &e)
+{
+    if (!mIsBinary) {
+        const char *line = nullptr;
+        const char *lineEnd = nullptr;
+        for (int i = 0; i < e.count; ++i) {
+            int rv = NextDataLine(&line, &lineEnd);
+            if (rv <= 0) {
+                printf("E: PlyReader::SkipElement(%s) failed%s.\n", e.name.c_str(), rv < 0 ? " line too long" : "");
+                return E_FAIL;
+            }
+        }
+        return S_OK;
+    }
+
+    if (0 < e.stride) {
+        if ((size_t)(mEnd - mPos) < (size_t)e.count * e.stride) {
+            printf("E: PlyReader::SkipElement(%s) file is too short.\n", e.name.c_str());
+            return E_FAIL;
+        }
+        mPos += (size_t)e.count * e.stride;
+        return S_OK;
+    }
+
+    for (int i = 0; i < e.count; ++i) {
+        mPos = SkipBinaryRecord(e, mPos);
+        if (mPos == nullptr) {
+            printf("E: PlyReader::SkipElement(%s) file is too short.\n", e.name.c_str());
+            return E_FAIL;
+        }
+    }
+    return S_OK;
+}
+
+/// ASCIIのデータ部を改行位置で分割し、複数スレッドで頂点と面を読む。
+/// 各チャンクの先頭の行番号を先に数えておき、出力配列の該当位置に直接書く。
+/// 1行ごとの解析はReadVertex(), ReadFace()と同じ関数を使うので、結果は同一になる。
+int
+PlyReader::ReadAsciiParallel(void)
+{
+    using namespace AsciiNumberParser;
+
+    // 各要素の先頭行の行番号。
+    size_t vtxLine = 0;
+    size_t faceLine = 0;
+    size_t nLines = 0;
+    for (int i = 0; i < (int)mElements.size(); ++i) {
+        if (i == mVtxElem) {
+            vtxLine = nLines;
+        }
+        if (i == mFaceElem) {
+            faceLine = nLines;
+        }
+        nLines += mElements[i].count;
+    }
+    const size_t nFace = (0 <= mFaceIdxProp) ? mNumFace : 0;
+
+    // チャンクの境界を行頭に合わせる。
+    const int nChunks = ParallelForNumThreads() * 4;
+    const size_t bytes = mEnd - mPos;
+    std::vector<const char*> bounds;
+    bounds.push_back(mPos);
+    for (int i = 1; i < nChunks; ++i) {
+        const char *p = mPos + bytes * i / nChunks;
+        if (p < bounds.back()) {
+            continue;
+        }
+        p = FindLF(p, mEnd);
+        if (p < mEnd) {
+            ++p;
+        }
+        if (bounds.back() < p && p < mEnd) {
+            bounds.push_back(p);
+        }
+    }
+    bounds.push_back(mEnd);
+    const int nc = (int)bounds.size() - 1;
+
+    // 各チャンクの行数を数え、先頭行の行番号を求める。
+    std::vector<size_t> firstLine(nc + 1, 0);
+    ParallelFor(nc, [&](int c) {
+        firstLine[c + 1] = CountLF(bounds[c], bounds[c + 1]);
+    });
+    if (mEnd[-1] != '\n') {
+        // 最後の行に改行が無い。
+        ++firstLine[nc];
+    }
+    for (int c = 0; c < nc; ++c) {
+        firstLine[c + 1] += firstLine[c];
+    }
+
+    XyzUv *vtx = mVtxDst;
+    uint32_t *idx = mIdxDst;
+
+    // チャンクごとに最初のエラーを記録する。
+    enum ErrorType {
+        ET_None,
+        ET_LineTooLong,
+        ET_VtxItem,
+        ET_FaceItem,
+        ET_FaceNotTriangle,
+        ET_FaceIndex,
+    };
+    struct ChunkError {
+        ErrorType type;
+        size_t line;
+        int value;
+    };
+    std::vector<ChunkError> errors(nc, { ET_None, 0, 0 });
+
+    const int nVtxItems = NumVtxItems();
+
+    ParallelFor(nc, [&](int c) {
+        const char *p = bounds[c];
+        const char *end = bounds[c + 1];
+        for (size_t line = firstLine[c]; p < end && line < nLines; ++line) {
+            const char *lineEnd = FindLF(p, end);
+            if (MAX_LINE_BYTES < lineEnd - p) {
+                errors[c] = { ET_LineTooLong, line, 0 };
+                return;
+            }
 
-        mTM->triangleIdxList.push_back(idx0);
-        mTM->triangleIdxList.push_back(idx1);
-        mTM->triangleIdxList.push_back(idx2);
+            if (vtxLine <= line && line < vtxLine + mNumVtx) {
+                int rv = ParseVertexLine(p, lineEnd, vtx[line - vtxLine]);
+                if (rv != nVtxItems) {
+                    errors[c] = { ET_VtxItem, line, rv };
+                    return;
+                }
+            } else if (faceLine <= line && line < faceLine + nFace) {
+                const size_t f = line - faceLine;
+                int nIdx = 0;
+                int rv = ParseFaceLine(p, lineEnd, &idx[3 * f], &nIdx);
+                if (rv == FACE_INDEX_OUT_OF_RANGE) {
+                    errors[c] = { ET_FaceIndex, line, (int)f };
+                    return;
+                }
+                if (rv < 0) {
+                    errors[c] = { ET_FaceItem, line, rv };
+                    return;
+                }
+                if (nIdx != 3) {
+                    errors[c] = { ET_FaceNotTriangle, line, nIdx };
+                    return;
+                }
+            }
+
+            p = (lineEnd < end) ? lineEnd + 1 : lineEnd;
+        }
+    });
+
+    // 一番前の行のエラーを、逐次処理と同じメッセージで出す。
+    for (auto &e : errors) {
+        switch (e.type) {
+        case ET_None:
+            continue;
+        case ET_LineTooLong:
+            {
+                // 行を含む要素。逐次処理でその要素を読む関数の名前で出す。
+                int elem = 0;
+                size_t elemLine = 0;
+                while (elem + 1 < (int)mElements.size() && elemLine + mElements[elem].count <= e.line) {
+                    elemLine += mElements[elem].count;
+                    ++elem;
+                }
+                if (elem == mVtxElem) {
+                    printf("E: PlyReader::ReadVertex() failed line too long.\n");
+                } else if (elem == mFaceElem && 0 <= mFaceIdxProp) {
+                    printf("E: PlyReader::ReadFace() failed line too long.\n");
+                } else {
+                    printf("E: PlyReader::SkipElement(%s) failed line too long.\n", mElements[elem].name.c_str());
+                }
+            }
+            break;
+        case ET_VtxItem:
+            printf("E: PlyReader::ReadVertex() vertex item read failed %d.\n", e.value);
+            break;
+        case ET_FaceItem:
+            printf("E: PlyReader::ReadFace() face item read failed.\n");
+            break;
+        case ET_FaceNotTriangle:
+            printf("E: PlyReader::ReadFace() only triangle index supported error. %d.\n", e.value);
+            break;
+        case ET_FaceIndex:
+            printf("E: PlyReader::ReadFace() face %d vertex index out of range.\n", e.value);
+            break;
+        }
+        return E_FAIL;
     }
 
+    if (firstLine[nc] < nLines) {
+        // 行が足りない。
+        if (firstLine[nc] < vtxLine + mNumVtx) {
+            printf("E: PlyReader::ReadVertex() failed.\n");
+        } else {
+            printf("E: PlyReader::ReadFace() failed.\n");
+        }
+        return E_FAIL;
+    }
+
+    mPos = mEnd;
     mState = ST_Finish;
     return S_OK;
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// バイナリー
+
+static inline uint32_t
+ByteSwap32(uint32_t v)
+{
+    return (v >> 24) | ((v >> 8) & 0x0000ff00) | ((v << 8) & 0x00ff0000) | (v << 24);
+}
+
+static inline uint16_t
+ByteSwap16(uint16_t v)
+{
+    return (uint16_t)((v >> 8) | (v << 8));
+}
+
+static inline uint64_t
+ByteSwap64(uint64_t v)
+{
+    return ((uint64_t)ByteSwap32((uint32_t)v) << 32) | ByteSwap32((uint32_t)(v >> 32));
+}
+
+/// バイナリーの値を1個読む。
+template <typename T, bool BigEndian>
+static inline T
+LoadValue(const char *p)
+{
+    T v;
+    if constexpr (sizeof(T) == 1 || !BigEndian) {
+        memcpy(&v, p, sizeof v);
+    } else if constexpr (sizeof(T) == 2) {
+        uint16_t u;
+        memcpy(&u, p, 2);
+        u = ByteSwap16(u);
+        memcpy(&v, &u, 2);
+    } else if constexpr (sizeof(T) == 4) {
+        uint32_t u;
+        memcpy(&u, p, 4);
+        u = ByteSwap32(u);
+        memcpy(&v, &u, 4);
+    } else {
+        static_assert(sizeof(T) == 8, "unexpected size");
+        uint64_t u;
+        memcpy(&u, p, 8);
+        u = ByteSwap64(u);
+        memcpy(&v, &u, 8);
+    }
+    return v;
+}
+
+template <bool BigEndian>
+static double
+LoadScalarT(const char *p, PlyReader::PlyType t)
+{
+    switch (t) {
+    case PlyReader::PT_Int8:    return LoadValue<int8_t,   BigEndian>(p);
+    case PlyReader::PT_Uint8:   return LoadValue<uint8_t,  BigEndian>(p);
+    case PlyReader::PT_Int16:   return LoadValue<int16_t,  BigEndian>(p);
+    case PlyReader::PT_Uint16:  return LoadValue<uint16_t, BigEndian>(p);
+    case PlyReader::PT_Int32:   return LoadValue<int32_t,  BigEndian>(p);
+    case PlyReader::PT_Uint32:  return LoadValue<uint32_t, BigEndian>(p);
+    case PlyReader::PT_Float32: return LoadValue<float,    BigEndian>(p);
+    case PlyReader::PT_Float64: return LoadValue<double,   BigEndian>(p);
+    default:
+        assert(0);
+        return 0;
+    }
+}
+
+/// 型を実行時に調べて値を読む。汎用の遅い経路で使う。
+static inline double
+LoadScalar(const char *p, PlyReader::PlyType t, bool bigEndian)
+{
+    return bigEndian ? LoadScalarT<true>(p, t) : LoadScalarT<false>(p, t);
+}
+
+/// 整数値を読む。リストの個数と頂点番号用。
+static inline uint32_t
+LoadUint(const char *p, PlyReader::PlyType t, bool bigEndian)
+{
+    switch (t) {
+    case PlyReader::PT_Int8:
+    case PlyReader::PT_Uint8:
+        return *(const uint8_t*)p;
+    case PlyReader::PT_Int16:
+    case PlyReader::PT_Uint16:
+        return bigEndian ? LoadValue<uint16_t, true>(p) : LoadValue<uint16_t, false>(p);
+    default:
+        return bigEndian ? LoadValue<uint32_t, true>(p) : LoadValue<uint32_t, false>(p);
+    }
+}
+
+typedef void (*VertexDecoder)(const char *from, int stride, const int *offs, size_t n, XyzUv *to);
+
+/// 位置とUVの型をコンパイル時に決めた頂点デコーダー。整数型のUVは型の最大値で割る。
+template <typename PosT, typename UvT, bool BigEndian>
+static void
+DecodeVerticesT(const char *from, int stride, const int *offs, size_t n, XyzUv *to)
+{
+    const double uvDiv = std::is_integral<UvT>::value ? (double)std::numeric_limits<UvT>::max() : 1.0;
+    for (size_t i = 0; i < n; ++i) {
+        const char *rec = from + i * stride;
+        to[i].xyz.x = (float)LoadValue<PosT, BigEndian>(rec + offs[PlyReader::VF_X]);
+        to[i].xyz.y = (float)LoadValue<PosT, BigEndian>(rec + offs[PlyReader::VF_Y]);
+        to[i].xyz.z = (float)LoadValue<PosT, BigEndian>(rec + offs[PlyReader::VF_Z]);
+        to[i].uv.x  = (float)(LoadValue<UvT, BigEndian>(rec + offs[PlyReader::VF_U]) / uvDiv);
+        to[i].uv.y  = (float)(LoadValue<UvT, BigEndian>(rec + offs[PlyReader::VF_V]) / uvDiv);
+    }
+}
+
+template <bool BigEndian>
+static VertexDecoder
+SelectVertexDecoderT(PlyReader::PlyType posType, PlyReader::PlyType uvType)
+{
+    using P = PlyReader;
+    if (posType == P::PT_Float32 && uvType == P::PT_Float32) {
+        return DecodeVerticesT<float, float, BigEndian>;
+    }
+    if (posType == P::PT_Float64 && uvType == P::PT_Float32) {
+        return DecodeVerticesT<double, float, BigEndian>;
+    }
+    if (posType == P::PT_Float64 && uvType == P::PT_Float64) {
+        return DecodeVerticesT<double, double, BigEndian>;
+    }
+    if (posType == P::PT_Float32 && uvType == P::PT_Uint16) {
+        return DecodeVerticesT<float, uint16_t, BigEndian>;
+    }
+    return nullptr;
+}
+
+/// よく使う型の組み合わせのデコーダーを選ぶ。無いときnullptr。
+static VertexDecoder
+SelectVertexDecoder(PlyReader::PlyType posType, PlyReader::PlyType uvType, bool bigEndian)
+{
+    return bigEndian ? SelectVertexDecoderT<true>(posType, uvType)
+                     : SelectVertexDecoderT<false>(posType, uvType);
+}
+
+/// 汎用の頂点デコーダー。値ごとに型を調べる。整数型のUVは型の最大値で割る。
+static void
+DecodeVerticesGeneric(const char *from, int stride, const int *offs, const PlyReader::PlyType *types,
+        bool bigEndian, size_t n, XyzUv *to)
+{
+    double div[PlyReader::VF_NUM];
+    for (int f = 0; f < PlyReader::VF_NUM; ++f) {
+        div[f] = (f == PlyReader::VF_U || f == PlyReader::VF_V) ? UvDivisor(types[f]) : 1.0;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const char *rec = from + i * stride;
+        float v[PlyReader::VF_NUM];
+        for (int f = 0; f < PlyReader::VF_NUM; ++f) {
+            v[f] = (float)(LoadScalar(rec + offs[f], types[f], bigEndian) / div[f]);
+        }
+        to[i].xyz = { v[PlyReader::VF_X], v[PlyReader::VF_Y], v[PlyReader::VF_Z] };
+        to[i].uv = { v[PlyReader::VF_U], v[PlyReader::VF_V] };
+    }
+}
+
+int
+PlyReader::ReadVertexBinary(void)
+{
+    static_assert(sizeof(XyzUv) == 20, "XyzUv must be 5 floats");
+
+    const Element &ve = mElements[mVtxElem];
+    const size_t bytes = (size_t)mNumVtx * ve.stride;
+    if ((size_t)(mEnd - mPos) < bytes) {
+        printf("E: PlyReader::ReadVertexBinary() file is too short.\n");
+        return E_FAIL;
+    }
+
+    int offs[VF_NUM];
+    PlyType types[VF_NUM];
+    for (int f = 0; f < VF_NUM; ++f) {
+        const Property &prop = ve.props[mVtxFieldProp[f]];
+        offs[f] = prop.offset;
+        types[f] = prop.type;
+    }
+
+    XyzUv *to = mVtxDst;
+
+    bool sameAsXyzUv = !mIsBigEndian && ve.stride == sizeof(XyzUv);
+    for (int f = 0; f < VF_NUM; ++f) {
+        sameAsXyzUv = sameAsXyzUv && offs[f] == 4 * f && types[f] == PT_Float32;
+    }
+
+    VertexDecoder decoder = nullptr;
+    if (types[VF_X] == types[VF_Y] && types[VF_X] == types[VF_Z] && types[VF_U] == types[VF_V]) {
+        decoder = SelectVertexDecoder(types[VF_X], types[VF_U], mIsBigEndian);
+    }
+
+    if (sameAsXyzUv) {
+        // ファイルの頂点レコードがXyzUvと同じ並びなので、そのままコピーする。
+        memcpy(to, mPos, bytes);
+    } else if (decoder != nullptr) {
+        decoder(mPos, ve.stride, offs, mNumVtx, to);
+    } else {
+        DecodeVerticesGeneric(mPos, ve.stride, offs, types, mIsBigEndian, mNumVtx, to);
+    }
+    mPos += bytes;
+
+    return S_OK;
+}
+
+/// 個数と頂点番号の型をコンパイル時に決めた、三角形リストのデコーダー。
+/// @return 成功のとき次のレコードの位置。失敗のときnullptr。
+template <typename CountT, typename IdxT, bool BigEndian>
+static const char *
+DecodeFacesT(const char *p, const char *end, size_t n, uint32_t *to, int *nIdx_r)
+{
+    const size_t recBytes = sizeof(CountT) + 3 * sizeof(IdxT);
+    if ((size_t)(end - p) < n * recBytes) {
+        *nIdx_r = -1;
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const CountT c = LoadValue<CountT, BigEndian>(p);
+        if (c != 3) {
+            *nIdx_r = (int)c;
+            return nullptr;
+        }
+        p += sizeof(CountT);
+        to[3 * i + 0] = LoadValue<IdxT, BigEndian>(p);
+        to[3 * i + 1] = LoadValue<IdxT, BigEndian>(p + sizeof(IdxT));
+        to[3 * i + 2] = LoadValue<IdxT, BigEndian>(p + 2 * sizeof(IdxT));
+        p += 3 * sizeof(IdxT);
+    }
+    return p;
+}
+
+typedef const char *(*FaceDecoder)(const char *p, const char *end, size_t n, uint32_t *to, int *nIdx_r);
+
+template <bool BigEndian>
+static FaceDecoder
+SelectFaceDecoderT(int countBytes, int idxBytes)
+{
+    switch (countBytes * 16 + idxBytes) {
+    case 0x14: return DecodeFacesT<uint8_t,  uint32_t, BigEndian>;
+    case 0x12: return DecodeFacesT<uint8_t,  uint16_t, BigEndian>;
+    case 0x24: return DecodeFacesT<uint16_t, uint32_t, BigEndian>;
+    case 0x22: return DecodeFacesT<uint16_t, uint16_t, BigEndian>;
+    case 0x44: return DecodeFacesT<uint32_t, uint32_t, BigEndian>;
+    case 0x42: return DecodeFacesT<uint32_t, uint16_t, BigEndian>;
+    default:   return nullptr;
+    }
+}
+
+/// 可変長レコードを1個読み飛ばす。
+/// @return 次のレコードの位置。ファイルが短いときnullptr。
+const char *
+PlyReader::SkipBinaryRecord(const Element &e, const char *p) const
+{
+    for (auto &prop : e.props) {
+        size_t bytes = PlyTypeBytes(prop.type);
+        if (prop.isList) {
+            const int cb = PlyTypeBytes(prop.countType);
+            if (mEnd - p < cb) {
+                return nullptr;
+            }
+            bytes *= LoadUint(p, prop.countType, mIsBigEndian);
+            p += cb;
+        }
+        if ((size_t)(mEnd - p) < bytes) {
+            return nullptr;
+        }
+        p += bytes;
+    }
+    return p;
+}
+
+int
+PlyReader::ReadFaceBinary(void)
+{
+    const Element &fe = mElements[mFaceElem];
+    const Property &ip = fe.props[mFaceIdxProp];
+    uint32_t *to = mIdxDst;
+
+    FaceDecoder decoder = nullptr;
+    if (fe.props.size() == 1 && IsIntegerType(ip.type)) {
+        const int cb = PlyTypeBytes(ip.countType);
+        const int ib = PlyTypeBytes(ip.type);
+        decoder = mIsBigEndian ? SelectFaceDecoderT<true>(cb, ib) : SelectFaceDecoderT<false>(cb, ib);
+    }
+
+    if (decoder != nullptr) {
+        // property list uchar uint vertex_indices 等、頂点番号リストだけの場合。
+        int nIdx = 0;
+        const char *p = decoder(mPos, mEnd, mNumFace, to, &nIdx);
+        if (p == nullptr) {
+            if (nIdx < 0) {
+                printf("E: PlyReader::ReadFaceBinary() file is too short.\n");
+            } else {
+                printf("E: PlyReader::ReadFaceBinary() only triangle index supported error. %d.\n", nIdx);
+            }
+            return E_FAIL;
+        }
+        mPos = p;
+        return CheckFaceIndicesBinary();
+    }
+
+    // 汎用の経路。プロパティーを順に読む。
+    const char *p = mPos;
+    for (int i = 0; i < mNumFace; ++i) {
+        for (int j = 0; j < (int)fe.props.size(); ++j) {
+            const Property &prop = fe.props[j];
+            const int vb = PlyTypeBytes(prop.type);
+            uint32_t count = 1;
+            if (prop.isList) {
+                const int cb = PlyTypeBytes(prop.countType);
+                if (mEnd - p < cb) {
+                    printf("E: PlyReader::ReadFaceBinary() file is too short.\n");
+                    return E_FAIL;
+                }
+                count = LoadUint(p, prop.countType, mIsBigEndian);
+                p += cb;
+            }
+            if ((size_t)(mEnd - p) < (size_t)count * vb) {
+                printf("E: PlyReader::ReadFaceBinary() file is too short.\n");
+                return E_FAIL;
+            }
+            if (j == mFaceIdxProp) {
+                if (count != 3) {
+                    printf("E: PlyReader::ReadFaceBinary() only triangle index supported error. %u.\n", count);
+                    return E_FAIL;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    to[3 * (size_t)i + k] = LoadUint(p + k * vb, prop.type, mIsBigEndian);
+                }
+            }
+            p += (size_t)count * vb;
+        }
+    }
+    mPos = p;
+
+    return CheckFaceIndicesBinary();
+}
+
+/// バイナリーで読んだ頂点番号が頂点数未満か確かめる。
+int
+PlyReader::CheckFaceIndicesBinary(void) const
+{
+    const size_t n = 3 * (size_t)mNumFace;
+    for (size_t i = 0; i < n; ++i) {
+        if ((uint32_t)mNumVtx <= mIdxDst[i]) {
+            printf("E: PlyReader::ReadFaceBinary() face %zu vertex index out of range.\n", i / 3);
+            return E_FAIL;
+        }
+    }
+    return S_OK;
+}
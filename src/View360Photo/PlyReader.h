@@ -3,6 +3,7 @@
 
 #include "pch.h"
 #include "TexturedMesh.h"
+#include "MappedFile.h"
 #include <stdio.h>
 #include <stdint.h>
 
@@ -10,52 +11,134 @@ class PlyReader {
 public:
     int Read(const std::wstring& path, TexturedMesh& tm_return);
 
+    // 呼び出し側が用意したメモリーに直接読み込む場合は、
+    // Open()でヘッダーを読み、NumVertices()とNumIndices()の大きさの出力先を用意して
+    // ReadBody()を呼ぶ。ReadBody()はファイルを閉じる。
+
+    int Open(const std::wstring& path);
+    size_t NumVertices(void) const { return (size_t)mNumVtx; }
+    size_t NumIndices(void) const;
+    int ReadBody(XyzUv* vtx_r, size_t vtxCount, uint32_t* idx_r, size_t idxCount);
+    void Close(void);
+
+    /// 大きなASCIIファイルを複数スレッドで読むかどうか。既定はtrue。
+    void SetParallel(bool b) { mParallel = b; }
+
+    /// PLYのプロパティーの型。
+    enum PlyType {
+        PT_Unknown,
+        PT_Int8,
+        PT_Uint8,
+        PT_Int16,
+        PT_Uint16,
+        PT_Int32,
+        PT_Uint32,
+        PT_Float32,
+        PT_Float64,
+    };
+
+    /// 頂点の出力先XyzUvの各値。
+    enum VtxField {
+        VF_X,
+        VF_Y,
+        VF_Z,
+        VF_U,
+        VF_V,
+        VF_NUM,
+    };
+
 private:
-    FILE* mFp = nullptr;
-    TexturedMesh* mTM = nullptr;
+    MappedFile mMF;
+
+    /// マップしたファイル内の読み出し位置。
+    const char* mPos = nullptr;
+    const char* mEnd = nullptr;
+
+    /// ReadBody()の出力先。
+    XyzUv* mVtxDst = nullptr;
+    uint32_t* mIdxDst = nullptr;
+
     bool mIsBinary = false;
+    bool mIsBigEndian = false;
     int mNumVtx = 0;
     int mNumFace = 0;
 
+    /// 1行の最大バイト数(改行を除く)。
+    static const int MAX_LINE_BYTES = 254;
+
+    /// 1要素のプロパティー数の上限。
+    static const int MAX_PROPS = 32;
+
+    /// データ部がこのバイト数以上のASCIIファイルは複数スレッドで読む。
+    static const int PARALLEL_THRESHOLD_BYTES = 4 * 1024 * 1024;
+    bool mParallel = true;
+
     enum State {
         ST_ReadSignature,
         ST_ReadFormat,
         ST_ReadHeader,
-        ST_ReadHeaderVtx,
-        ST_ReadHeaderFace,
-        ST_ReadVertex,
-        ST_ReadFace,
+        ST_ReadData,
         ST_Finish,
     };
     State mState = ST_ReadSignature;
 
-    enum Property {
-        PP_X = 1,
-        PP_Y = 2,
-        PP_Z = 4,
-        PP_NX = 8,
-        PP_NY = 16,
-
-        PP_NZ = 32,
-        PP_S = 64,
-        PP_T = 128,
-        PP_VTX_IDX = 256,
+    struct Property {
+        std::string name;
+
+        /// 値の型。リストの場合は要素の型。
+        PlyType type = PT_Unknown;
+
+        bool isList = false;
+
+        /// リストの個数の型。
+        PlyType countType = PT_Unknown;
+
+        /// 固定長レコードの中のバイト位置。
+        int offset = 0;
     };
-    uint32_t mVtxProp = 0;
-    uint32_t mFaceProp = 0;
 
-    enum VtxPropType {
-        VPT_Unknown,
-        VPT_XYZ_NXNYNZ_ST,
-        VPT_XYZ_ST,
+    struct Element {
+        std::string name;
+        int count = 0;
+        std::vector<Property> props;
+
+        /// 固定長レコードのバイト数。リストを含むとき0。
+        int stride = 0;
     };
-    VtxPropType mVtxPropType = VPT_Unknown;
+    std::vector<Element> mElements;
+
+    /// vertex, face要素のmElements中の位置。無いとき-1。
+    int mVtxElem = -1;
+    int mFaceElem = -1;
+
+    /// 頂点の各出力値に対応するプロパティー番号。
+    int mVtxFieldProp[VF_NUM];
+
+    /// 頂点の各出力値を割る値。整数型のUVはUNORM/SNORMと同じく型の最大値で割って0～1にする。それ以外は1。
+    float mVtxFieldDiv[VF_NUM];
 
+    /// 面の頂点番号リストのプロパティー番号。無いとき-1。
+    int mFaceIdxProp = -1;
 
-    int Read1(void);
+    int Read1(State stopState);
     int ReadSignature(void);
     int ReadFormat(void);
     int ReadHeader(void);
+    int CheckHeader(void);
+    int ReadData(void);
     int ReadVertex(void);
     int ReadFace(void);
+    int SkipElement(const Element& e);
+    int ReadVertexBinary(void);
+    int ReadFaceBinary(void);
+    int CheckFaceIndicesBinary(void) const;
+    char* GetLine(char* s, int sizeof_s);
+    int NumVtxItems(void) const;
+    int NextDataLine(const char** line_r, const char** lineEnd_r);
+    int ParseVertexLine(const char* line, const char* lineEnd, XyzUv& xyzUv_r) const;
+    /// ParseFaceLine()の、頂点番号が範囲外のときの戻り値。
+    static const int FACE_INDEX_OUT_OF_RANGE = -2;
+    int ParseFaceLine(const char* line, const char* lineEnd, uint32_t* idx_r, int* nIdx_r) const;
+    int ReadAsciiParallel(void);
+    const char* SkipBinaryRecord(const Element& e, const char* p) const;
 };
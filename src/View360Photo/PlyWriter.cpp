@@ -0,0 +1,66 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "PlyWriter.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <string.h>
+
+int
+PlyWriter::Write(const std::wstring& path, const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx,
+        Format fmt)
+{
+    if (numIdx % 3 != 0) {
+        printf("E: PlyWriter::Write() index count is not multiple of 3\n");
+        return E_FAIL;
+    }
+
+    FILE* fp = OpenFileToWrite(path);
+    if (fp == nullptr) {
+        printf("E: PlyWriter::Write(%S) open failed\n", path.c_str());
+        return E_FAIL;
+    }
+
+    fprintf(fp, "ply\n");
+    fprintf(fp, "format %s 1.0\n", (fmt == PF_Ascii) ? "ascii" : "binary_little_endian");
+    fprintf(fp, "element vertex %zu\n", numVtx);
+    fprintf(fp, "property float x\n");
+    fprintf(fp, "property float y\n");
+    fprintf(fp, "property float z\n");
+    fprintf(fp, "property float s\n");
+    fprintf(fp, "property float t\n");
+    fprintf(fp, "element face %zu\n", numIdx / 3);
+    fprintf(fp, "property list uchar uint vertex_indices\n");
+    fprintf(fp, "end_header\n");
+
+    bool ok = true;
+    if (fmt == PF_Ascii) {
+        // %.9gでfloatの値が正確に戻る。
+        for (size_t i = 0; i < numVtx && ok; ++i) {
+            const XyzUv& v = vtx[i];
+            ok = 0 < fprintf(fp, "%.9g %.9g %.9g %.9g %.9g\n", v.xyz.x, v.xyz.y, v.xyz.z, v.uv.x, v.uv.y);
+        }
+        for (size_t i = 0; i < numIdx && ok; i += 3) {
+            ok = 0 < fprintf(fp, "3 %u %u %u\n", idx[i + 0], idx[i + 1], idx[i + 2]);
+        }
+    } else {
+        static_assert(sizeof(XyzUv) == 20, "XyzUv must be 5 floats");
+        ok = numVtx == fwrite(vtx, sizeof(XyzUv), numVtx, fp);
+
+        // 1面13バイト。
+        uint8_t rec[13];
+        rec[0] = 3;
+        for (size_t i = 0; i < numIdx && ok; i += 3) {
+            memcpy(&rec[1], &idx[i], 12);
+            ok = 1 == fwrite(rec, sizeof rec, 1, fp);
+        }
+    }
+
+    ok = (0 == fclose(fp)) && ok;
+    if (!ok) {
+        printf("E: PlyWriter::Write(%S) write failed\n", path.c_str());
+        RemoveFile(path);
+        return E_FAIL;
+    }
+    return S_OK;
+}
@@ -0,0 +1,19 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "XyzUv.h"
+#include <stdint.h>
+
+/// 三角形メッシュをPLYファイルに書く。
+/// PlyReaderとGenerateSpherePlyと同じく、頂点はx y z s t、面は property list uchar uint vertex_indices。
+class PlyWriter {
+public:
+    enum Format {
+        PF_Ascii,
+        PF_BinaryLittleEndian,
+    };
+
+    int Write(const std::wstring& path, const XyzUv* vtx, size_t numVtx, const uint32_t* idx, size_t numIdx,
+            Format fmt = PF_Ascii);
+};
@@ -0,0 +1,157 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "SphereMesh.h"
+#include "ParallelFor.h"
+#include <math.h>
+#include <stdio.h>
+
+static const double PI = 3.14159265358979323846;
+
+/// 頂点数がこれ以上のメッシュは複数スレッドで作る。
+static const size_t PARALLEL_THRESHOLD_VERTICES = 256 * 1024;
+
+SphereMeshParams
+SphereMeshFullSphere(int xCount, int yCount)
+{
+    SphereMeshParams p;
+    p.xCount = xCount;
+    p.yCount = yCount;
+    p.lonBegin = 0;
+    p.lonEnd = 2.0 * PI;
+    return p;
+}
+
+SphereMeshParams
+SphereMeshHemisphere(int n, int xCount, int yCount)
+{
+    SphereMeshParams p;
+    p.xCount = xCount;
+    p.yCount = yCount;
+    p.lonBegin = n * PI;
+    p.lonEnd = (n + 1) * PI;
+    return p;
+}
+
+size_t
+SphereMeshNumVertices(const SphereMeshParams& p)
+{
+    return (size_t)(p.xCount + 1) * (p.yCount + 1);
+}
+
+size_t
+SphereMeshNumIndices(const SphereMeshParams& p)
+{
+    return 6 * (size_t)p.xCount * p.yCount;
+}
+
+/// UV値を0～1の範囲にする。
+/// 誤差により、若干0よりも小さい値になることがあるがその場合はそのままにする。
+static double
+WrapUV(double uv)
+{
+    while (uv < -1e-8) {
+        uv += 1.0;
+    }
+    return uv;
+}
+
+int
+SphereMeshGenerate(const SphereMeshParams& p, XyzUv* vtx_r, size_t vtxCount, uint32_t* idx_r, size_t idxCount)
+{
+    if (p.xCount <= 0 || p.yCount <= 0
+            || !(p.lonBegin < p.lonEnd) || !(p.colatBegin < p.colatEnd)
+            || p.colatBegin < 0 || PI < p.colatEnd) {
+        printf("E: SphereMeshGenerate() invalid parameter\n");
+        return E_FAIL;
+    }
+    if (UINT32_MAX < SphereMeshNumVertices(p)) {
+        printf("E: SphereMeshGenerate() too many vertices\n");
+        return E_FAIL;
+    }
+    if (vtxCount < SphereMeshNumVertices(p) || idxCount < SphereMeshNumIndices(p)) {
+        printf("E: SphereMeshGenerate() destination is too small\n");
+        return E_FAIL;
+    }
+
+    const int X = p.xCount;
+    const int Y = p.yCount;
+    const double lonRange = p.lonEnd - p.lonBegin;
+    const double colatRange = p.colatEnd - p.colatBegin;
+
+    // 三角関数は行と列ごとに1回だけ計算する。
+    std::vector<double> sinTheta(Y + 1);
+    std::vector<double> cosTheta(Y + 1);
+    std::vector<double> t(Y + 1);
+    for (int y = 0; y <= Y; ++y) {
+        // θ: 緯度 +1 → -1
+        const double thetaF = colatRange * y / Y;
+        const double theta = thetaF + p.colatBegin;
+        sinTheta[y] = sin(theta);
+        cosTheta[y] = cos(theta);
+        t[y] = WrapUV(1.0 - thetaF / colatRange);
+    }
+
+    // 列ごとに出力先が決まっているので、大きなメッシュは列を複数スレッドで作る。
+    const int nThreads = (SphereMeshNumVertices(p) < PARALLEL_THRESHOLD_VERTICES) ? 1 : 0;
+
+    ParallelFor(X + 1, [&](int x) {
+        // φ: 経度
+        const double phiF = lonRange * x / X;
+        const double phi = phiF + p.lonBegin;
+        const double cosPhi = cos(phi);
+        const double sinPhi = sin(phi);
+        const float s = (float)WrapUV(1.0 - phiF / lonRange);
+
+        XyzUv* v = vtx_r + (size_t)x * (Y + 1);
+        for (int y = 0; y <= Y; ++y) {
+            v->xyz = { (float)(sinTheta[y] * cosPhi), (float)cosTheta[y], (float)(sinTheta[y] * sinPhi) };
+            v->uv = { s, (float)t[y] };
+            ++v;
+        }
+    }, nThreads);
+
+    ParallelFor(X, [&](int x) {
+        uint32_t* idx = idx_r + 6 * (size_t)x * Y;
+        for (int y = 0; y < Y; ++y) {
+            const uint32_t idx00 = (uint32_t)((x + 0) * (Y + 1) + y + 0);
+            const uint32_t idx10 = (uint32_t)((x + 0) * (Y + 1) + y + 1);
+            const uint32_t idx01 = (uint32_t)((x + 1) * (Y + 1) + y + 0);
+            const uint32_t idx11 = (uint32_t)((x + 1) * (Y + 1) + y + 1);
+
+            // counter clock wiseで内側にメッシュを貼る。
+            idx[0] = idx00;
+            idx[1] = idx10;
+            idx[2] = idx01;
+            idx[3] = idx11;
+            idx[4] = idx01;
+            idx[5] = idx10;
+            idx += 6;
+        }
+    }, nThreads);
+
+    return S_OK;
+}
+
+int
+SphereMeshGenerate(const SphereMeshParams& p, TexturedMesh& tm_r)
+{
+    const size_t vtxBase = tm_r.vertexList.size();
+    const size_t idxBase = tm_r.triangleIdxList.size();
+    tm_r.vertexList.resize(vtxBase + SphereMeshNumVertices(p));
+    tm_r.triangleIdxList.resize(idxBase + SphereMeshNumIndices(p));
+
+    int hr = SphereMeshGenerate(p, tm_r.vertexList.data() + vtxBase, SphereMeshNumVertices(p),
+            tm_r.triangleIdxList.data() + idxBase, SphereMeshNumIndices(p));
+    if (FAILED(hr)) {
+        tm_r.vertexList.resize(vtxBase);
+        tm_r.triangleIdxList.resize(idxBase);
+        return hr;
+    }
+
+    // 既存の頂点の後ろに追加したので、頂点番号をずらす。
+    for (size_t i = idxBase; i < tm_r.triangleIdxList.size(); ++i) {
+        tm_r.triangleIdxList[i] += (uint32_t)vtxBase;
+    }
+    return S_OK;
+}
@@ -0,0 +1,40 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "TexturedMesh.h"
+#include <stdint.h>
+
+/// 経度緯度の格子で球面(の一部)のメッシュを作る。
+/// 経度φ、余緯度θ(北極0、南極π)の範囲を等分割し、頂点 (sinθcosφ, cosθ, sinθsinφ) を並べる。
+/// テクスチャーは範囲全体に1枚貼る。u = 1 → 0 (φの増加方向)、v = 1 → 0 (θの増加方向)。
+/// 三角形は球の内側から見て反時計回り。
+struct SphereMeshParams {
+    /// 経度方向、緯度方向の分割数。
+    int xCount = 64;
+    int yCount = 64;
+
+    /// 経度の範囲 (ラジアン)。
+    double lonBegin = 0;
+    double lonEnd = 2.0 * 3.14159265358979323846;
+
+    /// 余緯度の範囲 (ラジアン)。
+    double colatBegin = 0;
+    double colatEnd = 3.14159265358979323846;
+};
+
+/// 全球。GenerateSpherePlyのGenSphereと同じ。
+SphereMeshParams SphereMeshFullSphere(int xCount, int yCount);
+
+/// 半球。n=0のとき経度0～π、n=1のときπ～2π。GenerateSpherePlyのGenHalfSphereと同じ。
+SphereMeshParams SphereMeshHemisphere(int n, int xCount, int yCount);
+
+size_t SphereMeshNumVertices(const SphereMeshParams& p);
+size_t SphereMeshNumIndices(const SphereMeshParams& p);
+
+/// 呼び出し側が用意した出力先にメッシュを作る。
+/// 頂点番号は x * (yCount + 1) + y の格子の順。重複頂点の検索はしない。
+int SphereMeshGenerate(const SphereMeshParams& p, XyzUv* vtx_r, size_t vtxCount, uint32_t* idx_r, size_t idxCount);
+
+/// tm_rのvertexList, triangleIdxListにメッシュを追加する。
+int SphereMeshGenerate(const SphereMeshParams& p, TexturedMesh& tm_r);
@@ -0,0 +1,280 @@
+﻿// 日本語。
+
+#include "pch.h"
+#include "TextureCache.h"
+#include "Hash.h"
+#include "FileUtil.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static_assert(sizeof(TextureCacheHeader) == 128, "TextureCacheHeader size");
+static_assert(sizeof(TextureCacheLevel) == 32, "TextureCacheLevel size");
+static_assert(sizeof(TextureCacheParams) == 56, "TextureCacheParams must not have padding");
+
+static const char TEXTURE_CACHE_MAGIC[8] = { 'V', '3', '6', '0', 'T', 'E', 'X', 0 };
+static const wchar_t TEXTURE_CACHE_SUFFIX[] = L".texcache";
+
+static uint64_t
+AlignUp(uint64_t v)
+{
+    return (v + TextureCache::ALIGN_BYTES - 1) & ~(uint64_t)(TextureCache::ALIGN_BYTES - 1);
+}
+
+/// format, width x heightの段levelの、1行(BC形式はブロック1行)のバイト数と行数。
+static void
+ExpectedLevelSize(BcFormat format, uint32_t width, uint32_t height, uint32_t level, uint64_t* pitch_r, uint64_t* rows_r)
+{
+    const uint64_t w = std::max<uint64_t>(1, width >> level);
+    const uint64_t h = std::max<uint64_t>(1, height >> level);
+    if (format == BCF_None) {
+        *pitch_r = 4 * w;
+        *rows_r = h;
+    } else {
+        *pitch_r = (w + 3) / 4 * BcBlockBytes(format);
+        *rows_r = (h + 3) / 4;
+    }
+}
+
+/// width x heightの1x1までの段数。
+static uint32_t
+FullNumLevels(uint32_t width, uint32_t height)
+{
+    uint32_t n = 1;
+    for (uint32_t v = std::max(width, height); 1 < v; v >>= 1) {
+        ++n;
+    }
+    return n;
+}
+
+void
+TextureCacheEntry::Close(void)
+{
+    mMF.Close();
+    mHeader = TextureCacheHeader();
+    mLevels = nullptr;
+}
+
+void
+TextureCache::Init(const std::wstring& dir, uint64_t maxBytes)
+{
+    mDir = dir;
+    mMaxBytes = maxBytes;
+}
+
+int
+TextureCache::SourceHash(const wchar_t* path, uint64_t* hash_r)
+{
+    MappedFile src;
+    if (src.Open(path) < 0) {
+        return E_FAIL;
+    }
+    *hash_r = Hash::Hash64(src.Data(), src.Size());
+    return S_OK;
+}
+
+uint64_t
+TextureCache::Key(uint64_t srcHash, const TextureCacheParams& p)
+{
+    // 作り方を変えたときはVERSIONを上げて、古いキャッシュを使わないようにする。
+    const uint32_t version = VERSION;
+    const uint64_t h = Hash::Hash64(&p, sizeof p, srcHash);
+    return Hash::Hash64(&version, sizeof version, h);
+}
+
+std::wstring
+TextureCache::EntryPath(uint64_t key) const
+{
+    wchar_t name[32];
+    swprintf(name, sizeof name / sizeof name[0], L"%016llx", (unsigned long long)key);
+#ifdef _WIN32
+    return mDir + L"\\" + name + TEXTURE_CACHE_SUFFIX;
+#else
+    return mDir + L"/" + name + TEXTURE_CACHE_SUFFIX;
+#endif
+}
+
+int
+TextureCache::Open(uint64_t key, TextureCacheEntry& entry_r)
+{
+    entry_r.Close();
+    if (!IsEnabled()) {
+        return E_FAIL;
+    }
+
+    // 最後に使った時刻を今にする。失敗するのはほとんどファイルが無いとき。
+    const std::wstring path = EntryPath(key);
+    if (!TouchFile(path)) {
+        return E_FAIL;
+    }
+
+    MappedFile& mf = entry_r.mMF;
+    if (mf.Open(path.c_str()) < 0) {
+        return E_FAIL;
+    }
+
+    const uint64_t fileBytes = mf.Size();
+    if (fileBytes < sizeof(TextureCacheHeader)) {
+        printf("D: TextureCache::Open() cache is too short.\n");
+        entry_r.Close();
+        return E_FAIL;
+    }
+
+    TextureCacheHeader& h = entry_r.mHeader;
+    memcpy(&h, mf.Data(), sizeof h);
+
+    if (0 != memcmp(h.magic, TEXTURE_CACHE_MAGIC, sizeof h.magic)
+            || h.version != VERSION
+            || h.levelStride != sizeof(TextureCacheLevel)
+            || h.key != key
+            || BCF_NUM <= h.format) {
+        printf("D: TextureCache::Open() unknown cache format.\n");
+        entry_r.Close();
+        return E_FAIL;
+    }
+
+    // 段数と各段の行のバイト数、行数が大きさと形式から決まる値に等しく、各段がファイルに収まっているか。
+    // 表の値はそのままテクスチャーの初期データの行のバイト数になるので、違うときは使わない。
+    // BC形式のlevel 0は幅と高さが4の倍数であること。
+    const uint64_t tableEnd = sizeof(TextureCacheHeader) + (uint64_t)h.numLevels * sizeof(TextureCacheLevel);
+    bool ok = h.fileBytes == fileBytes && 1 <= h.width && h.width <= MAX_SIZE && 1 <= h.height && h.height <= MAX_SIZE
+            && 1 <= h.numLevels && h.numLevels <= FullNumLevels(h.width, h.height) && tableEnd <= fileBytes
+            && (h.format == BCF_None || ((h.width & 3) == 0 && (h.height & 3) == 0));
+    const TextureCacheLevel* levels = (const TextureCacheLevel*)(mf.Data() + sizeof(TextureCacheHeader));
+    for (uint32_t l = 0; ok && l < h.numLevels; ++l) {
+        const TextureCacheLevel& lv = levels[l];
+        uint64_t pitch = 0;
+        uint64_t rows = 0;
+        ExpectedLevelSize((BcFormat)h.format, h.width, h.height, l, &pitch, &rows);
+        ok = lv.pitch == pitch && lv.rows == rows
+                && lv.offset == AlignUp(lv.offset) && tableEnd <= lv.offset && lv.offset <= fileBytes
+                && pitch * rows <= fileBytes - lv.offset;
+    }
+    if (!ok) {
+        // 古いか壊れたキャッシュは、無いものとして作り直す。
+        printf("E: TextureCache::Open() cache is broken.\n");
+        entry_r.Close();
+        return E_FAIL;
+    }
+
+    entry_r.mLevels = levels;
+    return S_OK;
+}
+
+int
+TextureCache::Write(uint64_t key, BcFormat format, int width, int height, int numLevels, const TextureCacheLevelData* levels,
+        int srcWidth, int srcHeight)
+{
+    if (!IsEnabled()) {
+        return E_FAIL;
+    }
+    if (!CreateDirectories(mDir)) {
+        printf("E: TextureCache::Write() failed to create %S\n", mDir.c_str());
+        return E_FAIL;
+    }
+
+    TextureCacheHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, TEXTURE_CACHE_MAGIC, sizeof h.magic);
+    h.version = VERSION;
+    h.format = format;
+    h.width = width;
+    h.height = height;
+    h.numLevels = numLevels;
+    h.levelStride = sizeof(TextureCacheLevel);
+    h.key = key;
+    h.srcWidth = srcWidth;
+    h.srcHeight = srcHeight;
+
+    std::vector<TextureCacheLevel> table(numLevels);
+    uint64_t pos = sizeof h + (uint64_t)numLevels * sizeof(TextureCacheLevel);
+    for (int l = 0; l < numLevels; ++l) {
+        TextureCacheLevel& lv = table[l];
+        memset(&lv, 0, sizeof lv);
+        lv.offset = AlignUp(pos);
+        lv.pitch = levels[l].rowBytes;
+        lv.rows = levels[l].rows;
+        pos = lv.offset + (uint64_t)lv.pitch * lv.rows;
+    }
+    h.fileBytes = pos;
+
+    // 書き込み途中のファイルを読まないように、一時ファイルに書いてから改名する。
+    const std::wstring path = EntryPath(key);
+    const std::wstring tmpPath = path + L".tmp";
+    FILE* fp = OpenFileToWrite(tmpPath);
+    if (fp == nullptr) {
+        printf("E: TextureCache::Write(%S) open failed.\n", tmpPath.c_str());
+        return E_FAIL;
+    }
+
+    static const uint8_t zeros[ALIGN_BYTES] = {};
+    bool ok = 1 == fwrite(&h, sizeof h, 1, fp)
+            && (size_t)numLevels == fwrite(table.data(), sizeof(TextureCacheLevel), numLevels, fp);
+    pos = sizeof h + (uint64_t)numLevels * sizeof(TextureCacheLevel);
+    for (int l = 0; ok && l < numLevels; ++l) {
+        const size_t pad = (size_t)(table[l].offset - pos);
+        ok = pad == fwrite(zeros, 1, pad, fp);
+        const TextureCacheLevelData& d = levels[l];
+        for (int y = 0; ok && y < d.rows; ++y) {
+            ok = 1 == fwrite(d.pixels + (size_t)d.stride * y, d.rowBytes, 1, fp);
+        }
+        pos = table[l].offset + (uint64_t)table[l].pitch * table[l].rows;
+    }
+    ok = (0 == fclose(fp)) && ok;
+
+    if (!ok || !RenameReplacing(tmpPath, path)) {
+        RemoveFile(tmpPath);
+        printf("E: TextureCache::Write(%S) failed.\n", path.c_str());
+        return E_FAIL;
+    }
+
+    return Evict(path);
+}
+
+int
+TextureCache::Evict(const std::wstring& keepPath, int* removed_r)
+{
+    if (removed_r != nullptr) {
+        *removed_r = 0;
+    }
+    std::vector<FileListEntry> files;
+    if (!ListFiles(mDir, TEXTURE_CACHE_SUFFIX, files)) {
+        printf("E: TextureCache::Evict() failed to list %S\n", mDir.c_str());
+        return E_FAIL;
+    }
+
+    // 新しいものから数えて、maxBytesに収まらなくなった以降を消す。
+    std::sort(files.begin(), files.end(), [&keepPath](const FileListEntry& a, const FileListEntry& b) {
+        if (a.writeTime != b.writeTime) {
+            return b.writeTime < a.writeTime;
+        }
+        return a.path == keepPath && b.path != keepPath;
+    });
+    uint64_t total = 0;
+    for (const FileListEntry& f : files) {
+        total += f.bytes;
+        if (total <= mMaxBytes) {
+            continue;
+        }
+        RemoveFile(f.path);
+        if (removed_r != nullptr) {
+            ++*removed_r;
+        }
+    }
+    return S_OK;
+}
+
+int
+TextureCache::Usage(int* numFiles_r, uint64_t* bytes_r) const
+{
+    std::vector<FileListEntry> files;
+    if (!ListFiles(mDir, TEXTURE_CACHE_SUFFIX, files)) {
+        return E_FAIL;
+    }
+    *numFiles_r = (int)files.size();
+    *bytes_r = 0;
+    for (const FileListEntry& f : files) {
+        *bytes_r += f.bytes;
+    }
+    return S_OK;
+}
@@ -0,0 +1,159 @@
+﻿// 日本語。
+#pragma once
+
+#include "pch.h"
+#include "MappedFile.h"
+#include "BlockCompress.h"
+#include "CubeMap.h"
+#include <stdint.h>
+
+/// テクスチャーキャッシュファイルのヘッダー。
+/// ファイルの構成:
+///   TextureCacheHeader      (128バイト)
+///   TextureCacheLevel × numLevels
+///   各段の画素            (TextureCacheLevel::offsetから。64バイト境界)
+/// 値はリトルエンディアン。
+struct TextureCacheHeader {
+    char magic[8];
+
+    uint32_t version;
+
+    /// BcFormat。BCF_NoneのときBGRA 8ビット。
+    uint32_t format;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t numLevels;
+    uint32_t levelStride;
+
+    /// TextureCache::Key()の値。ファイル名と一致すること。
+    uint64_t key;
+
+    uint64_t fileBytes;
+
+    /// 元の画像の大きさ。PL_LatitudeBandsのとき、読んだ後に詰め方を決め直すのに使う。それ以外は0。
+    uint32_t srcWidth;
+    uint32_t srcHeight;
+
+    uint64_t reserved[9];
+};
+
+/// 1段の配置。
+struct TextureCacheLevel {
+    uint64_t offset;
+
+    /// 1行(BC形式はブロック1行)のバイト数と行数。
+    uint32_t pitch;
+    uint32_t rows;
+
+    uint64_t reserved[2];
+};
+
+/// キャッシュの鍵にする、元画像から作るときの設定。
+/// 同じ元画像でも、値が1個でも違えば別のキャッシュになる。
+struct TextureCacheParams {
+    /// 元画像から切り出す比率。XrRect2Dfのoffset.x, offset.y, extent.width, extent.height。
+    float portion[4] = { 0, 0, 1.0f, 1.0f };
+
+    uint32_t alpha = 0xff;
+
+    /// BcFormat, BcQuality。
+    uint32_t format = BCF_None;
+    uint32_t quality = BCQ_Fast;
+
+    /// MipFilter。
+    uint32_t mipFilter = MF_Kaiser;
+    uint32_t wrapX = 1;
+
+    /// PanoramaLayout。PL_Cubeのとき、一辺faceSize画素の立方体マップの面face (CubeFace)。
+    /// PL_LatitudeBandsのとき、faceSizeは帯の数。
+    uint32_t layout = PL_Equirect;
+    uint32_t faceSize = 0;
+    uint32_t face = 0;
+
+    /// 元画像を縮める幅の上限。0のとき上限なし。
+    uint32_t maxWidth = 0;
+
+    /// ミップマップの段数。0のとき1x1まで。
+    uint32_t mipLevels = 0;
+};
+
+/// TextureCache::Write()に渡す1段の画素。rowBytesバイトの行がrows行、strideバイトおきに並ぶ。
+struct TextureCacheLevelData {
+    const uint8_t* pixels;
+    int stride;
+    int rowBytes;
+    int rows;
+};
+
+/// マップしたキャッシュファイル1個。Close()まで各段の画素を指す。
+class TextureCacheEntry {
+public:
+    BcFormat Format(void) const { return (BcFormat)mHeader.format; }
+    int Width(void) const { return (int)mHeader.width; }
+    int Height(void) const { return (int)mHeader.height; }
+    int NumLevels(void) const { return (int)mHeader.numLevels; }
+    int SrcWidth(void) const { return (int)mHeader.srcWidth; }
+    int SrcHeight(void) const { return (int)mHeader.srcHeight; }
+
+    const uint8_t* LevelPixels(int level) const { return mMF.Data() + mLevels[level].offset; }
+    int LevelPitch(int level) const { return (int)mLevels[level].pitch; }
+    int LevelRows(int level) const { return (int)mLevels[level].rows; }
+
+    bool IsOpen(void) const { return mMF.IsOpen(); }
+    void Close(void);
+
+private:
+    friend class TextureCache;
+
+    MappedFile mMF;
+    TextureCacheHeader mHeader = {};
+    const TextureCacheLevel* mLevels = nullptr;
+};
+
+/// デコード、切り出し、ミップマップ作成、ブロック圧縮を終えたテクスチャーの全段を、
+/// 元画像の内容と設定のハッシュ値を名前にしたファイルに保存し、次回からはマップしてそのまま使う。
+/// ディレクトリーの合計がmaxBytesを超えたら、最後に使った時刻(ファイルの最終更新時刻)の古いものから消す。
+class TextureCache {
+public:
+    /// @param maxBytes 0のとき、キャッシュを使わない。
+    void Init(const std::wstring& dir, uint64_t maxBytes);
+
+    bool IsEnabled(void) const { return 0 < mMaxBytes && !mDir.empty(); }
+
+    /// 元ファイルの内容のハッシュ値。
+    static int SourceHash(const wchar_t* path, uint64_t* hash_r);
+
+    static uint64_t Key(uint64_t srcHash, const TextureCacheParams& p);
+
+    /// keyのキャッシュを開く。見つかったら最後に使った時刻を今にする。
+    /// 段数と各段の行のバイト数、行数がヘッダーの大きさと形式に合わないときは、失敗(キャッシュが無いとき)と同じにする。
+    int Open(uint64_t key, TextureCacheEntry& entry_r);
+
+    /// keyのキャッシュを書いて、合計がmaxBytes以下になるまで古いものを消す。
+    /// srcWidth, srcHeightはヘッダーに置く元の画像の大きさ。
+    int Write(uint64_t key, BcFormat format, int width, int height, int numLevels, const TextureCacheLevelData* levels,
+            int srcWidth = 0, int srcHeight = 0);
+
+    /// 合計がmaxBytes以下になるまで、古いものから消す。
+    /// 最終更新時刻の分解能は粗いので、keepPathは同じ時刻の他のファイルより新しいものとして扱う。
+    /// @param removed_r 非nullptrのとき、消したファイルの数を置く。
+    int Evict(const std::wstring& keepPath = std::wstring(), int* removed_r = nullptr);
+
+    /// ディレクトリーの中のキャッシュファイルの数と合計バイト数。
+    int Usage(int* numFiles_r, uint64_t* bytes_r) const;
+
+    std::wstring EntryPath(uint64_t key) const;
+
+    static const uint32_t VERSION = 1;
+
+    /// 各段の画素の先頭のアラインメント。
+    static const int ALIGN_BYTES = 64;
+
+    /// 開くキャッシュの幅と高さの上限。
+    static const uint32_t MAX_SIZE = 65536;
+
+private:
+    std::wstring mDir;
+    uint64_t mMaxBytes = 0;
+};
@@ -14,6 +14,13 @@ struct TexturedMesh {
     winrt::com_ptr<ID3D11Buffer> vb;
     winrt::com_ptr<ID3D11Buffer> ib;
 
+    /// vbの頂点1個のバイト数。
+    uint32_t vtxStride = sizeof(XyzUv);
+
+    /// ibの頂点番号の型と数。
+    DXGI_FORMAT idxFormat = DXGI_FORMAT_R32_UINT;
+    uint32_t numIndices = 0;
+
     uint32_t NumTriangles(void) {
         return (uint32_t)(triangleIdxList.size() / 3);
     }
@@ -21,6 +28,9 @@ struct TexturedMesh {
     void Clear(void) {
         vertexList.clear();
         triangleIdxList.clear();
+        vtxStride = sizeof(XyzUv);
+        idxFormat = DXGI_FORMAT_R32_UINT;
+        numIndices = 0;
         if (tex.get() != nullptr) {
             tex->Release();
         }
@@ -19,16 +19,22 @@
 #include "pch.h"
 #include "TexturedMeshRenderer.h"
 #include "DxUtility.h"
-#include "PlyReader.h"
+#include "SphereMesh.h"
+#include "MeshPack.h"
+#include "MeshWeld.h"
+#include "MeshOptimize.h"
 #include "JpegToTexture.h"
+#include "DecodedImage.h"
+#include "ParallelFor.h"
+#include "MipBuilder.h"
+#include "BlockCompress.h"
+#include "CubeMap.h"
+#include "LatitudeBands.h"
+#include "DisplayDensity.h"
+#include "FileUtil.h"
 #include "Config.h"
 
 namespace TexturedMeshShader {
-    struct Vertex {
-        XrVector3f Position;
-        XrVector2f Uv;
-    };
-
     struct ModelCB {
 		DirectX::XMFLOAT4X4 Model;
 	};
@@ -41,11 +47,26 @@ namespace TexturedMeshShader {
 		XrVector4f Alpha4;
 	};
 
+	static_assert(LATITUDE_BANDS <= LATITUDE_BANDS_MAX, "LATITUDE_BANDS is too large");
+
+	/// MainBandedPSが読む帯と区間の表。LatitudeBands.hを参照。
+	struct BandCB {
+		/// 帯ごとの(幅, 元の画像の最初の行, 最初の区間, 区間の数)。最後の帯の次のyは元の画像の高さ。
+		XrVector4f Bands[LATITUDE_BANDS_MAX + 1];
+
+		/// 区間ごとの(x - col0, y - srcY0, col1, 0)。
+		XrVector4f Segments[LATITUDE_SEGMENTS_MAX];
+
+		/// (帯の数, 元の画像の高さ, 1 / 詰めた画像の幅, 1 / 詰めた画像の高さ)。
+		XrVector4f Info;
+	};
+
 #if NUM_VIEWS != 4
 #  error "please fix size of ViewProjection[] below"
 #endif
 	
 	// Separate entrypoints for the vertex and pixel shader functions.
+	// VSShaderHlslの前に #define VTX_FORMAT (MeshVertexFormatの値) を付けてコンパイルする。
     constexpr char VSShaderHlsl[] = R"_(
         Texture2D g_texture : register(t0);
         SamplerState g_sampler : register(s0);
@@ -59,33 +80,77 @@ namespace TexturedMeshShader {
         struct VSOutput {
             float4 Pos : SV_POSITION;
             float2 Uv  : TEXCOORD;
+            float3 Dir : TEXCOORD1;
             uint viewId : SV_RenderTargetArrayIndex;
         };
+
+#if VTX_FORMAT == 0
+        // MVF_Float32
         struct VSInput {
             float3 Pos : POSITION;
             float2 Uv  : TEXCOORD;
             uint instId : SV_InstanceID;
         };
+        float3 DecodePos(VSInput input) {
+            return input.Pos;
+        }
+#elif VTX_FORMAT == 1
+        // MVF_Snorm16
+        struct VSInput {
+            float4 Pos : POSITION;
+            float2 Uv  : TEXCOORD;
+            uint instId : SV_InstanceID;
+        };
+        float3 DecodePos(VSInput input) {
+            return input.Pos.xyz;
+        }
+#else
+        // MVF_Octahedral16。MeshPack.cppのOctDecode()と同じ計算。
+        struct VSInput {
+            float2 Pos : POSITION;
+            float2 Uv  : TEXCOORD;
+            uint instId : SV_InstanceID;
+        };
+        float3 DecodePos(VSInput input) {
+            float3 v = float3(input.Pos.x, 1 - abs(input.Pos.x) - abs(input.Pos.y), input.Pos.y);
+            float t = max(-v.y, 0);
+            v.x += (0 <= v.x) ? -t : t;
+            v.z += (0 <= v.z) ? -t : t;
+            return normalize(v);
+        }
+#endif
 
         VSOutput MainVS(VSInput input) {
             VSOutput output;
-            output.Pos = mul(mul(float4(input.Pos, 1), Model), ViewProjection[input.instId]);
+            float3 pos = DecodePos(input);
+            output.Pos = mul(mul(float4(pos, 1), Model), ViewProjection[input.instId]);
             output.Uv = input.Uv;
+            output.Dir = pos;
             output.viewId = input.instId;
             return output;
         }
         )_";
 
+	// MainCubePS, MainEacPS, MainOctPS, MainBandedPSは、TEXTURE_LAYOUTがPL_Cube, PL_Eac, PL_Octahedral, PL_LatitudeBandsのとき、
+	// 全画素のテクスチャーをメッシュの頂点の向きで読む。向きとテクスチャーの座標の関係はCubeMap.h, LatitudeBands.hと同じ。
+	// PSShaderHlslの前に #define LATITUDE_BANDS_MAX, LATITUDE_SEGMENTS_MAX を付けてコンパイルする。
 	constexpr char PSShaderHlsl[] = R"_(
         Texture2D g_texture : register(t0);
+        TextureCube g_cube : register(t1);
         SamplerState g_sampler : register(s0);
         cbuffer AlphaCB : register(b0) {
             float4 Alpha4;
         };
+        cbuffer BandCB : register(b1) {
+            float4 Bands[LATITUDE_BANDS_MAX + 1];
+            float4 Segments[LATITUDE_SEGMENTS_MAX];
+            float4 BandInfo;
+        };
 
         struct VSOutput {
             float4 Pos : SV_POSITION;
             float2 Uv  : TEXCOORD;
+            float3 Dir : TEXCOORD1;
             uint viewId : SV_RenderTargetArrayIndex;
         };
 
@@ -94,76 +159,860 @@ namespace TexturedMeshShader {
 			bgra.a = Alpha4.w;
             return bgra;
         }
+
+        float4 MainCubePS(VSOutput input) : SV_TARGET {
+            float4 bgra = g_cube.Sample(g_sampler, input.Dir);
+            bgra.a = Alpha4.w;
+            return bgra;
+        }
+
+        // 立方体の面の座標を、CubeToEac()で等角キューブマップの面の座標にしてから読む。
+        float4 MainEacPS(VSOutput input) : SV_TARGET {
+            float3 a = abs(input.Dir);
+            float3 q = input.Dir / max(a.x, max(a.y, a.z));
+            float4 bgra = g_cube.Sample(g_sampler, atan(q) * (4 / 3.14159265));
+            bgra.a = Alpha4.w;
+            return bgra;
+        }
+
+        // 一辺n画素の八面体マップの段levelの画素p。外周の外の画素は、外周の辺の中点で折り返した画素(同じ向き)を読む。
+        float4 OctTexel(int2 p, int n, int level) {
+            if (p.x < 0 || n <= p.x) {
+                p = int2(clamp(p.x, 0, n - 1), n - 1 - p.y);
+            }
+            if (p.y < 0 || n <= p.y) {
+                p = int2(n - 1 - p.x, clamp(p.y, 0, n - 1));
+            }
+            return g_texture.Load(int3(p, level));
+        }
+
+        // 八面体マップの段levelを、外周で折り返す双線形で読む。CubeMap.cppのOctToEquirect()と同じ。
+        float4 SampleOctLevel(float2 uv, int level) {
+            uint w, h, numLevels;
+            g_texture.GetDimensions((uint)level, w, h, numLevels);
+            int n = (int)w;
+            float2 f = uv * (float)n - 0.5;
+            float2 f0 = floor(f);
+            float2 t = f - f0;
+            int2 p = (int2)f0;
+            float4 top = lerp(OctTexel(p, n, level), OctTexel(p + int2(1, 0), n, level), t.x);
+            float4 bottom = lerp(OctTexel(p + int2(0, 1), n, level), OctTexel(p + int2(1, 1), n, level), t.x);
+            return lerp(top, bottom, t.y);
+        }
+
+        // DirectionToOct()と同じ計算。
+        // サンプラーのCLAMPでは外周の外が端の画素になり、外周の辺に継ぎ目が出るので、4画素を自分で読んで外周で折り返す。
+        // 段は折り返す前の座標の微分で決める。折り返しは座標の向きを変えるだけなので長さは同じで、折り目で段が飛ばない。
+        float4 MainOctPS(VSOutput input) : SV_TARGET {
+            float3 d = input.Dir / dot(abs(input.Dir), float3(1, 1, 1));
+            float2 st = d.xz;
+
+            uint w, h, numLevels;
+            g_texture.GetDimensions(0, w, h, numLevels);
+            float2 dx = ddx(st) * (0.5 * (float)w);
+            float2 dy = ddy(st) * (0.5 * (float)w);
+            float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, (float)numLevels - 1.0);
+
+            if (d.y < 0) {
+                st = (1.0 - abs(st.yx)) * (0.0 <= st ? 1.0 : -1.0);
+            }
+            float2 uv = st * 0.5 + 0.5;
+            int l0 = (int)lod;
+            int l1 = min(l0 + 1, (int)numLevels - 1);
+            float4 bgra = lerp(SampleOctLevel(uv, l0), SampleOctLevel(uv, l1), lod - (float)l0);
+            bgra.a = Alpha4.w;
+            return bgra;
+        }
+
+        // 向きを正距円筒図法の座標(u, v)にして、LatitudeBandCoord()と同じ計算で詰めた画像の座標にする。
+        float4 MainBandedPS(VSOutput input) : SV_TARGET {
+            float3 d = input.Dir;
+            float u = frac(0.5 - atan2(d.z, d.x) * (0.5 / 3.14159265));
+            float v = saturate(0.5 + atan2(d.y, length(d.xz)) * (1 / 3.14159265));
+            float row = v * BandInfo.y;
+            int n = (int)BandInfo.x;
+            int k = min((int)(v * n), n - 1);
+            if (row < Bands[k].y && 0 < k) {
+                --k;
+            } else if (Bands[k + 1].y <= row && k < n - 1) {
+                ++k;
+            }
+            float col = u * Bands[k].x;
+            int s = (int)Bands[k].z;
+            int last = s + (int)Bands[k].w - 1;
+            while (s < last && Segments[s].z <= col) {
+                ++s;
+            }
+            float4 bgra = g_texture.Sample(g_sampler, (float2(col, row) + Segments[s].xy) * BandInfo.zw);
+            bgra.a = Alpha4.w;
+            return bgra;
+        }
         )_";
 
 } // namespace TexturedMeshShader
 
 namespace sample {
+    /// 全画素のテクスチャーをlayoutの形として読むピクセルシェーダーの関数名。
+    static const char* LayoutPixelShaderEntry(PanoramaLayout layout) {
+        switch (layout) {
+        case PL_Cube:          return "MainCubePS";
+        case PL_Eac:           return "MainEacPS";
+        case PL_Octahedral:    return "MainOctPS";
+        case PL_LatitudeBands: return "MainBandedPS";
+        default:               return "MainPS";
+        }
+    }
+
+    /// m_meshes[i]のテクスチャーにする、画像の左半分と右半分。
+    static const XrRect2Df gHemispherePortions[] = { { 0, 0, 0.5f, 1.0f }, { 0.5f, 0, 0.5f, 1.0f } };
+
+    void TexturedMeshRenderer::SetDisplayPixelsPerDegree(double pixelsPerDegree) {
+        m_maxTexWidth = EquirectWidthForDensity(pixelsPerDegree, TEXTURE_DENSITY_SCALE);
+        printf("D: TexturedMeshRenderer::SetDisplayPixelsPerDegree(%.1f) max texture width %d\n", pixelsPerDegree, m_maxTexWidth);
+    }
+
     int TexturedMeshRenderer::Load(const wchar_t *imagePath) {
         int hr;
-		{
-            TexturedMesh &mesh = m_meshes[0];
+        JoinFullThread();
+
+        for (int i = 0; i < N_MESH; ++i) {
+            TexturedMesh &mesh = m_meshes[i];
             mesh.Clear();
 
-            PlyReader pr;
-            hr = pr.Read(L"sphereL.ply", mesh);
+            hr = SphereMeshGenerate(SphereMeshHemisphere(i, SPHERE_DIVISIONS, SPHERE_DIVISIONS), mesh);
             if (FAILED(hr)) {
                 return hr;
             }
+            hr = MeshWeld(mesh);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            hr = MeshOptimize(mesh);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            hr = CreateMeshBuffers(mesh);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
 
-            JpegToTexture jt;
-            XrRect2Df leftHalf{ 0, 0, 0.5f, 1.0f };
-            hr = jt.ImageFileToTexture(m_dev, m_dctx, imagePath, leftHalf, (mesh.tex).put(), (mesh.srv).put());
+        if (SUCCEEDED(LoadCachedTextures(imagePath))) {
+            return S_OK;
+        }
+
+        // 画像は1回だけデコードし、左半分をm_meshes[0]、右半分をm_meshes[1]のテクスチャーにする。
+        // まず縮小した画像で表示を始める。プログレッシブJPEGは最初のスキャンだけで表示を始める。
+        // 縮小画像は、Mapしたlevel0に左半分と右半分を直接デコードする。
+        static_assert(std::size(gHemispherePortions) == N_MESH, "gHemispherePortions");
+        JpegToTexture jt;
+        winrt::com_ptr<ID3D11Texture2D> level0[N_MESH];
+        int scale = 1;
+        bool complete = true;
+        hr = jt.ImageFileToLevel0Textures(m_dev, m_dctx, imagePath, gHemispherePortions, N_MESH, level0,
+                0xff, PREVIEW_MAX_WIDTH, true, &scale, &complete);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        const bool preview = scale != 1 || !complete;
+
+        for (int i = 0; i < N_MESH; ++i) {
+            TexturedMesh &mesh = m_meshes[i];
+            hr = jt.Level0ToMipmappedTexture(m_dev, m_dctx, level0[i].get(), (mesh.tex).put(), (mesh.srv).put(),
+                    TEXTURE_MIP_LEVELS);
             if (FAILED(hr)) {
                 return hr;
             }
         }
+
         {
-            TexturedMesh &mesh = m_meshes[1];
-            mesh.Clear();
+            // 全画素のデコードとアップロードはID3D11Deviceだけを使うので、別のスレッドで行う。
+            // このスレッドはdctxをMapに使えないので、DecodedImageにデコードしてからアップロードする。
+            // プログレッシブJPEGは途中の画像もアップロードする。最後の画像はCPUでミップマップを作り、ブロック圧縮して全段をアップロードする。
+            // 縮小しなかったときも、GenerateMips()で作ったミップマップを差し替えるため、もう一度デコードする。
+            // 画像の幅がm_maxTexWidthより大きいときは、m_maxTexWidth以上のまま縮小してデコードしてから、m_maxTexWidthに縮める。
+            std::wstring path(imagePath);
+            const int maxWidth = m_maxTexWidth;
+            m_fullThread = std::thread([this, path, preview, maxWidth]() {
+                DecodedImageProgress progress = nullptr;
+                if (preview) {
+                    progress = [this](const DecodedImage &partial, int) {
+                        PostFullLevel0(partial);
+                        return !m_fullCancel;
+                    };
+                }
+                DecodedImage full;
+                int fullHr = full.Load(path.c_str(), 0, progress, PROGRESSIVE_UPDATE_BYTES, maxWidth);
+                if (SUCCEEDED(fullHr) && full.IsComplete() && !m_fullCancel) {
+                    int w;
+                    int h;
+                    CappedImageSize(full.Width(), full.Height(), maxWidth, &w, &h);
+                    if (w != full.Width() || h != full.Height()) {
+                        fullHr = full.Resize(w, h, MIP_FILTER);
+                    }
+                }
+                if (SUCCEEDED(fullHr) && full.IsComplete() && !m_fullCancel) {
+                    fullHr = PostFull(full);
+                }
+
+                std::lock_guard<std::mutex> lock(m_fullMutex);
+                m_fullHr = fullHr;
+                m_fullDone = true;
+            });
+        }
 
-            PlyReader pr;
-            hr = pr.Read(L"sphereR.ply", mesh);
+        return hr;
+    }
+
+    TexturedMeshRenderer::~TexturedMeshRenderer() {
+        JoinFullThread();
+    }
+
+    /// imgの左半分と右半分からlevel0_r[0]、level0_r[1]を作る。切り出した画素のアップロードは、半球ごとに同時に行う。
+    int TexturedMeshRenderer::CreateLevel0Textures(const DecodedImage &img, winrt::com_ptr<ID3D11Texture2D> (&level0_r)[N_MESH]) {
+        int hrs[N_MESH];
+        JpegToTexture jt;
+        ParallelFor(N_MESH, [&](int i) {
+            level0_r[i] = nullptr;
+            hrs[i] = jt.ImageViewToLevel0Texture(m_dev, img.Crop(gHemispherePortions[i]), level0_r[i].put());
+        });
+
+        for (int i = 0; i < N_MESH; ++i) {
+            if (FAILED(hrs[i])) {
+                return hrs[i];
+            }
+        }
+        return S_OK;
+    }
+
+    /// m_fullThreadから呼ぶ。imgからlevel0を作ってm_fullLevel0に置く。RenderView()がまだ使っていないlevel0は捨てる。
+    int TexturedMeshRenderer::PostFullLevel0(const DecodedImage &img) {
+        winrt::com_ptr<ID3D11Texture2D> level0[N_MESH];
+        int hr = CreateLevel0Textures(img, level0);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        std::lock_guard<std::mutex> lock(m_fullMutex);
+        for (int i = 0; i < N_MESH; ++i) {
+            m_fullLevel0[i] = level0[i];
+        }
+        return S_OK;
+    }
+
+    /// m_fullThreadから呼ぶ。TEXTURE_LAYOUTの形の全画素のテクスチャーを作る。
+    int TexturedMeshRenderer::PostFull(const DecodedImage &img) {
+        switch (TEXTURE_LAYOUT) {
+        case PL_Cube:
+        case PL_Eac:
+            return PostFullCube(img);
+        case PL_Octahedral:
+            return PostFullOct(img);
+        case PL_LatitudeBands:
+            return PostFullBands(img);
+        default:
+            return PostFullMipmapped(img);
+        }
+    }
+
+    /// srcとそのミップマップchainの全段をlevels_rに並べる。formatがBCF_Noneでないときは圧縮してbc_rに置き、それを指す。
+    static int CompressLevels(const MipSource &src, const MipChain &chain, BcFormat format, BcTexture *bc_r,
+            TextureCacheLevelData *levels_r) {
+        if (format != BCF_None) {
+            if (BcEncodeMips(src, chain, format, TEXTURE_QUALITY, bc_r) < 0) {
+                return E_FAIL;
+            }
+            for (int l = 0; l < chain.numLevels; ++l) {
+                levels_r[l] = { bc_r->Level(l), bc_r->LevelPitch(l), bc_r->LevelPitch(l), bc_r->LevelBlockRows(l) };
+            }
+            return S_OK;
+        }
+
+        levels_r[0] = { src.pixels, src.stride, 4 * src.width, src.height };
+        for (int l = 1; l < chain.numLevels; ++l) {
+            const int lw = chain.LevelWidth(l);
+            levels_r[l] = { chain.Level(l), 4 * lw, 4 * lw, chain.LevelHeight(l) };
+        }
+        return S_OK;
+    }
+
+    /// m_fullThreadから呼ぶ。imgの左半分と右半分のミップマップをMIP_FILTERで作り、全段を初期データにしたテクスチャーをm_fullTexに置く。
+    /// 左右の半分は、経度の継ぎ目で互いにつながった1枚の画像として縮小する。
+    int TexturedMeshRenderer::PostFullMipmapped(const DecodedImage &img) {
+        ImageView views[N_MESH];
+        MipSource srcs[N_MESH];
+        for (int i = 0; i < N_MESH; ++i) {
+            views[i] = img.Crop(gHemispherePortions[i]);
+            srcs[i].pixels = views[i].pixels;
+            srcs[i].width = views[i].width;
+            srcs[i].height = views[i].height;
+            srcs[i].stride = views[i].stride;
+        }
+
+        MipBuildParams mp;
+        mp.filter = MIP_FILTER;
+        mp.maxLevels = TEXTURE_MIP_LEVELS;
+        mp.wrapX = true;
+        MipChain chains[N_MESH];
+        if (MipBuild(srcs, N_MESH, mp, chains) < 0) {
+            return E_FAIL;
+        }
+
+        winrt::com_ptr<ID3D11Texture2D> tex[N_MESH];
+        winrt::com_ptr<ID3D11ShaderResourceView> srv[N_MESH];
+        JpegToTexture jt;
+        for (int i = 0; i < N_MESH; ++i) {
+            // BC形式は幅と高さが4の倍数のときだけ使える。そうでないときは圧縮しない。
+            const int w = views[i].width;
+            const int h = views[i].height;
+            const BcFormat format = ((w & 3) == 0 && (h & 3) == 0) ? TEXTURE_FORMAT : BCF_None;
+            BcTexture bc;
+            std::vector<TextureCacheLevelData> levels(chains[i].numLevels);
+            if (FAILED(CompressLevels(srcs[i], chains[i], format, &bc, levels.data()))) {
+                return E_FAIL;
+            }
+
+            int hr = jt.LevelsToTexture(m_dev, format, w, h, chains[i].numLevels, levels.data(), false,
+                    tex[i].put(), srv[i].put());
             if (FAILED(hr)) {
                 return hr;
             }
 
-            JpegToTexture jt;
-            XrRect2Df rightHalf{ 0.5f, 0, 0.5f, 1.0f };
-            hr = jt.ImageFileToTexture(m_dev, m_dctx, imagePath, rightHalf, (mesh.tex).put(), (mesh.srv).put());
+            // 次回からはキャッシュを使う。書けなくても表示は続ける。
+            if (m_cacheKeysValid) {
+                m_texCache.Write(m_cacheKeys[i], format, w, h, chains[i].numLevels, levels.data());
+            }
+            if (m_fullCancel) {
+                return E_ABORT;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_fullMutex);
+        for (int i = 0; i < N_MESH; ++i) {
+            m_fullTex[i] = tex[i];
+            m_fullSrv[i] = srv[i];
+            m_fullLevel0[i] = nullptr;
+        }
+        return S_OK;
+    }
+
+    /// m_fullThreadから呼ぶ。imgを立方体マップ(PL_Eacのときは等角キューブマップ)にして、各面のミップマップをMIP_FILTERで作り、
+    /// ブロック圧縮してm_fullCubeTexに置く。
+    /// 面の端は隣の面とつながっていないので、面ごとに端の画素を延ばして縮小する。
+    int TexturedMeshRenderer::PostFullCube(const DecodedImage &img) {
+        const ImageView view = img.View();
+        MipSource src;
+        src.pixels = view.pixels;
+        src.width = view.width;
+        src.height = view.height;
+        src.stride = view.stride;
+
+        CubeMapParams cp;
+        cp.faceSize = CUBE_FACE_SIZE;
+        cp.equiAngular = TEXTURE_LAYOUT == PL_Eac;
+        CubeMap cube;
+        if (EquirectToCube(src, cp, &cube) < 0) {
+            return E_FAIL;
+        }
+        if (m_fullCancel) {
+            return E_ABORT;
+        }
+
+        const int n = cube.faceSize;
+        MipBuildParams mp;
+        mp.filter = MIP_FILTER;
+        mp.maxLevels = TEXTURE_MIP_LEVELS;
+        mp.wrapX = false;
+        MipSource faces[CUBE_NUM];
+        MipChain chains[CUBE_NUM];
+        for (int f = 0; f < CUBE_NUM; ++f) {
+            faces[f].pixels = cube.Face(f);
+            faces[f].width = n;
+            faces[f].height = n;
+            faces[f].stride = 4 * n;
+            if (MipBuild(&faces[f], 1, mp, &chains[f]) < 0) {
+                return E_FAIL;
+            }
+        }
+        const int numLevels = chains[0].numLevels;
+
+        // BC形式は一辺が4の倍数のときだけ使える。そうでないときは圧縮しない。
+        const BcFormat format = ((n & 3) == 0) ? TEXTURE_FORMAT : BCF_None;
+        BcTexture bc[CUBE_NUM];
+        std::vector<TextureCacheLevelData> levels((size_t)CUBE_NUM * numLevels);
+        for (int f = 0; f < CUBE_NUM; ++f) {
+            if (FAILED(CompressLevels(faces[f], chains[f], format, &bc[f], &levels[(size_t)f * numLevels]))) {
+                return E_FAIL;
+            }
+            if (m_fullCancel) {
+                return E_ABORT;
+            }
+        }
+
+        winrt::com_ptr<ID3D11Texture2D> tex;
+        winrt::com_ptr<ID3D11ShaderResourceView> srv;
+        JpegToTexture jt;
+        int hr = jt.LevelsToTexture(m_dev, format, n, n, numLevels, levels.data(), true, tex.put(), srv.put());
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // 次回からはキャッシュを使う。書けなくても表示は続ける。
+        if (m_cacheKeysValid) {
+            for (int f = 0; f < CUBE_NUM; ++f) {
+                m_texCache.Write(m_cacheKeys[f], format, n, n, numLevels, &levels[(size_t)f * numLevels]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_fullMutex);
+        m_fullCubeTex = tex;
+        m_fullCubeSrv = srv;
+        for (int i = 0; i < N_MESH; ++i) {
+            m_fullLevel0[i] = nullptr;
+        }
+        return S_OK;
+    }
+
+    /// m_fullThreadから呼ぶ。imgを八面体マップにして、ミップマップをMIP_FILTERで作り、ブロック圧縮して両方の半球のm_fullTexに置く。
+    /// 八面体マップの端は折り返した先とつながっているが、縮小では端の画素を延ばす。
+    int TexturedMeshRenderer::PostFullOct(const DecodedImage &img) {
+        const ImageView view = img.View();
+        MipSource src;
+        src.pixels = view.pixels;
+        src.width = view.width;
+        src.height = view.height;
+        src.stride = view.stride;
+
+        CubeMapParams cp;
+        cp.faceSize = OCT_MAP_SIZE;
+        OctMap oct;
+        if (EquirectToOct(src, cp, &oct) < 0) {
+            return E_FAIL;
+        }
+        if (m_fullCancel) {
+            return E_ABORT;
+        }
+
+        const int n = oct.size;
+        MipSource octSrc;
+        octSrc.pixels = oct.pixels.data();
+        octSrc.width = n;
+        octSrc.height = n;
+        octSrc.stride = 4 * n;
+        MipBuildParams mp;
+        mp.filter = MIP_FILTER;
+        mp.maxLevels = TEXTURE_MIP_LEVELS;
+        mp.wrapX = false;
+        MipChain chain;
+        if (MipBuild(&octSrc, 1, mp, &chain) < 0) {
+            return E_FAIL;
+        }
+
+        // BC形式は一辺が4の倍数のときだけ使える。そうでないときは圧縮しない。
+        const BcFormat format = ((n & 3) == 0) ? TEXTURE_FORMAT : BCF_None;
+        BcTexture bc;
+        std::vector<TextureCacheLevelData> levels(chain.numLevels);
+        if (FAILED(CompressLevels(octSrc, chain, format, &bc, levels.data()))) {
+            return E_FAIL;
+        }
+
+        winrt::com_ptr<ID3D11Texture2D> tex;
+        winrt::com_ptr<ID3D11ShaderResourceView> srv;
+        JpegToTexture jt;
+        int hr = jt.LevelsToTexture(m_dev, format, n, n, chain.numLevels, levels.data(), false, tex.put(), srv.put());
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // 次回からはキャッシュを使う。書けなくても表示は続ける。
+        if (m_cacheKeysValid) {
+            m_texCache.Write(m_cacheKeys[0], format, n, n, chain.numLevels, levels.data());
+        }
+
+        std::lock_guard<std::mutex> lock(m_fullMutex);
+        for (int i = 0; i < N_MESH; ++i) {
+            m_fullTex[i] = tex;
+            m_fullSrv[i] = srv;
+            m_fullLevel0[i] = nullptr;
+        }
+        return S_OK;
+    }
+
+    /// m_fullThreadから呼ぶ。imgをLATITUDE_BANDS本の緯度の帯に分けて詰め、ミップマップをMIP_FILTERで作り、ブロック圧縮して
+    /// 両方の半球のm_fullTexに置き、詰め方をm_fullBandLayoutに置く。
+    /// サンプラーは最も精細な段だけを読むので、下の段で区間の縁が隣の区間と混ざってもよい。
+    int TexturedMeshRenderer::PostFullBands(const DecodedImage &img) {
+        const ImageView view = img.View();
+        MipSource src;
+        src.pixels = view.pixels;
+        src.width = view.width;
+        src.height = view.height;
+        src.stride = view.stride;
+
+        LatitudeBandImage bands;
+        if (EquirectToLatitudeBands(src, std::min(LATITUDE_BANDS, view.height), 0, &bands) < 0) {
+            return E_FAIL;
+        }
+        if (m_fullCancel) {
+            return E_ABORT;
+        }
+
+        const LatitudeBandLayout &layout = bands.layout;
+        MipSource bandSrc;
+        bandSrc.pixels = bands.pixels.data();
+        bandSrc.width = layout.width;
+        bandSrc.height = layout.height;
+        bandSrc.stride = 4 * layout.width;
+        MipBuildParams mp;
+        mp.filter = MIP_FILTER;
+        mp.maxLevels = TEXTURE_MIP_LEVELS;
+        mp.wrapX = false;
+        MipChain chain;
+        if (MipBuild(&bandSrc, 1, mp, &chain) < 0) {
+            return E_FAIL;
+        }
+
+        // 詰めた画像の大きさは4の倍数。
+        BcTexture bc;
+        std::vector<TextureCacheLevelData> levels(chain.numLevels);
+        if (FAILED(CompressLevels(bandSrc, chain, TEXTURE_FORMAT, &bc, levels.data()))) {
+            return E_FAIL;
+        }
+
+        winrt::com_ptr<ID3D11Texture2D> tex;
+        winrt::com_ptr<ID3D11ShaderResourceView> srv;
+        JpegToTexture jt;
+        int hr = jt.LevelsToTexture(m_dev, TEXTURE_FORMAT, layout.width, layout.height, chain.numLevels, levels.data(), false,
+                tex.put(), srv.put());
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // 次回からはキャッシュを使う。詰め方を決め直せるように元の画像の大きさも書く。書けなくても表示は続ける。
+        if (m_cacheKeysValid) {
+            m_texCache.Write(m_cacheKeys[0], TEXTURE_FORMAT, layout.width, layout.height, chain.numLevels, levels.data(),
+                    view.width, view.height);
+        }
+
+        std::lock_guard<std::mutex> lock(m_fullMutex);
+        for (int i = 0; i < N_MESH; ++i) {
+            m_fullTex[i] = tex;
+            m_fullSrv[i] = srv;
+            m_fullLevel0[i] = nullptr;
+        }
+        m_fullBandLayout = layout;
+        return S_OK;
+    }
+
+    /// imagePathの内容と今の設定の鍵をm_cacheKeysに置き、TEXTURE_LAYOUTの全部のテクスチャーのキャッシュがあればそれを使う。
+    /// 鍵は正距円筒図法では左右の半球ごと、立方体マップでは6面ごと、八面体マップと緯度の帯では1個。
+    /// 無いときは失敗を戻す。全画素のテクスチャーを作った後にPostFull()がキャッシュを書く。
+    int TexturedMeshRenderer::LoadCachedTextures(const wchar_t *imagePath) {
+        m_cacheKeysValid = false;
+        if (!m_texCache.IsEnabled()) {
+            const std::wstring dir = UserCacheDirectory(L"View360Photo");
+            m_texCache.Init(dir.empty() ? dir : dir + L"\\TextureCache", (uint64_t)TEXTURE_CACHE_MAX_MB * 1024 * 1024);
+            if (!m_texCache.IsEnabled()) {
+                return E_FAIL;
+            }
+        }
+
+        uint64_t srcHash = 0;
+        int hr = TextureCache::SourceHash(imagePath, &srcHash);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        // 立方体マップ、八面体マップ、緯度の帯は画像全体から作り、設定のCUBE_FACE_SIZE, OCT_MAP_SIZE, LATITUDE_BANDSで区別する。
+        constexpr bool cube = TEXTURE_LAYOUT == PL_Cube || TEXTURE_LAYOUT == PL_Eac;
+        constexpr bool oct = TEXTURE_LAYOUT == PL_Octahedral;
+        constexpr bool bands = TEXTURE_LAYOUT == PL_LatitudeBands;
+        constexpr int numKeys = cube ? CUBE_NUM : (oct || bands) ? 1 : N_MESH;
+        for (int i = 0; i < numKeys; ++i) {
+            TextureCacheParams p;
+            p.alpha = 0xff;
+            p.format = TEXTURE_FORMAT;
+            p.quality = TEXTURE_QUALITY;
+            p.mipFilter = MIP_FILTER;
+            p.maxWidth = m_maxTexWidth;
+            p.mipLevels = TEXTURE_MIP_LEVELS;
+            if constexpr (cube || oct || bands) {
+                p.wrapX = 0;
+                p.layout = TEXTURE_LAYOUT;
+                p.faceSize = cube ? CUBE_FACE_SIZE : oct ? OCT_MAP_SIZE : LATITUDE_BANDS;
+                p.face = i;
+            } else {
+                const XrRect2Df &r = gHemispherePortions[i];
+                p.portion[0] = r.offset.x;
+                p.portion[1] = r.offset.y;
+                p.portion[2] = r.extent.width;
+                p.portion[3] = r.extent.height;
+                p.wrapX = 1;
+            }
+            m_cacheKeys[i] = TextureCache::Key(srcHash, p);
+        }
+        m_cacheKeysValid = true;
+
+        TextureCacheEntry entries[numKeys];
+        for (int i = 0; i < numKeys; ++i) {
+            hr = m_texCache.Open(m_cacheKeys[i], entries[i]);
             if (FAILED(hr)) {
                 return hr;
             }
         }
 
-		for (int i = 0; i < N_MESH; ++i) {
-			TexturedMesh &tm = m_meshes[i];
-			const D3D11_SUBRESOURCE_DATA vertexBufferData{ &tm.vertexList[0] };
-			const CD3D11_BUFFER_DESC vertexBufferDesc((uint32_t)(sizeof(XyzUv) * tm.vertexList.size()), D3D11_BIND_VERTEX_BUFFER);
-			CHECK_HRCMD(m_dev->CreateBuffer(&vertexBufferDesc, &vertexBufferData, tm.vb.put()));
+        JpegToTexture jt;
+        if constexpr (cube) {
+            // 6面の形式と大きさがそろっていること。
+            const TextureCacheEntry &e0 = entries[0];
+            const int numLevels = e0.NumLevels();
+            std::vector<TextureCacheLevelData> levels((size_t)CUBE_NUM * numLevels);
+            for (int f = 0; f < CUBE_NUM; ++f) {
+                const TextureCacheEntry &e = entries[f];
+                if (e.Format() != e0.Format() || e.Width() != e0.Width() || e.Height() != e0.Height()
+                        || e.NumLevels() != numLevels) {
+                    printf("E: TexturedMeshRenderer::LoadCachedTextures() cube faces do not match\n");
+                    return E_FAIL;
+                }
+                for (int l = 0; l < numLevels; ++l) {
+                    levels[(size_t)f * numLevels + l] = { e.LevelPixels(l), e.LevelPitch(l), e.LevelPitch(l), e.LevelRows(l) };
+                }
+            }
+            hr = jt.LevelsToTexture(m_dev, e0.Format(), e0.Width(), e0.Height(), numLevels, levels.data(), true,
+                    m_cubeTex.put(), m_cubeSrv.put());
+            if (FAILED(hr)) {
+                return hr;
+            }
+        } else if constexpr (oct || bands) {
+            // 緯度の帯は、ヘッダーの元の画像の大きさから詰め方を決め直す。作ったときと同じ大きさになること。
+            LatitudeBandLayout layout;
+            if constexpr (bands) {
+                const TextureCacheEntry &e = entries[0];
+                if (LatitudeBandLayoutBuild(e.SrcWidth(), e.SrcHeight(), std::min(LATITUDE_BANDS, e.SrcHeight()), &layout) < 0
+                        || layout.width != e.Width() || layout.height != e.Height()) {
+                    printf("E: TexturedMeshRenderer::LoadCachedTextures() latitude band layout does not match\n");
+                    return E_FAIL;
+                }
+            }
 
-			// triangle index要素のサイズ(4バイト)は後でIASetIndexBuffer()で指定する。
-			const D3D11_SUBRESOURCE_DATA indexBufferData{ &tm.triangleIdxList[0] };
-			const CD3D11_BUFFER_DESC indexBufferDesc((uint32_t)(sizeof(uint32_t) * tm.triangleIdxList.size()), D3D11_BIND_INDEX_BUFFER);
-			CHECK_HRCMD(m_dev->CreateBuffer(&indexBufferDesc, &indexBufferData, tm.ib.put()));
-		}
+            winrt::com_ptr<ID3D11Texture2D> tex;
+            winrt::com_ptr<ID3D11ShaderResourceView> srv;
+            hr = jt.TextureCacheEntryToTexture(m_dev, entries[0], tex.put(), srv.put());
+            if (FAILED(hr)) {
+                return hr;
+            }
+            for (int i = 0; i < N_MESH; ++i) {
+                m_meshes[i].tex = tex;
+                m_meshes[i].srv = srv;
+            }
+            if constexpr (bands) {
+                UpdateBandCB(layout);
+            }
+        } else {
+            winrt::com_ptr<ID3D11Texture2D> tex[N_MESH];
+            winrt::com_ptr<ID3D11ShaderResourceView> srv[N_MESH];
+            for (int i = 0; i < N_MESH; ++i) {
+                hr = jt.TextureCacheEntryToTexture(m_dev, entries[i], tex[i].put(), srv[i].put());
+                if (FAILED(hr)) {
+                    return hr;
+                }
+            }
+            for (int i = 0; i < N_MESH; ++i) {
+                m_meshes[i].tex = tex[i];
+                m_meshes[i].srv = srv[i];
+            }
+        }
+        m_fullTexCreated = true;
+        m_layoutActive = true;
+        return S_OK;
+    }
 
-        return hr;
+    void TexturedMeshRenderer::JoinFullThread(void) {
+        if (m_fullThread.joinable()) {
+            m_fullCancel = true;
+            m_fullThread.join();
+        }
+        m_fullCancel = false;
+        m_fullDone = false;
+        m_fullTexCreated = false;
+        for (int i = 0; i < N_MESH; ++i) {
+            m_fullLevel0[i] = nullptr;
+            m_fullTex[i] = nullptr;
+            m_fullSrv[i] = nullptr;
+        }
+        m_fullCubeTex = nullptr;
+        m_fullCubeSrv = nullptr;
+        m_fullBandLayout = LatitudeBandLayout();
+        m_cubeTex = nullptr;
+        m_cubeSrv = nullptr;
+        m_layoutActive = false;
+    }
+
+    /// 全画素のlevel0が届いていれば、テクスチャーに入れる。
+    /// 最初は縮小画像のテクスチャーと差し替え、プログレッシブJPEGの2回目以降はその最も精細な段を書き換える。
+    /// CPUでミップマップを作ったテクスチャーが届いていれば、そのまま差し替える。
+    /// 以後はTEXTURE_LAYOUTの形として読む。立方体マップが届いたときは、縮小画像のテクスチャーは捨てる。
+    void TexturedMeshRenderer::SwapInFullTextures(void) {
+        if (!m_fullThread.joinable()) {
+            return;
+        }
+
+        winrt::com_ptr<ID3D11Texture2D> level0[N_MESH];
+        winrt::com_ptr<ID3D11Texture2D> tex[N_MESH];
+        winrt::com_ptr<ID3D11ShaderResourceView> srv[N_MESH];
+        winrt::com_ptr<ID3D11Texture2D> cubeTex;
+        winrt::com_ptr<ID3D11ShaderResourceView> cubeSrv;
+        LatitudeBandLayout bandLayout;
+        bool done;
+        int fullHr;
+        {
+            std::lock_guard<std::mutex> lock(m_fullMutex);
+            for (int i = 0; i < N_MESH; ++i) {
+                level0[i] = m_fullLevel0[i];
+                m_fullLevel0[i] = nullptr;
+                tex[i] = m_fullTex[i];
+                srv[i] = m_fullSrv[i];
+                m_fullTex[i] = nullptr;
+                m_fullSrv[i] = nullptr;
+            }
+            cubeTex = m_fullCubeTex;
+            cubeSrv = m_fullCubeSrv;
+            m_fullCubeTex = nullptr;
+            m_fullCubeSrv = nullptr;
+            std::swap(bandLayout, m_fullBandLayout);
+            done = m_fullDone;
+            fullHr = m_fullHr;
+        }
+
+        if (cubeSrv != nullptr) {
+            m_cubeTex = cubeTex;
+            m_cubeSrv = cubeSrv;
+            for (int i = 0; i < N_MESH; ++i) {
+                m_meshes[i].tex = nullptr;
+                m_meshes[i].srv = nullptr;
+            }
+            m_fullTexCreated = true;
+            m_layoutActive = true;
+        } else if (tex[0] != nullptr) {
+            for (int i = 0; i < N_MESH; ++i) {
+                m_meshes[i].tex = tex[i];
+                m_meshes[i].srv = srv[i];
+            }
+            if (!bandLayout.bands.empty()) {
+                UpdateBandCB(bandLayout);
+            }
+            m_fullTexCreated = true;
+            m_layoutActive = true;
+        } else if (level0[0] != nullptr) {
+            JpegToTexture jt;
+            int hr = S_OK;
+            for (int i = 0; i < N_MESH && SUCCEEDED(hr); ++i) {
+                TexturedMesh &mesh = m_meshes[i];
+                if (m_fullTexCreated) {
+                    jt.UpdateMipmappedTexture(m_dctx, level0[i].get(), mesh.tex.get(), mesh.srv.get());
+                    continue;
+                }
+                winrt::com_ptr<ID3D11Texture2D> newTex;
+                winrt::com_ptr<ID3D11ShaderResourceView> newSrv;
+                hr = jt.Level0ToMipmappedTexture(m_dev, m_dctx, level0[i].get(), newTex.put(), newSrv.put(),
+                        TEXTURE_MIP_LEVELS);
+                if (SUCCEEDED(hr)) {
+                    mesh.tex = newTex;
+                    mesh.srv = newSrv;
+                }
+            }
+            m_fullTexCreated = SUCCEEDED(hr);
+        }
+
+        if (done) {
+            if (FAILED(fullHr)) {
+                // 縮小画像のまま表示を続ける。
+                printf("E: TexturedMeshRenderer::SwapInFullTextures() full resolution load failed %x\n", fullHr);
+            }
+            m_fullThread.join();
+            m_fullDone = false;
+        }
+    }
+
+    /// MainBandedPSが読む帯と区間の表を、lの詰め方にする。
+    void TexturedMeshRenderer::UpdateBandCB(const LatitudeBandLayout &l) {
+        TexturedMeshShader::BandCB cb = {};
+        const int n = (int)l.bands.size();
+        for (int k = 0; k < n; ++k) {
+            const LatitudeBand &b = l.bands[k];
+            cb.Bands[k] = { (float)b.width, (float)b.srcY0, (float)b.firstSegment, (float)b.numSegments };
+            for (int s = b.firstSegment; s < b.firstSegment + b.numSegments; ++s) {
+                const LatitudeBandSegment &sg = l.segments[s];
+                cb.Segments[s] = { (float)(sg.x - sg.col0), (float)(sg.y - b.srcY0), (float)sg.col1, 0 };
+            }
+        }
+        cb.Bands[n].y = (float)l.srcHeight;
+        cb.Info = { (float)n, (float)l.srcHeight, 1.0f / (float)l.width, 1.0f / (float)l.height };
+        m_dctx->UpdateSubresource(m_bandCB.get(), 0, nullptr, &cb, 0, 0);
+    }
+
+    /// tmのvertexList, triangleIdxListをMESH_VERTEX_FORMATの形式に詰めて、頂点バッファとインデックスバッファを作る。
+    int TexturedMeshRenderer::CreateMeshBuffers(TexturedMesh &tm) {
+        PackedMesh pm;
+        int hr = MeshPack(tm.vertexList.data(), tm.vertexList.size(),
+                tm.triangleIdxList.data(), tm.triangleIdxList.size(), MESH_VERTEX_FORMAT, pm);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        const D3D11_SUBRESOURCE_DATA vertexBufferData{ pm.vtx.data() };
+        const CD3D11_BUFFER_DESC vertexBufferDesc((uint32_t)pm.vtx.size(), D3D11_BIND_VERTEX_BUFFER);
+        CHECK_HRCMD(m_dev->CreateBuffer(&vertexBufferDesc, &vertexBufferData, tm.vb.put()));
+
+        // triangle index要素のサイズ(2または4バイト)は後でIASetIndexBuffer()で指定する。
+        const D3D11_SUBRESOURCE_DATA indexBufferData{ pm.idx.data() };
+        const CD3D11_BUFFER_DESC indexBufferDesc((uint32_t)pm.idx.size(), D3D11_BIND_INDEX_BUFFER);
+        CHECK_HRCMD(m_dev->CreateBuffer(&indexBufferDesc, &indexBufferData, tm.ib.put()));
+
+        tm.vtxStride = pm.vtxStride;
+        tm.idxFormat = (pm.idxBytes == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+        tm.numIndices = (uint32_t)pm.numIndices;
+        return S_OK;
     }
 
     void TexturedMeshRenderer::InitializeD3DResources(void) {
 		{
-			const winrt::com_ptr<ID3DBlob> vertexShaderBytes = sample::dx::CompileShader(TexturedMeshShader::VSShaderHlsl, "MainVS", "vs_5_0");
+			const std::string vsHlsl = "#define VTX_FORMAT " + std::to_string((int)MESH_VERTEX_FORMAT) + "\n"
+				+ TexturedMeshShader::VSShaderHlsl;
+			const winrt::com_ptr<ID3DBlob> vertexShaderBytes = sample::dx::CompileShader(vsHlsl.c_str(), "MainVS", "vs_5_0");
 			CHECK_HRCMD(m_dev->CreateVertexShader(
 				vertexShaderBytes->GetBufferPointer(), vertexShaderBytes->GetBufferSize(), nullptr, m_vertexShader.put()));
 
-			const winrt::com_ptr<ID3DBlob> pixelShaderBytes = sample::dx::CompileShader(TexturedMeshShader::PSShaderHlsl, "MainPS", "ps_5_0");
+			const std::string psHlsl = "#define LATITUDE_BANDS_MAX " + std::to_string(LATITUDE_BANDS_MAX) + "\n"
+				+ "#define LATITUDE_SEGMENTS_MAX " + std::to_string(LATITUDE_SEGMENTS_MAX) + "\n"
+				+ TexturedMeshShader::PSShaderHlsl;
+			const winrt::com_ptr<ID3DBlob> pixelShaderBytes = sample::dx::CompileShader(psHlsl.c_str(), "MainPS", "ps_5_0");
 			CHECK_HRCMD(m_dev->CreatePixelShader(
 				pixelShaderBytes->GetBufferPointer(), pixelShaderBytes->GetBufferSize(), nullptr, m_pixelShader.put()));
 
+			const winrt::com_ptr<ID3DBlob> layoutPixelShaderBytes = sample::dx::CompileShader(psHlsl.c_str(),
+				LayoutPixelShaderEntry(TEXTURE_LAYOUT), "ps_5_0");
+			CHECK_HRCMD(m_dev->CreatePixelShader(
+				layoutPixelShaderBytes->GetBufferPointer(), layoutPixelShaderBytes->GetBufferSize(), nullptr, m_layoutPixelShader.put()));
+
+			// 頂点の形式ごとの位置とUVの要素の型。MeshPack.hを参照。
+			DXGI_FORMAT posFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+			DXGI_FORMAT uvFormat = DXGI_FORMAT_R32G32_FLOAT;
+			switch (MESH_VERTEX_FORMAT) {
+			case MVF_Snorm16:
+				posFormat = DXGI_FORMAT_R16G16B16A16_SNORM;
+				uvFormat = DXGI_FORMAT_R16G16_UNORM;
+				break;
+			case MVF_Octahedral16:
+				posFormat = DXGI_FORMAT_R16G16_SNORM;
+				uvFormat = DXGI_FORMAT_R16G16_UNORM;
+				break;
+			default:
+				break;
+			}
+
 			const D3D11_INPUT_ELEMENT_DESC vertexDesc[] = {
-				{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
-				{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+				{"POSITION", 0, posFormat, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+				{"TEXCOORD", 0, uvFormat, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
 			};
 
 			CHECK_HRCMD(m_dev->CreateInputLayout(vertexDesc,
@@ -194,6 +1043,12 @@ namespace sample {
 			CHECK_HRCMD(m_dev->CreateBuffer(&bd, nullptr, m_alphaCB.put()));
 		}
 
+		{
+			// 緯度の帯の表も、PS用。
+			const CD3D11_BUFFER_DESC bd(sizeof(TexturedMeshShader::BandCB), D3D11_BIND_CONSTANT_BUFFER);
+			CHECK_HRCMD(m_dev->CreateBuffer(&bd, nullptr, m_bandCB.put()));
+		}
+
 		{
 			D3D11_FEATURE_DATA_D3D11_OPTIONS3 options;
 			m_dev->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS3, &options, sizeof(options));
@@ -217,7 +1072,8 @@ namespace sample {
 			sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
 			sampDesc.MipLODBias = 0; //< 4等にすると、ボケボケになり、Mipmapが行われていることを確認できる。
 			sampDesc.MinLOD = 0;
-			sampDesc.MaxLOD = 0; // D3D11_FLOAT32_MAX; //< 0にすると、最も精細なテクスチャーだけが使用される。
+			// 0にすると、最も精細なテクスチャーだけが使用される。テクスチャーはTEXTURE_MIP_LEVELSの段までしか作らない。
+			sampDesc.MaxLOD = (TEXTURE_MIP_LEVELS == 0) ? D3D11_FLOAT32_MAX : (float)(TEXTURE_MIP_LEVELS - 1);
 			CHECK_HRCMD(m_dev->CreateSamplerState(&sampDesc, m_sampler.put()));
 		}
 
@@ -261,6 +1117,8 @@ namespace sample {
             DXGI_FORMAT depthSwapchainFormat,
             ID3D11Texture2D* depthTexture)
     {
+        SwapInFullTextures();
+
         const uint32_t viewInstanceCount = (uint32_t)viewProjections.size();
         CHECK_MSG(viewInstanceCount <= NUM_VIEWS,
                   "TexturedMeshShader supports 4 or fewer view instances. Adjust shader to accommodate more.")
@@ -288,7 +1146,8 @@ namespace sample {
 		m_dctx->OMSetBlendState(m_addBlend.get(), nullptr, 0xffffff);
 
         m_dctx->VSSetShader(m_vertexShader.get(), nullptr, 0);
-        m_dctx->PSSetShader(m_pixelShader.get(), nullptr, 0);
+        // 縮小画像は正距円筒図法。全画素のテクスチャーはTEXTURE_LAYOUTの形で、立方体マップは両方の半球のメッシュが読む。
+        m_dctx->PSSetShader(m_layoutActive ? m_layoutPixelShader.get() : m_pixelShader.get(), nullptr, 0);
 		ID3D11SamplerState* ss = m_sampler.get();
 		m_dctx->PSSetSamplers(0, 1, &ss);
 
@@ -297,7 +1156,7 @@ namespace sample {
 
 		ID3D11Buffer* const vscb[] = { m_modelCB.get(), m_viewProjCB.get() };
 		m_dctx->VSSetConstantBuffers(0, (UINT)std::size(vscb), vscb);
-		ID3D11Buffer* const pscb[] = { m_alphaCB.get() };
+		ID3D11Buffer* const pscb[] = { m_alphaCB.get(), m_bandCB.get() };
 		m_dctx->PSSetConstantBuffers(0, (UINT)std::size(pscb), pscb);
 		{
 			// ModelCBをアップロード。
@@ -344,18 +1203,18 @@ namespace sample {
             TexturedMesh &tm = m_meshes[i];
 
             // Set primitive data.
-            ID3D11ShaderResourceView* srv = tm.srv.get();
-            m_dctx->PSSetShaderResources(0, 1, &srv);
+            ID3D11ShaderResourceView* srvs[] = { tm.srv.get(), m_cubeSrv.get() };
+            m_dctx->PSSetShaderResources(0, (UINT)std::size(srvs), srvs);
 
-            const UINT strides[] = { sizeof(TexturedMeshShader::Vertex) };
+            const UINT strides[] = { tm.vtxStride };
             const UINT offsets[] = { 0 };
             ID3D11Buffer* vertexBuffers[] = { tm.vb.get() };
             m_dctx->IASetVertexBuffers(0, (UINT)std::size(vertexBuffers), vertexBuffers, strides, offsets);
-            m_dctx->IASetIndexBuffer(tm.ib.get(), DXGI_FORMAT_R32_UINT, 0);
+            m_dctx->IASetIndexBuffer(tm.ib.get(), tm.idxFormat, 0);
             m_dctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
             // Draw.
-            m_dctx->DrawIndexedInstanced((uint32_t)(tm.triangleIdxList.size()), viewInstanceCount, 0, 0, 0);
+            m_dctx->DrawIndexedInstanced(tm.numIndices, viewInstanceCount, 0, 0, 0);
         }
     }
 
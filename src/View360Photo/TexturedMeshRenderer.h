@@ -2,14 +2,22 @@
 #pragma once
 
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include "TexturedMesh.h"
+#include "TextureCache.h"
+#include "CubeMap.h"
+#include "LatitudeBands.h"
+
+class DecodedImage;
 
 namespace sample {
 
     struct TexturedMeshRenderer {
         TexturedMeshRenderer() = default;
         
-        virtual ~TexturedMeshRenderer() = default;
+        virtual ~TexturedMeshRenderer();
 
 		void InitGraphcisResources(ID3D11Device * device, ID3D11DeviceContext * dctx) {
             m_dev = device;
@@ -17,8 +25,16 @@ namespace sample {
             InitializeD3DResources();
         }
 
+		/// PREVIEW_MAX_WIDTHに縮小した画像ですぐにテクスチャーを作り、全画素のテクスチャーは別のスレッドで作る。
+		/// 全画素のテクスチャーは、できた後のRenderView()で差し替える。
+		/// プログレッシブJPEGでは縮小画像を最初のスキャンだけで作り、全画素のテクスチャーもスキャンごとに更新する。
+		/// 同じ画像と設定の全画素のテクスチャーがTextureCacheにあれば、デコードせずにそれを使う。
 		int Load(const wchar_t *imagePath);
 
+		/// 画面の視野の中心の1度あたりの画素数。次のLoad()から、全画素のテクスチャーにする画像の幅を
+		/// TEXTURE_DENSITY_SCALEで決めた上限までに縮める。
+		void SetDisplayPixelsPerDegree(double pixelsPerDegree);
+
         // Render to swapchain images using stereo image array
         void RenderView(
             const XrRect2Di& imageRect,
@@ -36,15 +52,69 @@ namespace sample {
         ID3D11DeviceContext * m_dctx = nullptr;
         winrt::com_ptr<ID3D11VertexShader> m_vertexShader;
         winrt::com_ptr<ID3D11PixelShader> m_pixelShader;
+        winrt::com_ptr<ID3D11PixelShader> m_layoutPixelShader;
         winrt::com_ptr<ID3D11InputLayout> m_inputLayout;
         winrt::com_ptr<ID3D11Buffer> m_modelCB;
         winrt::com_ptr<ID3D11Buffer> m_viewProjCB;
 		winrt::com_ptr<ID3D11Buffer> m_alphaCB;
+        winrt::com_ptr<ID3D11Buffer> m_bandCB;
 		winrt::com_ptr<ID3D11DepthStencilState> m_noZtestState;
         winrt::com_ptr<ID3D11SamplerState> m_sampler;
         winrt::com_ptr<ID3D11RasterizerState> m_rst;
 		winrt::com_ptr<ID3D11BlendState> m_addBlend;
+
+        /// 全画素のテクスチャーを作るスレッド。作ったテクスチャーをm_fullMutexの中でm_fullLevel0、m_fullTexに置く。
+        std::thread m_fullThread;
+        std::mutex m_fullMutex;
+        std::atomic<bool> m_fullCancel{ false };
+        bool m_fullDone = false;
+        int m_fullHr = S_OK;
+        winrt::com_ptr<ID3D11Texture2D> m_fullLevel0[N_MESH];
+
+        /// 最後に置かれる、CPUで作ったミップマップ付きのテクスチャー。
+        winrt::com_ptr<ID3D11Texture2D> m_fullTex[N_MESH];
+        winrt::com_ptr<ID3D11ShaderResourceView> m_fullSrv[N_MESH];
+
+        /// TEXTURE_LAYOUTがPL_CubeかPL_Eacのとき、m_fullTexの代わりに置かれる立方体マップ。
+        /// PL_Octahedralのときは、両方のm_fullTexに同じ八面体マップが置かれる。
+        winrt::com_ptr<ID3D11Texture2D> m_fullCubeTex;
+        winrt::com_ptr<ID3D11ShaderResourceView> m_fullCubeSrv;
+
+        /// TEXTURE_LAYOUTがPL_LatitudeBandsのとき、m_fullTexと一緒に置かれる詰め方。差し替えるときm_bandCBに入れる。
+        LatitudeBandLayout m_fullBandLayout;
+
+        /// 表示中の立方体マップ。nullptrでないとき、m_meshesのテクスチャーの代わりにこれを読む。
+        winrt::com_ptr<ID3D11Texture2D> m_cubeTex;
+        winrt::com_ptr<ID3D11ShaderResourceView> m_cubeSrv;
+
+        /// 全画素のテクスチャーにする画像の幅の上限。0のとき上限なし。
+        int m_maxTexWidth = 0;
+
+        /// m_meshesのテクスチャーが全画素の大きさになったときtrue。以後はその最も精細な段を書き換える。
+        bool m_fullTexCreated = false;
+
+        /// CPUで作った全画素のテクスチャーを表示しているときtrue。m_layoutPixelShaderでTEXTURE_LAYOUTの形として読む。
+        bool m_layoutActive = false;
+
+        /// 全画素のテクスチャーのキャッシュと、今の画像の左半分と右半分(立方体マップのときは6面)の鍵。
+        /// m_cacheKeysValidがfalseのときは書かない。
+        TextureCache m_texCache;
+        uint64_t m_cacheKeys[CUBE_NUM] = {};
+        bool m_cacheKeysValid = false;
+
 		void InitializeD3DResources(void);
+        int CreateMeshBuffers(TexturedMesh &tm);
+        int CreateLevel0Textures(const DecodedImage &img, winrt::com_ptr<ID3D11Texture2D> (&level0_r)[N_MESH]);
+        int PostFullLevel0(const DecodedImage &img);
+        int PostFull(const DecodedImage &img);
+        int PostFullMipmapped(const DecodedImage &img);
+        int PostFullCube(const DecodedImage &img);
+        int PostFullOct(const DecodedImage &img);
+        int PostFullBands(const DecodedImage &img);
+        int LoadCachedTextures(const wchar_t *imagePath);
+        void JoinFullThread(void);
+        void SwapInFullTextures(void);
+        void UpdateBandCB(const LatitudeBandLayout &l);
 	};
 
 }; // namespace sample
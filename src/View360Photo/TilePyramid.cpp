@@ -0,0 +1,485 @@
+﻿// 日本語。
+
+#include "TilePyramid.h"
+#include "FileUtil.h"
+#include "ParallelFor.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+static_assert(sizeof(TilePyramidHeader) == 64, "TilePyramidHeader size");
+static_assert(sizeof(TilePyramidLevel) == 32, "TilePyramidLevel size");
+static_assert(sizeof(TilePyramidTile) == 16, "TilePyramidTile size");
+
+static const char TILE_PYRAMID_MAGIC[8] = { 'V', '3', '6', '0', 'T', 'P', 'Y', 0 };
+
+/// 段の数の上限。level 0の一辺が2^31画素でも足りる。
+static const uint32_t TILE_PYRAMID_LEVELS_MAX = 32;
+
+static uint64_t
+AlignUp(uint64_t v)
+{
+    return (v + TilePyramid::ALIGN_BYTES - 1) & ~(uint64_t)(TilePyramid::ALIGN_BYTES - 1);
+}
+
+/// 縁を含めた一辺storedの1枚のタイルのバイト数。
+static uint64_t
+StoredTileBytes(BcFormat f, int stored)
+{
+    if (f == BCF_None) {
+        return (uint64_t)4 * stored * stored;
+    }
+    const uint64_t blocks = (uint64_t)(stored / 4) * (stored / 4);
+    return blocks * BcBlockBytes(f);
+}
+
+/// 段の行rowY0から置いた画素から、縁を含めたタイル(tx, ty)を切り出してdstに書く。
+/// 左右は経度の継ぎ目でつなぎ、上下は端の画素を延ばす。右端と下端のタイルの、段の外の部分も同じ。
+static void
+CopyTile(const uint8_t* rows, int rowY0, int w, int h, int stride, int tileSize, int border, int tx, int ty, uint8_t* dst)
+{
+    const int stored = tileSize + 2 * border;
+    const int x0 = tx * tileSize - border;
+    const int y0 = ty * tileSize - border;
+    for (int r = 0; r < stored; ++r) {
+        const int y = std::min(std::max(y0 + r, 0), h - 1);
+        const uint8_t* row = rows + (size_t)stride * (y - rowY0);
+        uint8_t* d = dst + (size_t)4 * stored * r;
+        for (int c = 0; c < stored; ++c) {
+            int x = (x0 + c) % w;
+            x = (x < 0) ? x + w : x;
+            memcpy(d + 4 * c, row + 4 * x, 4);
+        }
+    }
+}
+
+/// 1枚のタイルに収まる段までの段数。
+static int
+TilePyramidNumLevels(int width, int height, int tileSize)
+{
+    int numLevels = 1;
+    while (tileSize < std::max(1, width >> (numLevels - 1)) || tileSize < std::max(1, height >> (numLevels - 1))) {
+        ++numLevels;
+    }
+    return numLevels;
+}
+
+/// 書くときに、level 0を1回に読む行数。次の段以降に1回に足す行数も、これ以下になる。
+static int
+WriteReadRows(int tileSize)
+{
+    return tileSize / 4;
+}
+
+/// 書くときに段lに置く行数。縁を含めたタイル1行か次の段の1行が読む行の多い方と、1回に足す行。
+static int
+WriteLevelRows(int height, int numLevels, int l, const TilePyramidParams& p)
+{
+    const int stored = p.tileSize + 2 * TILE_PYRAMID_BORDER;
+    const int h = std::max(1, height >> l);
+    const int next = (l + 1 < numLevels) ? MipRowResizer::NumSrcRows(p.filter, h, std::max(1, height >> (l + 1))) : 0;
+    return std::min(h, std::max(stored, next) + WriteReadRows(p.tileSize));
+}
+
+size_t
+TilePyramidWriteBytes(int width, int height, const TilePyramidParams& p)
+{
+    if (width < 1 || height < 1 || p.tileSize < 16 || 1024 < p.tileSize || (p.tileSize & 3) != 0 || p.format < 0
+            || BCF_NUM <= p.format || p.filter < 0 || MF_NUM <= p.filter) {
+        return 0;
+    }
+    const int ts = p.tileSize;
+    const int stored = ts + 2 * TILE_PYRAMID_BORDER;
+    const int numLevels = TilePyramidNumLevels(width, height, ts);
+    const uint64_t tileBytes = AlignUp(StoredTileBytes(p.format, stored));
+    const int numThreads = ParallelForNumThreads(p.numThreads);
+
+    // 各段の行と、段の間の縮小。
+    size_t bytes = 0;
+    uint64_t numTiles = 0;
+    for (int l = 0; l < numLevels; ++l) {
+        const int w = std::max(1, width >> l);
+        const int h = std::max(1, height >> l);
+        bytes += (size_t)4 * w * WriteLevelRows(height, numLevels, l, p);
+        numTiles += (uint64_t)((w + ts - 1) / ts) * ((h + ts - 1) / ts);
+        if (l + 1 < numLevels) {
+            bytes += MipRowResizer::WorkBytes(p.filter, w, h, std::max(1, width >> (l + 1)), std::max(1, height >> (l + 1)),
+                    WriteReadRows(ts), p.numThreads);
+        }
+    }
+
+    // level 0のタイル1行分の書く前のバイト列と、スレッドごとのタイル1枚、索引。
+    bytes += (size_t)tileBytes * ((width + ts - 1) / ts);
+    bytes += (size_t)numThreads * 4 * stored * stored;
+    bytes += (size_t)numLevels * sizeof(TilePyramidLevel) + (size_t)numTiles * sizeof(TilePyramidTile);
+    return bytes;
+}
+
+/// 書いている途中の1段。段の行rowY0からnumRows行だけを置く。
+struct TilePyramidWriteLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rows;
+    int rowY0 = 0;
+    int numRows = 0;
+
+    /// 次に書くタイルの行。
+    uint32_t nextTileRow = 0;
+
+    /// 次の段を作る重みと、次に作る次の段の行。
+    MipRowResizer toNext;
+    int nextY = 0;
+
+    int RowsEnd(void) const { return rowY0 + numRows; }
+    uint8_t* RowsEndPtr(void) { return rows.data() + (size_t)4 * width * numRows; }
+
+    /// あとn行を足せるようにする。見積もりより多いときは増やす。
+    void Reserve(int n)
+    {
+        const size_t need = (size_t)4 * width * (numRows + n);
+        if (rows.size() < need) {
+            rows.resize(need);
+        }
+    }
+};
+
+/// TilePyramidWrite()の、書いている途中の状態。
+struct TilePyramidWriter {
+    TilePyramidParams p;
+    FILE* fp = nullptr;
+    uint64_t pos = 0;
+    size_t alignedBytes = 0;
+    std::vector<TilePyramidLevel> levels;
+    std::vector<TilePyramidTile> tiles;
+    std::vector<TilePyramidWriteLevel> st;
+    std::vector<uint8_t> rowBuf;
+
+    int WriteTileRow(int l);
+    int Advance(int l);
+};
+
+/// 段lのタイルの行nextTileRowを、複数のスレッドで切り出して圧縮し、ファイルの終わりに書く。
+int
+TilePyramidWriter::WriteTileRow(int l)
+{
+    static const uint8_t zeros[TilePyramid::ALIGN_BYTES] = {};
+    const TilePyramidLevel& lv = levels[l];
+    TilePyramidWriteLevel& s = st[l];
+    const int ts = p.tileSize;
+    const int border = TILE_PYRAMID_BORDER;
+    const int stored = ts + 2 * border;
+    const int ty = (int)s.nextTileRow;
+    ParallelFor((int)lv.tilesX, [&](int tx) {
+        uint8_t* out = rowBuf.data() + alignedBytes * tx;
+        if (p.format == BCF_None) {
+            CopyTile(s.rows.data(), s.rowY0, lv.width, lv.height, 4 * lv.width, ts, border, tx, ty, out);
+            return;
+        }
+        std::vector<uint8_t> tile((size_t)4 * stored * stored);
+        CopyTile(s.rows.data(), s.rowY0, lv.width, lv.height, 4 * lv.width, ts, border, tx, ty, tile.data());
+        BcEncode(tile.data(), stored, stored, 4 * stored, p.format, p.quality, out, 1);
+    }, p.numThreads);
+
+    const uint64_t start = AlignUp(pos);
+    const size_t pad = (size_t)(start - pos);
+    if (pad != fwrite(zeros, 1, pad, fp) || lv.tilesX != fwrite(rowBuf.data(), alignedBytes, lv.tilesX, fp)) {
+        return -1;
+    }
+    const uint64_t first = lv.firstTile + (uint64_t)ty * lv.tilesX;
+    for (uint32_t tx = 0; tx < lv.tilesX; ++tx) {
+        tiles[(size_t)(first + tx)].offset = start + (uint64_t)alignedBytes * tx;
+    }
+    pos = start + (uint64_t)alignedBytes * lv.tilesX;
+    ++s.nextTileRow;
+    return 0;
+}
+
+/// 段lに行を足した後に呼ぶ。揃ったタイルの行を書き、作れるだけ次の段の行を作り、もう読まない行を捨てる。
+int
+TilePyramidWriter::Advance(int l)
+{
+    const TilePyramidLevel& lv = levels[l];
+    TilePyramidWriteLevel& s = st[l];
+    const int ts = p.tileSize;
+    const int border = TILE_PYRAMID_BORDER;
+    const int end = s.RowsEnd();
+
+    while (s.nextTileRow < lv.tilesY && std::min((int)lv.height, ((int)s.nextTileRow + 1) * ts + border) <= end) {
+        if (WriteTileRow(l) < 0) {
+            return -1;
+        }
+    }
+
+    if (l + 1 < (int)levels.size()) {
+        TilePyramidWriteLevel& n = st[l + 1];
+        int y1 = s.nextY;
+        while (y1 < n.height && s.toNext.LastSrcRow(y1) < end) {
+            ++y1;
+        }
+        if (s.nextY < y1) {
+            MipSource src;
+            src.pixels = s.rows.data();
+            src.width = s.width;
+            src.height = s.numRows;
+            src.stride = 4 * s.width;
+            n.Reserve(y1 - s.nextY);
+            if (s.toNext.Resize(src, s.rowY0, s.nextY, y1, n.RowsEndPtr(), 4 * n.width) < 0) {
+                return -1;
+            }
+            n.numRows += y1 - s.nextY;
+            s.nextY = y1;
+            if (Advance(l + 1) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    // 次のタイルの行の上の縁と、次の段の次の行が読む行より前は、もう読まない。
+    int keep = end;
+    if (s.nextTileRow < lv.tilesY) {
+        keep = std::min(keep, std::max(0, (int)s.nextTileRow * ts - border));
+    }
+    if (l + 1 < (int)levels.size() && s.nextY < st[l + 1].height) {
+        keep = std::min(keep, s.toNext.FirstSrcRow(s.nextY));
+    }
+    if (s.rowY0 < keep) {
+        const int drop = keep - s.rowY0;
+        const size_t rowBytes = (size_t)4 * s.width;
+        memmove(s.rows.data(), s.rows.data() + rowBytes * drop, rowBytes * (s.numRows - drop));
+        s.rowY0 = keep;
+        s.numRows -= drop;
+    }
+    return 0;
+}
+
+int
+TilePyramidWrite(const std::wstring& path, int width, int height, const TilePyramidRowReader& readRows,
+        const TilePyramidParams& p)
+{
+    if (width < 1 || height < 1 || !readRows || p.tileSize < 16 || 1024 < p.tileSize || (p.tileSize & 3) != 0
+            || p.format < 0 || BCF_NUM <= p.format || p.filter < 0 || MF_NUM <= p.filter) {
+        printf("E: TilePyramidWrite() invalid argument\n");
+        return -1;
+    }
+    const int ts = p.tileSize;
+    const int border = TILE_PYRAMID_BORDER;
+    const int stored = ts + 2 * border;
+    const int numLevels = TilePyramidNumLevels(width, height, ts);
+
+    TilePyramidWriter wr;
+    wr.p = p;
+
+    TilePyramidHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, TILE_PYRAMID_MAGIC, sizeof h.magic);
+    h.version = TilePyramid::VERSION;
+    h.format = p.format;
+    h.width = width;
+    h.height = height;
+    h.tileSize = ts;
+    h.border = border;
+    h.numLevels = numLevels;
+
+    wr.levels.resize(numLevels);
+    uint64_t numTiles = 0;
+    for (int l = 0; l < numLevels; ++l) {
+        TilePyramidLevel& lv = wr.levels[l];
+        memset(&lv, 0, sizeof lv);
+        lv.width = std::max(1, width >> l);
+        lv.height = std::max(1, height >> l);
+        lv.tilesX = (lv.width + ts - 1) / ts;
+        lv.tilesY = (lv.height + ts - 1) / ts;
+        lv.firstTile = numTiles;
+        numTiles += (uint64_t)lv.tilesX * lv.tilesY;
+    }
+    const uint64_t tileBytes = StoredTileBytes(p.format, stored);
+    wr.tiles.resize((size_t)numTiles);
+    for (TilePyramidTile& t : wr.tiles) {
+        memset(&t, 0, sizeof t);
+        t.bytes = (uint32_t)tileBytes;
+    }
+
+    // 各段に置く行と、段の間の縮小の重みは先に確保する。
+    MipBuildParams mp;
+    mp.filter = p.filter;
+    mp.wrapX = true;
+    mp.numThreads = p.numThreads;
+    wr.st.resize(numLevels);
+    for (int l = 0; l < numLevels; ++l) {
+        TilePyramidWriteLevel& s = wr.st[l];
+        s.width = wr.levels[l].width;
+        s.height = wr.levels[l].height;
+        s.rows.resize((size_t)4 * s.width * WriteLevelRows(height, numLevels, l, p));
+        if (l + 1 < numLevels
+                && s.toNext.Init(s.width, s.height, wr.levels[l + 1].width, wr.levels[l + 1].height, mp) < 0) {
+            return -1;
+        }
+    }
+    wr.alignedBytes = (size_t)AlignUp(tileBytes);
+    wr.rowBuf.assign(wr.alignedBytes * wr.levels[0].tilesX, 0);
+
+    const std::wstring tmpPath = path + L".tmp";
+    wr.fp = OpenFileToWrite(tmpPath);
+    if (wr.fp == nullptr) {
+        printf("E: TilePyramidWrite(%ls) open failed.\n", tmpPath.c_str());
+        return -1;
+    }
+
+    // 索引の場所を空けておき、タイルは作れた順に書く。最後に索引を書く。
+    bool ok = 1 == fwrite(&h, sizeof h, 1, wr.fp)
+            && (size_t)numLevels == fwrite(wr.levels.data(), sizeof(TilePyramidLevel), numLevels, wr.fp)
+            && wr.tiles.size() == fwrite(wr.tiles.data(), sizeof(TilePyramidTile), wr.tiles.size(), wr.fp);
+    wr.pos = sizeof h + (uint64_t)numLevels * sizeof(TilePyramidLevel) + numTiles * sizeof(TilePyramidTile);
+
+    // level 0を上から少しずつ読む。
+    TilePyramidWriteLevel& s0 = wr.st[0];
+    while (ok && s0.RowsEnd() < height) {
+        const int n = std::min(height - s0.RowsEnd(), WriteReadRows(ts));
+        s0.Reserve(n);
+        ok = readRows(s0.RowsEnd(), n, s0.RowsEndPtr(), 4 * width) >= 0;
+        if (ok) {
+            s0.numRows += n;
+            ok = wr.Advance(0) >= 0;
+        }
+    }
+    for (int l = 0; ok && l < numLevels; ++l) {
+        ok = wr.st[l].nextTileRow == wr.levels[l].tilesY;
+    }
+
+    h.fileBytes = wr.pos;
+    ok = ok && 0 == fseek(wr.fp, 0, SEEK_SET)
+            && 1 == fwrite(&h, sizeof h, 1, wr.fp)
+            && (size_t)numLevels == fwrite(wr.levels.data(), sizeof(TilePyramidLevel), numLevels, wr.fp)
+            && wr.tiles.size() == fwrite(wr.tiles.data(), sizeof(TilePyramidTile), wr.tiles.size(), wr.fp);
+    ok = (0 == fclose(wr.fp)) && ok;
+
+    if (!ok || !RenameReplacing(tmpPath, path)) {
+        RemoveFile(tmpPath);
+        printf("E: TilePyramidWrite(%ls) failed.\n", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int
+TilePyramidWrite(const std::wstring& path, const MipSource& src, const TilePyramidParams& p)
+{
+    if (src.pixels == nullptr || src.width < 1 || src.height < 1 || src.stride < 4 * src.width) {
+        printf("E: TilePyramidWrite() invalid argument\n");
+        return -1;
+    }
+    return TilePyramidWrite(path, src.width, src.height, [&src](int y0, int numRows, uint8_t* dst, int dstStride) {
+        for (int y = 0; y < numRows; ++y) {
+            memcpy(dst + (size_t)dstStride * y, src.pixels + (size_t)src.stride * (y0 + y), (size_t)4 * src.width);
+        }
+        return 0;
+    }, p);
+}
+
+void
+TilePyramid::Close(void)
+{
+    mMF.Close();
+    mHeader = TilePyramidHeader();
+    mLevels = nullptr;
+    mTiles = nullptr;
+}
+
+int
+TilePyramid::Open(const wchar_t* path)
+{
+    Close();
+    if (mMF.Open(path) < 0) {
+        return -1;
+    }
+
+    const uint64_t fileBytes = mMF.Size();
+    if (fileBytes < sizeof(TilePyramidHeader)) {
+        printf("E: TilePyramid::Open(%ls) file is too short.\n", path);
+        Close();
+        return -1;
+    }
+    TilePyramidHeader& h = mHeader;
+    memcpy(&h, mMF.Data(), sizeof h);
+    if (0 != memcmp(h.magic, TILE_PYRAMID_MAGIC, sizeof h.magic)
+            || h.version != VERSION
+            || BCF_NUM <= h.format
+            || h.border != TILE_PYRAMID_BORDER
+            || h.tileSize < 16 || 1024 < h.tileSize || (h.tileSize & 3) != 0
+            || h.numLevels < 1 || TILE_PYRAMID_LEVELS_MAX < h.numLevels
+            || h.width < 1 || h.height < 1
+            || h.fileBytes != fileBytes) {
+        printf("E: TilePyramid::Open(%ls) unknown format.\n", path);
+        Close();
+        return -1;
+    }
+
+    // 各段の大きさとタイルの数が、level 0とタイルの大きさから決まる値と同じで、索引と各タイルがファイルに収まっているか。
+    const uint64_t levelsEnd = sizeof h + (uint64_t)h.numLevels * sizeof(TilePyramidLevel);
+    const TilePyramidLevel* levels = (const TilePyramidLevel*)(mMF.Data() + sizeof h);
+    bool ok = levelsEnd <= fileBytes;
+    uint64_t numTiles = 0;
+    for (uint32_t l = 0; ok && l < h.numLevels; ++l) {
+        const TilePyramidLevel& lv = levels[l];
+        ok = lv.width == std::max(1u, h.width >> l) && lv.height == std::max(1u, h.height >> l)
+                && lv.tilesX == (lv.width + h.tileSize - 1) / h.tileSize
+                && lv.tilesY == (lv.height + h.tileSize - 1) / h.tileSize
+                && lv.firstTile == numTiles;
+        numTiles += (uint64_t)lv.tilesX * lv.tilesY;
+    }
+    ok = ok && levels[h.numLevels - 1].tilesX == 1 && levels[h.numLevels - 1].tilesY == 1;
+
+    const uint64_t tilesEnd = levelsEnd + numTiles * sizeof(TilePyramidTile);
+    ok = ok && tilesEnd <= fileBytes;
+    const uint64_t tileBytes = StoredTileBytes((BcFormat)h.format, h.tileSize + 2 * h.border);
+    const TilePyramidTile* tiles = (const TilePyramidTile*)(mMF.Data() + levelsEnd);
+    for (uint64_t i = 0; ok && i < numTiles; ++i) {
+        const TilePyramidTile& t = tiles[i];
+        ok = t.offset == AlignUp(t.offset) && tilesEnd <= t.offset && t.offset <= fileBytes && t.bytes == tileBytes
+                && t.bytes <= fileBytes - t.offset;
+    }
+    if (!ok) {
+        printf("E: TilePyramid::Open(%ls) file is broken.\n", path);
+        Close();
+        return -1;
+    }
+
+    mLevels = levels;
+    mTiles = tiles;
+    return 0;
+}
+
+uint64_t
+TilePyramid::NumTiles(void) const
+{
+    const TilePyramidLevel& last = mLevels[mHeader.numLevels - 1];
+    return last.firstTile + (uint64_t)last.tilesX * last.tilesY;
+}
+
+const uint8_t*
+TilePyramid::TileData(int level, int tx, int ty, size_t* bytes_r) const
+{
+    const TilePyramidLevel& lv = mLevels[level];
+    const TilePyramidTile& t = mTiles[lv.firstTile + (uint64_t)ty * lv.tilesX + tx];
+    *bytes_r = t.bytes;
+    return mMF.Data() + t.offset;
+}
+
+int
+TilePyramid::DecodeTile(int level, int tx, int ty, uint8_t* dst) const
+{
+    if (!IsOpen() || level < 0 || NumLevels() <= level || tx < 0 || (int)mLevels[level].tilesX <= tx || ty < 0
+            || (int)mLevels[level].tilesY <= ty || dst == nullptr) {
+        printf("E: TilePyramid::DecodeTile() invalid argument\n");
+        return -1;
+    }
+    const int stored = StoredTileSize();
+    size_t bytes = 0;
+    const uint8_t* data = TileData(level, tx, ty, &bytes);
+    if (Format() == BCF_None) {
+        memcpy(dst, data, bytes);
+        return 0;
+    }
+    return BcDecode(data, stored, stored, Format(), dst, 4 * stored);
+}
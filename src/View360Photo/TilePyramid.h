@@ -0,0 +1,142 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <functional>
+#include "MappedFile.h"
+#include "MipBuilder.h"
+#include "BlockCompress.h"
+
+/// 1枚のテクスチャーに収まらない大きな正距円筒図法の画像を、段ごとに同じ大きさのタイルに分けて保存するファイル。
+/// 段lはlevel 0の1/2^lの大きさ(MipBuild()と同じ)で、1枚のタイルに収まる段まで作る。
+/// 索引から任意のタイルを直接読めるので、画像全体をメモリーに置かずに、見ている所の必要な段のタイルだけを読める。
+/// ファイルの構成:
+///   TilePyramidHeader      (64バイト)
+///   TilePyramidLevel × numLevels
+///   TilePyramidTile × 全部のタイルの数 (段の順、段の中は行優先)
+///   各タイル              (TilePyramidTile::offsetから。64バイト境界)
+/// 値はリトルエンディアン。
+struct TilePyramidHeader {
+    char magic[8];
+
+    uint32_t version;
+
+    /// BcFormat。BCF_NoneのときBGRA 8ビット。
+    uint32_t format;
+
+    /// level 0の大きさ。
+    uint32_t width;
+    uint32_t height;
+
+    /// タイルの中身の一辺の画素数と、その周りの縁の画素数。
+    /// 保存するタイルは一辺tileSize + 2 * border画素で、縁は隣のタイルの画素(左右は経度の継ぎ目でつなぎ、上下は端の画素を延ばす)。
+    /// 縁があるので、双線形で読むときに隣のタイルを読まなくてよい。
+    uint32_t tileSize;
+    uint32_t border;
+
+    uint32_t numLevels;
+    uint32_t reserved0;
+
+    uint64_t fileBytes;
+    uint64_t reserved[2];
+};
+
+/// 1段の大きさと、索引の中の最初のタイル。
+struct TilePyramidLevel {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint64_t firstTile;
+    uint64_t reserved;
+};
+
+/// 1枚のタイルの配置。
+struct TilePyramidTile {
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t reserved;
+};
+
+/// タイルの縁の画素数。BC形式で圧縮できるように、保存するタイルの一辺が4の倍数になる値にする。
+static const int TILE_PYRAMID_BORDER = 2;
+
+struct TilePyramidParams {
+    /// タイルの中身の一辺の画素数。16～1024の4の倍数。
+    int tileSize = 256;
+
+    BcFormat format = BCF_Bc7;
+    BcQuality quality = BCQ_Fast;
+
+    /// 各段を作るフィルター。左右は経度の継ぎ目でつなぐ。
+    MipFilter filter = MF_Kaiser;
+
+    /// 0のときハードウェアスレッド数。
+    int numThreads = 0;
+};
+
+/// TilePyramidWrite()に元の画像を上から順に渡す関数。行y0 ～ y0 + numRows - 1を、BGRA 8ビットでdstからdstStrideバイトおきに書く。
+/// @return 成功のとき0。失敗のとき負の値。
+typedef std::function<int(int y0, int numRows, uint8_t* dst, int dstStride)> TilePyramidRowReader;
+
+/// width x heightの正距円筒図法の画像から全段を作り、タイルに分けてpathに書く。タイルは複数のスレッドで圧縮する。
+/// 画像はreadRowsでタイルの一辺の1/4行ずつ上から読み、各段の行も上から順に作りながら、揃ったタイルの行から書く。
+/// 各段はタイル1行と、次の段を作るのに要る数行だけを置くので、使うメモリーは幅とタイルの一辺に比例し、画像の面積によらない。
+/// 各段の画素はMipBuild()と同じ。書き込み途中のファイルを読まないように、一時ファイルに書いてから改名する。
+/// @return 成功のとき0。失敗のとき負の値。
+int TilePyramidWrite(const std::wstring& path, int width, int height, const TilePyramidRowReader& readRows,
+        const TilePyramidParams& p);
+
+/// メモリーに置いた画像srcから、上のTilePyramidWrite()で書く。
+int TilePyramidWrite(const std::wstring& path, const MipSource& src, const TilePyramidParams& p);
+
+/// width x heightの画像のTilePyramidWrite()が確保するメモリーのバイト数の上限の見積もり。readRowsが確保する分は含まない。
+/// @return 引数が正しくないときは0。
+size_t TilePyramidWriteBytes(int width, int height, const TilePyramidParams& p);
+
+/// マップしたタイルピラミッドのファイル。Close()まで各タイルを指す。
+class TilePyramid {
+public:
+    /// ヘッダーと索引を確かめる。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int Open(const wchar_t* path);
+    void Close(void);
+    bool IsOpen(void) const { return mLevels != nullptr; }
+
+    BcFormat Format(void) const { return (BcFormat)mHeader.format; }
+    int Width(void) const { return (int)mHeader.width; }
+    int Height(void) const { return (int)mHeader.height; }
+    int TileSize(void) const { return (int)mHeader.tileSize; }
+    int Border(void) const { return (int)mHeader.border; }
+    int NumLevels(void) const { return (int)mHeader.numLevels; }
+    uint64_t FileBytes(void) const { return mHeader.fileBytes; }
+
+    /// 縁を含めたタイルの一辺の画素数。
+    int StoredTileSize(void) const { return TileSize() + 2 * Border(); }
+
+    const TilePyramidLevel& Level(int level) const { return mLevels[level]; }
+
+    /// 全段のタイルの数。
+    uint64_t NumTiles(void) const;
+
+    /// 段levelのタイル(tx, ty)の、保存した形式のままのバイト列。
+    const uint8_t* TileData(int level, int tx, int ty, size_t* bytes_r) const;
+
+    /// 段levelのタイル(tx, ty)を、縁を含めてBGRA 8ビットにしてdstに書く。
+    /// @param dst StoredTileSize()の4倍バイトの行をStoredTileSize()行、隙間なく並べる。
+    /// @return 成功のとき0。失敗のとき負の値。
+    int DecodeTile(int level, int tx, int ty, uint8_t* dst) const;
+
+    static const uint32_t VERSION = 1;
+
+    /// 各タイルの先頭のアラインメント。
+    static const int ALIGN_BYTES = 64;
+
+private:
+    MappedFile mMF;
+    TilePyramidHeader mHeader = {};
+    const TilePyramidLevel* mLevels = nullptr;
+    const TilePyramidTile* mTiles = nullptr;
+};
@@ -0,0 +1,282 @@
+﻿// 日本語。
+
+#include "VirtualTexture.h"
+#include "ParallelFor.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+int
+VirtualTexture::Init(const TilePyramid* pyramid, size_t budgetBytes, int numThreads)
+{
+    Clear();
+    if (pyramid == nullptr || !pyramid->IsOpen()) {
+        printf("E: VirtualTexture::Init() invalid argument\n");
+        return -1;
+    }
+    const int stored = pyramid->StoredTileSize();
+    const size_t pageBytes = (size_t)4 * stored * stored;
+    const size_t numPages = budgetBytes / pageBytes;
+    if (numPages < 2) {
+        printf("E: VirtualTexture::Init() budget %zu bytes is less than 2 pages of %zu bytes\n", budgetBytes, pageBytes);
+        return -1;
+    }
+
+    mPyramid = pyramid;
+    mNumThreads = numThreads;
+    mPageBytes = pageBytes;
+    mPageTable.resize(pyramid->NumLevels());
+    for (int l = 0; l < pyramid->NumLevels(); ++l) {
+        const TilePyramidLevel& lv = pyramid->Level(l);
+        mPageTable[l].assign((size_t)lv.tilesX * lv.tilesY, VT_PAGE_EMPTY);
+    }
+    mPhysical.resize(pageBytes * numPages);
+    mPages.resize(numPages);
+    for (int i = (int)numPages - 1; 0 <= i; --i) {
+        mFreePages.push_back(i);
+    }
+
+    // 最も粗い段は1枚で、どこを読むときも代わりに使えるように固定する。
+    const int coarsest = pyramid->NumLevels() - 1;
+    const int page = mFreePages.back();
+    mFreePages.pop_back();
+    if (pyramid->DecodeTile(coarsest, 0, 0, PagePixels(page)) < 0) {
+        Clear();
+        return -1;
+    }
+    Page& pg = mPages[page];
+    pg.level = coarsest;
+    pg.pinned = true;
+    PageEntry(coarsest, 0, 0) = page;
+    return 0;
+}
+
+void
+VirtualTexture::Clear(void)
+{
+    mPyramid = nullptr;
+    mPageBytes = 0;
+    mPageTable = std::vector<std::vector<int32_t>>();
+    mPhysical = std::vector<uint8_t>();
+    mPages.clear();
+    mFreePages.clear();
+    mLruHead = -1;
+    mLruTail = -1;
+    mRequests.clear();
+    mStats = VirtualTextureStats();
+}
+
+int32_t&
+VirtualTexture::PageEntry(int level, int tx, int ty)
+{
+    return mPageTable[level][(size_t)ty * mPyramid->Level(level).tilesX + tx];
+}
+
+int32_t
+VirtualTexture::PageEntry(int level, int tx, int ty) const
+{
+    return mPageTable[level][(size_t)ty * mPyramid->Level(level).tilesX + tx];
+}
+
+bool
+VirtualTexture::IsResident(int level, int tx, int ty) const
+{
+    return 0 <= PageEntry(level, tx, ty);
+}
+
+void
+VirtualTexture::LruRemove(int page)
+{
+    Page& pg = mPages[page];
+    if (pg.prev < 0) {
+        mLruHead = pg.next;
+    } else {
+        mPages[pg.prev].next = pg.next;
+    }
+    if (pg.next < 0) {
+        mLruTail = pg.prev;
+    } else {
+        mPages[pg.next].prev = pg.prev;
+    }
+    pg.prev = -1;
+    pg.next = -1;
+}
+
+void
+VirtualTexture::LruPushFront(int page)
+{
+    Page& pg = mPages[page];
+    pg.prev = -1;
+    pg.next = mLruHead;
+    if (0 <= mLruHead) {
+        mPages[mLruHead].prev = page;
+    }
+    mLruHead = page;
+    if (mLruTail < 0) {
+        mLruTail = page;
+    }
+}
+
+const uint8_t*
+VirtualTexture::Tile(int level, int tx, int ty)
+{
+    ++mStats.lookups;
+    const int32_t page = PageEntry(level, tx, ty);
+    if (page < 0) {
+        return nullptr;
+    }
+    ++mStats.hits;
+    if (!mPages[page].pinned && mLruHead != page) {
+        LruRemove(page);
+        LruPushFront(page);
+    }
+    return PagePixels(page);
+}
+
+void
+VirtualTexture::Request(int level, int tx, int ty)
+{
+    int32_t& e = PageEntry(level, tx, ty);
+    if (e != VT_PAGE_EMPTY) {
+        return;
+    }
+    e = VT_PAGE_REQUESTED;
+    mRequests.push_back({ level, tx, ty });
+    ++mStats.requests;
+}
+
+/// 空いている物理ページ。無いときは最後に使ったのが最も古いタイルを捨てる。
+size_t
+VirtualTexture::MemoryBytes(void) const
+{
+    size_t bytes = mPhysical.capacity() + mPages.capacity() * sizeof(Page) + mFreePages.capacity() * sizeof(int)
+            + mRequests.capacity() * sizeof(TileRequest) + mPageTable.capacity() * sizeof(mPageTable[0]);
+    for (const std::vector<int32_t>& t : mPageTable) {
+        bytes += t.capacity() * sizeof(int32_t);
+    }
+    return bytes;
+}
+
+int
+VirtualTexture::AllocPage(void)
+{
+    if (!mFreePages.empty()) {
+        const int page = mFreePages.back();
+        mFreePages.pop_back();
+        return page;
+    }
+    const int page = mLruTail;
+    LruRemove(page);
+    const Page& pg = mPages[page];
+    PageEntry(pg.level, pg.tx, pg.ty) = VT_PAGE_EMPTY;
+    ++mStats.evictions;
+    return page;
+}
+
+int
+VirtualTexture::Update(int maxLoads)
+{
+    // 粗い段を先に読むと、読めるまで代わりに使う段が早く細かくなる。
+    std::stable_sort(mRequests.begin(), mRequests.end(), [](const TileRequest& a, const TileRequest& b) {
+        return a.level > b.level;
+    });
+    const int numUnpinned = NumPages() - 1;
+    const int n = std::min({ maxLoads, (int)mRequests.size(), numUnpinned });
+
+    // 物理ページを決めてから、デコードは同時に行う。
+    std::vector<int> pages(std::max(n, 0));
+    for (int i = 0; i < n; ++i) {
+        const TileRequest& r = mRequests[i];
+        const int page = AllocPage();
+        Page& pg = mPages[page];
+        pg.level = r.level;
+        pg.tx = r.tx;
+        pg.ty = r.ty;
+        LruPushFront(page);
+        PageEntry(r.level, r.tx, r.ty) = page;
+        pages[i] = page;
+    }
+    std::vector<int> rvs(pages.size());
+    ParallelFor((int)pages.size(), [&](int i) {
+        const Page& pg = mPages[pages[i]];
+        rvs[i] = mPyramid->DecodeTile(pg.level, pg.tx, pg.ty, PagePixels(pages[i]));
+    }, mNumThreads);
+
+    int rv = (int)pages.size();
+    for (size_t i = 0; i < pages.size(); ++i) {
+        if (rvs[i] < 0) {
+            // 読めなかったタイルは置かない。
+            const Page& pg = mPages[pages[i]];
+            PageEntry(pg.level, pg.tx, pg.ty) = VT_PAGE_EMPTY;
+            LruRemove(pages[i]);
+            mFreePages.push_back(pages[i]);
+            rv = -1;
+            continue;
+        }
+        ++mStats.loads;
+    }
+
+    for (size_t i = pages.size(); i < mRequests.size(); ++i) {
+        const TileRequest& r = mRequests[i];
+        PageEntry(r.level, r.tx, r.ty) = VT_PAGE_EMPTY;
+        ++mStats.dropped;
+    }
+    mRequests.clear();
+    return rv;
+}
+
+int
+VirtualTextureSample(VirtualTexture& vt, float u, float v, float lod, uint8_t* bgra_r)
+{
+    const TilePyramid& tp = *vt.Pyramid();
+    const int numLevels = tp.NumLevels();
+    const int ts = tp.TileSize();
+    const int border = tp.Border();
+    const int stored = tp.StoredTileSize();
+
+    int level = std::min(std::max((int)lod, 0), numLevels - 1);
+    bool requested = false;
+    for (;; ++level) {
+        const TilePyramidLevel& lv = tp.Level(level);
+        const int w = (int)lv.width;
+        const int h = (int)lv.height;
+
+        // 画素の中心は0.5。x0, x0 + 1とy0, y0 + 1の4画素を読む。タイルの右と下の1画素と、上端の-1行は縁にある。
+        const float fx = u * (float)w - 0.5f;
+        const float fy = std::min(std::max(v, 0.0f), 1.0f) * (float)h - 0.5f;
+        const float flx = floorf(fx);
+        const float fly = floorf(fy);
+        int x0 = (int)flx % w;
+        x0 = (x0 < 0) ? x0 + w : x0;
+        const int y0 = (int)fly;
+        const int tx = x0 / ts;
+        const int ty = std::min(std::max(y0, 0), h - 1) / ts;
+
+        const uint8_t* tile = vt.Tile(level, tx, ty);
+        if (tile == nullptr) {
+            // 最も粗い段は固定なので、ここには来ない。要求するのは最初に読もうとした段だけ。
+            if (!requested) {
+                vt.Request(level, tx, ty);
+                requested = true;
+            }
+            continue;
+        }
+
+        const int lx = x0 - tx * ts + border;
+        const int ly = y0 - ty * ts + border;
+        const float wx = fx - flx;
+        const float wy = fy - fly;
+        const uint8_t* p00 = tile + ((size_t)stored * ly + lx) * 4;
+        const uint8_t* p10 = p00 + 4;
+        const uint8_t* p01 = p00 + (size_t)stored * 4;
+        const uint8_t* p11 = p01 + 4;
+        for (int c = 0; c < 4; ++c) {
+            const float top = (float)p00[c] + ((float)p10[c] - (float)p00[c]) * wx;
+            const float bottom = (float)p01[c] + ((float)p11[c] - (float)p01[c]) * wx;
+            const float s = top + (bottom - top) * wy;
+            bgra_r[c] = (uint8_t)(int)(std::min(std::max(s, 0.0f), 255.0f) + 0.5f);
+        }
+        return level;
+    }
+}
@@ -0,0 +1,127 @@
+﻿// 日本語。
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "TilePyramid.h"
+
+/// TilePyramidのタイルのうち、見ている所で要るものだけを決まった数の物理ページに置く仮想テクスチャー。
+/// ページテーブルは段ごとのタイルの配列で、置いた物理ページの番号を持つ。
+/// 読むときに置かれていないタイルは要求に積み(フィードバック)、Update()でまとめて読む。読めるまでは粗い段のタイルで代える。
+/// 物理ページが足りないときは、最後に使ったのが古いタイルから捨てる(LRU)。最も粗い段のタイルは常に置いておく。
+/// 物理ページはGPUの物理テクスチャーに当たるもので、ここではCPUで読むためにBGRA 8ビットにデコードして置く。
+/// スレッドセーフではない。Tile(), Request(), Update()は同じスレッドから呼ぶ。
+
+/// ページテーブルの値。0以上は物理ページの番号。
+static const int32_t VT_PAGE_EMPTY = -1;
+static const int32_t VT_PAGE_REQUESTED = -2;
+
+struct VirtualTextureStats {
+    /// Tile()の回数と、そのうち置かれていた回数。
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+
+    /// Request()で新しく積んだ要求の数。
+    uint64_t requests = 0;
+
+    /// Update()で読んだタイル、捨てたタイル、読まずに捨てた要求の数。
+    uint64_t loads = 0;
+    uint64_t evictions = 0;
+    uint64_t dropped = 0;
+};
+
+class VirtualTexture {
+public:
+    /// pyramidのタイルを置く物理ページを、合計budgetBytes以下で確保し、最も粗い段のタイルを読む。
+    /// pyramidはClear()まで開いておくこと。
+    /// @param numThreads Update()でタイルをデコードするスレッド数。0のときハードウェアスレッド数。
+    /// @return 成功のとき0。物理ページが2枚未満になるときなど、失敗のとき負の値。
+    int Init(const TilePyramid* pyramid, size_t budgetBytes, int numThreads = 0);
+    void Clear(void);
+
+    /// 段levelのタイル(tx, ty)が置かれていれば、縁を含めたBGRA 8ビットの画素(一辺TilePyramid::StoredTileSize())。
+    /// 最後に使った時刻を今にする。置かれていなければnullptr。
+    const uint8_t* Tile(int level, int tx, int ty);
+
+    /// 段levelのタイル(tx, ty)を読む要求を積む。置かれているか、既に積んであるときは何もしない。
+    void Request(int level, int tx, int ty);
+
+    /// 積んだ要求を、粗い段から順に、同じ段の中では積んだ順に、最大maxLoads枚読む。
+    /// 空いている物理ページが無いときは、最後に使ったのが古いタイルを捨てる。1回で読むのは、固定しない物理ページの数まで。
+    /// 読まなかった要求は捨てる。まだ要るタイルは、次のフレームのTile()でまた要求される。
+    /// タイルは複数のスレッドでデコードする。
+    /// @return 読んだ枚数。失敗のとき負の値。
+    int Update(int maxLoads);
+
+    /// 段levelのタイル(tx, ty)が置かれているか。最後に使った時刻は変えない。
+    bool IsResident(int level, int tx, int ty) const;
+
+    const TilePyramid* Pyramid(void) const { return mPyramid; }
+
+    /// 物理ページの数と、1枚のバイト数。
+    int NumPages(void) const { return (int)mPages.size(); }
+    size_t PageBytes(void) const { return mPageBytes; }
+
+    /// タイルを置いている物理ページの合計バイト数。
+    size_t ResidentBytes(void) const { return mPageBytes * (mPages.size() - mFreePages.size()); }
+
+    /// 物理ページ、ページテーブル、ページの管理と要求の配列に確保したバイト数。
+    size_t MemoryBytes(void) const;
+
+    /// 積んである要求の数。
+    int NumRequests(void) const { return (int)mRequests.size(); }
+
+    const VirtualTextureStats& Stats(void) const { return mStats; }
+    void ResetStats(void) { mStats = VirtualTextureStats(); }
+
+private:
+    /// 物理ページに置いたタイル。固定しないページは、prev, nextで最後に使った順の双方向リストにつなぐ。
+    struct Page {
+        int level = -1;
+        int tx = 0;
+        int ty = 0;
+        bool pinned = false;
+        int prev = -1;
+        int next = -1;
+    };
+
+    struct TileRequest {
+        int level;
+        int tx;
+        int ty;
+    };
+
+    const TilePyramid* mPyramid = nullptr;
+    int mNumThreads = 0;
+    size_t mPageBytes = 0;
+
+    /// mPageTable[level][ty * tilesX + tx]。
+    std::vector<std::vector<int32_t>> mPageTable;
+
+    /// 物理ページの画素。mPageBytesバイトずつ並べる。
+    std::vector<uint8_t> mPhysical;
+    std::vector<Page> mPages;
+    std::vector<int> mFreePages;
+
+    /// 最後に使ったのが最も新しいページと、最も古いページ。
+    int mLruHead = -1;
+    int mLruTail = -1;
+
+    std::vector<TileRequest> mRequests;
+    VirtualTextureStats mStats;
+
+    int32_t& PageEntry(int level, int tx, int ty);
+    int32_t PageEntry(int level, int tx, int ty) const;
+    uint8_t* PagePixels(int page) { return mPhysical.data() + mPageBytes * page; }
+    void LruRemove(int page);
+    void LruPushFront(int page);
+    int AllocPage(void);
+};
+
+/// 仮想テクスチャーを、正距円筒図法の座標(u, v) (0～1、vは下が正)で、段lodのタイルを双線形で読む。
+/// 左右は経度の継ぎ目でつなぎ、上下は端の画素を延ばす。GPUの参照になる、CPUでの実装。
+/// 段lodのタイルが置かれていないときはそれを要求し、置かれている最も精細な段で代える。
+/// @param lod 0以上。小数部は切り捨てる。最も粗い段より大きいときは最も粗い段。
+/// @return 読んだ段。
+int VirtualTextureSample(VirtualTexture& vt, float u, float v, float lod, uint8_t* bgra_r);
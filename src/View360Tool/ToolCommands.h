@@ -0,0 +1,32 @@
+﻿// 日本語。
+#pragma once
+
+#include <string>
+#include <vector>
+
+// View360Toolのサブコマンド。
+// argsはサブコマンド名より後ろの引数。戻り値はプロセスの終了コード。
+
+int ToolSphere(const std::vector<std::string>& args);
+int ToolMeshPack(const std::vector<std::string>& args);
+int ToolMeshOpt(const std::vector<std::string>& args);
+int ToolWeld(const std::vector<std::string>& args);
+int ToolDecode(const std::vector<std::string>& args);
+int ToolPixConv(const std::vector<std::string>& args);
+int ToolMips(const std::vector<std::string>& args);
+int ToolBc(const std::vector<std::string>& args);
+int ToolTexCache(const std::vector<std::string>& args);
+int ToolCube(const std::vector<std::string>& args);
+int ToolBands(const std::vector<std::string>& args);
+int ToolDensity(const std::vector<std::string>& args);
+int ToolPyramid(const std::vector<std::string>& args);
+
+/// コマンドライン引数の文字列をパスにする。
+std::wstring ToolPath(const std::string& s);
+
+/// 経過時間を計るためのミリ秒単位の時刻。
+double ToolNowMs(void);
+
+/// プロセスが確保した、ファイルに対応しないメモリーのバイト数。
+/// WindowsはコミットしたPrivateUsage、それ以外は置かれている匿名のページ(RssAnon)。マップしたファイルは含まない。読めないときは0。
+size_t ToolPrivateBytes(void);
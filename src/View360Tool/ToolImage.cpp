@@ -0,0 +1,1827 @@
+﻿// 日本語。
+
+// 画像関連のサブコマンド。
+
+#include "pch.h"
+#include "ToolCommands.h"
+#include "ImageDecoder.h"
+#include "PixelConvert.h"
+#include "MipBuilder.h"
+#include "BlockCompress.h"
+#include "TextureCache.h"
+#include "FileUtil.h"
+#include "CubeMap.h"
+#include "LatitudeBands.h"
+#include "DisplayDensity.h"
+#include "TilePyramid.h"
+#include "VirtualTexture.h"
+#include "Hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#  include "GdiplusHousekeeping.h"
+#endif
+
+static void
+DecodeUsage(void)
+{
+    printf("Usage: View360Tool decode [options] input.jpg\n");
+    printf("Decodes the image with each decoder backend and prints the throughput in MPix/s.\n");
+    printf("    -n count      number of decodes per backend (default 5)\n");
+    printf("    -threads n    decoder threads (default 0 = hardware threads)\n");
+    printf("    -scale denom  decode at 1/denom size, denom = 1, 2, 4 or 8 (default 1)\n");
+    printf("    -progress bytes  print the time of each intermediate image of a progressive JPEG,\n");
+    printf("                  at most one per the bytes read (0 = after each scan)\n");
+    printf("    -minpsnr dB   with -scale 2, 4 or 8, the lowest PSNR of the built-in decoder's reduced output against\n");
+    printf("                  the full-size decode averaged over denom x denom pixels (default 40)\n");
+    printf("The first backend that succeeds is the reference for the pixel difference of the others.\n");
+}
+
+/// 全画素でデコードしたw x hのfullを、denom x denom画素ずつ平均してsw x shのdstにする。端の欠けた部分は有る画素だけで平均する。
+static void
+BoxReduce(const uint8_t* full, int w, int h, int denom, int sw, int sh, uint8_t* dst)
+{
+    for (int y = 0; y < sh; ++y) {
+        for (int x = 0; x < sw; ++x) {
+            int sum[4] = {};
+            int n = 0;
+            for (int yy = y * denom; yy < std::min(h, (y + 1) * denom); ++yy) {
+                for (int xx = x * denom; xx < std::min(w, (x + 1) * denom); ++xx) {
+                    for (int c = 0; c < 4; ++c) {
+                        sum[c] += full[((size_t)w * yy + xx) * 4 + c];
+                    }
+                    ++n;
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                dst[((size_t)sw * y + x) * 4 + c] = (uint8_t)((sum[c] + n / 2) / n);
+            }
+        }
+    }
+}
+
+int
+ToolDecode(const std::vector<std::string>& args)
+{
+    int count = 5;
+    int nThreads = 0;
+    int scale = 1;
+    long long progressBytes = -1;
+    double minPsnr = 40.0;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a == "-scale" && 1 <= remain) {
+            scale = atoi(args[++i].c_str());
+        } else if (a == "-progress" && 1 <= remain) {
+            progressBytes = atoll(args[++i].c_str());
+        } else if (a == "-minpsnr" && 1 <= remain) {
+            minPsnr = atof(args[++i].c_str());
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            DecodeUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || count < 1 || (progressBytes < -1)) {
+        DecodeUsage();
+        return 1;
+    }
+
+#ifdef _WIN32
+    if (FAILED(GdiplusHousekeepingInit())) {
+        return 1;
+    }
+#endif
+
+    const std::wstring wpath = ToolPath(inPath);
+    std::vector<uint8_t> ref;
+    const char* refName = nullptr;
+    int refW = 0;
+    int refH = 0;
+    int rv = 1;
+    bool scaleOk = true;
+
+    for (int t = 0; t < IDT_NUM; ++t) {
+        const char* name = ImageDecoderTypeToStr((ImageDecoderType)t);
+        auto dec = ImageDecoderCreate((ImageDecoderType)t);
+        if (!dec) {
+            printf("%-8s not available on this platform\n", name);
+            continue;
+        }
+        dec->SetNumThreads(nThreads);
+
+        // ファイルを開くところから含めて計る。
+        std::vector<uint8_t> pixels;
+        int w = 0;
+        int h = 0;
+        double best = 0;
+        double total = 0;
+        bool ok = true;
+        for (int i = 0; i < count; ++i) {
+            const double t0 = ToolNowMs();
+            if (FAILED(dec->Open(wpath.c_str())) || FAILED(dec->SetScale(scale))) {
+                ok = false;
+                break;
+            }
+            if (0 <= progressBytes && i == 0) {
+                dec->SetProgress([t0](int scans) {
+                    printf("    %d scans at %.1f ms\n", scans, ToolNowMs() - t0);
+                    return true;
+                }, (size_t)progressBytes);
+            } else {
+                dec->SetProgress(nullptr, 0);
+            }
+            w = dec->Width();
+            h = dec->Height();
+            pixels.resize((size_t)4 * w * h);
+            if (FAILED(dec->Decode(pixels.data(), 4 * w))) {
+                ok = false;
+                break;
+            }
+            dec->Close();
+            const double ms = ToolNowMs() - t0;
+            best = (i == 0) ? ms : std::min(best, ms);
+            total += ms;
+        }
+        if (!ok) {
+            printf("%-8s failed\n", name);
+            continue;
+        }
+
+        const double mpix = (double)w * h / 1e6;
+        printf("%-8s %dx%d best %.1f ms (%.1f MPix/s), mean %.1f ms (%.1f MPix/s)\n",
+                name, w, h, best, mpix / best * 1000.0, total / count, mpix / (total / count) * 1000.0);
+        rv = 0;
+
+        // 縮小は低周波の係数だけの逆DCTで、libjpegのscale_denomとも画素の平均とも同じにはならない。
+        // 全画素のデコードをdenom x denom画素ずつ平均したものとの差が、許す範囲にあること。
+        if (1 < scale && t == IDT_Builtin) {
+            std::vector<uint8_t> full;
+            bool fullOk = SUCCEEDED(dec->Open(wpath.c_str())) && SUCCEEDED(dec->SetScale(1));
+            const int fw = fullOk ? dec->Width() : 0;
+            const int fh = fullOk ? dec->Height() : 0;
+            full.resize((size_t)4 * fw * fh);
+            fullOk = fullOk && SUCCEEDED(dec->Decode(full.data(), 4 * fw));
+            dec->Close();
+            if (!fullOk) {
+                printf("    full-size decode failed\n");
+                scaleOk = false;
+                continue;
+            }
+            std::vector<uint8_t> box((size_t)4 * w * h);
+            BoxReduce(full.data(), fw, fh, scale, w, h, box.data());
+            int maxDiff = 0;
+            for (size_t i = 0; i < box.size(); ++i) {
+                maxDiff = std::max(maxDiff, abs((int)box[i] - (int)pixels[i]));
+            }
+            const double psnr = BcPsnr(box.data(), 4 * w, pixels.data(), 4 * w, w, h);
+            printf("    against the full-size decode averaged 1/%d: PSNR %.2f dB, max %d, %s (-minpsnr %.1f)\n",
+                    scale, psnr, maxDiff, (minPsnr <= psnr) ? "OK" : "TOO LOW", minPsnr);
+            scaleOk = scaleOk && minPsnr <= psnr;
+        }
+
+        if (ref.empty()) {
+            ref.swap(pixels);
+            refName = name;
+            refW = w;
+            refH = h;
+            continue;
+        }
+        if (w != refW || h != refH) {
+            printf("    size differs from %s\n", refName);
+            continue;
+        }
+        int maxDiff = 0;
+        double sumDiff = 0;
+        for (size_t i = 0; i < ref.size(); ++i) {
+            const int d = abs((int)ref[i] - (int)pixels[i]);
+            maxDiff = std::max(maxDiff, d);
+            sumDiff += d;
+        }
+        printf("    difference from %s: max %d, mean %.4f\n", refName, maxDiff, sumDiff / ref.size());
+    }
+
+#ifdef _WIN32
+    GdiplusHousekeepingTerm();
+#endif
+    return scaleOk ? rv : 1;
+}
+
+static void
+PixConvUsage(void)
+{
+    printf("Usage: View360Tool pixconv [options]\n");
+    printf("Checks that each SIMD version of the pixel conversion kernels writes the same values as the scalar version,\n");
+    printf("and prints the throughput of each version in GB/s (bytes read + bytes written).\n");
+    printf("    -n count      number of runs per kernel (default 5)\n");
+    printf("    -size MiB     source buffer size of the benchmark (default 64)\n");
+}
+
+/// pixconvで調べるカーネル。要素のバイト数と、引数をそろえて呼ぶ関数。
+struct PixelKernelEntry {
+    const char* name;
+    int srcBytes;
+    int dstBytes;
+
+    /// 要素の型のアラインメント。ずらして調べるときの単位。
+    int align;
+
+    /// 版ごとに同じ関数かを比べるための関数ポインター。
+    const void* (*ptr)(const PixelKernels& k);
+    void (*run)(const PixelKernels& k, const uint8_t* src, uint8_t* dst, size_t n);
+};
+
+#define PIXEL_KERNEL_ENTRY(f, srcBytes, dstBytes, align, call) \
+    { #f, srcBytes, dstBytes, align, \
+      [](const PixelKernels& k) { return (const void*)k.f; }, \
+      [](const PixelKernels& k, const uint8_t* s, uint8_t* d, size_t n) { call; } }
+
+static const PixelKernelEntry gPixelKernelEntries[] = {
+    PIXEL_KERNEL_ENTRY(bgraSetAlpha,   4, 4, 1, k.bgraSetAlpha(s, d, n, 0x80)),
+    PIXEL_KERNEL_ENTRY(rgb24ToBgra,    3, 4, 1, k.rgb24ToBgra(s, d, n, 0x80)),
+    PIXEL_KERNEL_ENTRY(bgr24ToBgra,    3, 4, 1, k.bgr24ToBgra(s, d, n, 0x80)),
+    PIXEL_KERNEL_ENTRY(swapRB,         4, 4, 1, k.swapRB(s, d, n)),
+    PIXEL_KERNEL_ENTRY(premultiply,    4, 4, 1, k.premultiply(s, d, n)),
+    PIXEL_KERNEL_ENTRY(srgbToLinear16, 4, 8, 2, k.srgbToLinear16(s, (uint16_t*)d, n)),
+    PIXEL_KERNEL_ENTRY(linear16ToSrgb, 8, 4, 2, k.linear16ToSrgb((const uint16_t*)s, d, n)),
+    PIXEL_KERNEL_ENTRY(u8ToU16,        1, 2, 2, k.u8ToU16(s, (uint16_t*)d, n)),
+    PIXEL_KERNEL_ENTRY(u8ToHalf,       1, 2, 2, k.u8ToHalf(s, (uint16_t*)d, n)),
+};
+
+#undef PIXEL_KERNEL_ENTRY
+
+/// kの版がスカラー版と同じ値を書くかを調べる。失敗した数を戻す。
+/// 要素の番号eの偶数バイトにeの下位、奇数バイトに上位を置いた65536要素で、
+/// 1バイトと16ビットの全値、および(色, アルファー)の全組を通す。
+/// 次に乱数で、長さ0～80、src, dstの位置をずらした各組を調べ、範囲外に書かないことも見る。
+static int
+PixConvCheck(const PixelKernelEntry& e, const PixelKernels& k, const PixelKernels& scalar)
+{
+    int fails = 0;
+
+    {
+        const size_t n = 65536;
+        std::vector<uint8_t> src(n * e.srcBytes);
+        for (size_t i = 0; i < n; ++i) {
+            for (int b = 0; b < e.srcBytes; ++b) {
+                src[i * e.srcBytes + b] = (uint8_t)((b & 1) ? (i >> 8) : i);
+            }
+        }
+        std::vector<uint8_t> want(n * e.dstBytes);
+        std::vector<uint8_t> got(n * e.dstBytes);
+        e.run(scalar, src.data(), want.data(), n);
+        e.run(k, src.data(), got.data(), n);
+        if (want != got) {
+            printf("    E: all values differ\n");
+            ++fails;
+        }
+    }
+
+    const int MAX_N = 80;
+    const int GUARD = 64;
+    uint32_t rnd = 12345;
+    std::vector<uint8_t> src(MAX_N * e.srcBytes + 4 * e.align + GUARD);
+    std::vector<uint8_t> want(MAX_N * e.dstBytes + 4 * e.align + GUARD);
+    std::vector<uint8_t> got(want.size());
+    for (int n = 0; n <= MAX_N; ++n) {
+        for (int so = 0; so < 4; ++so) {
+            for (int dOff = 0; dOff < 4; ++dOff) {
+                for (auto& v : src) {
+                    rnd = rnd * 1664525u + 1013904223u;
+                    v = (uint8_t)(rnd >> 24);
+                }
+                std::fill(want.begin(), want.end(), (uint8_t)0xcd);
+                std::fill(got.begin(), got.end(), (uint8_t)0xcd);
+                const uint8_t* s = src.data() + so * e.align;
+                e.run(scalar, s, want.data() + dOff * e.align, n);
+                e.run(k, s, got.data() + dOff * e.align, n);
+                if (want != got) {
+                    if (fails < 10) {
+                        printf("    E: n=%d src offset %d dst offset %d differs\n", n, so * e.align, dOff * e.align);
+                    }
+                    ++fails;
+                }
+            }
+        }
+    }
+    return fails;
+}
+
+int
+ToolPixConv(const std::vector<std::string>& args)
+{
+    int count = 5;
+    int sizeMiB = 64;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-size" && 1 <= remain) {
+            sizeMiB = atoi(args[++i].c_str());
+        } else {
+            PixConvUsage();
+            return 1;
+        }
+    }
+    if (count < 1 || sizeMiB < 1) {
+        PixConvUsage();
+        return 1;
+    }
+
+    const PixelSimdLevel detected = PixelSimdLevelDetect();
+    printf("CPU: %s\n", PixelSimdLevelToStr(detected));
+
+    const PixelKernels& scalar = *PixelConvertForLevel(PSL_Scalar);
+    int fails = 0;
+    for (auto& e : gPixelKernelEntries) {
+        const size_t n = (size_t)sizeMiB * 1024 * 1024 / e.srcBytes;
+        std::vector<uint8_t> src(n * e.srcBytes);
+        std::vector<uint8_t> dst(n * e.dstBytes);
+        for (size_t i = 0; i < src.size(); ++i) {
+            src[i] = (uint8_t)(i * 7 + (i >> 9));
+        }
+
+        // levelに自身の実装があるものだけ計る。下の版と同じ関数のときは飛ばす。
+        std::vector<const void*> done;
+        for (int l = 0; l < PSL_NUM; ++l) {
+            const PixelKernels* k = PixelConvertForLevel((PixelSimdLevel)l);
+            if (k == nullptr || std::find(done.begin(), done.end(), e.ptr(*k)) != done.end()) {
+                continue;
+            }
+            done.push_back(e.ptr(*k));
+
+            const int f = (l == PSL_Scalar) ? 0 : PixConvCheck(e, *k, scalar);
+            fails += f;
+
+            double best = 0;
+            for (int i = 0; i < count; ++i) {
+                const double t0 = ToolNowMs();
+                e.run(*k, src.data(), dst.data(), n);
+                const double ms = ToolNowMs() - t0;
+                best = (i == 0) ? ms : std::min(best, ms);
+            }
+            const double gb = (double)(src.size() + dst.size()) / 1e9;
+            printf("%-15s %-8s %6.2f GB/s %s\n", e.name, PixelSimdLevelToStr((PixelSimdLevel)l),
+                    gb / best * 1000.0, (l == PSL_Scalar) ? "reference" : (f == 0 ? "same as scalar" : "DIFFERS"));
+        }
+    }
+
+    if (fails != 0) {
+        printf("E: %d mismatches\n", fails);
+        return 1;
+    }
+    return 0;
+}
+
+/// 画像の全画素を、使える最初のデコーダーでBGRA 8ビットにデコードする。
+/// @param minWidth 0より大きいとき、幅がminWidth以上のままの最大の縮小率でデコードする。
+/// @param scale_r nullptrでないとき、縮小率の分母を置く。
+static int
+LoadImagePixels(const std::string& inPath, std::vector<uint8_t>& pixels_r, int* w_r, int* h_r, int minWidth = 0,
+        int* scale_r = nullptr)
+{
+#ifdef _WIN32
+    if (FAILED(GdiplusHousekeepingInit())) {
+        return -1;
+    }
+#endif
+
+    const std::wstring wpath = ToolPath(inPath);
+    pixels_r.clear();
+    for (int t = 0; t < IDT_NUM && pixels_r.empty(); ++t) {
+        int scale = 1;
+        auto dec = ImageDecoderOpen((ImageDecoderType)t, wpath.c_str(), 0, &scale, minWidth);
+        if (!dec) {
+            continue;
+        }
+        if (scale_r != nullptr) {
+            *scale_r = scale;
+        }
+        *w_r = dec->Width();
+        *h_r = dec->Height();
+        pixels_r.resize((size_t)4 * *w_r * *h_r);
+        if (FAILED(dec->Decode(pixels_r.data(), 4 * *w_r))) {
+            pixels_r.clear();
+        }
+    }
+
+#ifdef _WIN32
+    GdiplusHousekeepingTerm();
+#endif
+
+    if (pixels_r.empty()) {
+        printf("E: failed to decode %s\n", inPath.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+/// View360Photoと同じく、左半分と右半分を別のテクスチャーにする。
+static void
+SplitHalves(const std::vector<uint8_t>& pixels, int w, int h, MipSource* whole_r, MipSource halves_r[2])
+{
+    whole_r->pixels = pixels.data();
+    whole_r->width = w;
+    whole_r->height = h;
+    whole_r->stride = 4 * w;
+    halves_r[0] = *whole_r;
+    halves_r[1] = *whole_r;
+    halves_r[0].width = w / 2;
+    halves_r[1].width = w - w / 2;
+    halves_r[1].pixels = pixels.data() + (size_t)4 * (w / 2);
+}
+
+static void
+MipsUsage(void)
+{
+    printf("Usage: View360Tool mips [options] input.jpg\n");
+    printf("Builds the mipmaps of the left and right halves of the image as View360Photo does (linear light,\n");
+    printf("wrapping around the longitude seam) and prints the time and a hash of the result for each filter.\n");
+    printf("    -filter name  box, kaiser, lanczos3 or all (default all)\n");
+    printf("    -n count      number of builds per filter (default 3)\n");
+    printf("    -threads n    threads (default 0 = hardware threads)\n");
+    printf("The result is checked to be the same with 1 thread, and to match the mipmaps of the whole image\n");
+    printf("built as one texture on the levels where the halves have an exact width.\n");
+}
+
+static uint64_t
+MipChainsHash(const MipChain* chains, int n)
+{
+    uint64_t h = 0;
+    for (int i = 0; i < n; ++i) {
+        h = Hash::Hash64(chains[i].pixels.data(), chains[i].pixels.size(), h);
+    }
+    return h;
+}
+
+int
+ToolMips(const std::vector<std::string>& args)
+{
+    int count = 3;
+    int nThreads = 0;
+    int filter = -1;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a == "-filter" && 1 <= remain) {
+            static const char* names[MF_NUM] = { "box", "kaiser", "lanczos3" };
+            const std::string& name = args[++i];
+            filter = MF_NUM;
+            for (int f = 0; f < MF_NUM; ++f) {
+                if (name == names[f]) {
+                    filter = f;
+                }
+            }
+            if (name == "all") {
+                filter = -1;
+            } else if (filter == MF_NUM) {
+                MipsUsage();
+                return 1;
+            }
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            MipsUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || count < 1) {
+        MipsUsage();
+        return 1;
+    }
+
+    std::vector<uint8_t> pixels;
+    int w = 0;
+    int h = 0;
+    if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+        return 1;
+    }
+
+    MipSource whole;
+    MipSource halves[2];
+    SplitHalves(pixels, w, h, &whole, halves);
+
+    printf("%dx%d, halves %dx%d and %dx%d\n", w, h, halves[0].width, h, halves[1].width, h);
+
+    int rv = 0;
+    for (int f = 0; f < MF_NUM; ++f) {
+        if (0 <= filter && f != filter) {
+            continue;
+        }
+        MipBuildParams p;
+        p.filter = (MipFilter)f;
+        p.wrapX = true;
+        p.numThreads = nThreads;
+
+        MipChain chains[2];
+        double best = 0;
+        for (int i = 0; i < count; ++i) {
+            const double t0 = ToolNowMs();
+            if (MipBuild(halves, 2, p, chains) < 0) {
+                return 1;
+            }
+            const double ms = ToolNowMs() - t0;
+            best = (i == 0) ? ms : std::min(best, ms);
+        }
+        const uint64_t hash = MipChainsHash(chains, 2);
+
+        // 1スレッドでも同じ結果になること。
+        MipBuildParams p1 = p;
+        p1.numThreads = 1;
+        MipChain chains1[2];
+        MipBuild(halves, 2, p1, chains1);
+        const bool sameThreads = (hash == MipChainsHash(chains1, 2));
+
+        // 画像全体を1枚として作った各段の左右の半分と、継ぎ目も含めて同じになること。
+        // 左右の幅が等しく、前の段の幅が偶数の段だけ比べられる。
+        MipChain wholeChain;
+        MipBuild(&whole, 1, p, &wholeChain);
+        int seamLevels = 0;
+        bool seamSame = true;
+        for (int l = 1; halves[0].width == halves[1].width && l < chains[0].numLevels; ++l) {
+            if ((chains[0].LevelWidth(l - 1) & 1) || (chains[1].LevelWidth(l - 1) & 1)) {
+                break;
+            }
+            const int lw = chains[0].LevelWidth(l);
+            if (wholeChain.LevelWidth(l) != 2 * lw || chains[1].LevelWidth(l) != lw) {
+                break;
+            }
+            for (int y = 0; y < chains[0].LevelHeight(l); ++y) {
+                const uint8_t* row = wholeChain.Level(l) + (size_t)8 * lw * y;
+                if (0 != memcmp(row, chains[0].Level(l) + (size_t)4 * lw * y, (size_t)4 * lw)
+                        || 0 != memcmp(row + (size_t)4 * lw, chains[1].Level(l) + (size_t)4 * lw * y, (size_t)4 * lw)) {
+                    seamSame = false;
+                }
+            }
+            ++seamLevels;
+        }
+
+        const double mpix = (double)w * h / 1e6;
+        printf("%-9s %d levels, best %.1f ms (%.1f MPix/s), hash %016llx\n", MipFilterToStr((MipFilter)f),
+                chains[0].numLevels, best, mpix / best * 1000.0, (unsigned long long)hash);
+        if (seamLevels == 0) {
+            printf("    1 thread: %s, whole image: not compared (odd width)\n", sameThreads ? "same" : "DIFFERS");
+        } else {
+            printf("    1 thread: %s, whole image: %s on %d levels\n", sameThreads ? "same" : "DIFFERS",
+                    seamSame ? "same" : "DIFFERS", seamLevels);
+        }
+        if (!sameThreads || !seamSame) {
+            rv = 1;
+        }
+    }
+    return rv;
+}
+
+static void
+BcUsage(void)
+{
+    printf("Usage: View360Tool bc [options] input.jpg\n");
+    printf("Builds the mipmaps of the left and right halves of the image as View360Photo does, compresses all levels\n");
+    printf("to BC1 / BC7 and prints the time, the PSNR of the decoded blocks and the size for each preset.\n");
+    printf("    -format name   bc1, bc7 or all (default all)\n");
+    printf("    -quality name  fast, normal, slow or all (default all)\n");
+    printf("    -n count       number of compressions per preset (default 1)\n");
+    printf("    -threads n     threads (default 0 = hardware threads)\n");
+    printf("The result is checked to be the same with 1 thread. The halves must be a multiple of 4 pixels.\n");
+}
+
+/// nameをnames[0]～names[num - 1]から探す。"all"のとき-1。見つからないときnum。
+static int
+ParseNameOrAll(const std::string& name, const char* const* names, int num)
+{
+    if (name == "all") {
+        return -1;
+    }
+    for (int i = 0; i < num; ++i) {
+        if (name == names[i]) {
+            return i;
+        }
+    }
+    return num;
+}
+
+int
+ToolBc(const std::vector<std::string>& args)
+{
+    static const char* formatNames[BCF_NUM] = { "none", "bc1", "bc7" };
+    static const char* qualityNames[BCQ_NUM] = { "fast", "normal", "slow" };
+    int count = 1;
+    int nThreads = 0;
+    int format = -1;
+    int quality = -1;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a == "-format" && 1 <= remain) {
+            format = ParseNameOrAll(args[++i], formatNames, BCF_NUM);
+            if (format == BCF_None || format == BCF_NUM) {
+                BcUsage();
+                return 1;
+            }
+        } else if (a == "-quality" && 1 <= remain) {
+            quality = ParseNameOrAll(args[++i], qualityNames, BCQ_NUM);
+            if (quality == BCQ_NUM) {
+                BcUsage();
+                return 1;
+            }
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            BcUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || count < 1) {
+        BcUsage();
+        return 1;
+    }
+
+    std::vector<uint8_t> pixels;
+    int w = 0;
+    int h = 0;
+    if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+        return 1;
+    }
+
+    MipSource whole;
+    MipSource halves[2];
+    SplitHalves(pixels, w, h, &whole, halves);
+
+    MipBuildParams mp;
+    mp.wrapX = true;
+    mp.numThreads = nThreads;
+    MipChain chains[2];
+    if (MipBuild(halves, 2, mp, chains) < 0) {
+        return 1;
+    }
+
+    size_t rawBytes = 0;
+    for (int i = 0; i < 2; ++i) {
+        for (int l = 0; l < chains[i].numLevels; ++l) {
+            rawBytes += (size_t)4 * chains[i].LevelWidth(l) * chains[i].LevelHeight(l);
+        }
+    }
+    printf("%dx%d, halves %dx%d and %dx%d, %d levels, BGRA8 %.1f MiB\n", w, h, halves[0].width, h, halves[1].width, h,
+            chains[0].numLevels, (double)rawBytes / 1048576.0);
+
+    int rv = 0;
+    for (int f = BCF_Bc1; f < BCF_NUM; ++f) {
+        if (0 <= format && f != format) {
+            continue;
+        }
+        for (int q = 0; q < BCQ_NUM; ++q) {
+            if (0 <= quality && q != quality) {
+                continue;
+            }
+
+            BcTexture bc[2];
+            double best = 0;
+            for (int n = 0; n < count; ++n) {
+                const double t0 = ToolNowMs();
+                for (int i = 0; i < 2; ++i) {
+                    if (BcEncodeMips(halves[i], chains[i], (BcFormat)f, (BcQuality)q, &bc[i], nThreads) < 0) {
+                        return 1;
+                    }
+                }
+                const double ms = ToolNowMs() - t0;
+                best = (n == 0) ? ms : std::min(best, ms);
+            }
+
+            // 1スレッドでも同じ結果になること。
+            bool sameThreads = true;
+            for (int i = 0; i < 2; ++i) {
+                BcTexture bc1;
+                BcEncodeMips(halves[i], chains[i], (BcFormat)f, (BcQuality)q, &bc1, 1);
+                sameThreads = sameThreads && bc1.blocks == bc[i].blocks;
+            }
+
+            // level 0と、最も悪い段のPSNR。
+            double psnr0 = 0;
+            double psnrMin = 999.0;
+            size_t bcBytes = 0;
+            for (int i = 0; i < 2; ++i) {
+                bcBytes += bc[i].blocks.size();
+                for (int l = 0; l < bc[i].numLevels; ++l) {
+                    const int lw = bc[i].LevelWidth(l);
+                    const int lh = bc[i].LevelHeight(l);
+                    std::vector<uint8_t> dec((size_t)4 * lw * lh);
+                    if (BcDecode(bc[i].Level(l), lw, lh, (BcFormat)f, dec.data(), 4 * lw) < 0) {
+                        return 1;
+                    }
+                    const uint8_t* src = (l == 0) ? halves[i].pixels : chains[i].Level(l);
+                    const int srcStride = (l == 0) ? halves[i].stride : 4 * lw;
+                    const double psnr = BcPsnr(src, srcStride, dec.data(), 4 * lw, lw, lh);
+                    if (l == 0) {
+                        psnr0 += psnr / 2;
+                    }
+                    psnrMin = std::min(psnrMin, psnr);
+                }
+            }
+
+            const double mpix = (double)w * h / 1e6;
+            printf("%s %-6s best %.1f ms (%.1f MPix/s), PSNR level 0 %.2f dB, worst level %.2f dB, %.1f MiB (1/%.0f)\n",
+                    BcFormatToStr((BcFormat)f), BcQualityToStr((BcQuality)q), best, mpix / best * 1000.0, psnr0,
+                    psnrMin, (double)bcBytes / 1048576.0, (double)rawBytes / (double)bcBytes);
+            printf("    1 thread: %s\n", sameThreads ? "same" : "DIFFERS");
+            if (!sameThreads) {
+                rv = 1;
+            }
+        }
+    }
+    return rv;
+}
+
+static void
+TexCacheUsage(void)
+{
+    printf("Usage: View360Tool texcache [options] input.jpg\n");
+    printf("Looks up the full-resolution textures of the left and right halves of the image in the texture cache\n");
+    printf("that View360Photo uses. On a miss, decodes, builds the mipmaps, compresses and writes them, then reads\n");
+    printf("them back. Prints the time of each step and checks that the cached levels match, and that an entry\n");
+    printf("whose level pitch does not match its size and format is rejected.\n");
+    printf("    -dir path      cache directory (default: the View360Photo cache directory)\n");
+    printf("    -max MiB       cache size cap, least recently used entries are removed (default 2048)\n");
+    printf("    -format name   none, bc1 or bc7 (default bc7)\n");
+    printf("    -quality name  fast, normal or slow (default fast)\n");
+    printf("    -threads n     threads (default 0 = hardware threads)\n");
+}
+
+/// キャッシュの全段を読んで、levelsと比べる。levelsがnullptrのときは読むだけ。
+static bool
+TexCacheEntryMatches(const TextureCacheEntry& e, const TextureCacheLevelData* levels, uint64_t* hash_r)
+{
+    bool same = true;
+    for (int l = 0; l < e.NumLevels(); ++l) {
+        const int rows = e.LevelRows(l);
+        const int rowBytes = e.LevelPitch(l);
+        if (levels != nullptr && (levels[l].rowBytes != rowBytes || levels[l].rows != rows)) {
+            return false;
+        }
+        for (int y = 0; levels != nullptr && y < rows; ++y) {
+            if (0 != memcmp(e.LevelPixels(l) + (size_t)rowBytes * y, levels[l].pixels + (size_t)levels[l].stride * y,
+                    rowBytes)) {
+                same = false;
+            }
+        }
+        *hash_r = Hash::Hash64(e.LevelPixels(l), (size_t)rowBytes * rows, *hash_r);
+    }
+    return same;
+}
+
+int
+ToolTexCache(const std::vector<std::string>& args)
+{
+    static const char* formatNames[BCF_NUM] = { "none", "bc1", "bc7" };
+    static const char* qualityNames[BCQ_NUM] = { "fast", "normal", "slow" };
+    int maxMiB = 2048;
+    int nThreads = 0;
+    int format = BCF_Bc7;
+    int quality = BCQ_Fast;
+    std::string dirArg;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-dir" && 1 <= remain) {
+            dirArg = args[++i];
+        } else if (a == "-max" && 1 <= remain) {
+            maxMiB = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a == "-format" && 1 <= remain) {
+            format = ParseNameOrAll(args[++i], formatNames, BCF_NUM);
+            if (format < 0 || format == BCF_NUM) {
+                TexCacheUsage();
+                return 1;
+            }
+        } else if (a == "-quality" && 1 <= remain) {
+            quality = ParseNameOrAll(args[++i], qualityNames, BCQ_NUM);
+            if (quality < 0 || quality == BCQ_NUM) {
+                TexCacheUsage();
+                return 1;
+            }
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            TexCacheUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || maxMiB < 1) {
+        TexCacheUsage();
+        return 1;
+    }
+
+    std::wstring dir = ToolPath(dirArg);
+    if (dirArg.empty()) {
+        dir = UserCacheDirectory(L"View360Photo");
+#ifdef _WIN32
+        dir += L"\\TextureCache";
+#else
+        dir += L"/TextureCache";
+#endif
+    }
+    TextureCache cache;
+    cache.Init(dir, (uint64_t)maxMiB * 1024 * 1024);
+    printf("cache %S, max %d MiB\n", dir.c_str(), maxMiB);
+
+    // View360Photoと同じ鍵。
+    static const float portions[2][4] = { { 0, 0, 0.5f, 1.0f }, { 0.5f, 0, 0.5f, 1.0f } };
+    double t0 = ToolNowMs();
+    uint64_t srcHash = 0;
+    if (FAILED(TextureCache::SourceHash(ToolPath(inPath).c_str(), &srcHash))) {
+        printf("E: failed to read %s\n", inPath.c_str());
+        return 1;
+    }
+    uint64_t keys[2];
+    for (int i = 0; i < 2; ++i) {
+        TextureCacheParams p;
+        memcpy(p.portion, portions[i], sizeof p.portion);
+        p.alpha = 0xff;
+        p.format = format;
+        p.quality = quality;
+        p.mipFilter = MF_Kaiser;
+        p.wrapX = 1;
+        keys[i] = TextureCache::Key(srcHash, p);
+    }
+    printf("source hash %016llx %.1f ms, keys %016llx %016llx\n", (unsigned long long)srcHash, ToolNowMs() - t0,
+            (unsigned long long)keys[0], (unsigned long long)keys[1]);
+
+    TextureCacheEntry entries[2];
+    t0 = ToolNowMs();
+    bool hit = SUCCEEDED(cache.Open(keys[0], entries[0])) && SUCCEEDED(cache.Open(keys[1], entries[1]));
+    const double openMs = ToolNowMs() - t0;
+
+    int rv = 0;
+    if (hit) {
+        t0 = ToolNowMs();
+        uint64_t h = 0;
+        for (int i = 0; i < 2; ++i) {
+            TexCacheEntryMatches(entries[i], nullptr, &h);
+        }
+        printf("hit: open %.2f ms, %s %dx%d %d levels, read all levels %.1f ms\n", openMs,
+                BcFormatToStr(entries[0].Format()), entries[0].Width(), entries[0].Height(), entries[0].NumLevels(),
+                ToolNowMs() - t0);
+    } else {
+        printf("miss: open %.2f ms\n", openMs);
+
+        t0 = ToolNowMs();
+        std::vector<uint8_t> pixels;
+        int w = 0;
+        int h = 0;
+        if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+            return 1;
+        }
+        const double decodeMs = ToolNowMs() - t0;
+
+        MipSource whole;
+        MipSource halves[2];
+        SplitHalves(pixels, w, h, &whole, halves);
+        t0 = ToolNowMs();
+        MipBuildParams mp;
+        mp.wrapX = true;
+        mp.numThreads = nThreads;
+        MipChain chains[2];
+        if (MipBuild(halves, 2, mp, chains) < 0) {
+            return 1;
+        }
+        const double mipMs = ToolNowMs() - t0;
+
+        t0 = ToolNowMs();
+        BcTexture bc[2];
+        std::vector<TextureCacheLevelData> levels[2];
+        for (int i = 0; i < 2; ++i) {
+            levels[i].resize(chains[i].numLevels);
+            if (format != BCF_None && 0 <= BcEncodeMips(halves[i], chains[i], (BcFormat)format, (BcQuality)quality,
+                    &bc[i], nThreads)) {
+                for (int l = 0; l < bc[i].numLevels; ++l) {
+                    levels[i][l] = { bc[i].Level(l), bc[i].LevelPitch(l), bc[i].LevelPitch(l), bc[i].LevelBlockRows(l) };
+                }
+                continue;
+            }
+            bc[i].format = BCF_None;
+            levels[i][0] = { halves[i].pixels, halves[i].stride, 4 * halves[i].width, halves[i].height };
+            for (int l = 1; l < chains[i].numLevels; ++l) {
+                const int lw = chains[i].LevelWidth(l);
+                levels[i][l] = { chains[i].Level(l), 4 * lw, 4 * lw, chains[i].LevelHeight(l) };
+            }
+        }
+        const double compressMs = ToolNowMs() - t0;
+
+        t0 = ToolNowMs();
+        for (int i = 0; i < 2; ++i) {
+            if (FAILED(cache.Write(keys[i], bc[i].format, halves[i].width, halves[i].height, chains[i].numLevels,
+                    levels[i].data()))) {
+                return 1;
+            }
+        }
+        const double writeMs = ToolNowMs() - t0;
+        printf("decode %.1f ms, mips %.1f ms, %s %s %.1f ms, write %.1f ms\n", decodeMs, mipMs,
+                BcFormatToStr(bc[0].format), BcQualityToStr((BcQuality)quality), compressMs, writeMs);
+
+        // 書いたものを開き直して、全段が同じこと。
+        t0 = ToolNowMs();
+        hit = SUCCEEDED(cache.Open(keys[0], entries[0])) && SUCCEEDED(cache.Open(keys[1], entries[1]));
+        const double reopenMs = ToolNowMs() - t0;
+        if (!hit) {
+            printf("reopen: evicted, the entries do not fit in -max\n");
+        }
+        bool same = true;
+        for (int i = 0; i < 2 && hit && same; ++i) {
+            uint64_t hh = 0;
+            same = entries[i].NumLevels() == chains[i].numLevels && entries[i].Format() == bc[i].format
+                    && TexCacheEntryMatches(entries[i], levels[i].data(), &hh);
+        }
+        if (hit) {
+            printf("reopen %.2f ms, content: %s\n", reopenMs, same ? "same" : "DIFFERS");
+        }
+        if (!same) {
+            rv = 1;
+        }
+    }
+
+    // 行のバイト数が大きさと形式に合わないキャッシュは開かない。4x4画素のBGRAを1行32バイトとして書く。
+    {
+        static const uint8_t badPixels[32 * 4] = {};
+        const TextureCacheLevelData bad = { badPixels, 32, 32, 4 };
+        const uint64_t badKey = keys[0] ^ 0x5a5a5a5a5a5a5a5aULL;
+        TextureCacheEntry e;
+        if (SUCCEEDED(cache.Write(badKey, BCF_None, 4, 4, 1, &bad))) {
+            const bool rejected = FAILED(cache.Open(badKey, e));
+            printf("entry with a wrong pitch: %s\n", rejected ? "rejected" : "OPENED");
+            e.Close();
+            RemoveFile(cache.EntryPath(badKey));
+            if (!rejected) {
+                rv = 1;
+            }
+        }
+    }
+
+    int numFiles = 0;
+    uint64_t bytes = 0;
+    if (SUCCEEDED(cache.Usage(&numFiles, &bytes))) {
+        printf("cache: %d files, %.1f MiB\n", numFiles, (double)bytes / 1048576.0);
+    }
+    return rv;
+}
+
+static void
+CubeUsage(void)
+{
+    printf("Usage: View360Tool cube [options] input.jpg\n");
+    printf("Resamples the equirectangular image to a cube map, an equi-angular cube map (EAC) or an octahedral map\n");
+    printf("as View360Photo does with TEXTURE_LAYOUT PL_Cube, PL_Eac or PL_Octahedral, and prints the time, the size\n");
+    printf("compared with the image and the PSNR of the image converted back to equirectangular.\n");
+    printf("    -layout name   cube, eac, oct or all (default all)\n");
+    printf("    -size n        face size in pixels (default 0 = image width / 4, image width / 2 for oct)\n");
+    printf("    -filter name   bilinear, bicubic or all (default all)\n");
+    printf("    -n count       number of conversions per filter (default 3)\n");
+    printf("    -threads n     threads (default 0 = hardware threads)\n");
+    printf("The result is checked to be the same with 1 thread and without SIMD, and the mapping from directions to\n");
+    printf("texture coordinates is checked to round trip.\n");
+}
+
+/// 変換したパノラマ画像。layoutのcubeかoctを使う。
+struct ToolPanorama {
+    CubeMap cube;
+    OctMap oct;
+};
+
+static int
+ToolPanoramaConvert(PanoramaLayout layout, const MipSource& src, const CubeMapParams& p, ToolPanorama* pano_r)
+{
+    if (layout == PL_Octahedral) {
+        return EquirectToOct(src, p, &pano_r->oct);
+    }
+    CubeMapParams pc = p;
+    pc.equiAngular = layout == PL_Eac;
+    return EquirectToCube(src, pc, &pano_r->cube);
+}
+
+static bool
+ToolPanoramaSame(PanoramaLayout layout, const ToolPanorama& a, const ToolPanorama& b)
+{
+    return (layout == PL_Octahedral) ? a.oct.pixels == b.oct.pixels : a.cube.pixels == b.cube.pixels;
+}
+
+/// 球面上の向きを格子状に取り、テクスチャーの座標にしてから向きに戻した角度の誤差の最大(ラジアン)。
+static double
+PanoramaDirectionRoundTrip(PanoramaLayout layout)
+{
+    double worst = 0;
+    const int n = 256;
+    for (int y = 0; y < n; ++y) {
+        const double lat = ((y + 0.5) / n - 0.5) * 3.14159265358979;
+        for (int x = 0; x < 2 * n; ++x) {
+            const double lon = ((x + 0.5) / (2 * n)) * 2.0 * 3.14159265358979;
+            const float d[3] = { (float)(cos(lat) * cos(lon)), (float)sin(lat), (float)(cos(lat) * sin(lon)) };
+            float back[3];
+            float s;
+            float t;
+            if (layout == PL_Octahedral) {
+                DirectionToOct(d, &s, &t);
+                OctDirection(s, t, back);
+            } else {
+                const bool eac = layout == PL_Eac;
+                const int face = DirectionToCubeFace(d, eac, &s, &t);
+                CubeFaceDirection(face, eac ? EacToCube(s) : s, eac ? EacToCube(t) : t, back);
+            }
+            // 小さな角度はacos()では精度が出ないので、外積の大きさと内積から求める。
+            const double a[3] = { d[0], d[1], d[2] };
+            const double b[3] = { back[0], back[1], back[2] };
+            const double cx = a[1] * b[2] - a[2] * b[1];
+            const double cy = a[2] * b[0] - a[0] * b[2];
+            const double cz = a[0] * b[1] - a[1] * b[0];
+            const double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+            worst = std::max(worst, atan2(sqrt(cx * cx + cy * cy + cz * cz), dot));
+        }
+    }
+    return worst;
+}
+
+int
+ToolCube(const std::vector<std::string>& args)
+{
+    static const char* filterNames[CUF_NUM] = { "bilinear", "bicubic" };
+    static const char* layoutNames[] = { "cube", "eac", "oct" };
+    static const PanoramaLayout layouts[] = { PL_Cube, PL_Eac, PL_Octahedral };
+    static const int numLayouts = (int)(sizeof layouts / sizeof layouts[0]);
+    int count = 3;
+    int nThreads = 0;
+    int faceSize = 0;
+    int filter = -1;
+    int layoutIdx = -1;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a == "-size" && 1 <= remain) {
+            faceSize = atoi(args[++i].c_str());
+        } else if (a == "-filter" && 1 <= remain) {
+            filter = ParseNameOrAll(args[++i], filterNames, CUF_NUM);
+            if (filter == CUF_NUM) {
+                CubeUsage();
+                return 1;
+            }
+        } else if (a == "-layout" && 1 <= remain) {
+            layoutIdx = ParseNameOrAll(args[++i], layoutNames, numLayouts);
+            if (layoutIdx == numLayouts) {
+                CubeUsage();
+                return 1;
+            }
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            CubeUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || count < 1 || faceSize < 0) {
+        CubeUsage();
+        return 1;
+    }
+
+    std::vector<uint8_t> pixels;
+    int w = 0;
+    int h = 0;
+    if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+        return 1;
+    }
+
+    MipSource whole;
+    MipSource halves[2];
+    SplitHalves(pixels, w, h, &whole, halves);
+
+    int rv = 0;
+    for (int li = 0; li < numLayouts; ++li) {
+        if (0 <= layoutIdx && li != layoutIdx) {
+            continue;
+        }
+        const PanoramaLayout layout = layouts[li];
+
+        // 向きの誤差は画素の大きさ(最大で約2π / w)よりずっと小さいこと。
+        const double dirErr = PanoramaDirectionRoundTrip(layout);
+        printf("%s: direction round trip max error %.2e rad\n", PanoramaLayoutToStr(layout), dirErr);
+        if (1e-5 < dirErr) {
+            rv = 1;
+        }
+
+        for (int f = 0; f < CUF_NUM; ++f) {
+            if (0 <= filter && f != filter) {
+                continue;
+            }
+            CubeMapParams p;
+            p.faceSize = faceSize;
+            p.filter = (CubeFilter)f;
+            p.numThreads = nThreads;
+
+            ToolPanorama pano;
+            double best = 0;
+            for (int i = 0; i < count; ++i) {
+                const double t0 = ToolNowMs();
+                if (ToolPanoramaConvert(layout, whole, p, &pano) < 0) {
+                    return 1;
+                }
+                const double ms = ToolNowMs() - t0;
+                best = (i == 0) ? ms : std::min(best, ms);
+            }
+
+            // 1スレッドでも、SIMDを使わなくても同じ結果になること。
+            CubeMapParams p1 = p;
+            p1.numThreads = 1;
+            ToolPanorama pano1;
+            ToolPanoramaConvert(layout, whole, p1, &pano1);
+            const bool sameThreads = ToolPanoramaSame(layout, pano, pano1);
+
+            CubeMapParams ps = p;
+            ps.simd = false;
+            ToolPanorama panoScalar;
+            ToolPanoramaConvert(layout, whole, ps, &panoScalar);
+            const bool sameScalar = ToolPanoramaSame(layout, pano, panoScalar);
+
+            // 元の大きさの正距円筒図法に戻した画像のPSNR。
+            std::vector<uint8_t> back((size_t)4 * w * h);
+            const int backRv = (layout == PL_Octahedral) ? OctToEquirect(pano.oct, w, h, back.data(), 4 * w, nThreads)
+                    : CubeToEquirect(pano.cube, w, h, back.data(), 4 * w, nThreads);
+            if (backRv < 0) {
+                return 1;
+            }
+            const double psnr = BcPsnr(whole.pixels, whole.stride, back.data(), 4 * w, w, h);
+
+            const int n = (layout == PL_Octahedral) ? pano.oct.size : pano.cube.faceSize;
+            const size_t bytes = (layout == PL_Octahedral) ? pano.oct.pixels.size() : pano.cube.pixels.size();
+            const double mpix = (double)bytes / 4 / 1e6;
+            printf("    %-8s %dx%d, best %.1f ms (%.1f MPix/s), %.1f MiB (%.0f%% of the image), round trip PSNR %.2f dB\n",
+                    CubeFilterToStr((CubeFilter)f), n, n, best, mpix / best * 1000.0, (double)bytes / 1048576.0,
+                    100.0 * (double)bytes / (double)pixels.size(), psnr);
+            printf("        1 thread: %s, scalar: %s\n", sameThreads ? "same" : "DIFFERS", sameScalar ? "same" : "DIFFERS");
+            if (!sameThreads || !sameScalar) {
+                rv = 1;
+            }
+        }
+    }
+    return rv;
+}
+
+static void
+BandsUsage(void)
+{
+    printf("Usage: View360Tool bands [options] input.jpg\n");
+    printf("Splits the equirectangular image into latitude bands, shrinks each band horizontally by cos(latitude)\n");
+    printf("and packs them into one image as View360Photo does with TEXTURE_LAYOUT PL_LatitudeBands. Prints the time,\n");
+    printf("the size compared with the image, and the PSNR of the image read back through the band coordinates,\n");
+    printf("both per pixel and weighted by the solid angle of each row (the error seen on the sphere).\n");
+    printf("    -bands n       number of bands, 1 to %d, or 0 for 8, 16, 32 and 64 (default 0)\n", LATITUDE_BANDS_MAX);
+    printf("    -n count       number of conversions per band count (default 3)\n");
+    printf("    -threads n     threads (default 0 = hardware threads)\n");
+    printf("The result is checked to be the same with 1 thread, and the segments of the bands with their borders\n");
+    printf("are checked to cover each band and not to overlap.\n");
+}
+
+/// 帯の区間と縁が詰めた画像の中に収まり、互いに重ならず、区間が帯の列を順に隙間なく覆うこと。
+static bool
+LatitudeBandLayoutValid(const LatitudeBandLayout& l)
+{
+    if (LATITUDE_SEGMENTS_MAX < (int)l.segments.size()) {
+        return false;
+    }
+    std::vector<uint8_t> used((size_t)l.width * l.height, 0);
+    for (const LatitudeBand& b : l.bands) {
+        if (b.numSegments < 1 || 3 < b.numSegments) {
+            return false;
+        }
+        int col = 0;
+        for (int i = 0; i < b.numSegments; ++i) {
+            const LatitudeBandSegment& sg = l.segments[(size_t)b.firstSegment + i];
+            if (sg.col0 != col || sg.col1 <= sg.col0) {
+                return false;
+            }
+            col = sg.col1;
+
+            const int x0 = sg.x - 1;
+            const int y0 = sg.y - 1;
+            const int x1 = sg.x + sg.col1 - sg.col0 + 1;
+            const int y1 = sg.y + b.srcY1 - b.srcY0 + 1;
+            if (x0 < 0 || y0 < 0 || l.width < x1 || l.height < y1) {
+                return false;
+            }
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    uint8_t& u = used[(size_t)l.width * y + x];
+                    if (u != 0) {
+                        return false;
+                    }
+                    u = 1;
+                }
+            }
+        }
+        if (col != b.width) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// 行ごとに、その行が球面上で占める立体角(cos(緯度))で重み付けしたRGBのPSNR (dB)。
+static double
+SolidAnglePsnr(const uint8_t* a, int strideA, const uint8_t* b, int strideB, int w, int h)
+{
+    double sum = 0;
+    double weights = 0;
+    for (int y = 0; y < h; ++y) {
+        const double wt = cos(((y + 0.5) / h - 0.5) * 3.14159265358979);
+        const uint8_t* pa = a + (size_t)strideA * y;
+        const uint8_t* pb = b + (size_t)strideB * y;
+        int64_t row = 0;
+        for (int x = 0; x < w; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const int d = pa[4 * x + c] - pb[4 * x + c];
+                row += d * d;
+            }
+        }
+        sum += wt * (double)row;
+        weights += wt;
+    }
+    if (sum == 0) {
+        return 999.0;
+    }
+    const double mse = sum / (3.0 * w * weights);
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+int
+ToolBands(const std::vector<std::string>& args)
+{
+    static const int defaultBands[] = { 8, 16, 32, 64 };
+    int count = 3;
+    int nThreads = 0;
+    int numBands = 0;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a == "-bands" && 1 <= remain) {
+            numBands = atoi(args[++i].c_str());
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            BandsUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || count < 1 || numBands < 0 || LATITUDE_BANDS_MAX < numBands) {
+        BandsUsage();
+        return 1;
+    }
+
+    std::vector<uint8_t> pixels;
+    int w = 0;
+    int h = 0;
+    if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+        return 1;
+    }
+
+    MipSource whole;
+    MipSource halves[2];
+    SplitHalves(pixels, w, h, &whole, halves);
+
+    std::vector<int> bandCounts;
+    if (numBands == 0) {
+        bandCounts.assign(defaultBands, defaultBands + sizeof defaultBands / sizeof defaultBands[0]);
+    } else {
+        bandCounts.push_back(numBands);
+    }
+
+    int rv = 0;
+    for (int n : bandCounts) {
+        if (h < n) {
+            continue;
+        }
+        LatitudeBandImage img;
+        double best = 0;
+        for (int i = 0; i < count; ++i) {
+            const double t0 = ToolNowMs();
+            if (EquirectToLatitudeBands(whole, n, nThreads, &img) < 0) {
+                return 1;
+            }
+            const double ms = ToolNowMs() - t0;
+            best = (i == 0) ? ms : std::min(best, ms);
+        }
+        const LatitudeBandLayout& l = img.layout;
+        const bool valid = LatitudeBandLayoutValid(l);
+
+        // 1スレッドでも同じ結果になること。
+        LatitudeBandImage img1;
+        EquirectToLatitudeBands(whole, n, 1, &img1);
+        const bool sameThreads = img.pixels == img1.pixels;
+
+        // 元の大きさの正距円筒図法に戻した画像のPSNR。
+        std::vector<uint8_t> back((size_t)4 * w * h);
+        if (LatitudeBandsToEquirect(img, w, h, back.data(), 4 * w, nThreads) < 0) {
+            return 1;
+        }
+        const double psnr = BcPsnr(whole.pixels, whole.stride, back.data(), 4 * w, w, h);
+        const double psnrSphere = SolidAnglePsnr(whole.pixels, whole.stride, back.data(), 4 * w, w, h);
+
+        const size_t bytes = img.pixels.size();
+        const double mpix = (double)w * h / 1e6;
+        printf("%2d bands: %dx%d, best %.1f ms (%.1f MPix/s), %.1f MiB (%.0f%% of the image), round trip PSNR %.2f dB, "
+                "on the sphere %.2f dB\n", n, l.width, l.height, best, mpix / best * 1000.0, (double)bytes / 1048576.0,
+                100.0 * (double)bytes / (double)pixels.size(), psnr, psnrSphere);
+        printf("    layout: %s, 1 thread: %s\n", valid ? "ok" : "OVERLAPS", sameThreads ? "same" : "DIFFERS");
+        if (!valid || !sameThreads) {
+            rv = 1;
+        }
+    }
+    return rv;
+}
+
+static void
+DensityUsage(void)
+{
+    printf("Usage: View360Tool density [options] input.jpg\n");
+    printf("Caps the width of the equirectangular image at the pixels per degree of the display as View360Photo does\n");
+    printf("with TEXTURE_DENSITY_SCALE, and compares it with loading the whole image: decode at the largest scale that\n");
+    printf("keeps the width at or above the cap, resize to the cap in linear light and build only the level the sampler\n");
+    printf("reads, against full decode with the full mip chain. Prints the times, the texels and the PSNR of the capped\n");
+    printf("image against the whole image resized to the same size.\n");
+    printf("    -width px      recommended image width of one eye (default 2160)\n");
+    printf("    -fov degrees   horizontal field of view of one eye (default 90)\n");
+    printf("    -scale s       density scale, the image pixels per display pixel at the equator (default 1)\n");
+    printf("    -filter name   box, kaiser or lanczos3 (default kaiser)\n");
+    printf("    -n count       number of loads (default 3)\n");
+    printf("    -threads n     threads (default 0 = hardware threads)\n");
+}
+
+int
+ToolDensity(const std::vector<std::string>& args)
+{
+    int viewWidth = 2160;
+    double fov = 90.0;
+    double densityScale = 1.0;
+    int count = 3;
+    int nThreads = 0;
+    MipFilter filter = MF_Kaiser;
+    std::string inPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-width" && 1 <= remain) {
+            viewWidth = atoi(args[++i].c_str());
+        } else if (a == "-fov" && 1 <= remain) {
+            fov = atof(args[++i].c_str());
+        } else if (a == "-scale" && 1 <= remain) {
+            densityScale = atof(args[++i].c_str());
+        } else if (a == "-filter" && 1 <= remain) {
+            static const char* names[MF_NUM] = { "box", "kaiser", "lanczos3" };
+            const int f = ParseNameOrAll(args[++i], names, MF_NUM);
+            if (f < 0 || MF_NUM <= f) {
+                DensityUsage();
+                return 1;
+            }
+            filter = (MipFilter)f;
+        } else if (a == "-n" && 1 <= remain) {
+            count = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            nThreads = atoi(args[++i].c_str());
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            DensityUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || viewWidth < 1 || fov <= 0 || 180 <= fov || densityScale <= 0 || count < 1) {
+        DensityUsage();
+        return 1;
+    }
+
+    const double halfFov = fov * 3.14159265358979323846 / 360.0;
+    const double ppd = DisplayPixelsPerDegree(viewWidth, -halfFov, halfFov);
+    const int maxWidth = EquirectWidthForDensity(ppd, densityScale);
+    printf("display: %d px, %.0f degrees, %.1f px/degree at the center, max image width %d\n", viewWidth, fov, ppd, maxWidth);
+
+    MipBuildParams fullMp;
+    fullMp.filter = filter;
+    fullMp.wrapX = true;
+    fullMp.numThreads = nThreads;
+
+    // 全画素をデコードして、半分ずつ1x1までのミップマップを作る。
+    std::vector<uint8_t> pixels;
+    int w = 0;
+    int h = 0;
+    size_t fullBytes = 0;
+    double fullBest = 0;
+    for (int i = 0; i < count; ++i) {
+        const double t0 = ToolNowMs();
+        if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+            return 1;
+        }
+        MipSource whole;
+        MipSource halves[2];
+        SplitHalves(pixels, w, h, &whole, halves);
+        MipChain chains[2];
+        if (MipBuild(halves, 2, fullMp, chains) < 0) {
+            return 1;
+        }
+        const double ms = ToolNowMs() - t0;
+        fullBest = (i == 0) ? ms : std::min(fullBest, ms);
+        fullBytes = pixels.size() + chains[0].pixels.size() + chains[1].pixels.size();
+    }
+
+    int cw = 0;
+    int ch = 0;
+    CappedImageSize(w, h, maxWidth, &cw, &ch);
+
+    // 上限以上のまま縮小してデコードし、上限に縮める。最も精細な段だけを使う。
+    std::vector<uint8_t> scaled;
+    std::vector<uint8_t> capped;
+    int sw = 0;
+    int sh = 0;
+    int scale = 1;
+    double cappedBest = 0;
+    for (int i = 0; i < count; ++i) {
+        const double t0 = ToolNowMs();
+        if (LoadImagePixels(inPath, scaled, &sw, &sh, maxWidth, &scale) < 0) {
+            return 1;
+        }
+        MipSource src;
+        src.pixels = scaled.data();
+        src.width = sw;
+        src.height = sh;
+        src.stride = 4 * sw;
+        if (sw == cw && sh == ch) {
+            capped = scaled;
+        } else if (MipResize(src, cw, ch, fullMp, &capped) < 0) {
+            return 1;
+        }
+        const double ms = ToolNowMs() - t0;
+        cappedBest = (i == 0) ? ms : std::min(cappedBest, ms);
+    }
+
+    // 全画素の画像を同じ大きさに縮めたものと比べる。
+    MipSource whole;
+    MipSource halves[2];
+    SplitHalves(pixels, w, h, &whole, halves);
+    std::vector<uint8_t> ref;
+    if (cw == w && ch == h) {
+        ref = pixels;
+    } else if (MipResize(whole, cw, ch, fullMp, &ref) < 0) {
+        return 1;
+    }
+    const double psnr = BcPsnr(ref.data(), 4 * cw, capped.data(), 4 * cw, cw, ch);
+
+    const size_t cappedBytes = capped.size();
+    printf("full:   decode %dx%d, %s mipmaps to 1x1, best %.1f ms, %.1f MiB\n", w, h, MipFilterToStr(filter), fullBest,
+            (double)fullBytes / 1048576.0);
+    printf("capped: decode 1/%d %dx%d, resize to %dx%d, 1 level, best %.1f ms, %.1f MiB (%.0f%% of the texels), "
+            "PSNR %.2f dB\n", scale, sw, sh, cw, ch, cappedBest, (double)cappedBytes / 1048576.0,
+            100.0 * (double)cappedBytes / (double)fullBytes, psnr);
+
+    // 縮小してデコードした幅が上限を下回らないこと。
+    if (sw < cw) {
+        printf("E: decoded width %d is smaller than the cap %d\n", sw, cw);
+        return 1;
+    }
+    return 0;
+}
+
+/// pyramidの、確保したメモリーの増分の見積もりに足す分。ヒープの管理やスレッドのスタックなど。
+static const int PYRAMID_MEMORY_SLACK_MIB = 8;
+
+/// 別のスレッドで1ミリ秒ごとにToolPrivateBytes()を読み、Start()の時からの増分の最大を記録する。
+class PrivateBytesMonitor {
+public:
+    ~PrivateBytesMonitor(void) { Stop(); }
+
+    void
+    Start(void)
+    {
+        Stop();
+        mBase = ToolPrivateBytes();
+        mPeak = mBase;
+        mRun = true;
+        mThread = std::thread([this]() {
+            while (mRun) {
+                mPeak = std::max(mPeak.load(), ToolPrivateBytes());
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    /// 止めて、Start()の時からの増分の最大を戻す。
+    size_t
+    Stop(void)
+    {
+        if (mThread.joinable()) {
+            mRun = false;
+            mThread.join();
+            mPeak = std::max(mPeak.load(), ToolPrivateBytes());
+        }
+        return mPeak - mBase;
+    }
+
+private:
+    std::thread mThread;
+    std::atomic<bool> mRun{ false };
+    std::atomic<size_t> mPeak{ 0 };
+    size_t mBase = 0;
+};
+
+static void
+PyramidUsage(void)
+{
+    printf("Usage: View360Tool pyramid [options] input.jpg\n");
+    printf("Writes the equirectangular image as a tiled pyramid file (fixed-size tiles for every mip level with an index\n");
+    printf("for random access) and reads it back through a virtual texture: a page table, physical pages limited to a\n");
+    printf("byte budget with LRU eviction, and tile requests fed back by the CPU sampler.\n");
+    printf("First every tile of level 0 is requested and sampled at the pixel centers; the result must match the image\n");
+    printf("(exactly with -format none). Then a camera turns around the panorama for a number of frames; each frame\n");
+    printf("samples every pixel of the view at the mip level of the display density, falls back to coarser resident\n");
+    printf("levels for missing tiles and loads at most the given number of requested tiles. After that the camera stops\n");
+    printf("until every pixel is sampled at the wanted level.\n");
+    printf("The private memory of the process is sampled every millisecond while writing and while the camera moves.\n");
+    printf("The writer's growth must stay within its estimate, which grows with the width and the tile size but not\n");
+    printf("with the height, and the reader's growth within the memory of the virtual texture, plus %d MiB each.\n",
+            PYRAMID_MEMORY_SLACK_MIB);
+    printf("    -out path      pyramid file (default input.jpg.tpy)\n");
+    printf("    -tile px       tile size without the %d pixel border, multiple of 4 (default 256)\n", TILE_PYRAMID_BORDER);
+    printf("    -format name   none, bc1 or bc7 (default bc7)\n");
+    printf("    -budget MiB    physical page budget (default 64)\n");
+    printf("    -view px       view width and height (default 512)\n");
+    printf("    -fov degrees   view field of view (default 90)\n");
+    printf("    -frames n      frames of the turning camera (default 90)\n");
+    printf("    -loads n       tiles loaded per frame (default 32)\n");
+    printf("    -threads n     threads (default 0 = hardware threads)\n");
+}
+
+/// 1フレーム分、yaw, pitch (ラジアン)を向いたview x view画素の画面の各画素を、段lodで読む。
+/// @return 段lodで読めた画素の数。
+static int
+PyramidViewFrame(VirtualTexture& vt, double yaw, double pitch, int view, double fov, float lod, uint32_t* hash_r)
+{
+    static const double PI = 3.14159265358979323846;
+    const double t = tan(fov * PI / 360.0);
+    const double f[3] = { cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw) };
+    const double r[3] = { cos(yaw), 0, -sin(yaw) };
+    const double up[3] = { -sin(pitch) * sin(yaw), cos(pitch), -sin(pitch) * cos(yaw) };
+    const int wanted = std::min((int)lod, vt.Pyramid()->NumLevels() - 1);
+
+    int resolved = 0;
+    uint32_t hash = 2166136261u;
+    for (int y = 0; y < view; ++y) {
+        const double ny = (1.0 - 2.0 * (y + 0.5) / view) * t;
+        for (int x = 0; x < view; ++x) {
+            const double nx = (2.0 * (x + 0.5) / view - 1.0) * t;
+            double d[3];
+            for (int c = 0; c < 3; ++c) {
+                d[c] = f[c] + nx * r[c] + ny * up[c];
+            }
+            const double lon = atan2(d[0], d[2]);
+            const double lat = atan2(d[1], sqrt(d[0] * d[0] + d[2] * d[2]));
+            uint8_t bgra[4];
+            const int level = VirtualTextureSample(vt, (float)(0.5 + lon / (2.0 * PI)), (float)(0.5 - lat / PI), lod, bgra);
+            resolved += (level == wanted) ? 1 : 0;
+            for (int c = 0; c < 4; ++c) {
+                hash = (hash ^ bgra[c]) * 16777619u;
+            }
+        }
+    }
+    *hash_r = hash;
+    return resolved;
+}
+
+int
+ToolPyramid(const std::vector<std::string>& args)
+{
+    static const char* formatNames[BCF_NUM] = { "none", "bc1", "bc7" };
+    TilePyramidParams tp;
+    int budgetMiB = 64;
+    int view = 512;
+    double fov = 90.0;
+    int frames = 90;
+    int loads = 32;
+    std::string inPath;
+    std::string outPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-out" && 1 <= remain) {
+            outPath = args[++i];
+        } else if (a == "-tile" && 1 <= remain) {
+            tp.tileSize = atoi(args[++i].c_str());
+        } else if (a == "-format" && 1 <= remain) {
+            const int f = ParseNameOrAll(args[++i], formatNames, BCF_NUM);
+            if (f < 0 || BCF_NUM <= f) {
+                PyramidUsage();
+                return 1;
+            }
+            tp.format = (BcFormat)f;
+        } else if (a == "-budget" && 1 <= remain) {
+            budgetMiB = atoi(args[++i].c_str());
+        } else if (a == "-view" && 1 <= remain) {
+            view = atoi(args[++i].c_str());
+        } else if (a == "-fov" && 1 <= remain) {
+            fov = atof(args[++i].c_str());
+        } else if (a == "-frames" && 1 <= remain) {
+            frames = atoi(args[++i].c_str());
+        } else if (a == "-loads" && 1 <= remain) {
+            loads = atoi(args[++i].c_str());
+        } else if (a == "-threads" && 1 <= remain) {
+            tp.numThreads = atoi(args[++i].c_str());
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            PyramidUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty() || tp.tileSize < 16 || 1024 < tp.tileSize || (tp.tileSize & 3) != 0 || budgetMiB < 1 || view < 1
+            || fov <= 0 || 180 <= fov || frames < 0 || loads < 1) {
+        PyramidUsage();
+        return 1;
+    }
+    if (outPath.empty()) {
+        outPath = inPath + ".tpy";
+    }
+
+    std::vector<uint8_t> pixels;
+    int w = 0;
+    int h = 0;
+    if (LoadImagePixels(inPath, pixels, &w, &h) < 0) {
+        return 1;
+    }
+    MipSource whole;
+    MipSource halves[2];
+    SplitHalves(pixels, w, h, &whole, halves);
+
+    // 元の画像はデコードしたものを置いたまま渡すので、書く間に増えた分を計る。
+    const size_t slack = (size_t)PYRAMID_MEMORY_SLACK_MIB * 1024 * 1024;
+    const size_t writeBound = TilePyramidWriteBytes(w, h, tp);
+    PrivateBytesMonitor monitor;
+    monitor.Start();
+    double t0 = ToolNowMs();
+    if (TilePyramidWrite(ToolPath(outPath), whole, tp) < 0) {
+        return 1;
+    }
+    const double writeMs = ToolNowMs() - t0;
+    const size_t writeGrowth = monitor.Stop();
+
+    TilePyramid pyr;
+    if (pyr.Open(ToolPath(outPath).c_str()) < 0) {
+        return 1;
+    }
+    printf("%s: %dx%d, %d levels, %llu tiles of %dx%d (%d + border %d), %s, %.1f MiB, written in %.1f ms\n",
+            outPath.c_str(), w, h, pyr.NumLevels(), (unsigned long long)pyr.NumTiles(), pyr.StoredTileSize(),
+            pyr.StoredTileSize(), pyr.TileSize(), pyr.Border(), BcFormatToStr(pyr.Format()),
+            (double)pyr.FileBytes() / 1048576.0, writeMs);
+    printf("    writer memory +%.1f MiB (estimate %.1f MiB, image %.1f MiB)\n", (double)writeGrowth / 1048576.0,
+            (double)writeBound / 1048576.0, (double)pixels.size() / 1048576.0);
+
+    const size_t budget = (size_t)budgetMiB * 1024 * 1024;
+    VirtualTexture vt;
+    if (vt.Init(&pyr, budget, tp.numThreads) < 0) {
+        return 1;
+    }
+    printf("virtual texture: %d pages of %.2f MiB (%.1f MiB budget)\n", vt.NumPages(), (double)vt.PageBytes() / 1048576.0,
+            (double)budgetMiB);
+
+    // level 0の各タイルを読み、画素の中心を読む。縁のある双線形は画素の中心でその画素になる。
+    int rv = 0;
+    {
+        std::vector<uint8_t> back((size_t)4 * w * h);
+        const TilePyramidLevel& lv = pyr.Level(0);
+        const int ts = pyr.TileSize();
+        bool allLevel0 = true;
+        t0 = ToolNowMs();
+        for (int ty = 0; ty < (int)lv.tilesY; ++ty) {
+            for (int tx = 0; tx < (int)lv.tilesX; ++tx) {
+                vt.Request(0, tx, ty);
+                if (vt.Update(1) < 0) {
+                    return 1;
+                }
+                for (int y = ty * ts; y < std::min(h, (ty + 1) * ts); ++y) {
+                    for (int x = tx * ts; x < std::min(w, (tx + 1) * ts); ++x) {
+                        const int level = VirtualTextureSample(vt, (x + 0.5f) / (float)w, (y + 0.5f) / (float)h, 0.0f,
+                                &back[((size_t)w * y + x) * 4]);
+                        allLevel0 = allLevel0 && level == 0;
+                    }
+                }
+            }
+        }
+        const double ms = ToolNowMs() - t0;
+        const double psnr = BcPsnr(whole.pixels, whole.stride, back.data(), 4 * w, w, h);
+        const bool exact = memcmp(whole.pixels, back.data(), back.size()) == 0;
+        printf("level 0 read back: %.1f ms, PSNR %.2f dB, %s\n", ms, psnr,
+                !allLevel0 ? "NOT ALL LEVEL 0" : exact ? "exact" : "not exact");
+        if (!allLevel0 || (pyr.Format() == BCF_None && !exact)) {
+            rv = 1;
+        }
+    }
+
+    // 画面の1度あたりの画素数と、level 0の1度あたりの画素数の比から読む段を決める。
+    static const double PI = 3.14159265358979323846;
+    const double screenPpd = view / (2.0 * tan(fov * PI / 360.0)) * PI / 180.0;
+    const float lod = (float)std::max(0.0, log2((double)w / 360.0 / screenPpd));
+    const int wanted = std::min((int)lod, pyr.NumLevels() - 1);
+
+    // 最も粗い段だけを置いた状態から始める。物理ページも確保し直して、その分から計る。
+    vt.Clear();
+    monitor.Start();
+    if (vt.Init(&pyr, budget, tp.numThreads) < 0) {
+        return 1;
+    }
+
+    // カメラを1周回してから止め、全部の画素が段wantedで読めるまで続ける。
+    double resolvedSum = 0;
+    uint32_t hash = 0;
+    const int numPixels = view * view;
+    t0 = ToolNowMs();
+    for (int i = 0; i < frames; ++i) {
+        const double yaw = 2.0 * PI * i / frames;
+        const double pitch = 0.6 * sin(4.0 * PI * i / frames);
+        const int resolved = PyramidViewFrame(vt, yaw, pitch, view, fov, lod, &hash);
+        resolvedSum += (double)resolved / numPixels;
+        if (vt.Update(loads) < 0) {
+            return 1;
+        }
+    }
+    const double turnMs = ToolNowMs() - t0;
+    int settle = 0;
+    for (; settle < 1000; ++settle) {
+        const int resolved = PyramidViewFrame(vt, 0, 0, view, fov, lod, &hash);
+        if (resolved == numPixels) {
+            break;
+        }
+        if (vt.Update(loads) < 0) {
+            return 1;
+        }
+    }
+    const size_t readGrowth = monitor.Stop();
+
+    const VirtualTextureStats& st = vt.Stats();
+    const double mpix = (double)numPixels * frames / 1e6;
+    printf("view %dx%d, %.0f degrees: level %d (lod %.2f), %d frames in %.1f ms (%.1f MPix/s), %.1f%% of the pixels at "
+            "level %d\n", view, view, fov, wanted, lod, frames, turnMs, (frames == 0) ? 0.0 : mpix / turnMs * 1000.0,
+            (frames == 0) ? 100.0 : 100.0 * resolvedSum / frames, wanted);
+    printf("    settled after %d more frames, hash %08x\n", settle, hash);
+    printf("    tile lookups %llu, hits %.1f%%, requests %llu, loads %llu (%.1f MiB decoded), evictions %llu, "
+            "dropped %llu\n", (unsigned long long)st.lookups, (st.lookups == 0) ? 0.0 : 100.0 * st.hits / st.lookups,
+            (unsigned long long)st.requests, (unsigned long long)st.loads,
+            (double)st.loads * vt.PageBytes() / 1048576.0, (unsigned long long)st.evictions,
+            (unsigned long long)st.dropped);
+    printf("    reader memory +%.1f MiB (virtual texture %.1f MiB, %d MiB budget, %.1f MiB resident)\n",
+            (double)readGrowth / 1048576.0, (double)vt.MemoryBytes() / 1048576.0, budgetMiB,
+            (double)vt.ResidentBytes() / 1048576.0);
+    if (writeBound + slack < writeGrowth) {
+        printf("E: writer memory exceeds the estimate\n");
+        rv = 1;
+    }
+    if (vt.MemoryBytes() + slack < readGrowth) {
+        printf("E: reader memory exceeds the virtual texture\n");
+        rv = 1;
+    }
+    if (settle == 1000) {
+        printf("E: view did not settle\n");
+        rv = 1;
+    }
+    return rv;
+}
@@ -0,0 +1,383 @@
+﻿// 日本語。
+
+// メッシュ関連のサブコマンド。
+
+#include "pch.h"
+#include "ToolCommands.h"
+#include "SphereMesh.h"
+#include "PlyWriter.h"
+#include "MeshCache.h"
+#include "MeshPack.h"
+#include "MeshOptimize.h"
+#include "MeshWeld.h"
+#include "PlyReader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double PI = 3.14159265358979323846;
+
+static bool
+EndsWith(const std::string& s, const char* suffix)
+{
+    const size_t n = strlen(suffix);
+    return n <= s.size() && 0 == s.compare(s.size() - n, n, suffix);
+}
+
+/// 出力ファイルの形式。
+enum MeshFileFormat {
+    MFF_PlyAscii,
+    MFF_PlyBinary,
+    MFF_MeshCache,
+};
+
+static int
+WriteMesh(const std::string& path, MeshFileFormat fmt, const TexturedMesh& tm)
+{
+    const std::wstring wpath = ToolPath(path);
+
+    if (fmt == MFF_MeshCache) {
+        return MeshCache::Write(wpath, tm.vertexList.data(), tm.vertexList.size(),
+                tm.triangleIdxList.data(), tm.triangleIdxList.size());
+    }
+
+    PlyWriter pw;
+    return pw.Write(wpath, tm.vertexList.data(), tm.vertexList.size(),
+            tm.triangleIdxList.data(), tm.triangleIdxList.size(),
+            (fmt == MFF_PlyAscii) ? PlyWriter::PF_Ascii : PlyWriter::PF_BinaryLittleEndian);
+}
+
+/// pathの拡張子が.meshcacheならキャッシュファイル、それ以外はPLYとして読む。
+static int
+ReadMesh(const std::string& path, TexturedMesh& tm_r)
+{
+    if (EndsWith(path, ".meshcache")) {
+        MeshCache mc;
+        return mc.Read(ToolPath(path), tm_r);
+    }
+
+    PlyReader pr;
+    return pr.Read(ToolPath(path), tm_r);
+}
+
+static void
+SphereUsage(void)
+{
+    printf("Usage: View360Tool sphere [options] output.ply|output.meshcache\n");
+    printf("    -hemisphere n     hemisphere n=0: longitude 0 to 180, n=1: 180 to 360 (same as sphereL.ply, sphereR.ply)\n");
+    printf("    -lon begin end    longitude range in degrees (default 0 360)\n");
+    printf("    -colat begin end  colatitude range in degrees, 0 = north pole (default 0 180)\n");
+    printf("    -x n              longitude divisions (default 64)\n");
+    printf("    -y n              latitude divisions (default 64)\n");
+    printf("    -binary           write binary_little_endian PLY\n");
+    printf("Output format is mesh cache when the file name ends with .meshcache.\n");
+}
+
+int
+ToolSphere(const std::vector<std::string>& args)
+{
+    SphereMeshParams p = SphereMeshFullSphere(64, 64);
+    bool binary = false;
+    std::string outPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-hemisphere" && 1 <= remain) {
+            int n = atoi(args[++i].c_str());
+            p = SphereMeshHemisphere(n, p.xCount, p.yCount);
+        } else if (a == "-lon" && 2 <= remain) {
+            p.lonBegin = atof(args[++i].c_str()) * PI / 180.0;
+            p.lonEnd   = atof(args[++i].c_str()) * PI / 180.0;
+        } else if (a == "-colat" && 2 <= remain) {
+            p.colatBegin = atof(args[++i].c_str()) * PI / 180.0;
+            p.colatEnd   = atof(args[++i].c_str()) * PI / 180.0;
+        } else if (a == "-x" && 1 <= remain) {
+            p.xCount = atoi(args[++i].c_str());
+        } else if (a == "-y" && 1 <= remain) {
+            p.yCount = atoi(args[++i].c_str());
+        } else if (a == "-binary") {
+            binary = true;
+        } else if (a[0] != '-' && outPath.empty()) {
+            outPath = a;
+        } else {
+            SphereUsage();
+            return 1;
+        }
+    }
+    if (outPath.empty()) {
+        SphereUsage();
+        return 1;
+    }
+
+    const double t0 = ToolNowMs();
+    TexturedMesh tm;
+    int hr = SphereMeshGenerate(p, tm);
+    if (FAILED(hr)) {
+        return 1;
+    }
+    const double t1 = ToolNowMs();
+
+    MeshFileFormat fmt = EndsWith(outPath, ".meshcache") ? MFF_MeshCache
+            : (binary ? MFF_PlyBinary : MFF_PlyAscii);
+    hr = WriteMesh(outPath, fmt, tm);
+    if (FAILED(hr)) {
+        return 1;
+    }
+    const double t2 = ToolNowMs();
+
+    printf("%s: %zu vertices, %zu triangles. generate %.3f ms, write %.3f ms\n",
+            outPath.c_str(), tm.vertexList.size(), tm.triangleIdxList.size() / 3, t1 - t0, t2 - t1);
+    return 0;
+}
+
+static void
+MeshPackUsage(void)
+{
+    printf("Usage: View360Tool meshpack [input.ply|input.meshcache]\n");
+    printf("Packs the mesh to each vertex format and checks the round trip error.\n");
+    printf("Without input, the 64x64 hemisphere mesh is used.\n");
+}
+
+int
+ToolMeshPack(const std::vector<std::string>& args)
+{
+    TexturedMesh tm;
+    int hr = S_OK;
+    if (args.empty()) {
+        hr = SphereMeshGenerate(SphereMeshHemisphere(0, 64, 64), tm);
+    } else if (args.size() == 1 && args[0][0] != '-') {
+        hr = ReadMesh(args[0], tm);
+    } else {
+        MeshPackUsage();
+        return 1;
+    }
+    if (FAILED(hr)) {
+        return 1;
+    }
+
+    const XyzUv* vtx = tm.vertexList.data();
+    const size_t nVtx = tm.vertexList.size();
+    const uint32_t* idx = tm.triangleIdxList.data();
+    const size_t nIdx = tm.triangleIdxList.size();
+    const size_t origBytes = nVtx * sizeof(XyzUv) + nIdx * sizeof(uint32_t);
+
+    printf("%zu vertices, %zu triangles, %zu bytes as XyzUv + uint32 index\n", nVtx, nIdx / 3, origBytes);
+    printf("%-13s %6s %10s %10s %7s %12s %12s %12s %12s\n",
+            "format", "stride", "vtxBytes", "idxBytes", "ratio", "posErr", "posBound", "uvErr", "uvBound");
+
+    int rv = 0;
+    for (int f = 0; f < MVF_NUM; ++f) {
+        const MeshVertexFormat fmt = (MeshVertexFormat)f;
+        PackedMesh pm;
+        hr = MeshPack(vtx, nVtx, idx, nIdx, fmt, pm);
+        if (FAILED(hr)) {
+            printf("%-13s not applicable\n", MeshVertexFormatName(fmt));
+            continue;
+        }
+
+        const MeshPackError e = MeshPackRoundTripError(vtx, nVtx, idx, nIdx, pm);
+        const bool ok = e.indicesEqual
+                && e.maxPos <= MeshPackPosErrorBound(fmt) && e.maxUv <= MeshPackUvErrorBound(fmt);
+        printf("%-13s %6u %10zu %10zu %7.3f %12.4g %12.4g %12.4g %12.4g %s\n",
+                MeshVertexFormatName(fmt), pm.vtxStride, pm.vtx.size(), pm.idx.size(),
+                (double)(pm.vtx.size() + pm.idx.size()) / origBytes,
+                e.maxPos, MeshPackPosErrorBound(fmt), e.maxUv, MeshPackUvErrorBound(fmt),
+                ok ? "OK" : "NG");
+        if (!ok) {
+            rv = 1;
+        }
+    }
+    return rv;
+}
+
+static void
+MeshOptUsage(void)
+{
+    printf("Usage: View360Tool meshopt [options] [input.ply|input.meshcache]\n");
+    printf("Reorders triangles for the post-transform vertex cache and vertices for fetch locality,\n");
+    printf("and prints ACMR / ATVR of FIFO vertex caches before and after.\n");
+    printf("    -cache n          cache size the optimizer assumes (default %d)\n", MESH_OPTIMIZE_CACHE_SIZE);
+    printf("    -o output         write the optimized mesh (.ply or .meshcache)\n");
+    printf("Without input, hemisphere meshes of several sizes are measured in generator order and in random triangle order.\n");
+}
+
+/// 三角形の順番を乱数で並べ替える。出力順が不定のエクスポーターのPLYの代わり。
+static void
+ShuffleTriangles(TexturedMesh& tm)
+{
+    std::vector<uint32_t>& idx = tm.triangleIdxList;
+    const size_t numTri = idx.size() / 3;
+    uint64_t s = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = numTri; 1 < i; --i) {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        const size_t j = (size_t)(s % i);
+        for (int k = 0; k < 3; ++k) {
+            std::swap(idx[3 * (i - 1) + k], idx[3 * j + k]);
+        }
+    }
+}
+
+static const int MEASURE_CACHE_SIZES[] = { 16, 32 };
+
+static void
+PrintCacheStats(const char* label, const TexturedMesh& tm)
+{
+    printf("  %-9s", label);
+    for (int cacheSize : MEASURE_CACHE_SIZES) {
+        const MeshCacheStats st = MeshSimulateVertexCache(tm.triangleIdxList.data(), tm.triangleIdxList.size(),
+                tm.vertexList.size(), cacheSize);
+        printf("  FIFO%-2d ACMR %.3f ATVR %.3f", cacheSize, st.acmr, st.atvr);
+    }
+    printf("\n");
+}
+
+static int
+MeasureMeshOpt(const char* name, TexturedMesh& tm, int cacheSize)
+{
+    printf("%s: %zu vertices, %zu triangles\n", name, tm.vertexList.size(), tm.triangleIdxList.size() / 3);
+    PrintCacheStats("before", tm);
+
+    const double t0 = ToolNowMs();
+    int hr = MeshOptimize(tm, cacheSize);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    const double t1 = ToolNowMs();
+
+    PrintCacheStats("after", tm);
+    printf("  optimize %.3f ms\n", t1 - t0);
+    return S_OK;
+}
+
+int
+ToolMeshOpt(const std::vector<std::string>& args)
+{
+    int cacheSize = MESH_OPTIMIZE_CACHE_SIZE;
+    std::string inPath;
+    std::string outPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-cache" && 1 <= remain) {
+            cacheSize = atoi(args[++i].c_str());
+        } else if (a == "-o" && 1 <= remain) {
+            outPath = args[++i];
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else {
+            MeshOptUsage();
+            return 1;
+        }
+    }
+
+    if (inPath.empty()) {
+        if (!outPath.empty()) {
+            MeshOptUsage();
+            return 1;
+        }
+
+        static const int divisions[] = { 16, 64, 256, 1024 };
+        for (int d : divisions) {
+            for (int shuffle = 0; shuffle < 2; ++shuffle) {
+                TexturedMesh tm;
+                if (FAILED(SphereMeshGenerate(SphereMeshHemisphere(0, d, d), tm))) {
+                    return 1;
+                }
+                if (shuffle) {
+                    ShuffleTriangles(tm);
+                }
+
+                char name[64];
+                sprintf_s(name, "hemisphere %dx%d %s", d, d, shuffle ? "random" : "generator");
+                if (FAILED(MeasureMeshOpt(name, tm, cacheSize))) {
+                    return 1;
+                }
+            }
+        }
+        return 0;
+    }
+
+    TexturedMesh tm;
+    if (FAILED(ReadMesh(inPath, tm))) {
+        return 1;
+    }
+    if (FAILED(MeasureMeshOpt(inPath.c_str(), tm, cacheSize))) {
+        return 1;
+    }
+    if (!outPath.empty()) {
+        const MeshFileFormat fmt = EndsWith(outPath, ".meshcache") ? MFF_MeshCache : MFF_PlyBinary;
+        if (FAILED(WriteMesh(outPath, fmt, tm))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+WeldUsage(void)
+{
+    printf("Usage: View360Tool weld [options] input.ply|input.meshcache [output]\n");
+    printf("Welds vertices closer than epsilon, removes degenerate and duplicate triangles, compacts the arrays.\n");
+    printf("    -eps e            max difference of each of x, y, z, u, v to weld (default %g, 0 = exact)\n", MeshWeldParams().epsilon);
+    printf("    -keepdegenerate   do not remove zero area triangles\n");
+    printf("    -keepduplicate    do not remove duplicate triangles\n");
+    printf("Output is binary PLY, or mesh cache when the file name ends with .meshcache.\n");
+}
+
+int
+ToolWeld(const std::vector<std::string>& args)
+{
+    MeshWeldParams p;
+    std::string inPath;
+    std::string outPath;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        const size_t remain = args.size() - i - 1;
+        if (a == "-eps" && 1 <= remain) {
+            p.epsilon = atof(args[++i].c_str());
+        } else if (a == "-keepdegenerate") {
+            p.removeDegenerate = false;
+        } else if (a == "-keepduplicate") {
+            p.removeDuplicate = false;
+        } else if (a[0] != '-' && inPath.empty()) {
+            inPath = a;
+        } else if (a[0] != '-' && outPath.empty()) {
+            outPath = a;
+        } else {
+            WeldUsage();
+            return 1;
+        }
+    }
+    if (inPath.empty()) {
+        WeldUsage();
+        return 1;
+    }
+
+    TexturedMesh tm;
+    if (FAILED(ReadMesh(inPath, tm))) {
+        return 1;
+    }
+
+    const double t0 = ToolNowMs();
+    MeshWeldStats st;
+    if (FAILED(MeshWeld(tm, p, &st))) {
+        return 1;
+    }
+    const double t1 = ToolNowMs();
+
+    printf("%s: vertices %zu -> %zu, triangles %zu -> %zu (degenerate %zu, duplicate %zu). weld %.3f ms\n",
+            inPath.c_str(), st.vtxBefore, st.vtxAfter, st.triBefore, st.triAfter, st.degenerate, st.duplicate, t1 - t0);
+
+    if (!outPath.empty()) {
+        const MeshFileFormat fmt = EndsWith(outPath, ".meshcache") ? MFF_MeshCache : MFF_PlyBinary;
+        if (FAILED(WriteMesh(outPath, fmt, tm))) {
+            return 1;
+        }
+    }
+    return 0;
+}
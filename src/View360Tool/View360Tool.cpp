@@ -0,0 +1,122 @@
+﻿// 日本語。
+
+// View360Photoのメッシュやテクスチャーを前処理するコマンドラインツール。
+
+#include "pch.h"
+#include "ToolCommands.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#  include <psapi.h>
+#endif
+
+struct ToolCommand {
+    const char* name;
+    int (*func)(const std::vector<std::string>& args);
+    const char* description;
+};
+
+static const ToolCommand gCommands[] = {
+    { "sphere",   ToolSphere,   "generate sphere / hemisphere mesh and write PLY or mesh cache" },
+    { "meshpack", ToolMeshPack, "pack mesh to 16-bit index and quantized vertex formats, check error" },
+    { "meshopt",  ToolMeshOpt,  "reorder mesh for vertex cache and fetch locality, print ACMR / ATVR" },
+    { "weld",     ToolWeld,     "weld vertices, remove degenerate and duplicate triangles" },
+    { "decode",   ToolDecode,   "decode image with each decoder backend, print MPix/s" },
+    { "pixconv",  ToolPixConv,  "check SIMD pixel conversion kernels against scalar, print GB/s" },
+    { "mips",     ToolMips,     "build gamma-correct mipmaps on the CPU, check seam and determinism" },
+    { "bc",       ToolBc,       "compress mipmaps to BC1 / BC7 on the CPU, print PSNR and MPix/s" },
+    { "texcache", ToolTexCache, "look up / fill the on-disk texture cache, print hit and miss times" },
+    { "cube",     ToolCube,     "resample equirect image to cube / EAC / octahedral map, print round trip PSNR" },
+    { "bands",    ToolBands,    "pack equirect image into latitude bands shrunk by cos(latitude), print size and PSNR" },
+    { "density",  ToolDensity,  "cap image width at display pixels per degree, compare load time and texels with full" },
+    { "pyramid",  ToolPyramid,  "write tiled pyramid file, sample it through an LRU virtual texture under a budget" },
+};
+
+std::wstring
+ToolPath(const std::string& s)
+{
+    std::wstring w;
+    size_t n = 0;
+    if (0 != mbstowcs_s(&n, nullptr, 0, s.c_str(), 0) || n == 0) {
+        return w;
+    }
+    w.resize(n);
+    mbstowcs_s(&n, &w[0], n, s.c_str(), n - 1);
+    w.resize(n - 1);
+    return w;
+}
+
+double
+ToolNowMs(void)
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+size_t
+ToolPrivateBytes(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX pmc = {};
+    pmc.cb = sizeof pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof pmc)) {
+        return 0;
+    }
+    return pmc.PrivateUsage;
+#else
+    // ファイルに対応しない、置かれているページ。
+    FILE* fp = fopen("/proc/self/status", "r");
+    if (fp == nullptr) {
+        return 0;
+    }
+    size_t bytes = 0;
+    char line[256];
+    while (fgets(line, sizeof line, fp) != nullptr) {
+        unsigned long long kb = 0;
+        if (1 == sscanf(line, "RssAnon: %llu kB", &kb)) {
+            bytes = (size_t)kb * 1024;
+            break;
+        }
+    }
+    fclose(fp);
+    return bytes;
+#endif
+}
+
+static void
+PrintUsage(void)
+{
+    printf("Usage: View360Tool command [options]\n");
+    printf("Commands:\n");
+    for (auto& c : gCommands) {
+        printf("    %-10s %s\n", c.name, c.description);
+    }
+    printf("Run \"View360Tool command -help\" for the options of each command.\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<std::string> args;
+    for (int i = 2; i < argc; ++i) {
+        args.push_back(argv[i]);
+    }
+
+    for (auto& c : gCommands) {
+        if (0 == strcmp(c.name, argv[1])) {
+            return c.func(args);
+        }
+    }
+
+    printf("E: unknown command %s\n", argv[1]);
+    PrintUsage();
+    return 1;
+}